@@ -1,14 +1,17 @@
 /*
 
   Description:  Convert the AST from the parser
-                to stack-based instructions of
-                the VM
+                to stack-based or register-based
+                instructions of the VM, or to
+                expression trees
 
   Author: Niels A. Moseley (c) 2016
 
 */
 
-#include <QDebug>
+#include <string.h>
+#include <algorithm>
+#include "logging.h"
 #include "asttovm.h"
 
 bool ASTToVM::process(const ParseContext &s,
@@ -29,6 +32,15 @@ bool ASTToVM::process(const ParseContext &s,
             return false;
         iter2++;
     }
+
+    // the VM sizes its stack to the depth of the program,
+    // programs that are too deep are rejected here.
+    uint32_t depth;
+    if (!VM::getStackDepth(program, depth))
+    {
+        doLog(LOG_ERROR, "Program exceeds the maximum stack depth of %d\n", VM_MAXSTACKDEPTH);
+        return false;
+    }
     return true;
 }
 
@@ -132,6 +144,19 @@ bool ASTToVM::convertNode(ASTNode *node,
         program.push_back(instr);
         return true;
     }
+    case ASTNode::NodeFIR:
+    case ASTNode::NodeBiquad:
+    {
+        // replace the input on the stack by the output
+        if (node->m_varIdx < 0)
+        {
+            // error! cannot find variable
+            return false;
+        }
+        instr.icode = ((node->m_type == ASTNode::NodeFIR) ? P_fir : P_biquad) | node->m_varIdx;
+        program.push_back(instr);
+        return true;
+    }
     case ASTNode::NodeAdd:
     {
         instr.icode = P_add;
@@ -171,3 +196,308 @@ bool ASTToVM::convertNode(ASTNode *node,
     } // end switch
     return true;
 }
+
+// ********************************************************************************
+//   register byte code
+// ********************************************************************************
+
+bool ASTToVM::process(const ParseContext &s, VM::regprogram_t &program)
+{
+    program.code.clear();
+    program.constants.clear();
+    program.temporaries = 0;
+
+    auto iter = s.getStatements().begin();
+    while(iter != s.getStatements().end())
+    {
+        ASTNode *node = *iter++;
+        if (node == 0)
+            continue;
+
+        uint32_t value = 0;
+        switch(node->m_type)
+        {
+        case ASTNode::NodeDelayDefinition:
+            // delay memory is allocated by the VM
+            break;
+        case ASTNode::NodeAssign:
+            if (node->m_varIdx < 0)
+                return false;
+            if (!convertNode(node->right, program, 0, value))
+                return false;
+
+            // let the last instruction write the variable
+            // directly instead of going through a temporary
+            if (((value & R_KINDMASK) == R_TEMP) && (!program.code.empty())
+                && (program.code.back().dst == value))
+            {
+                program.code.back().dst = R_VAR | node->m_varIdx;
+            }
+            else
+            {
+                emit(program, P_writevar, R_VAR | node->m_varIdx, value);
+            }
+            break;
+        case ASTNode::NodeDelayAssign:
+            if (node->m_varIdx < 0)
+                return false;
+            if (!convertNode(node->right, program, 0, value))
+                return false;
+            emit(program, P_writedelay | node->m_varIdx, 0, value);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ASTToVM::getConstant(VM::regprogram_t &program, float value)
+{
+    const size_t N = program.constants.size();
+    for(size_t i=0; i<N; i++)
+    {
+        if (memcmp(&program.constants[i], &value, sizeof(float)) == 0)
+            return R_CONST | (uint32_t)i;
+    }
+    program.constants.push_back(value);
+    return R_CONST | (uint32_t)N;
+}
+
+void ASTToVM::emit(VM::regprogram_t &program, uint32_t opcode, uint32_t dst,
+                   uint32_t src0, uint32_t src1, uint32_t src2)
+{
+    VM::reginstr_t instr;
+    instr.opcode = opcode;
+    instr.dst = dst;
+    instr.src[0] = src0;
+    instr.src[1] = src1;
+    instr.src[2] = src2;
+    program.code.push_back(instr);
+}
+
+bool ASTToVM::convertNode(ASTNode *node, VM::regprogram_t &program,
+                          uint32_t depth, uint32_t &result)
+{
+    if (node == 0)
+        return false;
+
+    // operands of an operation are evaluated into the
+    // temporaries at and above 'depth', so the
+    // temporaries are used like the stack of the
+    // stack byte code.
+    const uint32_t dst = R_TEMP | depth;
+    program.temporaries = std::max(program.temporaries, depth+1);
+
+    uint32_t a = 0;
+    uint32_t b = 0;
+    switch(node->m_type)
+    {
+    default:
+    case ASTNode::NodeUnknown:
+        return false;
+    case ASTNode::NodeFloat:
+        result = getConstant(program, node->m_literalFloat);
+        return true;
+    case ASTNode::NodeInteger:
+        result = getConstant(program, node->m_literalInt);
+        return true;
+    case ASTNode::NodeIdent:
+        if (node->m_varIdx < 0)
+            return false;
+        result = R_VAR | node->m_varIdx;
+        return true;
+    case ASTNode::NodeDelayLookup:
+        if (node->m_varIdx < 0)
+            return false;
+        if (!convertNode(node->left, program, depth, a))
+            return false;
+        emit(program, P_readdelay | node->m_varIdx, dst, a);
+        break;
+    case ASTNode::NodeFIR:
+    case ASTNode::NodeBiquad:
+        if (node->m_varIdx < 0)
+            return false;
+        if (!convertNode(node->left, program, depth, a))
+            return false;
+        emit(program, ((node->m_type == ASTNode::NodeFIR) ? P_fir : P_biquad) | node->m_varIdx, dst, a);
+        break;
+    case ASTNode::NodeAdd:
+    case ASTNode::NodeSub:
+    case ASTNode::NodeMul:
+    case ASTNode::NodeDiv:
+    {
+        if (!convertNode(node->left, program, depth, a))
+            return false;
+        if (!convertNode(node->right, program, depth+1, b))
+            return false;
+
+        uint32_t opcode = P_add;
+        if (node->m_type == ASTNode::NodeSub) opcode = P_sub;
+        if (node->m_type == ASTNode::NodeMul) opcode = P_mul;
+        if (node->m_type == ASTNode::NodeDiv) opcode = P_div;
+        emit(program, opcode, dst, a, b);
+        break;
+    }
+    case ASTNode::NodeUnaryMinus:
+        if (!convertNode(node->right, program, depth, a))
+            return false;
+        emit(program, P_neg, dst, a);
+        break;
+    case ASTNode::NodeFunction:
+    {
+        const uint32_t nargs = node->m_functionArgs.size();
+        if (nargs > 3)
+            return false;
+
+        uint32_t args[3] = {0,0,0};
+        for(uint32_t i=0; i<nargs; i++)
+        {
+            if (!convertNode(node->m_functionArgs[i], program, depth+i, args[i]))
+                return false;
+        }
+        emit(program, node->m_functionID, dst, args[0], args[1], args[2]);
+        break;
+    }
+    } // end switch
+
+    result = dst;
+    return true;
+}
+
+// ********************************************************************************
+//   expression trees
+// ********************************************************************************
+
+bool ASTToVM::process(const ParseContext &s, VM::exprprogram_t &program)
+{
+    program.nodes.clear();
+    program.statements.clear();
+
+    auto iter = s.getStatements().begin();
+    while(iter != s.getStatements().end())
+    {
+        ASTNode *node = *iter++;
+        if (node == 0)
+            continue;
+
+        int32_t value = -1;
+        switch(node->m_type)
+        {
+        case ASTNode::NodeDelayDefinition:
+            // delay memory is allocated by the VM
+            break;
+        case ASTNode::NodeAssign:
+            if (node->m_varIdx < 0)
+                return false;
+            if (!convertNode(node->right, program, value))
+                return false;
+            program.statements.push_back(addNode(program, P_writevar, node->m_varIdx, value));
+            break;
+        case ASTNode::NodeDelayAssign:
+            if (node->m_varIdx < 0)
+                return false;
+            if (!convertNode(node->right, program, value))
+                return false;
+            program.statements.push_back(addNode(program, P_writedelay, node->m_varIdx, value));
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t ASTToVM::addNode(VM::exprprogram_t &program, uint32_t opcode, uint32_t index,
+                         int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    VM::exprnode_t node;
+    node.opcode = opcode;
+    node.index = index;
+    node.value = 0.0f;
+    node.args[0] = arg0;
+    node.args[1] = arg1;
+    node.args[2] = arg2;
+    program.nodes.push_back(node);
+    return (int32_t)program.nodes.size()-1;
+}
+
+bool ASTToVM::convertNode(ASTNode *node, VM::exprprogram_t &program, int32_t &result)
+{
+    if (node == 0)
+        return false;
+
+    int32_t a = -1;
+    int32_t b = -1;
+    switch(node->m_type)
+    {
+    default:
+    case ASTNode::NodeUnknown:
+        return false;
+    case ASTNode::NodeFloat:
+        result = addNode(program, P_literal, 0);
+        program.nodes[result].value = node->m_literalFloat;
+        return true;
+    case ASTNode::NodeInteger:
+        result = addNode(program, P_literal, 0);
+        program.nodes[result].value = node->m_literalInt;
+        return true;
+    case ASTNode::NodeIdent:
+        if (node->m_varIdx < 0)
+            return false;
+        result = addNode(program, P_readvar, node->m_varIdx);
+        return true;
+    case ASTNode::NodeDelayLookup:
+        if (node->m_varIdx < 0)
+            return false;
+        if (!convertNode(node->left, program, a))
+            return false;
+        result = addNode(program, P_readdelay, node->m_varIdx, a);
+        return true;
+    case ASTNode::NodeFIR:
+    case ASTNode::NodeBiquad:
+        if (node->m_varIdx < 0)
+            return false;
+        if (!convertNode(node->left, program, a))
+            return false;
+        result = addNode(program, (node->m_type == ASTNode::NodeFIR) ? P_fir : P_biquad, node->m_varIdx, a);
+        return true;
+    case ASTNode::NodeAdd:
+    case ASTNode::NodeSub:
+    case ASTNode::NodeMul:
+    case ASTNode::NodeDiv:
+    {
+        if (!convertNode(node->left, program, a))
+            return false;
+        if (!convertNode(node->right, program, b))
+            return false;
+
+        uint32_t opcode = P_add;
+        if (node->m_type == ASTNode::NodeSub) opcode = P_sub;
+        if (node->m_type == ASTNode::NodeMul) opcode = P_mul;
+        if (node->m_type == ASTNode::NodeDiv) opcode = P_div;
+        result = addNode(program, opcode, 0, a, b);
+        return true;
+    }
+    case ASTNode::NodeUnaryMinus:
+        if (!convertNode(node->right, program, a))
+            return false;
+        result = addNode(program, P_neg, 0, a);
+        return true;
+    case ASTNode::NodeFunction:
+    {
+        const uint32_t nargs = node->m_functionArgs.size();
+        if (nargs > 3)
+            return false;
+
+        int32_t args[3] = {-1,-1,-1};
+        for(uint32_t i=0; i<nargs; i++)
+        {
+            if (!convertNode(node->m_functionArgs[i], program, args[i]))
+                return false;
+        }
+        result = addNode(program, node->m_functionID, 0, args[0], args[1], args[2]);
+        return true;
+    }
+    } // end switch
+}
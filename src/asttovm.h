@@ -1,8 +1,9 @@
 /*
 
   Description:  Convert the AST from the parser
-                to stack-based instructions of
-                the VM
+                to stack-based or register-based
+                instructions of the VM, or to
+                expression trees
 
   Author: Niels A. Moseley (c) 2016
 
@@ -19,8 +20,43 @@ class ASTToVM
 public:
     static bool process(const ParseContext &s, VM::program_t &program, VM::variables_t &variables);
 
+    /** convert the AST to three-address register byte code.
+        the operands refer to the variables of the
+        ParseContext, which are the same as those
+        produced by the stack byte code conversion.
+    */
+    static bool process(const ParseContext &s, VM::regprogram_t &program);
+
+    /** convert the AST to an expression tree program,
+        which the VM compiles into closures.
+    */
+    static bool process(const ParseContext &s, VM::exprprogram_t &program);
+
 protected:
     static bool convertNode(ASTNode *node, VM::program_t &program, VM::variables_t &variables);
+
+    /** convert an expression to register byte code.
+        the result is stored in temporary register 'depth',
+        unless the expression is a variable or a constant.
+        the operand holding the result is returned in 'result'.
+    */
+    static bool convertNode(ASTNode *node, VM::regprogram_t &program, uint32_t depth, uint32_t &result);
+
+    /** convert an expression to expression tree nodes.
+        the index of the root node is returned in 'result'.
+    */
+    static bool convertNode(ASTNode *node, VM::exprprogram_t &program, int32_t &result);
+
+    /** add an expression tree node and return its index */
+    static int32_t addNode(VM::exprprogram_t &program, uint32_t opcode, uint32_t index,
+                           int32_t arg0 = -1, int32_t arg1 = -1, int32_t arg2 = -1);
+
+    /** get the constant pool operand for a value */
+    static uint32_t getConstant(VM::regprogram_t &program, float value);
+
+    /** emit a register instruction */
+    static void emit(VM::regprogram_t &program, uint32_t opcode, uint32_t dst,
+                     uint32_t src0 = 0, uint32_t src1 = 0, uint32_t src2 = 0);
 };
 
 #endif
@@ -0,0 +1,227 @@
+/*
+
+  Description:  Parallel rendering of many .wav files
+                through one compiled script.
+
+  License: GPLv2
+
+*/
+
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "batchrenderer.h"
+
+BatchRenderer::BatchRenderer(uint32_t threads)
+    : m_script(NULL),
+      m_noiseSeed(NOISE_DEFAULTSEED),
+      m_nextJob(0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // the VMs are created on this thread, as PortAudio
+    // is initialized by their constructor.
+    for(uint32_t i=0; i<threads; i++)
+    {
+        m_renderers.push_back(std::unique_ptr<Renderer>(new Renderer()));
+    }
+}
+
+BatchRenderer::~BatchRenderer()
+{
+}
+
+bool BatchRenderer::load(const RenderScript &script)
+{
+    for(std::unique_ptr<Renderer> &renderer : m_renderers)
+    {
+        if (!renderer->load(script))
+        {
+            m_error = renderer->getError();
+            return false;
+        }
+    }
+    m_script = &script;
+    return true;
+}
+
+void BatchRenderer::setEngine(VirtualMachine::engine_t engine)
+{
+    for(std::unique_ptr<Renderer> &renderer : m_renderers)
+    {
+        renderer->setEngine(engine);
+    }
+}
+
+void BatchRenderer::setSlider(uint32_t id, float value)
+{
+    for(std::unique_ptr<Renderer> &renderer : m_renderers)
+    {
+        renderer->setSlider(id, value);
+    }
+}
+
+void BatchRenderer::setNoiseSeed(uint32_t seed)
+{
+    m_noiseSeed = seed;
+    for(std::unique_ptr<Renderer> &renderer : m_renderers)
+    {
+        renderer->setNoiseSeed(seed);
+    }
+}
+
+void BatchRenderer::work(Renderer *renderer, std::vector<renderjob_t> *jobs)
+{
+    size_t idx;
+    while((idx = m_nextJob.fetch_add(1)) < jobs->size())
+    {
+        renderjob_t &job = (*jobs)[idx];
+        job.ok = renderer->render(job.inFile, job.outFile, job.variableFile, job.stats);
+        job.error = job.ok ? std::string() : renderer->getError();
+    }
+}
+
+uint32_t BatchRenderer::render(std::vector<renderjob_t> &jobs, renderstats_t &total)
+{
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    m_nextJob = 0;
+    std::vector<std::thread> threads;
+    for(uint32_t i=1; i<m_renderers.size(); i++)
+    {
+        threads.push_back(std::thread(&BatchRenderer::work, this, m_renderers[i].get(), &jobs));
+    }
+    work(m_renderers[0].get(), &jobs);
+    for(std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    total.frames = 0;
+    total.audioTime = 0.0;
+    uint32_t failed = 0;
+    for(const renderjob_t &job : jobs)
+    {
+        if (job.ok)
+        {
+            total.frames += job.stats.frames;
+            total.audioTime += job.stats.audioTime;
+        }
+        else
+        {
+            failed++;
+        }
+    }
+    total.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return failed;
+}
+
+uint32_t BatchRenderer::getWarmup(float settleTime) const
+{
+    if (m_script == NULL)
+    {
+        return 0;
+    }
+    if ((!m_script->memory.bounded) && (settleTime <= 0.0f))
+    {
+        settleTime = RENDER_SETTLETIME;
+    }
+    const uint32_t settleFrames = (uint32_t)std::min(ceil((double)settleTime*m_script->sampleRate), (double)UINT32_MAX);
+    return m_script->memory.bounded ? std::max(m_script->warmup, settleFrames) : settleFrames;
+}
+
+void BatchRenderer::workParts(Renderer *renderer, const std::string *inFile, const std::string *outFile,
+                              std::vector<renderpart_t> *parts)
+{
+    size_t idx;
+    while((idx = m_nextJob.fetch_add(1)) < parts->size())
+    {
+        renderpart_t &part = (*parts)[idx];
+        renderer->setNoiseSeed(m_noiseSeed + (uint32_t)idx*0x9E3779B9u);
+        part.ok = renderer->renderPart(*inFile, *outFile, part.start, part.first, part.count, part.stats);
+        part.error = part.ok ? std::string() : renderer->getError();
+    }
+}
+
+bool BatchRenderer::renderSplit(const std::string &inFile, const std::string &outFile,
+                                float settleTime, renderstats_t &total)
+{
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    total.frames = 0;
+    total.audioTime = 0.0;
+    total.renderTime = 0.0;
+    if (m_script == NULL)
+    {
+        m_error = "No script loaded";
+        return false;
+    }
+
+    WavStreamer input;
+    WavFormatChunk format;
+    if ((input.openFile(inFile) != 0) || (!input.getFormat(format)))
+    {
+        m_error = "Cannot read " + inFile + ", only stereo PCM or float .wav files are supported";
+        return false;
+    }
+    const uint32_t frames = input.getSampleCount();
+
+    // the workers fill in the samples of the output file
+    WavWriter output;
+    if ((output.openFile(outFile, 2, format.dwSamplesPerSec) != 0) ||
+        (!output.skip(frames)) || (!output.close()))
+    {
+        m_error = "Cannot create " + outFile;
+        return false;
+    }
+
+    // each part starts at a multiple of the resampler period,
+    // so the program samples fall at the same times as in
+    // a continuous render.
+    const uint32_t warmup = getWarmup(settleTime);
+    const uint32_t partFrames = (uint32_t)std::min((uint64_t)std::max((uint64_t)RENDER_PARTFRAMES,
+                                                   (uint64_t)warmup*RENDER_PARTWARMUPS),
+                                                   (uint64_t)UINT32_MAX/2);
+    std::vector<renderpart_t> parts;
+    for(uint32_t first=0; first<frames; first += std::min(partFrames, frames - first))
+    {
+        renderpart_t part;
+        part.first = first;
+        part.count = std::min(partFrames, frames - first);
+        part.start = (first > warmup) ? first - warmup : 0;
+        part.start -= part.start % m_script->period;
+        part.ok = false;
+        parts.push_back(part);
+    }
+
+    m_nextJob = 0;
+    std::vector<std::thread> threads;
+    for(uint32_t i=1; i<m_renderers.size(); i++)
+    {
+        threads.push_back(std::thread(&BatchRenderer::workParts, this, m_renderers[i].get(),
+                                      &inFile, &outFile, &parts));
+    }
+    workParts(m_renderers[0].get(), &inFile, &outFile, &parts);
+    for(std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    setNoiseSeed(m_noiseSeed);
+
+    for(const renderpart_t &part : parts)
+    {
+        if (!part.ok)
+        {
+            m_error = part.error;
+            return false;
+        }
+        total.frames += part.stats.frames;
+        total.audioTime += part.stats.audioTime;
+    }
+    total.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
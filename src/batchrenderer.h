@@ -0,0 +1,141 @@
+/*
+
+  Description:  Parallel rendering of many .wav files
+                through one compiled script.
+
+                Every worker thread has a Renderer with its
+                own VM, so the workers share no state. They
+                all load the same RenderScript, which is
+                compiled once and only read. The workers take
+                the next file from the list as they finish
+                one, so slow files do not hold up the others.
+
+                A single long file is rendered in parallel by
+                splitting it into parts. Each part starts a
+                warm-up early, so the delay lines, filters and
+                variables of the script hold the same values as
+                in a continuous render by the time the first
+                output of the part is written. The warm-up
+                follows from the memory of the script, which is
+                found by the compiler. A script with feedback,
+                like an IIR filter, has unbounded memory: its
+                state only settles approximately, during a
+                settling time given by the user.
+
+  License: GPLv2
+
+*/
+
+#ifndef batchrenderer_h
+#define batchrenderer_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "renderer.h"
+
+/** a file to render and its result */
+struct renderjob_t
+{
+    std::string     inFile;
+    std::string     outFile;
+    std::string     variableFile;   // empty if the variables are not written
+
+    bool            ok;             // set by the renderer
+    std::string     error;          // description of the error if not ok
+    renderstats_t   stats;
+};
+
+// smallest number of frames in a part of a split file
+#define RENDER_PARTFRAMES   262144
+
+// parts are at least this many times longer than their warm-up
+#define RENDER_PARTWARMUPS  16
+
+// settling time of a script with unbounded memory
+// if the user does not give one (in seconds)
+#define RENDER_SETTLETIME   1.0f
+
+/** a part of a split file and its result */
+struct renderpart_t
+{
+    uint32_t        start;          // frame at which the script starts
+    uint32_t        first;          // first frame that is written
+    uint32_t        count;          // number of frames that are written
+
+    bool            ok;             // set by the renderer
+    std::string     error;          // description of the error if not ok
+    renderstats_t   stats;
+};
+
+class BatchRenderer
+{
+public:
+    /** create 'threads' renderers, 0 for one per core */
+    BatchRenderer(uint32_t threads);
+    virtual ~BatchRenderer();
+
+    /** number of worker threads */
+    uint32_t getThreads() const
+    {
+        return m_renderers.size();
+    }
+
+    /** load a compiled script into all renderers */
+    bool load(const RenderScript &script);
+
+    /** select the execution engine of all renderers */
+    void setEngine(VirtualMachine::engine_t engine);
+
+    /** set the value of one of the four sliders */
+    void setSlider(uint32_t id, float value);
+
+    /** set the seed of the noise generators. each file
+        starts from this seed, whichever worker renders it. */
+    void setNoiseSeed(uint32_t seed);
+
+    /** render all jobs. 'total' gets the sum of the frames
+        and audio time of the files that were rendered and
+        the time the whole batch took.
+        Returns the number of jobs that failed. */
+    uint32_t render(std::vector<renderjob_t> &jobs, renderstats_t &total);
+
+    /** number of frames each part of a split file starts early.
+        This is the warm-up of the loaded script, or 'settleTime'
+        seconds if that is longer. A script with unbounded memory
+        settles for RENDER_SETTLETIME seconds if 'settleTime' is 0. */
+    uint32_t getWarmup(float settleTime) const;
+
+    /** render the file 'inFile' on all threads by splitting it
+        into parts that start getWarmup(settleTime) frames early.
+        The parts do not depend on the number of threads. Their
+        noise generators get different seeds, the first part
+        starts from the seed of setNoiseSeed().
+        Returns false on an error, see getError(). */
+    bool renderSplit(const std::string &inFile, const std::string &outFile,
+                     float settleTime, renderstats_t &total);
+
+    /** description of the last error of load() or renderSplit() */
+    std::string getError() const
+    {
+        return m_error;
+    }
+
+protected:
+    /** render jobs until there are none left */
+    void work(Renderer *renderer, std::vector<renderjob_t> *jobs);
+
+    /** render parts of a split file until there are none left */
+    void workParts(Renderer *renderer, const std::string *inFile, const std::string *outFile,
+                   std::vector<renderpart_t> *parts);
+
+    std::vector<std::unique_ptr<Renderer> > m_renderers;
+    const RenderScript *m_script;       // the loaded script
+    uint32_t            m_noiseSeed;
+    std::atomic<size_t> m_nextJob;      // index of the next job or part to render
+    std::string         m_error;
+};
+
+#endif
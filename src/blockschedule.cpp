@@ -0,0 +1,380 @@
+/*
+
+  Description:  Statement scheduler for block-based
+                execution of VM programs.
+
+  License: GPLv2
+
+*/
+
+#include <algorithm>
+#include "functiondefs.h"
+#include "blockschedule.h"
+
+BlockSchedule::BlockSchedule()
+{
+    clear();
+}
+
+void BlockSchedule::clear()
+{
+    m_statementInfo.clear();
+    m_segments.clear();
+    m_rowIndex.clear();
+    m_numRows = 0;
+    m_stackDepth = 0;
+    m_serialCount = 0;
+    m_valid = false;
+}
+
+bool BlockSchedule::readsVar(const statement_t &s, uint32_t v) const
+{
+    return std::find(s.reads.begin(), s.reads.end(), v) != s.reads.end();
+}
+
+bool BlockSchedule::findStatements(const VM::program_t &program, const VM::variables_t &vars)
+{
+    // Walk the program and track the stack depth.
+    // The compiler emits one statement per assignment,
+    // which always ends with a write and an empty stack.
+
+    statement_t stmt;
+    stmt.range.begin = 0;
+    stmt.write   = -1;
+    stmt.carried = false;
+    stmt.depth   = 0;
+
+    const size_t N = program.size();
+    int32_t depth = 0;
+    size_t pc = 0;
+    while(pc < N)
+    {
+        uint32_t icode = program[pc++].icode;
+        bool endOfStatement = false;
+        if (icode & 0x80000000)
+        {
+            uint32_t n = icode & 0xFFFF;
+            if (n >= vars.size())
+                return false;
+
+            switch(icode & 0xff000000)
+            {
+            case P_readvar:
+                stmt.reads.push_back(n);
+                depth++;
+                break;
+            case P_writevar:
+                stmt.write = n;
+                depth--;
+                endOfStatement = true;
+                break;
+            case P_readdelay:
+                stmt.delays.push_back(n);
+                break;
+            case P_writedelay:
+                stmt.delays.push_back(n);
+                depth--;
+                endOfStatement = true;
+                break;
+            case P_fir:
+            case P_biquad:
+                // a filter keeps a history or state like
+                // a delay line, so it runs sample-by-sample
+                stmt.delays.push_back(n);
+                break;
+            default:
+                return false;
+            }
+        }
+        else
+        {
+            switch(icode)
+            {
+            case P_literal:
+                depth++;
+                pc++;   // skip the literal value
+                break;
+            case P_add:
+            case P_sub:
+            case P_mul:
+            case P_div:
+                depth--;
+                break;
+            case P_neg:
+                break;
+            default:
+            {
+                int32_t nargs = functionDefs::getNumberOfArguments(icode);
+                if (nargs < 0)
+                    return false;
+                depth += 1 - nargs;
+                break;
+            }
+            }
+        }
+
+        if (depth < 0)
+            return false;
+
+        stmt.depth = std::max(stmt.depth, (uint32_t)depth);
+
+        if (endOfStatement)
+        {
+            if (depth != 0)
+                return false;
+
+            stmt.range.end = (uint32_t)pc;
+            m_statementInfo.push_back(stmt);
+
+            stmt.range.begin = (uint32_t)pc;
+            stmt.reads.clear();
+            stmt.delays.clear();
+            stmt.write = -1;
+            stmt.depth = 0;
+        }
+    }
+
+    // a trailing expression without assignment
+    // cannot be scheduled
+    return (depth == 0) && (stmt.range.begin == N);
+}
+
+bool BlockSchedule::build(const VM::program_t &program, const VM::variables_t &vars)
+{
+    clear();
+
+    if (!findStatements(program, vars))
+    {
+        m_statementInfo.clear();
+        return false;
+    }
+
+    const uint32_t nvars = (uint32_t)vars.size();
+    const uint32_t nstmts = (uint32_t)m_statementInfo.size();
+
+    // the input variables are written by the VM
+    // before the program starts.
+    std::vector<bool> isInput(nvars, false);
+    const char *inputNames[] = {"in", "inl", "inr"};
+    for(uint32_t i=0; i<3; i++)
+    {
+        int32_t idx = VM::findVariableByName(vars, inputNames[i]);
+        if (idx >= 0)
+            isInput[idx] = true;
+    }
+
+    std::vector<int32_t> lastWriter(nvars, -1);
+    for(uint32_t i=0; i<nstmts; i++)
+    {
+        if (m_statementInfo[i].write >= 0)
+            lastWriter[m_statementInfo[i].write] = i;
+    }
+
+    // A variable that is read before it is written
+    // in the same sample carries its value from the
+    // previous sample. All statements from the first
+    // such read up to the last write of the variable
+    // form a feedback loop.
+    typedef std::pair<uint32_t, uint32_t> span_t;
+    std::vector<span_t> spans;
+
+    std::vector<bool> defined = isInput;
+    std::vector<int32_t> firstCarriedRead(nvars, -1);
+    for(uint32_t i=0; i<nstmts; i++)
+    {
+        statement_t &s = m_statementInfo[i];
+        for(uint32_t r : s.reads)
+        {
+            if (!defined[r] && (lastWriter[r] >= 0))
+            {
+                s.carried = true;
+                if (firstCarriedRead[r] < 0)
+                    firstCarriedRead[r] = i;
+            }
+        }
+        if (s.write >= 0)
+            defined[s.write] = true;
+    }
+
+    for(uint32_t v=0; v<nvars; v++)
+    {
+        if (firstCarriedRead[v] >= 0)
+            spans.push_back(span_t(firstCarriedRead[v], lastWriter[v]));
+    }
+
+    // delay lines and filters hold state from previous
+    // samples, so all statements using one are kept
+    // together and run sample-by-sample.
+    for(uint32_t v=0; v<nvars; v++)
+    {
+        if (vars[v].m_type == varInfo::TYPE_VAR)
+            continue;
+
+        int32_t first = -1;
+        int32_t last = -1;
+        for(uint32_t i=0; i<nstmts; i++)
+        {
+            const statement_t &s = m_statementInfo[i];
+            if (std::find(s.delays.begin(), s.delays.end(), v) != s.delays.end())
+            {
+                if (first < 0)
+                    first = i;
+                last = i;
+            }
+        }
+        if (first >= 0)
+            spans.push_back(span_t(first, last));
+    }
+
+    // merge overlapping spans into serial intervals
+    std::sort(spans.begin(), spans.end());
+    std::vector<span_t> intervals;
+    for(const span_t &span : spans)
+    {
+        if ((!intervals.empty()) && (span.first <= intervals.back().second))
+        {
+            intervals.back().second = std::max(intervals.back().second, span.second);
+        }
+        else
+        {
+            intervals.push_back(span);
+        }
+    }
+
+    // determine the execution order of the statements.
+    // Statements inside an interval that do not depend
+    // on the feedback loop are moved in front of it or
+    // behind it so they can still run in block mode.
+    std::vector<uint32_t> order;
+    std::vector<bool> serial(nstmts, false);
+
+    uint32_t i = 0;
+    auto interval = intervals.begin();
+    while(i < nstmts)
+    {
+        if ((interval == intervals.end()) || (i < interval->first))
+        {
+            order.push_back(i++);
+            continue;
+        }
+
+        std::vector<uint32_t> hoisted;
+        std::vector<uint32_t> rest;
+        for(uint32_t k=interval->first; k<=interval->second; k++)
+        {
+            const statement_t &s = m_statementInfo[k];
+            bool ok = s.delays.empty() && (!s.carried);
+            for(uint32_t j : rest)
+            {
+                if (!ok) break;
+                const statement_t &prev = m_statementInfo[j];
+                if ((prev.write >= 0) && readsVar(s, prev.write))
+                    ok = false;
+                if ((s.write >= 0) && ((prev.write == s.write) || readsVar(prev, s.write)))
+                    ok = false;
+            }
+            if (ok)
+                hoisted.push_back(k);
+            else
+                rest.push_back(k);
+        }
+
+        std::vector<uint32_t> sunk;
+        std::vector<uint32_t> core;
+        for(int32_t idx=(int32_t)rest.size()-1; idx>=0; idx--)
+        {
+            const statement_t &s = m_statementInfo[rest[idx]];
+            bool ok = s.delays.empty() && (!s.carried);
+            for(uint32_t j : core)
+            {
+                if (!ok) break;
+                const statement_t &next = m_statementInfo[j];
+                if ((next.write >= 0) && readsVar(s, next.write))
+                    ok = false;
+                if ((s.write >= 0) && ((next.write == s.write) || readsVar(next, s.write)))
+                    ok = false;
+            }
+            for(int32_t j=0; ok && (j<idx); j++)
+            {
+                if ((s.write >= 0) && readsVar(m_statementInfo[rest[j]], s.write))
+                    ok = false;
+            }
+            if (ok)
+                sunk.push_back(rest[idx]);
+            else
+                core.push_back(rest[idx]);
+        }
+
+        order.insert(order.end(), hoisted.begin(), hoisted.end());
+        order.insert(order.end(), core.rbegin(), core.rend());
+        order.insert(order.end(), sunk.rbegin(), sunk.rend());
+        for(uint32_t k : core)
+        {
+            serial[k] = true;
+        }
+        m_serialCount += (uint32_t)core.size();
+
+        i = interval->second+1;
+        interval++;
+    }
+
+    // every variable that is written, and the inputs,
+    // get a row holding one value per sample.
+    m_rowIndex.resize(nvars, -1);
+    for(uint32_t v=0; v<nvars; v++)
+    {
+        if (isInput[v] || (lastWriter[v] >= 0))
+            m_rowIndex[v] = m_numRows++;
+    }
+
+    // group statements into segments
+    std::vector<int32_t> segmentOf(nstmts, -1);
+    for(uint32_t k : order)
+    {
+        if (m_segments.empty() || (m_segments.back().serial != serial[k]))
+        {
+            segment_t seg;
+            seg.serial = serial[k];
+            m_segments.push_back(seg);
+        }
+        m_segments.back().statements.push_back(m_statementInfo[k].range);
+        segmentOf[k] = (int32_t)m_segments.size()-1;
+
+        if (!serial[k])
+            m_stackDepth = std::max(m_stackDepth, m_statementInfo[k].depth);
+    }
+
+    // serial segments keep their variables in the
+    // scalar variable store and exchange values
+    // with the block rows for every sample.
+    for(uint32_t k=0; k<nstmts; k++)
+    {
+        if (!serial[k])
+            continue;
+
+        segment_t &seg = m_segments[segmentOf[k]];
+        const statement_t &s = m_statementInfo[k];
+        for(uint32_t r : s.reads)
+        {
+            bool external = isInput[r];
+            for(uint32_t j=0; (j<nstmts) && (!external); j++)
+            {
+                if ((m_statementInfo[j].write == (int32_t)r) && (segmentOf[j] != segmentOf[k]))
+                    external = true;
+            }
+            if (external && (std::find(seg.gather.begin(), seg.gather.end(), r) == seg.gather.end()))
+                seg.gather.push_back(r);
+        }
+        if ((s.write >= 0) && (std::find(seg.scatter.begin(), seg.scatter.end(), (uint32_t)s.write) == seg.scatter.end()))
+            seg.scatter.push_back(s.write);
+        for(uint32_t d : s.delays)
+        {
+            if (std::find(seg.delays.begin(), seg.delays.end(), d) == seg.delays.end())
+                seg.delays.push_back(d);
+        }
+    }
+
+    m_statementInfo.clear();
+    m_valid = true;
+    return true;
+}
@@ -0,0 +1,124 @@
+/*
+
+  Description:  Statement scheduler for block-based
+                execution of VM programs.
+
+                The scheduler splits a program into
+                segments that can be executed for a
+                whole block of samples at a time and
+                segments that must run sample-by-sample
+                because they are part of a feedback loop.
+
+  License: GPLv2
+
+*/
+
+#ifndef blockschedule_h
+#define blockschedule_h
+
+#include <stdint.h>
+#include <vector>
+#include "vmtypes.h"
+
+// number of samples processed by one block execution
+#define VM_BLOCKSIZE 64
+
+class BlockSchedule
+{
+public:
+    BlockSchedule();
+
+    /** program counter range of a single statement */
+    struct range_t
+    {
+        uint32_t begin;     // first instruction
+        uint32_t end;       // one past the last instruction
+    };
+
+    /** a group of statements executed in the same mode */
+    struct segment_t
+    {
+        bool                    serial;     // true if the statements must run sample-by-sample
+        std::vector<range_t>    statements; // statements in execution order
+
+        // serial segments only:
+        std::vector<uint32_t>   gather;     // variables loaded from their block row before each sample
+        std::vector<uint32_t>   scatter;    // variables stored into their block row after each sample
+        std::vector<uint32_t>   delays;     // delay lines advanced after each sample
+    };
+
+    /** analyse a program and build the segment list.
+        returns false if the program cannot be run in
+        block mode. */
+    bool build(const VM::program_t &program, const VM::variables_t &vars);
+
+    /** remove the current schedule */
+    void clear();
+
+    /** returns true if a valid schedule is available */
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    /** get the row of a variable, or -1 if the variable
+        holds the same value for the whole block */
+    int32_t getRow(uint32_t varIdx) const
+    {
+        if (varIdx < m_rowIndex.size())
+            return m_rowIndex[varIdx];
+        return -1;
+    }
+
+    /** number of variables that need a block row */
+    uint32_t getNumberOfRows() const
+    {
+        return m_numRows;
+    }
+
+    /** maximum stack depth of the block segments */
+    uint32_t getStackDepth() const
+    {
+        return m_stackDepth;
+    }
+
+    /** the number of statements that run in serial segments */
+    uint32_t getSerialStatementCount() const
+    {
+        return m_serialCount;
+    }
+
+    const std::vector<segment_t>& getSegments() const
+    {
+        return m_segments;
+    }
+
+protected:
+    /** information on one statement of the program */
+    struct statement_t
+    {
+        range_t                 range;
+        std::vector<uint32_t>   reads;      // variables read
+        std::vector<uint32_t>   delays;     // delay lines and filters referenced, which hold state
+        int32_t                 write;      // variable written, or -1
+        bool                    carried;    // reads a value from the previous sample
+        uint32_t                depth;      // maximum stack depth
+    };
+
+    /** split the program into statements.
+        returns false if an unknown instruction is found. */
+    bool findStatements(const VM::program_t &program, const VM::variables_t &vars);
+
+    /** returns true if statement s reads variable v */
+    bool readsVar(const statement_t &s, uint32_t v) const;
+
+    std::vector<statement_t>    m_statementInfo;
+    std::vector<segment_t>      m_segments;
+    std::vector<int32_t>        m_rowIndex;     // block row per variable, or -1
+    uint32_t                    m_numRows;
+    uint32_t                    m_stackDepth;
+    uint32_t                    m_serialCount;
+    bool                        m_valid;
+};
+
+#endif
@@ -0,0 +1,322 @@
+/*
+
+  Description:  Portable fast execution of VM programs
+                by closure compilation.
+
+  License: GPLv2
+
+*/
+
+#include "functiondefs.h"
+#include "vmfunctions.h"
+#include "closureprogram.h"
+
+typedef ClosureProgram::closure_t closure_t;
+
+/** evaluate a closure */
+static inline float eval(const closure_t *c)
+{
+    return c->fn(c);
+}
+
+/** evaluate argument k, which is read directly
+    from its variable or constant if DIRECT is set. */
+template<bool DIRECT> static inline float operand(const closure_t *c, uint32_t k)
+{
+    return DIRECT ? *c->src[k] : eval(c->arg[k]);
+}
+
+struct OpAdd { static float apply(float a, float b) { return a + b; } };
+struct OpSub { static float apply(float a, float b) { return a - b; } };
+struct OpMul { static float apply(float a, float b) { return a * b; } };
+struct OpDiv { static float apply(float a, float b) { return a / b; } };
+
+template<class OP, bool LDIRECT, bool RDIRECT> static float evalBinary(const closure_t *c)
+{
+    // the left operand is evaluated first, as in the
+    // interpreter, so noise() is called in the same order.
+    const float a = operand<LDIRECT>(c, 0);
+    const float b = operand<RDIRECT>(c, 1);
+    return OP::apply(a, b);
+}
+
+template<class OP> static closure_t::eval_t selectBinary(bool ldirect, bool rdirect)
+{
+    if (ldirect)
+        return rdirect ? &evalBinary<OP, true, true> : &evalBinary<OP, true, false>;
+    return rdirect ? &evalBinary<OP, false, true> : &evalBinary<OP, false, false>;
+}
+
+static float evalConstant(const closure_t *c)
+{
+    return c->value;
+}
+
+static float evalVariable(const closure_t *c)
+{
+    return *c->src[0];
+}
+
+static float evalNeg(const closure_t *c)
+{
+    return -eval(c->arg[0]);
+}
+
+static float evalNoise(const closure_t *c)
+{
+    return VM::funcNoise(c->noise);
+}
+
+static float evalGaussNoise(const closure_t *c)
+{
+    return VM::funcGaussNoise(c->noise);
+}
+
+static float evalPinkNoise(const closure_t *c)
+{
+    return VM::funcPinkNoise(c->noise);
+}
+
+template<bool DIRECT> static float evalFunction1(const closure_t *c)
+{
+    return c->func.f1(operand<DIRECT>(c, 0));
+}
+
+static float evalFunction2(const closure_t *c)
+{
+    const float a = eval(c->arg[0]);
+    const float b = eval(c->arg[1]);
+    return c->func.f2(a, b);
+}
+
+static float evalFunction3(const closure_t *c)
+{
+    const float a = eval(c->arg[0]);
+    const float b = eval(c->arg[1]);
+    const float d = eval(c->arg[2]);
+    return c->func.f3(a, b, d);
+}
+
+static float evalReadDelay(const closure_t *c)
+{
+    return VM::funcReadDelay(eval(c->arg[0]), c->delay);
+}
+
+template<bool DIRECT> static float evalFIR(const closure_t *c)
+{
+    return VM::funcFIR(operand<DIRECT>(c, 0), c->delay);
+}
+
+template<bool DIRECT> static float evalBiquad(const closure_t *c)
+{
+    return VM::funcBiquad(operand<DIRECT>(c, 0), c->delay);
+}
+
+template<bool DIRECT> static float evalAssign(const closure_t *c)
+{
+    const float v = operand<DIRECT>(c, 0);
+    *c->dst = v;
+    return v;
+}
+
+template<bool DIRECT> static float evalWriteDelay(const closure_t *c)
+{
+    const float v = operand<DIRECT>(c, 0);
+    VM::funcWriteDelay(v, c->delay);
+    return v;
+}
+
+ClosureProgram::ClosureProgram()
+{
+}
+
+void ClosureProgram::clear()
+{
+    m_closures.clear();
+    m_statements.clear();
+}
+
+const float* ClosureProgram::getOperand(const VM::exprprogram_t &program, VM::values_t &values, int32_t idx)
+{
+    const VM::exprnode_t &node = program.nodes[idx];
+    if (node.opcode == P_literal)
+        return &m_closures[idx].value;
+    if (node.opcode == P_readvar)
+        return &values[node.index];
+    return NULL;
+}
+
+bool ClosureProgram::build(const VM::exprprogram_t &program, VM::variables_t &vars, VM::values_t &values,
+                           NoiseGenerator *noise)
+{
+    clear();
+
+    // the closures point to each other, so the
+    // vector must not be resized after this.
+    m_closures.resize(program.nodes.size());
+    for(uint32_t i=0; i<program.nodes.size(); i++)
+    {
+        if (!bindNode(program, vars, values, noise, i))
+        {
+            clear();
+            return false;
+        }
+    }
+
+    for(uint32_t root : program.statements)
+    {
+        if (root >= m_closures.size())
+        {
+            clear();
+            return false;
+        }
+        m_statements.push_back(&m_closures[root]);
+    }
+    return true;
+}
+
+bool ClosureProgram::bindNode(const VM::exprprogram_t &program, VM::variables_t &vars,
+                              VM::values_t &values, NoiseGenerator *noise, uint32_t idx)
+{
+    const VM::exprnode_t &node = program.nodes[idx];
+    closure_t &c = m_closures[idx];
+
+    // the arguments of a node are created before
+    // the node itself.
+    int32_t nargs = 0;
+    for(uint32_t k=0; k<3; k++)
+    {
+        c.arg[k] = NULL;
+        if (node.args[k] >= 0)
+        {
+            if ((uint32_t)node.args[k] >= idx)
+                return false;
+            c.arg[k] = &m_closures[node.args[k]];
+            nargs = k+1;
+        }
+    }
+
+    c.fn = NULL;
+    c.src[0] = (nargs > 0) ? getOperand(program, values, node.args[0]) : NULL;
+    c.src[1] = (nargs > 1) ? getOperand(program, values, node.args[1]) : NULL;
+    c.dst = NULL;
+    c.delay = NULL;
+    c.noise = NULL;
+    c.func.f1 = NULL;
+    c.value = node.value;
+
+    const bool ldirect = (c.src[0] != NULL);
+    const bool rdirect = (c.src[1] != NULL);
+    switch(node.opcode)
+    {
+    case P_literal:
+        c.fn = &evalConstant;
+        return (nargs == 0);
+    case P_readvar:
+        if (node.index >= values.size())
+            return false;
+        c.src[0] = &values[node.index];
+        c.fn = &evalVariable;
+        return (nargs == 0);
+    case P_writevar:
+        if (node.index >= values.size())
+            return false;
+        c.dst = &values[node.index];
+        c.fn = ldirect ? &evalAssign<true> : &evalAssign<false>;
+        return (nargs == 1);
+    case P_readdelay:
+    case P_writedelay:
+        if ((node.index >= vars.size()) || (vars[node.index].m_type != varInfo::TYPE_DELAY))
+            return false;
+        c.delay = &vars[node.index];
+        if (node.opcode == P_readdelay)
+            c.fn = &evalReadDelay;
+        else
+            c.fn = ldirect ? &evalWriteDelay<true> : &evalWriteDelay<false>;
+        return (nargs == 1);
+    case P_fir:
+        if ((node.index >= vars.size()) || (vars[node.index].m_type != varInfo::TYPE_FIR))
+            return false;
+        c.delay = &vars[node.index];
+        c.fn = ldirect ? &evalFIR<true> : &evalFIR<false>;
+        return (nargs == 1);
+    case P_biquad:
+        if ((node.index >= vars.size()) || (vars[node.index].m_type != varInfo::TYPE_BIQUAD))
+            return false;
+        c.delay = &vars[node.index];
+        c.fn = ldirect ? &evalBiquad<true> : &evalBiquad<false>;
+        return (nargs == 1);
+    case P_add:
+        c.fn = selectBinary<OpAdd>(ldirect, rdirect);
+        return (nargs == 2);
+    case P_sub:
+        c.fn = selectBinary<OpSub>(ldirect, rdirect);
+        return (nargs == 2);
+    case P_mul:
+        c.fn = selectBinary<OpMul>(ldirect, rdirect);
+        return (nargs == 2);
+    case P_div:
+        c.fn = selectBinary<OpDiv>(ldirect, rdirect);
+        return (nargs == 2);
+    case P_neg:
+        c.fn = &evalNeg;
+        return (nargs == 1);
+    case P_noise:
+    case P_gaussnoise:
+    case P_pinknoise:
+        c.noise = noise;
+        if (node.opcode == P_noise)
+            c.fn = &evalNoise;
+        else if (node.opcode == P_gaussnoise)
+            c.fn = &evalGaussNoise;
+        else
+            c.fn = &evalPinkNoise;
+        return (nargs == 0);
+    case P_sin:     c.func.f1 = &VM::funcSin; break;
+    case P_cos:     c.func.f1 = &VM::funcCos; break;
+    case P_sin1:    c.func.f1 = &VM::funcSin1; break;
+    case P_cos1:    c.func.f1 = &VM::funcCos1; break;
+    case P_mod1:    c.func.f1 = &VM::funcMod1; break;
+    case P_abs:     c.func.f1 = &VM::funcAbs; break;
+    case P_round:   c.func.f1 = &VM::funcRound; break;
+    case P_sqrt:    c.func.f1 = &VM::funcSqrt; break;
+    case P_tan:     c.func.f1 = &VM::funcTan; break;
+    case P_tanh:    c.func.f1 = &VM::funcTanh; break;
+    case P_limit:   c.func.f1 = &VM::funcLimit; break;
+    case P_sign:    c.func.f1 = &VM::funcSign; break;
+    case P_trunc:   c.func.f1 = &VM::funcTrunc; break;
+    case P_ceil:    c.func.f1 = &VM::funcCeil; break;
+    case P_floor:   c.func.f1 = &VM::funcFloor; break;
+    case P_pow:     c.func.f2 = &VM::funcPow; break;
+    case P_atan2:   c.func.f2 = &VM::funcAtan2; break;
+    case P_choose:  c.func.f3 = &VM::funcChoose; break;
+    case P_fastsin:     c.func.f1 = &VM::fastSin; break;
+    case P_fastcos:     c.func.f1 = &VM::fastCos; break;
+    case P_fastsin1:    c.func.f1 = &VM::fastSin1; break;
+    case P_fastcos1:    c.func.f1 = &VM::fastCos1; break;
+    case P_fasttan:     c.func.f1 = &VM::fastTan; break;
+    case P_fasttanh:    c.func.f1 = &VM::fastTanh; break;
+    case P_fastpow:     c.func.f2 = &VM::fastPow; break;
+    case P_fastatan2:   c.func.f2 = &VM::fastAtan2; break;
+    default:
+        return false;
+    }
+
+    // built-in functions
+    if (functionDefs::getNumberOfArguments(node.opcode) != nargs)
+        return false;
+
+    switch(nargs)
+    {
+    case 1:
+        c.fn = ldirect ? &evalFunction1<true> : &evalFunction1<false>;
+        break;
+    case 2:
+        c.fn = &evalFunction2;
+        break;
+    default:
+        c.fn = &evalFunction3;
+        break;
+    }
+    return true;
+}
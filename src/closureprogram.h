@@ -0,0 +1,101 @@
+/*
+
+  Description:  Portable fast execution of VM programs
+                by closure compilation.
+
+                Each node of an expression tree program
+                is compiled into a closure: a pointer to a
+                small evaluation function together with the
+                data it needs, pre-bound to the addresses of
+                the variables. Operands that are variables or
+                constants are read directly by their parent,
+                so most leaves of the tree cost no call.
+
+  License: GPLv2
+
+*/
+
+#ifndef closureprogram_h
+#define closureprogram_h
+
+#include <stdint.h>
+#include <vector>
+#include "vmtypes.h"
+#include "noisegenerator.h"
+
+class ClosureProgram
+{
+public:
+    ClosureProgram();
+
+    /** a compiled expression tree node */
+    struct closure_t
+    {
+        typedef float (*eval_t)(const closure_t *c);
+
+        eval_t          fn;         // evaluation function
+        const closure_t *arg[3];    // argument closures
+        const float     *src[2];    // arguments read directly from a variable or constant
+        float           *dst;       // variable written by an assignment
+        varInfo         *delay;     // delay line for delay access
+        NoiseGenerator  *noise;     // generator of the noise functions
+        union
+        {
+            float (*f1)(float);
+            float (*f2)(float, float);
+            float (*f3)(float, float, float);
+        } func;                     // built-in function
+        float           value;      // literal value
+    };
+
+    /** compile an expression tree program.
+        the closures access the values in 'values', the
+        delay lines in 'vars' and the noise generator
+        directly, so none of them must be reallocated
+        while the closures are in use.
+        returns false if the program contains an
+        unsupported or invalid node. */
+    bool build(const VM::exprprogram_t &program, VM::variables_t &vars, VM::values_t &values,
+               NoiseGenerator *noise);
+
+    /** remove the compiled program */
+    void clear();
+
+    /** returns true if a compiled program is available */
+    bool isValid() const
+    {
+        return !m_statements.empty();
+    }
+
+    /** execute all statements once */
+    void execute() const
+    {
+        const size_t N = m_statements.size();
+        for(size_t i=0; i<N; i++)
+        {
+            const closure_t *c = m_statements[i];
+            c->fn(c);
+        }
+    }
+
+    /** the number of closures of the compiled program */
+    size_t getNumberOfClosures() const
+    {
+        return m_closures.size();
+    }
+
+protected:
+    /** compile a single node. its arguments must
+        have been compiled already. */
+    bool bindNode(const VM::exprprogram_t &program, VM::variables_t &vars,
+                  VM::values_t &values, NoiseGenerator *noise, uint32_t idx);
+
+    /** returns the address of the value of a variable
+        or constant node, or NULL for other nodes */
+    const float* getOperand(const VM::exprprogram_t &program, VM::values_t &values, int32_t idx);
+
+    std::vector<closure_t>          m_closures;     // one closure per node
+    std::vector<const closure_t*>   m_statements;   // root closure of each statement
+};
+
+#endif
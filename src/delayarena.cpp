@@ -0,0 +1,115 @@
+/*
+
+  Description:  Memory of the delay lines and filter
+                states of a VM program.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <utility>
+#include "delayarena.h"
+
+DelayArena::DelayArena()
+    : m_memory(NULL),
+      m_lines(NULL),
+      m_position(NULL),
+      m_size(0)
+{
+    reserve(0);
+}
+
+DelayArena::~DelayArena()
+{
+    delete[] m_memory;
+}
+
+void DelayArena::reserve(size_t size)
+{
+    delete[] m_memory;
+
+    // one aligned slot for the write position, followed
+    // by the delay lines, plus room for the alignment.
+    const size_t total = VM_DELAYALIGN + size + VM_DELAYALIGN;
+    m_memory = new float[total];
+    memset(m_memory, 0, sizeof(float)*total);
+
+    const uintptr_t alignMask = VM_DELAYALIGN*sizeof(float) - 1;
+    float *base = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(m_memory) + alignMask) & ~alignMask);
+    m_position = reinterpret_cast<uint32_t*>(base);
+    m_lines = base + VM_DELAYALIGN;
+    m_size = size;
+}
+
+bool DelayArena::isAllocated(const varInfo &var)
+{
+    return (var.m_type == varInfo::TYPE_DELAY) ||
+           (var.m_type == varInfo::TYPE_FIR) ||
+           (var.m_type == varInfo::TYPE_BIQUAD);
+}
+
+size_t DelayArena::getLineSize(const varInfo &var)
+{
+    // the history of a FIR filter is stored twice,
+    // a biquad section has two state variables.
+    const size_t length = var.m_mask + 1;
+    size_t size = length;
+    if (var.m_type == varInfo::TYPE_FIR)
+        size = 2*length;
+    if (var.m_type == varInfo::TYPE_BIQUAD)
+        size = 2*var.m_length;
+    return (size + VM_DELAYALIGN - 1) & ~(size_t)(VM_DELAYALIGN - 1);
+}
+
+void DelayArena::allocate(VM::variables_t &vars)
+{
+    // round the lengths up to a power of two and
+    // start each delay line on an aligned address.
+    size_t size = 0;
+    for(varInfo &var : vars)
+    {
+        if (!isAllocated(var))
+            continue;
+
+        uint32_t length = 1;
+        while(length < (uint32_t)var.m_length)
+        {
+            length <<= 1;
+        }
+        var.m_mask = length-1;
+        size += getLineSize(var);
+    }
+
+    reserve(size);
+
+    float *line = m_lines;
+    for(varInfo &var : vars)
+    {
+        if (!isAllocated(var))
+            continue;
+
+        var.m_data = line;
+        var.m_position = m_position;
+        line += getLineSize(var);
+    }
+}
+
+void DelayArena::clear()
+{
+    reserve(0);
+}
+
+void DelayArena::reset()
+{
+    *m_position = 0;
+    memset(m_lines, 0, sizeof(float)*m_size);
+}
+
+void DelayArena::swap(DelayArena &other)
+{
+    std::swap(m_memory, other.m_memory);
+    std::swap(m_lines, other.m_lines);
+    std::swap(m_position, other.m_position);
+    std::swap(m_size, other.m_size);
+}
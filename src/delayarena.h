@@ -0,0 +1,103 @@
+/*
+
+  Description:  Memory of the delay lines, FIR filter
+                histories and biquad states of a VM program.
+
+                All delay lines are allocated in one aligned
+                block of memory when a program is loaded. The
+                length of each delay line is rounded up to a
+                power of two, so a position is wrapped with a
+                mask instead of a modulo.
+
+                The delay lines share a single write position,
+                which is decremented once per sample. Sample k
+                of a delay line is at (position + k) & mask.
+                A FIR history is written twice, 'mask + 1'
+                apart, so its last samples are contiguous.
+                A biquad keeps its two state variables per
+                section and does not use the write position.
+
+  License: GPLv2
+
+*/
+
+#ifndef delayarena_h
+#define delayarena_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vmtypes.h"
+
+// alignment of the arena and of each delay line in floats
+#define VM_DELAYALIGN 16
+
+class DelayArena
+{
+public:
+    DelayArena();
+    virtual ~DelayArena();
+
+    /** allocate the memory of all delay lines and
+        filters in 'vars' and point the variables to it.
+        The memory is cleared. */
+    void allocate(VM::variables_t &vars);
+
+    /** release the memory of the delay lines */
+    void clear();
+
+    /** clear the delay lines and filter states
+        and return to the first write position */
+    void reset();
+
+    /** exchange the memory with another arena. the
+        delay variables keep pointing to the same memory. */
+    void swap(DelayArena &other);
+
+    /** move all delay lines to the next sample */
+    void advance()
+    {
+        (*m_position)--;
+    }
+
+    /** the current write position */
+    uint32_t getPosition() const
+    {
+        return *m_position;
+    }
+
+    /** set the write position, used by the block engine
+        to run serial segments from the start of a block */
+    void setPosition(uint32_t position)
+    {
+        *m_position = position;
+    }
+
+    /** the number of floats allocated for the delay lines */
+    size_t getSize() const
+    {
+        return m_size;
+    }
+
+    /** returns true if the variable keeps its
+        samples or state in the arena */
+    static bool isAllocated(const varInfo &var);
+
+protected:
+    /** the number of floats allocated for a delay
+        line or filter, including the alignment */
+    static size_t getLineSize(const varInfo &var);
+
+    /** replace the memory by a cleared block with room
+        for the write position and 'size' floats */
+    void reserve(size_t size);
+
+    // the write position is kept in the first aligned
+    // slot of the memory, so its address does not change
+    // when arenas are swapped.
+    float       *m_memory;      // allocation, not aligned
+    float       *m_lines;       // aligned start of the delay lines
+    uint32_t    *m_position;    // shared write position
+    size_t      m_size;         // floats allocated for delay lines
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+
+  Description:  Fast approximations of the transcendental
+                functions of the VM, used when a program
+                runs in fast-math mode.
+
+                The functions use only arithmetic, compares
+                and integer conversions without branches on
+                the data, so the compiler can vectorize the
+                loops of the block engine that call them.
+
+                Maximum errors, as measured by
+                tests/fastmathbench.cpp:
+
+                fastSin1, fastCos1  absolute 1.8e-7
+                fastSin, fastCos    absolute 3.5e-7, |x| < 1000
+                fastTan             relative 1.7e-6, |x| < 1.5
+                fastTanh            absolute 1.4e-7, relative 5e-7
+                fastAtan2           absolute 3.7e-7
+                fastPow             relative 1.2e-6, |y*log2(x)| < 30
+
+                NaN arguments always give NaN, also where
+                pow() would return 1.
+
+  License: GPLv2
+
+*/
+
+#ifndef fastmath_h
+#define fastmath_h
+
+#include <stdint.h>
+#include <string.h>
+#include <cmath>
+
+namespace VM
+{
+    /** round to the nearest integer, for |x| < 2^22.
+        adding and subtracting 1.5*2^23 drops the
+        fraction bits. */
+    inline float fastRound(float x)
+    {
+        const float magic = 12582912.0f;
+        return (x + magic) - magic;
+    }
+
+    /** the fraction of x, in [-0.5, 0.5]. floats of
+        2^23 and above are integers, infinities and NaN
+        give NaN. */
+    inline float fastFraction(float x)
+    {
+        const float t = x - fastRound(x);
+        return (std::fabs(x) < 8388608.0f) ? t : x*0.0f;
+    }
+
+    /** sin(2*pi*u) for u in [-0.25, 0.25] */
+    inline float fastSinCore(float u)
+    {
+        const float w = u*u;
+        const float p = 6.283185280e+00f + w*(-4.134168072e+01f + w*(8.160248503e+01f
+                        + w*(-7.658139425e+01f + w*3.976159997e+01f)));
+        return u*p;
+    }
+
+    /** sin(2*pi*x) */
+    inline float fastSin1(float x)
+    {
+        // sin(2*pi*t) = sin(2*pi*(0.5-t)), so fold
+        // |t| onto [0, 0.25].
+        const float t = fastFraction(x);
+        const float a = std::fabs(t);
+        const float u = (a > 0.25f) ? 0.5f - a : a;
+        return std::copysign(fastSinCore(u), t);
+    }
+
+    /** cos(2*pi*x) */
+    inline float fastCos1(float x)
+    {
+        // cos(2*pi*t) = sin(2*pi*(0.25-|t|))
+        const float t = fastFraction(x);
+        return fastSinCore(0.25f - std::fabs(t));
+    }
+
+    /** x/(2*pi), with x reduced to [-pi, pi] first.
+        2*pi is split into 6.28125, which multiplies
+        exactly, and the rest, so the reduction is
+        accurate for |x| < 2^17. */
+    inline float fastTurns(float x)
+    {
+        const float k = fastRound(x * 0.159154943f);
+        const float r = (x - k*6.28125f) - k*1.93530717e-3f;
+        return r * 0.159154943f;
+    }
+
+    inline float fastSin(float x)
+    {
+        return fastSin1(fastTurns(x));
+    }
+
+    inline float fastCos(float x)
+    {
+        return fastCos1(fastTurns(x));
+    }
+
+    inline float fastTan(float x)
+    {
+        const float t = fastTurns(x);
+        return fastSin1(t) / fastCos1(t);
+    }
+
+    /** 2^x */
+    inline float fastExp2(float x)
+    {
+        // 2^x = 2^n * 2^f with n = floor(x), f in [0,1)
+        float c = (x > -126.0f) ? x : -126.0f;
+        c = (c < 127.0f) ? c : 127.0f;
+        int32_t n = (int32_t)c;
+        n -= (c < (float)n) ? 1 : 0;
+        const float f = c - (float)n;
+        const float p = 9.999999251e-01f + f*(6.931530729e-01f + f*(2.401536194e-01f
+                        + f*(5.582631122e-02f + f*(8.989348182e-03f + f*1.877573349e-03f))));
+        const uint32_t bits = (uint32_t)(n + 127) << 23;
+        float scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        float result = p*scale;
+        result = (x < -126.0f) ? 0.0f : result;
+        result = (x >= 128.0f) ? INFINITY : result;
+        return (x == x) ? result : x;
+    }
+
+    /** log2(x) for positive, normal x */
+    inline float fastLog2(float x)
+    {
+        // x = 2^e * m with m in [sqrt(0.5), sqrt(2))
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        int32_t e = (int32_t)(bits >> 23) - 127;
+        bits = (bits & 0x007FFFFF) | 0x3F800000;
+        float m;
+        memcpy(&m, &bits, sizeof(m));
+        const bool high = (m > 1.414213562f);
+        m = high ? 0.5f*m : m;
+        e += high ? 1 : 0;
+
+        // log2(m) = 2/ln(2) * atanh(s), s = (m-1)/(m+1)
+        const float s = (m - 1.0f)/(m + 1.0f);
+        const float w = s*s;
+        const float p = 2.885390080e+00f + w*(9.617988537e-01f + w*(5.767138366e-01f
+                        + w*4.317482697e-01f));
+        return (float)e + s*p;
+    }
+
+    /** x^y = 2^(y*log2(|x|)). zero, negative x and
+        infinities are handled like pow(), except that
+        the sign of zero is ignored. */
+    inline float fastPow(float x, float y)
+    {
+        const float ax = std::fabs(x);
+        float r = fastExp2(y*fastLog2(ax));
+
+        // zero and denormal x
+        const float zero = (y > 0.0f) ? 0.0f : ((y < 0.0f) ? INFINITY : 1.0f);
+        r = (ax < 1.17549435e-38f) ? zero : r;
+
+        // a negative x needs an integer y, floats
+        // of 2^23 and above are even integers.
+        const float ay = std::fabs(y);
+        const bool integer = (ay >= 8388608.0f) || (y == fastRound(y));
+        const bool odd = (ay < 8388608.0f) && (0.5f*y != fastRound(0.5f*y));
+        const float negative = integer ? (odd ? -r : r) : NAN;
+        r = (x < 0.0f) ? negative : r;
+        return ((x == x) && (y == y)) ? r : x + y;
+    }
+
+    inline float fastTanh(float x)
+    {
+        // tanh(|x|) = (1-t)/(1+t) with t = exp(-2|x|).
+        // near zero this cancels, so a series is used.
+        const float a = std::fabs(x);
+        const float t = fastExp2(-2.885390082f*a);
+        const float large = (1.0f - t)/(1.0f + t);
+        const float w = a*a;
+        const float small = a*(1.0f + w*(-0.333333333f + w*(0.133333333f + w*-0.053968254f)));
+        return std::copysign((a >= 0.125f) ? large : small, x);
+    }
+
+    inline float fastAtan2(float y, float x)
+    {
+        // atan of the ratio of the smaller to the larger
+        // magnitude, which is in [0, 1]
+        const float ax = std::fabs(x);
+        const float ay = std::fabs(y);
+        const bool steep = (ay > ax);
+        const float mx = steep ? ay : ax;
+        const float mn = steep ? ax : ay;
+        const float a = (mx > 0.0f) ? mn/mx : 0.0f;
+        const float w = a*a;
+        const float p = 9.999999113e-01f + w*(-3.333209265e-01f + w*(1.997136126e-01f
+                        + w*(-1.402933579e-01f + w*(9.942517975e-02f + w*(-5.990116479e-02f
+                        + w*(2.455453371e-02f + w*-4.779713171e-03f))))));
+        float r = a*p;
+        r = steep ? 1.570796327f - r : r;
+        r = std::signbit(x) ? 3.141592654f - r : r;
+        r = std::copysign(r, y);
+        return ((x == x) && (y == y)) ? r : x + y;
+    }
+}
+
+#endif
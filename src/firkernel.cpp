@@ -0,0 +1,117 @@
+/*
+
+  Description:  Vectorized FIR filter kernel of the VM.
+
+  License: GPLv2
+
+*/
+
+#include "firkernel.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define FIR_SSE
+#include <xmmintrin.h>
+#endif
+
+#ifdef FIR_SSE
+/** sum of the four elements of a vector */
+static inline float horizontalSum(__m128 v)
+{
+    __m128 high = _mm_movehl_ps(v, v);
+    v = _mm_add_ps(v, high);
+    high = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1));
+    v = _mm_add_ss(v, high);
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+/** sum of h[i]*c[i] for i < n */
+static float dotProduct(const float *h, const float *c, uint32_t n)
+{
+    uint32_t i = 0;
+    float sum = 0.0f;
+#ifdef FIR_SSE
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for(; i+8 <= n; i+=8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(h+i), _mm_loadu_ps(c+i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(h+i+4), _mm_loadu_ps(c+i+4)));
+    }
+    if (i+4 <= n)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(h+i), _mm_loadu_ps(c+i)));
+        i += 4;
+    }
+    sum = horizontalSum(_mm_add_ps(acc0, acc1));
+#else
+    // independent partial sums, which compilers
+    // turn into vector code.
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for(; i+4 <= n; i+=4)
+    {
+        acc[0] += h[i]*c[i];
+        acc[1] += h[i+1]*c[i+1];
+        acc[2] += h[i+2]*c[i+2];
+        acc[3] += h[i+3]*c[i+3];
+    }
+    sum = (acc[0] + acc[2]) + (acc[1] + acc[3]);
+#endif
+    for(; i<n; i++)
+    {
+        sum += h[i]*c[i];
+    }
+    return sum;
+}
+
+/** sum of (h[i] + t[-i])*c[i] for i < n */
+static float foldedProduct(const float *h, const float *t, const float *c, uint32_t n)
+{
+    uint32_t i = 0;
+    float sum = 0.0f;
+#ifdef FIR_SSE
+    __m128 acc = _mm_setzero_ps();
+    for(; i+4 <= n; i+=4)
+    {
+        // t[-i-3] .. t[-i] in reverse order
+        __m128 tail = _mm_loadu_ps(t-i-3);
+        tail = _mm_shuffle_ps(tail, tail, _MM_SHUFFLE(0,1,2,3));
+        const __m128 pair = _mm_add_ps(_mm_loadu_ps(h+i), tail);
+        acc = _mm_add_ps(acc, _mm_mul_ps(pair, _mm_loadu_ps(c+i)));
+    }
+    sum = horizontalSum(acc);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for(; i+4 <= n; i+=4)
+    {
+        acc[0] += (h[i] + t[-(int32_t)i])*c[i];
+        acc[1] += (h[i+1] + t[-(int32_t)i-1])*c[i+1];
+        acc[2] += (h[i+2] + t[-(int32_t)i-2])*c[i+2];
+        acc[3] += (h[i+3] + t[-(int32_t)i-3])*c[i+3];
+    }
+    sum = (acc[0] + acc[2]) + (acc[1] + acc[3]);
+#endif
+    for(; i<n; i++)
+    {
+        sum += (h[i] + t[-(int32_t)i])*c[i];
+    }
+    return sum;
+}
+
+float VM::firKernel(const float *history, const float *coefficients,
+                    uint32_t taps, uint32_t ncoefficients)
+{
+    if (ncoefficients >= taps)
+    {
+        return dotProduct(history, coefficients, taps);
+    }
+
+    // tap i and tap taps-1-i share coefficient i
+    const uint32_t pairs = taps/2;
+    float sum = foldedProduct(history, history+taps-1, coefficients, pairs);
+    if (taps & 1)
+    {
+        sum += history[pairs]*coefficients[pairs];
+    }
+    return sum;
+}
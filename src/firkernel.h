@@ -0,0 +1,34 @@
+/*
+
+  Description:  Vectorized FIR filter kernel of the VM.
+
+                The history of a filter is passed as a
+                contiguous array with the most recent sample
+                first. Symmetric filters are folded: the two
+                samples that share a coefficient are added
+                before the multiplication, which halves the
+                number of multiplications.
+
+  License: GPLv2
+
+*/
+
+#ifndef firkernel_h
+#define firkernel_h
+
+#include <stdint.h>
+
+namespace VM
+{
+    /** output of a FIR filter with 'taps' taps.
+        'history' holds the last 'taps' input samples,
+        history[0] is the current input.
+        When 'ncoefficients' is smaller than 'taps', the
+        filter is symmetric and 'coefficients' holds the
+        first half of the taps, including the centre tap
+        of a filter with an odd number of taps. */
+    float firKernel(const float *history, const float *coefficients,
+                    uint32_t taps, uint32_t ncoefficients);
+}
+
+#endif
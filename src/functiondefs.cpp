@@ -29,7 +29,22 @@ const functionInfo_t g_functionDefs[] =
     {"trunc",P_trunc,1},
     {"ceil",P_ceil,1},
     {"floor",P_floor,1},
-    {"choose", P_choose,3}
+    {"choose", P_choose,3},
+    {"fir", F_fir, FUNC_VARARGS},
+    {"firsymodd", F_firsymodd, FUNC_VARARGS},
+    {"firsymeven", F_firsymeven, FUNC_VARARGS},
+    {"biquad", F_biquad, FUNC_VARARGS},
+    {"biquads", F_biquads, FUNC_VARARGS},
+    {"fastsin",P_fastsin,1},
+    {"fastcos",P_fastcos,1},
+    {"fastsin1",P_fastsin1,1},
+    {"fastcos1",P_fastcos1,1},
+    {"fasttan",P_fasttan,1},
+    {"fasttanh",P_fasttanh,1},
+    {"fastpow",P_fastpow,2},
+    {"fastatan2",P_fastatan2,2},
+    {"gaussnoise",P_gaussnoise,0},
+    {"pinknoise",P_pinknoise,0}
 };
 
 int32_t functionDefs::getNumberOfArguments(uint32_t functionID)
@@ -43,3 +58,20 @@ int32_t functionDefs::getNumberOfArguments(uint32_t functionID)
     }
     return -1;
 }
+
+uint32_t functionDefs::getFastFunction(uint32_t functionID)
+{
+    switch(functionID)
+    {
+    case P_sin:     return P_fastsin;
+    case P_cos:     return P_fastcos;
+    case P_sin1:    return P_fastsin1;
+    case P_cos1:    return P_fastcos1;
+    case P_tan:     return P_fasttan;
+    case P_tanh:    return P_fasttanh;
+    case P_pow:     return P_fastpow;
+    case P_atan2:   return P_fastatan2;
+    default:
+        return functionID;
+    }
+}
@@ -19,12 +19,29 @@ struct functionInfo_t
     uint32_t      nargs;  // expected number of arguments
 };
 
-#define  g_functionDefsLen 19
+// FIR and biquad filters take the input signal followed
+// by any number of constant coefficients. They are not
+// VM opcodes, the parser turns them into P_fir and P_biquad.
+#define F_fir           119
+#define F_firsymodd     120
+#define F_firsymeven    121
+#define F_biquad        122
+#define F_biquads       123
+
+// number of arguments of a function with
+// a variable number of arguments
+#define FUNC_VARARGS    0xFFFF
+
+#define  g_functionDefsLen 34
 extern const functionInfo_t g_functionDefs[];
 
 namespace functionDefs
 {
     int32_t getNumberOfArguments(uint32_t functionID);
+
+    /** returns the fast approximation of a function,
+        or the function itself if it has none */
+    uint32_t getFastFunction(uint32_t functionID);
 }
 
 #endif
@@ -0,0 +1,485 @@
+/*
+
+  Description:  Just-in-time compiler that translates
+                VM programs into native x86-64 code.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <utility>
+#include "vmfunctions.h"
+#include "jitcompiler.h"
+
+#ifdef VM_JIT
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// The evaluation stack lives in xmm4..xmm15,
+// xmm0..xmm3 are used for call arguments and
+// temporaries.
+#define JIT_FIRSTSLOT   4
+#define JIT_SLOTS       12
+
+// general purpose registers
+#define JIT_RAX 0
+#define JIT_RCX 1
+#define JIT_RDX 2
+#define JIT_RBX 3
+#define JIT_RSP 4
+#define JIT_RDI 7
+
+// SSE opcodes
+#define JIT_MOVSS_LOAD  0x10
+#define JIT_MOVSS_STORE 0x11
+#define JIT_MOVAPS      0x28
+#define JIT_SQRTSS      0x51
+#define JIT_ANDPS       0x54
+#define JIT_XORPS       0x57
+#define JIT_ADDSS       0x58
+#define JIT_MULSS       0x59
+#define JIT_SUBSS       0x5C
+#define JIT_MINSS       0x5D
+#define JIT_DIVSS       0x5E
+#define JIT_MAXSS       0x5F
+
+// Stack frame: 32 bytes of shadow space for the
+// Windows calling convention, followed by the
+// spill area for the stack slots that must survive
+// a helper call. Windows also requires xmm6..xmm15
+// to be preserved. The frame size keeps the stack
+// 16-byte aligned after pushing rbx.
+#define JIT_SPILL       32
+#ifdef _WIN64
+#define JIT_XMMSAVE     (JIT_SPILL + 4*JIT_SLOTS)
+#define JIT_FRAME       (JIT_XMMSAVE + 16*10)
+#else
+#define JIT_FRAME       (JIT_SPILL + 4*JIT_SLOTS)
+#endif
+
+// register of a pointer argument that follows 'nargs'
+// float arguments. Windows assigns the registers by
+// position, rcx to the first and rdx to the second
+// argument. System V passes the first integer in rdi.
+#ifdef _WIN64
+#define JIT_PTRARG(nargs) (((nargs) == 0) ? JIT_RCX : JIT_RDX)
+#else
+#define JIT_PTRARG(nargs) JIT_RDI
+#endif
+
+JITCompiler::JITCompiler()
+    : m_memory(NULL),
+      m_memorySize(0)
+{
+}
+
+JITCompiler::~JITCompiler()
+{
+    clear();
+}
+
+bool JITCompiler::isSupported()
+{
+#ifdef VM_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JITCompiler::clear()
+{
+#ifdef VM_JIT
+    if (m_memory != NULL)
+    {
+#ifdef _WIN32
+        VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+        munmap(m_memory, m_memorySize);
+#endif
+    }
+#endif
+    m_memory = NULL;
+    m_memorySize = 0;
+    m_code.clear();
+    m_functions.clear();
+}
+
+void JITCompiler::swap(JITCompiler &other)
+{
+    std::swap(m_code, other.m_code);
+    std::swap(m_functions, other.m_functions);
+    std::swap(m_memory, other.m_memory);
+    std::swap(m_memorySize, other.m_memorySize);
+}
+
+bool JITCompiler::finalize()
+{
+#ifdef VM_JIT
+    if (m_code.empty() || (m_memory != NULL))
+        return false;
+
+    // the memory is writable while the code is copied
+    // and executable afterwards, never both at once.
+    const size_t size = m_code.size();
+#ifdef _WIN32
+    void *mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (mem == NULL)
+        return false;
+    memcpy(mem, &m_code[0], size);
+    DWORD oldProtect;
+    if (!VirtualProtect(mem, size, PAGE_EXECUTE_READ, &oldProtect))
+    {
+        VirtualFree(mem, 0, MEM_RELEASE);
+        return false;
+    }
+    FlushInstructionCache(GetCurrentProcess(), mem, size);
+#else
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+    memcpy(mem, &m_code[0], size);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(mem, size);
+        return false;
+    }
+#endif
+    m_memory = (uint8_t*)mem;
+    m_memorySize = size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+JITCompiler::function_t JITCompiler::getFunction(int32_t index) const
+{
+    if ((m_memory == NULL) || (index < 0) || ((size_t)index >= m_functions.size()))
+        return NULL;
+
+    return (function_t)(m_memory + m_functions[index]);
+}
+
+int32_t JITCompiler::addFunction(const VM::program_t &program, VM::variables_t &vars, VM::values_t &values,
+                                 NoiseGenerator *noise, const std::vector<BlockSchedule::range_t> &statements)
+{
+#ifdef VM_JIT
+    if ((m_memory != NULL) || vars.empty() || (values.size() != vars.size()))
+        return -1;
+
+    const size_t start = m_code.size();
+    emitPrologue(values);
+
+    uint32_t sp = 0;
+    for(const BlockSchedule::range_t &range : statements)
+    {
+        if (!emitStatements(program, vars, noise, range, sp))
+        {
+            m_code.resize(start);
+            return -1;
+        }
+    }
+
+    emitEpilogue();
+    m_functions.push_back(start);
+    return (int32_t)m_functions.size()-1;
+#else
+    return -1;
+#endif
+}
+
+bool JITCompiler::emitStatements(const VM::program_t &program, VM::variables_t &vars,
+                                 NoiseGenerator *noise, const BlockSchedule::range_t &range, uint32_t &sp)
+{
+    size_t pc = range.begin;
+    while(pc < range.end)
+    {
+        uint32_t icode = program[pc++].icode;
+        if (icode & 0x80000000)
+        {
+            uint32_t n = icode & 0xFFFF;
+            if (n >= vars.size())
+                return false;
+
+            // the value slots are addressed relative to rbx
+            int32_t disp = (int32_t)(n*sizeof(float));
+            switch(icode & 0xff000000)
+            {
+            case P_readvar:
+                if (sp >= JIT_SLOTS)
+                    return false;
+                emitSSEMem(0xF3, JIT_MOVSS_LOAD, JIT_FIRSTSLOT+sp, JIT_RBX, disp);
+                sp++;
+                break;
+            case P_writevar:
+                if (sp < 1)
+                    return false;
+                sp--;
+                emitSSEMem(0xF3, JIT_MOVSS_STORE, JIT_FIRSTSLOT+sp, JIT_RBX, disp);
+                break;
+            case P_readdelay:
+                if (!emitCall((const void*)&VM::funcReadDelay, 1, true, sp, &vars[n]))
+                    return false;
+                break;
+            case P_writedelay:
+                if (!emitCall((const void*)&VM::funcWriteDelay, 1, false, sp, &vars[n]))
+                    return false;
+                break;
+            case P_fir:
+                if (!emitCall((const void*)&VM::funcFIR, 1, true, sp, &vars[n]))
+                    return false;
+                break;
+            case P_biquad:
+                if (!emitCall((const void*)&VM::funcBiquad, 1, true, sp, &vars[n]))
+                    return false;
+                break;
+            default:
+                return false;
+            }
+            continue;
+        }
+
+        const uint32_t top = JIT_FIRSTSLOT+sp-1;
+        switch(icode)
+        {
+        case P_literal:
+            if (sp >= JIT_SLOTS)
+                return false;
+            emitLoadConstant(JIT_FIRSTSLOT+sp, program[pc++].value);
+            sp++;
+            break;
+        case P_add:
+        case P_sub:
+        case P_mul:
+        case P_div:
+        {
+            if (sp < 2)
+                return false;
+            const uint8_t ops[] = {JIT_ADDSS, JIT_SUBSS, JIT_MULSS, JIT_DIVSS};
+            emitSSE(0xF3, ops[icode-P_add], top-1, top);
+            sp--;
+            break;
+        }
+        case P_neg:
+            if (sp < 1)
+                return false;
+            emitByte(0xB8);     // mov eax, sign bit
+            emitDWord(0x80000000);
+            emitSSE(0x66, 0x6E, 0, JIT_RAX);    // movd xmm0, eax
+            emitSSE(0, JIT_XORPS, top, 0);
+            break;
+        case P_abs:
+            if (sp < 1)
+                return false;
+            emitByte(0xB8);     // mov eax, all bits except the sign
+            emitDWord(0x7FFFFFFF);
+            emitSSE(0x66, 0x6E, 0, JIT_RAX);    // movd xmm0, eax
+            emitSSE(0, JIT_ANDPS, top, 0);
+            break;
+        case P_sqrt:
+            if (sp < 1)
+                return false;
+            emitSSE(0xF3, JIT_SQRTSS, top, top);
+            break;
+        case P_limit:
+            // minss and maxss return the second operand
+            // if the first one is not smaller/larger,
+            // which is what std::min and std::max do.
+            if (sp < 1)
+                return false;
+            emitLoadConstant(0, 1.0f);
+            emitSSE(0xF3, JIT_MINSS, 0, top);
+            emitLoadConstant(top, -1.0f);
+            emitSSE(0xF3, JIT_MAXSS, top, 0);
+            break;
+        case P_sin:     if (!emitCall((const void*)&VM::funcSin, 1, true, sp)) return false; break;
+        case P_cos:     if (!emitCall((const void*)&VM::funcCos, 1, true, sp)) return false; break;
+        case P_sin1:    if (!emitCall((const void*)&VM::funcSin1, 1, true, sp)) return false; break;
+        case P_cos1:    if (!emitCall((const void*)&VM::funcCos1, 1, true, sp)) return false; break;
+        case P_mod1:    if (!emitCall((const void*)&VM::funcMod1, 1, true, sp)) return false; break;
+        case P_round:   if (!emitCall((const void*)&VM::funcRound, 1, true, sp)) return false; break;
+        case P_tan:     if (!emitCall((const void*)&VM::funcTan, 1, true, sp)) return false; break;
+        case P_tanh:    if (!emitCall((const void*)&VM::funcTanh, 1, true, sp)) return false; break;
+        case P_sign:    if (!emitCall((const void*)&VM::funcSign, 1, true, sp)) return false; break;
+        case P_trunc:   if (!emitCall((const void*)&VM::funcTrunc, 1, true, sp)) return false; break;
+        case P_ceil:    if (!emitCall((const void*)&VM::funcCeil, 1, true, sp)) return false; break;
+        case P_floor:   if (!emitCall((const void*)&VM::funcFloor, 1, true, sp)) return false; break;
+        case P_pow:     if (!emitCall((const void*)&VM::funcPow, 2, true, sp)) return false; break;
+        case P_atan2:   if (!emitCall((const void*)&VM::funcAtan2, 2, true, sp)) return false; break;
+        case P_choose:  if (!emitCall((const void*)&VM::funcChoose, 3, true, sp)) return false; break;
+        case P_noise:   if (!emitCall((const void*)&VM::funcNoise, 0, true, sp, noise)) return false; break;
+        case P_gaussnoise:  if (!emitCall((const void*)&VM::funcGaussNoise, 0, true, sp, noise)) return false; break;
+        case P_pinknoise:   if (!emitCall((const void*)&VM::funcPinkNoise, 0, true, sp, noise)) return false; break;
+        case P_fastsin:     if (!emitCall((const void*)&VM::fastSin, 1, true, sp)) return false; break;
+        case P_fastcos:     if (!emitCall((const void*)&VM::fastCos, 1, true, sp)) return false; break;
+        case P_fastsin1:    if (!emitCall((const void*)&VM::fastSin1, 1, true, sp)) return false; break;
+        case P_fastcos1:    if (!emitCall((const void*)&VM::fastCos1, 1, true, sp)) return false; break;
+        case P_fasttan:     if (!emitCall((const void*)&VM::fastTan, 1, true, sp)) return false; break;
+        case P_fasttanh:    if (!emitCall((const void*)&VM::fastTanh, 1, true, sp)) return false; break;
+        case P_fastpow:     if (!emitCall((const void*)&VM::fastPow, 2, true, sp)) return false; break;
+        case P_fastatan2:   if (!emitCall((const void*)&VM::fastAtan2, 2, true, sp)) return false; break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JITCompiler::emitCall(const void *func, uint32_t nargs, bool result, uint32_t &sp,
+                           const void *ptrArg)
+{
+    if (sp < nargs)
+        return false;
+
+    const uint32_t first = sp - nargs;
+    if (result && (first >= JIT_SLOTS))
+        return false;
+
+    // only one float may precede a pointer argument
+    if ((ptrArg != NULL) && (nargs > 1))
+        return false;
+
+    // all xmm registers are caller-saved on System V,
+    // so the stack slots below the arguments are spilled.
+    for(uint32_t i=0; i<first; i++)
+    {
+        emitSSEMem(0xF3, JIT_MOVSS_STORE, JIT_FIRSTSLOT+i, JIT_RSP, JIT_SPILL+4*i);
+    }
+    // register moves use movaps, which writes the whole
+    // register. movss would merge into the old value and
+    // chain every call to the result of the previous one.
+    for(uint32_t k=0; k<nargs; k++)
+    {
+        emitSSE(0, JIT_MOVAPS, k, JIT_FIRSTSLOT+first+k);
+    }
+    if (ptrArg != NULL)
+    {
+        emitMovImm64(JIT_PTRARG(nargs), (uint64_t)(uintptr_t)ptrArg);
+    }
+    emitMovImm64(JIT_RAX, (uint64_t)(uintptr_t)func);
+    emitByte(0xFF);     // call rax
+    emitByte(0xD0);
+
+    if (result)
+    {
+        emitSSE(0, JIT_MOVAPS, JIT_FIRSTSLOT+first, 0);
+        sp = first+1;
+    }
+    else
+    {
+        sp = first;
+    }
+
+    for(uint32_t i=0; i<first; i++)
+    {
+        emitSSEMem(0xF3, JIT_MOVSS_LOAD, JIT_FIRSTSLOT+i, JIT_RSP, JIT_SPILL+4*i);
+    }
+    return true;
+}
+
+void JITCompiler::emitPrologue(const VM::values_t &values)
+{
+    emitByte(0x53);                 // push rbx
+    emitByte(0x48);                 // sub rsp, frame
+    emitByte(0x81);
+    emitByte(0xEC);
+    emitDWord(JIT_FRAME);
+#ifdef _WIN64
+    for(uint32_t i=0; i<10; i++)    // movups [rsp+...], xmm6..xmm15
+    {
+        emitSSEMem(0, JIT_MOVSS_STORE, 6+i, JIT_RSP, JIT_XMMSAVE+16*i);
+    }
+#endif
+    // rbx points to the value slots
+    emitMovImm64(JIT_RBX, (uint64_t)(uintptr_t)&values[0]);
+}
+
+void JITCompiler::emitEpilogue()
+{
+#ifdef _WIN64
+    for(uint32_t i=0; i<10; i++)    // movups xmm6..xmm15, [rsp+...]
+    {
+        emitSSEMem(0, JIT_MOVSS_LOAD, 6+i, JIT_RSP, JIT_XMMSAVE+16*i);
+    }
+#endif
+    emitByte(0x48);                 // add rsp, frame
+    emitByte(0x81);
+    emitByte(0xC4);
+    emitDWord(JIT_FRAME);
+    emitByte(0x5B);                 // pop rbx
+    emitByte(0xC3);                 // ret
+}
+
+void JITCompiler::emitByte(uint8_t b)
+{
+    m_code.push_back(b);
+}
+
+void JITCompiler::emitDWord(uint32_t d)
+{
+    for(uint32_t i=0; i<4; i++)
+    {
+        m_code.push_back((d >> (8*i)) & 0xFF);
+    }
+}
+
+void JITCompiler::emitQWord(uint64_t q)
+{
+    for(uint32_t i=0; i<8; i++)
+    {
+        m_code.push_back((q >> (8*i)) & 0xFF);
+    }
+}
+
+void JITCompiler::emitSSE(uint8_t prefix, uint8_t opcode, uint32_t reg, uint32_t rm)
+{
+    if (prefix != 0)
+        emitByte(prefix);
+
+    uint8_t rex = 0x40 | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+    if (rex != 0x40)
+        emitByte(rex);
+
+    emitByte(0x0F);
+    emitByte(opcode);
+    emitByte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void JITCompiler::emitSSEMem(uint8_t prefix, uint8_t opcode, uint32_t reg, uint32_t base, int32_t disp)
+{
+    if (prefix != 0)
+        emitByte(prefix);
+
+    uint8_t rex = 0x40 | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+    if (rex != 0x40)
+        emitByte(rex);
+
+    emitByte(0x0F);
+    emitByte(opcode);
+    emitByte(0x80 | ((reg & 7) << 3) | (base & 7));    // [base+disp32]
+    if ((base & 7) == JIT_RSP)
+        emitByte(0x24);     // SIB byte for rsp
+    emitDWord((uint32_t)disp);
+}
+
+void JITCompiler::emitLoadConstant(uint32_t reg, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    emitByte(0xB8);         // mov eax, imm32
+    emitDWord(bits);
+    emitSSE(0x66, 0x6E, reg, JIT_RAX);  // movd xmm, eax
+}
+
+void JITCompiler::emitMovImm64(uint32_t gpr, uint64_t value)
+{
+    emitByte(0x48 | ((gpr & 8) ? 0x01 : 0));    // mov r64, imm64
+    emitByte(0xB8 + (gpr & 7));
+    emitQWord(value);
+}
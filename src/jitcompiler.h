@@ -0,0 +1,113 @@
+/*
+
+  Description:  Just-in-time compiler that translates
+                VM programs into native x86-64 code.
+
+                The evaluation stack of the VM is mapped
+                onto SSE registers; the variables are
+                accessed at their fixed addresses in the
+                variable store. Transcendental functions
+                and delay line access call out to helper
+                functions.
+
+                On other architectures, or when VM_NO_JIT
+                is defined, no code is generated and the
+                VM falls back to the interpreter.
+
+  License: GPLv2
+
+*/
+
+#ifndef jitcompiler_h
+#define jitcompiler_h
+
+#include <stdint.h>
+#include <vector>
+#include "vmtypes.h"
+#include "blockschedule.h"
+#include "noisegenerator.h"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(VM_NO_JIT)
+#define VM_JIT
+#endif
+
+class JITCompiler
+{
+public:
+    JITCompiler();
+    virtual ~JITCompiler();
+
+    /** native function that executes a group of statements once */
+    typedef void (*function_t)();
+
+    /** returns true if native code can be generated on this platform */
+    static bool isSupported();
+
+    /** remove all generated code */
+    void clear();
+
+    /** exchange the generated code with another compiler */
+    void swap(JITCompiler &other);
+
+    /** translate the statements into a native function.
+        the code accesses the values in 'values', the
+        delay lines in 'vars' and the noise generator
+        directly, so none of them must be reallocated
+        while the code is in use.
+        returns the function index, or -1 if the statements
+        cannot be compiled. */
+    int32_t addFunction(const VM::program_t &program, VM::variables_t &vars, VM::values_t &values,
+                        NoiseGenerator *noise, const std::vector<BlockSchedule::range_t> &statements);
+
+    /** copy the generated code to executable memory.
+        returns false if no executable memory is available. */
+    bool finalize();
+
+    /** get a function after finalize(), or NULL */
+    function_t getFunction(int32_t index) const;
+
+    /** size of the generated code in bytes */
+    size_t getCodeSize() const
+    {
+        return m_code.size();
+    }
+
+protected:
+    /** emit the instructions of a single statement range.
+        returns false if an instruction is not supported. */
+    bool emitStatements(const VM::program_t &program, VM::variables_t &vars,
+                        NoiseGenerator *noise, const BlockSchedule::range_t &range, uint32_t &sp);
+
+    /** emit a call to a helper function with nargs float
+        arguments taken from the top of the stack, followed
+        by 'ptrArg' if it is not NULL. the result, if any,
+        replaces the arguments. */
+    bool emitCall(const void *func, uint32_t nargs, bool result, uint32_t &sp,
+                  const void *ptrArg = NULL);
+
+    void emitPrologue(const VM::values_t &values);
+    void emitEpilogue();
+
+    void emitByte(uint8_t b);
+    void emitDWord(uint32_t d);
+    void emitQWord(uint64_t q);
+
+    /** scalar SSE instruction xmm(reg) <- xmm(rm) */
+    void emitSSE(uint8_t prefix, uint8_t opcode, uint32_t reg, uint32_t rm);
+
+    /** scalar SSE instruction with a memory operand [base+disp] */
+    void emitSSEMem(uint8_t prefix, uint8_t opcode, uint32_t reg, uint32_t base, int32_t disp);
+
+    /** load a float constant into xmm(reg) */
+    void emitLoadConstant(uint32_t reg, float value);
+
+    /** load a 64-bit immediate into a general purpose register */
+    void emitMovImm64(uint32_t gpr, uint64_t value);
+
+    std::vector<uint8_t>    m_code;         // generated code
+    std::vector<size_t>     m_functions;    // start of each function in m_code
+    uint8_t                 *m_memory;      // executable copy of the code
+    size_t                  m_memorySize;   // size of the executable memory
+};
+
+#endif
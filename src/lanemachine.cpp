@@ -0,0 +1,610 @@
+/*
+
+  Description:  Runs several instances of one program side
+                by side, for parameter sweeps.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "blockschedule.h"
+#include "vmfunctions.h"
+#include "lanemachine.h"
+
+// number of samples at the file rate that the output
+// resampler of a lane can hold, as in the VM
+#define LANE_RESAMPLEDSIZE (2*VM_BLOCKSIZE + 2*RESAMPLER_MAXRATIO)
+
+LaneMachine::LaneMachine()
+    : m_lanes(0),
+      m_sampleRate(44100.0f),
+      m_programRate(44100.0f),
+      m_constantRow(0),
+      m_tempRow(0),
+      m_position(0),
+      m_in(NULL),
+      m_inl(NULL),
+      m_inr(NULL),
+      m_out(NULL),
+      m_outl(NULL),
+      m_outr(NULL),
+      m_noiseSeed(NOISE_DEFAULTSEED),
+      m_resampling(false)
+{
+    for(uint32_t k=0; k<4; k++)
+    {
+        m_sliderRow[k] = NULL;
+    }
+    for(uint32_t lane=0; lane<LANE_MAXLANES; lane++)
+    {
+        for(uint32_t k=0; k<4; k++)
+        {
+            m_slider[lane][k] = 0.0f;
+        }
+        m_resampled[lane][0].resize(LANE_RESAMPLEDSIZE);
+        m_resampled[lane][1].resize(LANE_RESAMPLEDSIZE);
+        m_resampledCount[lane] = 0;
+        m_programOut[lane].resize(2*VM_BLOCKSIZE);
+    }
+}
+
+LaneMachine::~LaneMachine()
+{
+}
+
+bool LaneMachine::setSamplerate(float sampleRate, float programRate)
+{
+    m_sampleRate = sampleRate;
+    m_programRate = programRate;
+    m_resampling = (programRate != sampleRate);
+    if (!m_resampling)
+    {
+        return true;
+    }
+
+    if (!m_inResampler.setup((uint32_t)sampleRate, (uint32_t)programRate))
+    {
+        m_error = "Virtual sample rate not supported";
+        return false;
+    }
+    for(uint32_t lane=0; lane<LANE_MAXLANES; lane++)
+    {
+        if (!m_outResampler[lane].setup((uint32_t)programRate, (uint32_t)sampleRate))
+        {
+            m_error = "Virtual sample rate not supported";
+            return false;
+        }
+    }
+    return true;
+}
+
+float* LaneMachine::findRow(const char *name)
+{
+    const int32_t idx = VM::findVariableByName(m_vars, name);
+    return (idx < 0) ? NULL : &m_rows[idx*m_lanes];
+}
+
+bool LaneMachine::loadProgram(const VM::regprogram_t &program, const VM::variables_t &variables,
+                              uint32_t lanes)
+{
+    if ((lanes != 4) && (lanes != 8) && (lanes != 16))
+    {
+        m_error = "The number of lanes must be 4, 8 or 16";
+        return false;
+    }
+
+    m_lanes = lanes;
+    m_program = program;
+    m_vars = variables;
+
+    m_constantRow = m_vars.size();
+    m_tempRow = m_constantRow + m_program.constants.size();
+    m_rows.assign((m_tempRow + m_program.temporaries)*m_lanes, 0.0f);
+
+    // the delay lines are rounded up to a power
+    // of two, like in the DelayArena.
+    size_t size = 0;
+    m_lines.assign(m_vars.size(), laneline_t());
+    for(uint32_t i=0; i<m_vars.size(); i++)
+    {
+        const varInfo &var = m_vars[i];
+        laneline_t &line = m_lines[i];
+        line.data = NULL;
+        line.length = std::max(var.m_length, 0);
+        line.coefficients = var.m_coefficients.empty() ? NULL : &var.m_coefficients[0];
+        line.ncoefficients = var.m_coefficients.size();
+
+        uint32_t length = 1;
+        while(length < line.length)
+        {
+            length <<= 1;
+        }
+        line.mask = length-1;
+
+        // a FIR history is kept twice, a biquad
+        // section has two state variables.
+        switch(var.m_type)
+        {
+        case varInfo::TYPE_DELAY:
+            size += length*m_lanes;
+            break;
+        case varInfo::TYPE_FIR:
+            size += 2*length*m_lanes;
+            break;
+        case varInfo::TYPE_BIQUAD:
+            size += 2*line.length*m_lanes;
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_lineMemory.assign(size, 0.0f);
+    float *memory = m_lineMemory.data();
+    for(uint32_t i=0; i<m_vars.size(); i++)
+    {
+        laneline_t &line = m_lines[i];
+        switch(m_vars[i].m_type)
+        {
+        case varInfo::TYPE_DELAY:
+            line.data = memory;
+            memory += (line.mask+1)*m_lanes;
+            break;
+        case varInfo::TYPE_FIR:
+            line.data = memory;
+            memory += 2*(line.mask+1)*m_lanes;
+            break;
+        case varInfo::TYPE_BIQUAD:
+            line.data = memory;
+            memory += 2*line.length*m_lanes;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!resolve())
+    {
+        m_ops.clear();
+        m_error = "The register program has an invalid operand";
+        return false;
+    }
+
+    m_in = findRow("in");
+    m_inl = findRow("inl");
+    m_inr = findRow("inr");
+    m_out = findRow("out");
+    m_outl = findRow("outl");
+    m_outr = findRow("outr");
+    m_sliderRow[0] = findRow("slider1");
+    m_sliderRow[1] = findRow("slider2");
+    m_sliderRow[2] = findRow("slider3");
+    m_sliderRow[3] = findRow("slider4");
+
+    reset();
+    return true;
+}
+
+bool LaneMachine::resolve()
+{
+    m_ops.clear();
+    for(const VM::reginstr_t &instr : m_program.code)
+    {
+        laneop_t op;
+        op.opcode = instr.opcode;
+        op.line = NULL;
+        op.offset = -1;
+
+        // unused operands are resolved but never read
+        const uint32_t operands[4] = {instr.dst, instr.src[0], instr.src[1], instr.src[2]};
+        float *rows[4];
+        for(uint32_t k=0; k<4; k++)
+        {
+            const uint32_t idx = operands[k] & R_INDEXMASK;
+            uint32_t row;
+            switch(operands[k] & R_KINDMASK)
+            {
+            case R_VAR:
+                if (idx >= m_vars.size())
+                    return false;
+                row = idx;
+                break;
+            case R_CONST:
+                if (idx >= m_program.constants.size())
+                    return false;
+                row = m_constantRow + idx;
+                break;
+            case R_TEMP:
+                if (idx >= m_program.temporaries)
+                    return false;
+                row = m_tempRow + idx;
+                break;
+            default:
+                return false;
+            }
+            rows[k] = &m_rows[row*m_lanes];
+        }
+        op.dst = rows[0];
+        op.src[0] = rows[1];
+        op.src[1] = rows[2];
+        op.src[2] = rows[3];
+
+        // delay operations address the delay by index
+        if (op.opcode & 0x80000000)
+        {
+            const uint32_t n = op.opcode & 0xFFFF;
+            op.opcode &= 0xff000000;
+            varInfo::type_t type = varInfo::TYPE_VAR;
+            if ((op.opcode == P_readdelay) || (op.opcode == P_writedelay))
+                type = varInfo::TYPE_DELAY;
+            if (op.opcode == P_fir)
+                type = varInfo::TYPE_FIR;
+            if (op.opcode == P_biquad)
+                type = varInfo::TYPE_BIQUAD;
+            if (type != varInfo::TYPE_VAR)
+            {
+                if ((n >= m_vars.size()) || (m_vars[n].m_type != type))
+                    return false;
+                op.line = &m_lines[n];
+            }
+
+            // a constant offset reads the same row in all lanes
+            if ((op.opcode == P_readdelay) && ((instr.src[0] & R_KINDMASK) == R_CONST))
+            {
+                op.offset = static_cast<int32_t>(m_program.constants[instr.src[0] & R_INDEXMASK]);
+            }
+        }
+        m_ops.push_back(op);
+    }
+    return true;
+}
+
+void LaneMachine::setSlider(uint32_t lane, uint32_t id, float value)
+{
+    if ((lane < LANE_MAXLANES) && (id < 4))
+    {
+        m_slider[lane][id] = value;
+        if ((lane < m_lanes) && (m_sliderRow[id] != NULL))
+        {
+            m_sliderRow[id][lane] = value;
+        }
+    }
+}
+
+void LaneMachine::setNoiseSeed(uint32_t seed)
+{
+    m_noiseSeed = seed;
+    m_noise.seed(seed);
+}
+
+void LaneMachine::reset()
+{
+    for(uint32_t i=0; i<m_vars.size(); i++)
+    {
+        std::fill(&m_rows[i*m_lanes], &m_rows[(i+1)*m_lanes], m_vars[i].m_value);
+    }
+    for(uint32_t i=0; i<m_program.constants.size(); i++)
+    {
+        std::fill(&m_rows[(m_constantRow+i)*m_lanes], &m_rows[(m_constantRow+i+1)*m_lanes],
+                  m_program.constants[i]);
+    }
+
+    float *samplerate = findRow("samplerate");
+    if (samplerate != NULL)
+    {
+        std::fill(samplerate, samplerate + m_lanes, m_programRate);
+    }
+    for(uint32_t lane=0; lane<m_lanes; lane++)
+    {
+        for(uint32_t k=0; k<4; k++)
+        {
+            setSlider(lane, k, m_slider[lane][k]);
+        }
+    }
+
+    std::fill(m_lineMemory.begin(), m_lineMemory.end(), 0.0f);
+    m_position = 0;
+    m_noise.seed(m_noiseSeed);
+
+    m_inResampler.reset();
+    for(uint32_t lane=0; lane<LANE_MAXLANES; lane++)
+    {
+        m_outResampler[lane].reset();
+        m_resampledCount[lane] = 0;
+    }
+}
+
+// apply an expression to all lanes, 'a', 'b' and 'c'
+// are the rows of the sources and 'k' is the lane.
+#define LANE_LOOP(expr) for(uint32_t k=0; k<N; k++) { dst[k] = (expr); } break;
+
+template<uint32_t N> void LaneMachine::execute()
+{
+    const laneop_t *op = m_ops.data();
+    const laneop_t *end = op + m_ops.size();
+    for(; op != end; op++)
+    {
+        float *dst = op->dst;
+        const float *a = op->src[0];
+        const float *b = op->src[1];
+        const float *c = op->src[2];
+        switch(op->opcode)
+        {
+        case P_writevar:    LANE_LOOP(a[k])
+        case P_add:         LANE_LOOP(a[k] + b[k])
+        case P_sub:         LANE_LOOP(a[k] - b[k])
+        case P_mul:         LANE_LOOP(a[k] * b[k])
+        case P_div:         LANE_LOOP(a[k] / b[k])
+        case P_neg:         LANE_LOOP(-a[k])
+        case P_sin:         LANE_LOOP(VM::funcSin(a[k]))
+        case P_cos:         LANE_LOOP(VM::funcCos(a[k]))
+        case P_sin1:        LANE_LOOP(VM::funcSin1(a[k]))
+        case P_cos1:        LANE_LOOP(VM::funcCos1(a[k]))
+        case P_mod1:        LANE_LOOP(VM::funcMod1(a[k]))
+        case P_abs:         LANE_LOOP(VM::funcAbs(a[k]))
+        case P_round:       LANE_LOOP(VM::funcRound(a[k]))
+        case P_sqrt:        LANE_LOOP(VM::funcSqrt(a[k]))
+        case P_tan:         LANE_LOOP(VM::funcTan(a[k]))
+        case P_tanh:        LANE_LOOP(VM::funcTanh(a[k]))
+        case P_pow:         LANE_LOOP(VM::funcPow(a[k], b[k]))
+        case P_limit:       LANE_LOOP(VM::funcLimit(a[k]))
+        case P_atan2:       LANE_LOOP(VM::funcAtan2(a[k], b[k]))
+        case P_sign:        LANE_LOOP(VM::funcSign(a[k]))
+        case P_trunc:       LANE_LOOP(VM::funcTrunc(a[k]))
+        case P_ceil:        LANE_LOOP(VM::funcCeil(a[k]))
+        case P_floor:       LANE_LOOP(VM::funcFloor(a[k]))
+        case P_choose:      LANE_LOOP(VM::funcChoose(a[k], b[k], c[k]))
+        case P_fastsin:     LANE_LOOP(VM::fastSin(a[k]))
+        case P_fastcos:     LANE_LOOP(VM::fastCos(a[k]))
+        case P_fastsin1:    LANE_LOOP(VM::fastSin1(a[k]))
+        case P_fastcos1:    LANE_LOOP(VM::fastCos1(a[k]))
+        case P_fasttan:     LANE_LOOP(VM::fastTan(a[k]))
+        case P_fasttanh:    LANE_LOOP(VM::fastTanh(a[k]))
+        case P_fastpow:     LANE_LOOP(VM::fastPow(a[k], b[k]))
+        case P_fastatan2:   LANE_LOOP(VM::fastAtan2(a[k], b[k]))
+        case P_noise:
+        case P_gaussnoise:
+        case P_pinknoise:
+        {
+            // all lanes get the noise a VM would get
+            float value;
+            if (op->opcode == P_noise)
+                value = m_noise.uniform();
+            else if (op->opcode == P_gaussnoise)
+                value = m_noise.gaussian();
+            else
+                value = m_noise.pink();
+            LANE_LOOP(value)
+        }
+        case P_readdelay:
+        {
+            const laneline_t *line = op->line;
+            if (op->offset >= 0)
+            {
+                const float *row = line->data + ((m_position + op->offset) & line->mask)*N;
+                LANE_LOOP(row[k])
+            }
+            for(uint32_t k=0; k<N; k++)
+            {
+                const uint32_t offset = static_cast<uint32_t>(static_cast<int32_t>(a[k]));
+                dst[k] = line->data[((m_position + offset) & line->mask)*N + k];
+            }
+            break;
+        }
+        case P_writedelay:
+        {
+            const laneline_t *line = op->line;
+            float *row = line->data + (m_position & line->mask)*N;
+            for(uint32_t k=0; k<N; k++)
+            {
+                row[k] = a[k];
+            }
+            break;
+        }
+        case P_fir:
+        {
+            // the history is kept twice, so the rows of
+            // the last samples follow each other
+            const laneline_t *line = op->line;
+            const uint32_t pos = m_position & line->mask;
+            float *history = line->data + pos*N;
+            float *copy = line->data + (pos + line->mask + 1)*N;
+            for(uint32_t k=0; k<N; k++)
+            {
+                history[k] = a[k];
+                copy[k] = a[k];
+            }
+
+            float sum[N];
+            for(uint32_t k=0; k<N; k++)
+            {
+                sum[k] = 0.0f;
+            }
+            const float *coef = line->coefficients;
+            const uint32_t taps = line->length;
+            if (line->ncoefficients >= taps)
+            {
+                for(uint32_t i=0; i<taps; i++)
+                {
+                    for(uint32_t k=0; k<N; k++)
+                    {
+                        sum[k] += history[i*N + k]*coef[i];
+                    }
+                }
+            }
+            else
+            {
+                // a symmetric filter, tap i and
+                // tap taps-1-i share coefficient i
+                const uint32_t pairs = taps/2;
+                for(uint32_t i=0; i<pairs; i++)
+                {
+                    const float *tail = history + (taps-1-i)*N;
+                    for(uint32_t k=0; k<N; k++)
+                    {
+                        sum[k] += (history[i*N + k] + tail[k])*coef[i];
+                    }
+                }
+                if (taps & 1)
+                {
+                    for(uint32_t k=0; k<N; k++)
+                    {
+                        sum[k] += history[pairs*N + k]*coef[pairs];
+                    }
+                }
+            }
+            LANE_LOOP(sum[k])
+        }
+        case P_biquad:
+        {
+            // transposed direct form II, as VM::funcBiquad
+            const laneline_t *line = op->line;
+            const float *coef = line->coefficients;
+            float *state = line->data;
+            float x[N];
+            for(uint32_t k=0; k<N; k++)
+            {
+                x[k] = a[k];
+            }
+            for(uint32_t s=0; s<line->length; s++)
+            {
+                float *s0 = state;
+                float *s1 = state + N;
+                for(uint32_t k=0; k<N; k++)
+                {
+                    const float y = coef[0]*x[k] + s0[k];
+                    s0[k] = coef[1]*x[k] - coef[3]*y + s1[k];
+                    s1[k] = coef[2]*x[k] - coef[4]*y;
+                    x[k] = y;
+                }
+                coef += 5;
+                state += 2*N;
+            }
+            LANE_LOOP(x[k])
+        }
+        default:
+            break;
+        }
+    }
+}
+
+#undef LANE_LOOP
+
+template<uint32_t N> void LaneMachine::runSample(float inLeft, float inRight,
+                                                 float *const *outbufs, uint32_t offset)
+{
+    const float mono = (inLeft + inRight) / 2.0f;
+    for(uint32_t k=0; k<N; k++)
+    {
+        if (m_in != NULL)  m_in[k] = mono;
+        if (m_inl != NULL) m_inl[k] = inLeft;
+        if (m_inr != NULL) m_inr[k] = inRight;
+    }
+
+    execute<N>();
+
+    // a mono output goes to both channels
+    const float *left = (m_out != NULL) ? m_out : m_outl;
+    const float *right = (m_out != NULL) ? m_out : m_outr;
+    for(uint32_t k=0; k<N; k++)
+    {
+        outbufs[k][offset] = (left != NULL) ? left[k] : 0.0f;
+        outbufs[k][offset+1] = (right != NULL) ? right[k] : 0.0f;
+    }
+    m_position--;
+}
+
+void LaneMachine::run(const float *inLeft, const float *inRight, float *const *outbufs, uint32_t samples)
+{
+    for(uint32_t i=0; i<samples; i++)
+    {
+        switch(m_lanes)
+        {
+        case 4:
+            runSample<4>(inLeft[i], inRight[i], outbufs, i<<1);
+            break;
+        case 8:
+            runSample<8>(inLeft[i], inRight[i], outbufs, i<<1);
+            break;
+        case 16:
+            runSample<16>(inLeft[i], inRight[i], outbufs, i<<1);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void LaneMachine::process(const float *inbuf, float *const *outbufs, uint32_t frames)
+{
+    if (m_lanes == 0)
+    {
+        return;
+    }
+
+    // the blocks and resamplers work as in the VM,
+    // so the lanes give the same results.
+    float inLeft[VM_BLOCKSIZE];
+    float inRight[VM_BLOCKSIZE];
+    float *programOut[LANE_MAXLANES];
+    float *laneOut[LANE_MAXLANES];
+    for(uint32_t lane=0; lane<m_lanes; lane++)
+    {
+        programOut[lane] = m_programOut[lane].data();
+    }
+
+    uint32_t offset = 0;
+    while(offset < frames)
+    {
+        const uint32_t samples = std::min(frames - offset, (uint32_t)VM_BLOCKSIZE);
+        for(uint32_t i=0; i<samples; i++)
+        {
+            inLeft[i] = inbuf[(offset+i)<<1];
+            inRight[i] = inbuf[((offset+i)<<1)+1];
+        }
+
+        for(uint32_t lane=0; lane<m_lanes; lane++)
+        {
+            laneOut[lane] = outbufs[lane] + (offset<<1);
+        }
+
+        if (!m_resampling)
+        {
+            run(inLeft, inRight, laneOut, samples);
+            offset += samples;
+            continue;
+        }
+
+        float programLeft[VM_BLOCKSIZE];
+        float programRight[VM_BLOCKSIZE];
+        const uint32_t n = m_inResampler.process(inLeft, inRight, samples, programLeft, programRight);
+        run(programLeft, programRight, programOut, n);
+
+        for(uint32_t lane=0; lane<m_lanes; lane++)
+        {
+            for(uint32_t i=0; i<n; i++)
+            {
+                programLeft[i] = programOut[lane][i<<1];
+                programRight[i] = programOut[lane][(i<<1)+1];
+            }
+
+            float *resampled[2] = {m_resampled[lane][0].data(), m_resampled[lane][1].data()};
+            uint32_t &count = m_resampledCount[lane];
+            count += m_outResampler[lane].process(programLeft, programRight, n,
+                                                  resampled[0] + count, resampled[1] + count);
+
+            const uint32_t ready = std::min(samples, count);
+            for(uint32_t i=0; i<samples; i++)
+            {
+                laneOut[lane][i<<1] = (i < ready) ? resampled[0][i] : 0.0f;
+                laneOut[lane][(i<<1)+1] = (i < ready) ? resampled[1][i] : 0.0f;
+            }
+            count -= ready;
+            memmove(resampled[0], resampled[0] + ready, count*sizeof(float));
+            memmove(resampled[1], resampled[1] + ready, count*sizeof(float));
+        }
+        offset += samples;
+    }
+}
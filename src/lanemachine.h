@@ -0,0 +1,167 @@
+/*
+
+  Description:  Runs several instances of one program side
+                by side, for parameter sweeps.
+
+                Every instance is a lane with its own variables,
+                delay lines, filter states and slider values.
+                All values are stored as rows of one float per
+                lane, so one decode of a register instruction
+                drives all lanes and the inner loop over the
+                lanes is turned into vector code. The input is
+                shared by the lanes, each lane has its own output.
+
+                The lanes see the same noise as a VM with the
+                same seed, so a lane produces the same output as
+                a VM running the program with its slider values.
+
+  License: GPLv2
+
+*/
+
+#ifndef lanemachine_h
+#define lanemachine_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "vmtypes.h"
+#include "noisegenerator.h"
+#include "resampler.h"
+
+// largest number of lanes
+#define LANE_MAXLANES   16
+
+class LaneMachine
+{
+public:
+    LaneMachine();
+    virtual ~LaneMachine();
+
+    /** set the sample rate of the input and outputs and the
+        rate of the program (in Hz). A lower program rate runs
+        behind resamplers, like the VM. Programs must be loaded
+        after this call. false if the rates are not supported. */
+    bool setSamplerate(float sampleRate, float programRate);
+
+    /** load the register byte code of a program into 'lanes'
+        lanes, which must be 4, 8 or 16. Returns false if the
+        program cannot be run, see getError(). */
+    bool loadProgram(const VM::regprogram_t &program, const VM::variables_t &variables,
+                     uint32_t lanes);
+
+    /** number of lanes of the loaded program */
+    uint32_t getLanes() const
+    {
+        return m_lanes;
+    }
+
+    /** set slider 'id' (0-3) of a lane. The value is
+        kept when the program state is reset. */
+    void setSlider(uint32_t lane, uint32_t id, float value);
+
+    /** set the seed of the noise generator */
+    void setNoiseSeed(uint32_t seed);
+
+    /** return all lanes to the initial state of the
+        program and restart the noise and resamplers */
+    void reset();
+
+    /** run the program over 'frames' interleaved stereo
+        samples of 'inbuf', which all lanes get as input.
+        Lane k writes its interleaved stereo output to
+        outbufs[k]. */
+    void process(const float *inbuf, float *const *outbufs, uint32_t frames);
+
+    /** description of the last error */
+    std::string getError() const
+    {
+        return m_error;
+    }
+
+protected:
+    /** delay line, FIR history or biquad state of all lanes.
+        Sample k of a delay line is at row (position + k) & mask,
+        like in the DelayArena. */
+    struct laneline_t
+    {
+        float       *data;          // rows of m_lanes floats
+        uint32_t    mask;           // allocated length - 1, a power of two - 1
+        uint32_t    length;         // delay length, FIR taps or biquad sections
+        const float *coefficients;  // FIR or biquad coefficients
+        uint32_t    ncoefficients;
+    };
+
+    /** register instruction with its operands
+        resolved to rows */
+    struct laneop_t
+    {
+        uint32_t    opcode;     // the opcode without the index of a delay
+        float       *dst;
+        const float *src[3];
+        laneline_t  *line;      // delay line or filter, or NULL
+        int32_t     offset;     // constant offset of P_readdelay, or -1
+    };
+
+    /** resolve the operands of the register program to rows.
+        false if an operand is out of range. */
+    bool resolve();
+
+    /** run the program over 'samples' samples at the rate of
+        the program, writing the interleaved outputs of each
+        lane to outbufs[lane] */
+    void run(const float *inLeft, const float *inRight, float *const *outbufs, uint32_t samples);
+
+    /** run the program once in all lanes */
+    template<uint32_t N> void execute();
+
+    /** run one sample of the program and write the outputs of the
+        lanes to outbufs[lane][offset] and outbufs[lane][offset+1] */
+    template<uint32_t N> void runSample(float inLeft, float inRight, float *const *outbufs, uint32_t offset);
+
+    /** the row of a variable, or NULL if the program
+        does not have it */
+    float* findRow(const char *name);
+
+    uint32_t        m_lanes;
+    float           m_sampleRate;       // rate of the input and outputs in Hz
+    float           m_programRate;      // rate of the program in Hz
+
+    VM::regprogram_t    m_program;
+    VM::variables_t     m_vars;
+    std::vector<laneop_t>   m_ops;
+
+    // the rows of the variables, constants and temporaries
+    // follow each other, each holds m_lanes floats.
+    std::vector<float>  m_rows;
+    uint32_t            m_constantRow;  // first constant row
+    uint32_t            m_tempRow;      // first temporary row
+
+    std::vector<laneline_t> m_lines;    // delay lines and filters, by variable index
+    std::vector<float>  m_lineMemory;   // memory of the delay lines and filters
+    uint32_t            m_position;     // shared write position
+
+    float   *m_in;          // rows of the input and output variables, or NULL
+    float   *m_inl;
+    float   *m_inr;
+    float   *m_out;
+    float   *m_outl;
+    float   *m_outr;
+    float   *m_sliderRow[4];
+    float   m_slider[LANE_MAXLANES][4]; // slider values of each lane
+
+    NoiseGenerator  m_noise;
+    uint32_t        m_noiseSeed;
+
+    // resampling to and from the program rate
+    bool            m_resampling;
+    Resampler       m_inResampler;      // shared by all lanes
+    Resampler       m_outResampler[LANE_MAXLANES];
+    std::vector<float> m_resampled[LANE_MAXLANES][2];   // outputs at the file rate, left and right
+    uint32_t        m_resampledCount[LANE_MAXLANES];    // samples in m_resampled
+    std::vector<float> m_programOut[LANE_MAXLANES];     // interleaved outputs at the program rate
+
+    std::string     m_error;
+};
+
+#endif
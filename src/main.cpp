@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "portaudio.h"
 #include <QApplication>
 #include <QPixmap>
 #include <QThread>
@@ -21,9 +22,20 @@ int main(int argc, char *argv[])
     app.processEvents();
     QThread::msleep(1000);
 
-    MainWindow w;
-    w.show();    
-    splash.finish(&w);
+    // the GUI lists and checks devices itself, the
+    // virtual machine only initialises PortAudio to
+    // open its stream.
+    Pa_Initialize();
 
-    return app.exec();
+    int result;
+    {
+        MainWindow w;
+        w.show();
+        splash.finish(&w);
+
+        result = app.exec();
+    }
+
+    Pa_Terminate();
+    return result;
 }
@@ -61,9 +61,12 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->inputSineWave, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
     connect(ui->inputWhiteNoise, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
     connect(ui->inputSoundcard, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
+    connect(ui->inputSweep, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
+    connect(ui->inputLogSweep, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
+    connect(ui->inputMultitone, SIGNAL(clicked(bool)), this, SLOT(on_SourceChanged()));
 
     /** create the virtual machine */
-    m_machine = new VirtualMachine(this);
+    m_machine = new VirtualMachine();
 
     /** create a GUI timer to update VU etc */
     m_guiTimer = new QTimer(this);
@@ -120,6 +123,8 @@ void MainWindow::readSettings()
 
     m_lastDirectory = m_settings.value("lastdir", "").toString();
     m_lastAudioDirectory = m_settings.value("lastaudiodir","").toString();
+
+    ui->fastMathCheckBox->setChecked(m_settings.value("vm/fastmath", false).toBool());
 }
 
 void MainWindow::writeSettings()
@@ -134,6 +139,8 @@ void MainWindow::writeSettings()
 
     m_settings.setValue("lastdir", m_lastDirectory);
     m_settings.setValue("lastaudiodir", m_lastAudioDirectory);
+
+    m_settings.setValue("vm/fastmath", ui->fastMathCheckBox->isChecked());
 }
 
 bool MainWindow::save()
@@ -300,6 +307,13 @@ void MainWindow::scopeChannelChanged(uint32_t channelID)
 {
     qDebug() << "scopeChannelChanged() " << channelID;
     std::string varname = m_scope->getChannelName(channelID);
+    if (m_machine->isRunning() && (getMonitoredVariables() != m_monitored))
+    {
+        // the variable may have been removed from
+        // the running program.
+        loadOptimizedProgram();
+        return;
+    }
     m_machine->setMonitoringVariable(0, channelID, varname);
 }
 
@@ -307,6 +321,11 @@ void MainWindow::spectrumChannelChanged(uint32_t channelID)
 {
     qDebug() << "spectrumChannelChanged() " << channelID;
     std::string varname = m_spectrum->getChannelName(channelID);
+    if (m_machine->isRunning() && (getMonitoredVariables() != m_monitored))
+    {
+        loadOptimizedProgram();
+        return;
+    }
     m_machine->setMonitoringVariable(1, channelID, varname);
 }
 
@@ -315,10 +334,7 @@ bool MainWindow::compileAndRun()
     Parser    parser;
     Tokenizer tokenizer;
 
-    if (m_machine->isRunning())
-        m_machine->stop();
-
-    QScopedPointer<Reader> reader(Reader::create(m_sourceEditor->toPlainText()));
+    QScopedPointer<Reader> reader(Reader::create(m_sourceEditor->toPlainText().toLocal8Bit().toStdString()));
     if (reader.isNull())
     {
         // error, probably due to an empty source code editor
@@ -379,9 +395,67 @@ bool MainWindow::compileAndRun()
         m_sourceEditor->setErrorLine(0);
     }
 
+    // a precision statement in the script
+    // overrides the fast math checkbox.
+    if ((context.getPrecision() == ParseContext::PrecisionDefault) &&
+        ui->fastMathCheckBox->isChecked())
+    {
+        context.useFastMath();
+    }
+
+    // a virtualrate statement runs the program at a
+    // lower rate behind a resampler. the displays
+    // show the variables at that rate.
+    const float programRate = m_machine->setProgramSamplerate(context.getSamplerate());
+    if ((context.getSamplerate() != 0) && (programRate != context.getSamplerate()))
+    {
+        ui->statusBar->showMessage(QString("Virtual sample rate not supported, running at %1 Hz").arg(programRate));
+    }
+    m_spectrum->setSampleRate(programRate);
+    m_scope->setSampleRate(programRate);
+
+    // optimize the program. The sample rate is folded
+    // into constants, so the program is compiled again
+    // when the soundcard settings change.
+    if (!m_ssa.build(context, programRate))
+    {
+        ui->statusBar->showMessage("Program optimization failed!");
+        qDebug() << "Program optimization failed! :(";
+        return false;
+    }
+
+    std::stringstream ssaDump;
+    m_ssa.dump(ssaDump);
+    qDebug() << ssaDump.str().c_str();
+
+    return loadOptimizedProgram();
+}
+
+std::vector<std::string> MainWindow::getMonitoredVariables()
+{
+    std::vector<std::string> names;
+    names.push_back(m_scope->getChannelName(0));
+    names.push_back(m_scope->getChannelName(1));
+    names.push_back(m_spectrum->getChannelName(0));
+    names.push_back(m_spectrum->getChannelName(1));
+    return names;
+}
+
+bool MainWindow::loadOptimizedProgram()
+{
+    // statements that only compute unmonitored
+    // variables are left out of the program.
+    m_monitored = getMonitoredVariables();
+
+    ParseContext optimized;
     VM::program_t program;
+    VM::regprogram_t regprogram;
+    VM::exprprogram_t exprprogram;
     VM::variables_t vars;
-    if (!ASTToVM::process(context, program, vars))
+    if ((!m_ssa.generate(optimized, m_monitored)) ||
+        (!ASTToVM::process(optimized, program, vars)) ||
+        (!ASTToVM::process(optimized, regprogram)) ||
+        (!ASTToVM::process(optimized, exprprogram)))
     {
         ui->statusBar->showMessage("AST conversion failed!");
         qDebug() << "AST conversion failed! :(";
@@ -389,13 +463,13 @@ bool MainWindow::compileAndRun()
     }
     else
     {
-        ss.clear();
         if (m_machine != 0)
         {
             // dump the program for debugging and run!
+            // a running machine switches to the new
+            // program without stopping the audio.
             std::stringstream ss;
-            m_machine->stop();
-            m_machine->loadProgram(program, vars);
+            m_machine->loadProgram(program, regprogram, exprprogram, vars);
             m_machine->dump(ss);
             m_machine->setSlider(0, m_slider1->getValue());
             m_machine->setSlider(1, m_slider2->getValue());
@@ -403,12 +477,13 @@ bool MainWindow::compileAndRun()
             m_machine->setSlider(3, m_slider4->getValue());
             m_machine->setFrequency(ui->freqSlider->value());
 
-            m_machine->setMonitoringVariable(0,0,m_scope->getChannelName(0));
-            m_machine->setMonitoringVariable(0,1,m_scope->getChannelName(1));
-            m_machine->setMonitoringVariable(1,0,m_spectrum->getChannelName(0));
-            m_machine->setMonitoringVariable(1,1,m_spectrum->getChannelName(1));
+            m_machine->setMonitoringVariable(0,0,m_monitored[0]);
+            m_machine->setMonitoringVariable(0,1,m_monitored[1]);
+            m_machine->setMonitoringVariable(1,0,m_monitored[2]);
+            m_machine->setMonitoringVariable(1,1,m_monitored[3]);
 
-            m_machine->start();
+            if (!m_machine->isRunning())
+                m_machine->start();
             qDebug() << ss.str().c_str();
             qDebug() << " - Variables -";
             for(size_t i=0; i<vars.size(); i++)
@@ -503,6 +578,10 @@ void MainWindow::on_SourceChanged()
     if (m_machine == 0)
         return;
 
+    // the sweep rate is only used by the sweeps
+    const bool sweep = ui->inputSweep->isChecked() || ui->inputLogSweep->isChecked();
+    ui->sweepRateLineEdit->setEnabled(sweep);
+
     if (ui->inputAudioFile->isChecked())
     {
         m_machine->setSource(VirtualMachine::SRC_WAV);
@@ -543,6 +622,40 @@ void MainWindow::on_SourceChanged()
         ui->freqLineEdit->setEnabled(false);
         ui->freqSlider->setEnabled(false);
     }
+    if (ui->inputSweep->isChecked() || ui->inputLogSweep->isChecked() || ui->inputMultitone->isChecked())
+    {
+        if (ui->inputSweep->isChecked())
+        {
+            m_machine->setSource(VirtualMachine::SRC_SWEEP);
+            if (ui->sweepRateUnit->text() != "Hz/s")
+            {
+                ui->sweepRateUnit->setText("Hz/s");
+                ui->sweepRateLineEdit->setText("1000");
+            }
+        }
+        else if (ui->inputLogSweep->isChecked())
+        {
+            m_machine->setSource(VirtualMachine::SRC_LOGSWEEP);
+            if (ui->sweepRateUnit->text() != "octaves/s")
+            {
+                ui->sweepRateUnit->setText("octaves/s");
+                ui->sweepRateLineEdit->setText("1");
+            }
+        }
+        else
+        {
+            m_machine->setSource(VirtualMachine::SRC_MULTITONE);
+        }
+        ui->freqLineEdit->setValidator(new QDoubleValidator(0,m_machine->getSamplerate()/2,3));
+        ui->freqSlider->setRange(0,m_machine->getSamplerate()/2);
+        ui->freqLineEdit->setEnabled(true);
+        ui->freqSlider->setEnabled(true);
+    }
+
+    if (sweep)
+    {
+        on_sweepRateLineEdit_editingFinished();
+    }
 }
 
 void MainWindow::on_actionSoundcard_triggered()
@@ -561,8 +674,8 @@ void MainWindow::on_actionSoundcard_triggered()
                                   dialog->getOutputSource(),
                                   dialog->getSamplerate());
 
-        m_spectrum->setSampleRate(dialog->getSamplerate());
-        m_scope->setSampleRate(dialog->getSamplerate());
+        m_spectrum->setSampleRate(m_machine->getProgramSamplerate());
+        m_scope->setSampleRate(m_machine->getProgramSamplerate());
     }
     delete dialog;
 }
@@ -668,12 +781,22 @@ void MainWindow::on_recompileButton_clicked()
     }
     else
     {
-        // compile failed, don't run
+        // compile failed, stop the old program
+        m_machine->stop();
         ui->runButton->setText("Run");
         ui->recompileButton->setEnabled(false);
     }
 }
 
+void MainWindow::on_fastMathCheckBox_toggled(bool checked)
+{
+    Q_UNUSED(checked);
+
+    // a running program is compiled again
+    if ((m_machine != 0) && m_machine->isRunning())
+        on_recompileButton_clicked();
+}
+
 void MainWindow::on_freqLineEdit_editingFinished()
 {
     bool ok;
@@ -693,6 +816,17 @@ void MainWindow::on_freqSlider_valueChanged(int value)
     m_machine->setFrequency(value);
 }
 
+void MainWindow::on_sweepRateLineEdit_editingFinished()
+{
+    bool ok;
+    QString valstr = ui->sweepRateLineEdit->text();
+    double value = valstr.toDouble(&ok);
+    if (ok && (m_machine != 0))
+    {
+        m_machine->setSweepRate(value);
+    }
+}
+
 void MainWindow::on_actionAbout_triggered()
 {
     AboutDialog *dialog = new AboutDialog(this);
@@ -704,7 +838,7 @@ void MainWindow::on_actionAudio_file_triggered()
     if (m_machine != 0)
     {
         QString filename = openAudioFile();
-        if (m_machine->setAudioFile(filename))
+        if (m_machine->setAudioFile(filename.toLocal8Bit().toStdString()))
         {
             QFileInfo info(filename);
             m_lastAudioDirectory = info.path();
@@ -13,6 +13,7 @@
 #include "spectrumwindow.h"
 #include "scopewindow.h"
 #include "fft.h"
+#include "ssaprogram.h"
 
 namespace Ui {
 class MainWindow;
@@ -56,10 +57,14 @@ private slots:
 
     void on_recompileButton_clicked();
 
+    void on_fastMathCheckBox_toggled(bool checked);
+
     void on_freqLineEdit_editingFinished();
 
     void on_freqSlider_valueChanged(int value);
 
+    void on_sweepRateLineEdit_editingFinished();
+
     void on_actionAbout_triggered();
 
     void on_actionAudio_file_triggered();
@@ -104,6 +109,15 @@ private:
     /** compile the program */
     bool compileAndRun();
 
+    /** generate the VM program from the optimized
+        program for the variables that are currently
+        monitored, and run it */
+    bool loadOptimizedProgram();
+
+    /** the names of the variables shown by the
+        scope and spectrum windows */
+    std::vector<std::string> getMonitoredVariables();
+
     /** show a file dialog to open an audio file */
     QString openAudioFile();
 
@@ -126,6 +140,9 @@ private:
     SpectrumWindow *m_spectrum;
     ScopeWindow    *m_scope;
 
+    SSAProgram                  m_ssa;          // optimized form of the last compiled program
+    std::vector<std::string>    m_monitored;    // variables monitored by the loaded program
+
     QSettings m_settings;
     QString   m_filepath;
     QString   m_lastDirectory;
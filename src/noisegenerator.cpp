@@ -0,0 +1,152 @@
+/*
+
+  Description:  Seedable pseudo-random noise generator
+                of a VM.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "noisegenerator.h"
+
+/** splitmix64, used to expand the seed into
+    the state of all lanes */
+static uint64_t splitMix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+NoiseGenerator::NoiseGenerator(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void NoiseGenerator::seed(uint64_t seed)
+{
+    uint64_t x = seed;
+    for(uint32_t lane=0; lane<NOISE_LANES; lane++)
+    {
+        const uint64_t a = splitMix64(x);
+        const uint64_t b = splitMix64(x);
+        m_state[0][lane] = (uint32_t)a;
+        m_state[1][lane] = (uint32_t)(a >> 32);
+        m_state[2][lane] = (uint32_t)b;
+        m_state[3][lane] = (uint32_t)(b >> 32) | 1;    // never all zero
+    }
+
+    m_position = NOISE_BUFFERSIZE;
+    m_spare = 0.0f;
+    m_hasSpare = false;
+    for(uint32_t i=0; i<7; i++)
+    {
+        m_pink[i] = 0.0f;
+    }
+}
+
+void NoiseGenerator::refill()
+{
+    // the state is copied to local arrays, so the
+    // compiler can keep it in vector registers.
+    uint32_t s0[NOISE_LANES], s1[NOISE_LANES], s2[NOISE_LANES], s3[NOISE_LANES];
+    memcpy(s0, m_state[0], sizeof(s0));
+    memcpy(s1, m_state[1], sizeof(s1));
+    memcpy(s2, m_state[2], sizeof(s2));
+    memcpy(s3, m_state[3], sizeof(s3));
+
+    for(uint32_t i=0; i<NOISE_BUFFERSIZE; i+=NOISE_LANES)
+    {
+        for(uint32_t lane=0; lane<NOISE_LANES; lane++)
+        {
+            const uint32_t result = s0[lane] + s3[lane];
+            const uint32_t t = s1[lane] << 9;
+            s2[lane] ^= s0[lane];
+            s3[lane] ^= s1[lane];
+            s1[lane] ^= s2[lane];
+            s0[lane] ^= s3[lane];
+            s2[lane] ^= t;
+            s3[lane] = (s3[lane] << 11) | (s3[lane] >> 21);
+
+            // the upper 24 bits are the best ones
+            // and fit exactly into a float.
+            m_buffer[i+lane] = (float)((int32_t)result >> 8) * (1.0f/8388608.0f);
+        }
+    }
+
+    memcpy(m_state[0], s0, sizeof(s0));
+    memcpy(m_state[1], s1, sizeof(s1));
+    memcpy(m_state[2], s2, sizeof(s2));
+    memcpy(m_state[3], s3, sizeof(s3));
+    m_position = 0;
+}
+
+void NoiseGenerator::uniform(float *out, uint32_t samples)
+{
+    while(samples > 0)
+    {
+        if (m_position >= NOISE_BUFFERSIZE)
+            refill();
+
+        const uint32_t n = std::min(samples, NOISE_BUFFERSIZE - m_position);
+        memcpy(out, m_buffer + m_position, n*sizeof(float));
+        m_position += n;
+        out += n;
+        samples -= n;
+    }
+}
+
+float NoiseGenerator::gaussian()
+{
+    // the Box-Muller transform produces
+    // two independent values at a time.
+    if (m_hasSpare)
+    {
+        m_hasSpare = false;
+        return m_spare;
+    }
+
+    const float u = 0.5f - 0.5f*uniform();     // in (0, 1]
+    const float angle = 3.14159265f*uniform();
+    const float r = 0.577350269f*std::sqrt(-2.0f*std::log(u));
+    m_spare = r*std::sin(angle);
+    m_hasSpare = true;
+    return r*std::cos(angle);
+}
+
+void NoiseGenerator::gaussian(float *out, uint32_t samples)
+{
+    for(uint32_t i=0; i<samples; i++)
+    {
+        out[i] = gaussian();
+    }
+}
+
+float NoiseGenerator::pink()
+{
+    // Paul Kellet's pinking filter, accurate
+    // to 0.05 dB above 9.2 Hz at 44.1 kHz.
+    const float white = uniform();
+    float *b = m_pink;
+    b[0] = 0.99886f*b[0] + white*0.0555179f;
+    b[1] = 0.99332f*b[1] + white*0.0750759f;
+    b[2] = 0.96900f*b[2] + white*0.1538520f;
+    b[3] = 0.86650f*b[3] + white*0.3104856f;
+    b[4] = 0.55000f*b[4] + white*0.5329522f;
+    b[5] = -0.7616f*b[5] - white*0.0168980f;
+    const float sum = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white*0.5362f;
+    b[6] = white*0.115926f;
+    return 0.11f*sum;
+}
+
+void NoiseGenerator::pink(float *out, uint32_t samples)
+{
+    for(uint32_t i=0; i<samples; i++)
+    {
+        out[i] = pink();
+    }
+}
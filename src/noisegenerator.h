@@ -0,0 +1,83 @@
+/*
+
+  Description:  Seedable pseudo-random noise generator
+                of a VM.
+
+                Uniform noise is produced by eight independent
+                xoshiro128+ generators, one per lane, which
+                fill a buffer of NOISE_BUFFERSIZE samples at a
+                time. The lanes are updated in lock step, so
+                the compiler can vectorize the refill. Single
+                samples and blocks are taken from the same
+                buffer, so both see the same sequence.
+
+                The generator has no global state. Two
+                generators with the same seed produce the
+                same noise.
+
+  License: GPLv2
+
+*/
+
+#ifndef noisegenerator_h
+#define noisegenerator_h
+
+#include <stdint.h>
+
+// number of parallel xoshiro128+ generators
+#define NOISE_LANES         8
+
+// number of samples generated per refill,
+// a multiple of NOISE_LANES
+#define NOISE_BUFFERSIZE    64
+
+// seed of a new generator
+#define NOISE_DEFAULTSEED   1
+
+class NoiseGenerator
+{
+public:
+    NoiseGenerator(uint64_t seed = NOISE_DEFAULTSEED);
+
+    /** restart the generator from a seed */
+    void seed(uint64_t seed);
+
+    /** uniform white noise in [-1, 1) */
+    float uniform()
+    {
+        if (m_position >= NOISE_BUFFERSIZE)
+            refill();
+        return m_buffer[m_position++];
+    }
+
+    /** fill a block with uniform white noise */
+    void uniform(float *out, uint32_t samples);
+
+    /** Gaussian white noise with zero mean and the
+        same power as uniform(), a standard deviation
+        of 1/sqrt(3). */
+    float gaussian();
+
+    /** fill a block with Gaussian white noise */
+    void gaussian(float *out, uint32_t samples);
+
+    /** pink noise, roughly in [-1, 1]. the filter
+        state is shared by all callers. */
+    float pink();
+
+    /** fill a block with pink noise */
+    void pink(float *out, uint32_t samples);
+
+protected:
+    /** generate the next NOISE_BUFFERSIZE samples */
+    void refill();
+
+    uint32_t    m_state[4][NOISE_LANES];    // xoshiro128+ state, one column per lane
+    float       m_buffer[NOISE_BUFFERSIZE]; // generated uniform samples
+    uint32_t    m_position;                 // next unused sample in m_buffer
+    float       m_spare;                    // second value of the last Box-Muller pair
+    bool        m_hasSpare;                 // true if m_spare was not used yet
+    float       m_pink[7];                  // state of the pinking filter
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+
+  Description:  Test signal generator of a VM.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "oscillator.h"
+
+Oscillator::Oscillator()
+    : m_mode(MODE_SINE),
+      m_sampleRate(44100.0f),
+      m_startFrequency(0.0f),
+      m_frequency(0.0f),
+      m_sweepRate(0.0f)
+{
+    m_tones.reserve(OSC_MAXTONES);
+    setTones(std::vector<float>(1, 1.0f));
+}
+
+void Oscillator::setMode(mode_t mode)
+{
+    if (mode != m_mode)
+    {
+        m_mode = mode;
+        m_frequency = m_startFrequency;
+    }
+}
+
+void Oscillator::setSamplerate(float Hz)
+{
+    m_sampleRate = Hz;
+    reset();
+}
+
+void Oscillator::setFrequency(float Hz)
+{
+    m_startFrequency = Hz;
+    m_frequency = Hz;
+}
+
+void Oscillator::setSweepRate(float rate)
+{
+    m_sweepRate = rate;
+}
+
+void Oscillator::setTones(const std::vector<float> &ratios)
+{
+    setTones(ratios.data(), (uint32_t)ratios.size());
+}
+
+void Oscillator::setTones(const float *ratios, uint32_t count)
+{
+    // the capacity is reserved, so this does not allocate
+    m_tones.resize(std::min(std::max(count, (uint32_t)1), (uint32_t)OSC_MAXTONES));
+    for(uint32_t i=0; i<m_tones.size(); i++)
+    {
+        m_tones[i].ratio = (i < count) ? ratios[i] : 1.0f;
+    }
+    m_toneGain = 1.0f / (float)m_tones.size();
+    reset();
+}
+
+void Oscillator::reset()
+{
+    for(tone_t &tone : m_tones)
+    {
+        tone.re = 1.0f;
+        tone.im = 0.0f;
+        tone.turns = NAN;   // the multipliers are not set
+    }
+    m_frequency = m_startFrequency;
+    m_position = OSC_CHUNK;
+}
+
+void Oscillator::generate(float *left, float *right, uint32_t samples)
+{
+    while(samples > 0)
+    {
+        if (m_position >= OSC_CHUNK)
+            refill();
+
+        const uint32_t n = std::min(samples, OSC_CHUNK - m_position);
+        memcpy(left, m_left + m_position, n*sizeof(float));
+        memcpy(right, m_right + m_position, n*sizeof(float));
+        m_position += n;
+        left += n;
+        right += n;
+        samples -= n;
+    }
+}
+
+void Oscillator::rotate(tone_t &tone, double turns, float *re, float *im)
+{
+    // the multipliers only change with the frequency,
+    // they are calculated in double precision by
+    // repeated rotation from a single sin and cos.
+    if (turns != tone.turns)
+    {
+        const double angle = 2.0*M_PI*turns;
+        const double wr = cos(angle);
+        const double wi = sin(angle);
+        double pr = 1.0;
+        double pi = 0.0;
+        for(uint32_t k=0; k<OSC_LANES; k++)
+        {
+            tone.mulRe[k] = (float)pr;
+            tone.mulIm[k] = (float)pi;
+            const double t = pr*wr - pi*wi;
+            pi = pr*wi + pi*wr;
+            pr = t;
+        }
+        tone.stepRe = (float)pr;
+        tone.stepIm = (float)pi;
+        tone.turns = turns;
+    }
+
+    float zr[OSC_LANES];
+    float zi[OSC_LANES];
+    for(uint32_t k=0; k<OSC_LANES; k++)
+    {
+        zr[k] = tone.re*tone.mulRe[k] - tone.im*tone.mulIm[k];
+        zi[k] = tone.re*tone.mulIm[k] + tone.im*tone.mulRe[k];
+    }
+
+    const float sr = tone.stepRe;
+    const float si = tone.stepIm;
+    for(uint32_t n=0; n<OSC_CHUNK; n+=OSC_LANES)
+    {
+        for(uint32_t k=0; k<OSC_LANES; k++)
+        {
+            re[n+k] = zr[k];
+            im[n+k] = zi[k];
+            const float t = zr[k]*sr - zi[k]*si;
+            zi[k] = zr[k]*si + zi[k]*sr;
+            zr[k] = t;
+        }
+    }
+
+    // lane 0 now holds the first phasor of the next chunk.
+    // one Newton step for 1/sqrt(|z|^2) pulls its magnitude
+    // back to 1, as it is always close to 1.
+    const float gain = 1.5f - 0.5f*(zr[0]*zr[0] + zi[0]*zi[0]);
+    tone.re = gain*zr[0];
+    tone.im = gain*zi[0];
+}
+
+double Oscillator::nextSweepFrequency()
+{
+    const double chunkTime = (double)OSC_CHUNK / m_sampleRate;
+    const double nyquist = 0.5*m_sampleRate;
+    double middle;
+    if (m_mode == MODE_LOGSWEEP)
+    {
+        middle = m_frequency*exp2(0.5*m_sweepRate*chunkTime);
+        m_frequency *= exp2(m_sweepRate*chunkTime);
+        if ((m_frequency >= nyquist) || (m_frequency < OSC_MINLOGFREQ))
+        {
+            m_frequency = m_startFrequency;
+        }
+    }
+    else
+    {
+        middle = m_frequency + 0.5*m_sweepRate*chunkTime;
+        m_frequency += m_sweepRate*chunkTime;
+        if ((m_frequency >= nyquist) || (m_frequency < 0.0))
+        {
+            m_frequency = m_startFrequency;
+        }
+    }
+    return middle;
+}
+
+void Oscillator::refill()
+{
+    switch(m_mode)
+    {
+    default:
+    case MODE_SINE:
+        rotate(m_tones[0], m_frequency / (double)m_sampleRate, m_left, m_scratch);
+        memcpy(m_right, m_left, sizeof(m_right));
+        break;
+    case MODE_QUADSINE:
+        rotate(m_tones[0], m_frequency / (double)m_sampleRate, m_left, m_right);
+        break;
+    case MODE_SWEEP:
+    case MODE_LOGSWEEP:
+        rotate(m_tones[0], nextSweepFrequency() / (double)m_sampleRate, m_left, m_scratch);
+        memcpy(m_right, m_left, sizeof(m_right));
+        break;
+    case MODE_MULTITONE:
+        for(uint32_t i=0; i<OSC_CHUNK; i++)
+        {
+            m_left[i] = 0.0f;
+        }
+        for(tone_t &tone : m_tones)
+        {
+            // tones above the Nyquist frequency would alias
+            const double frequency = tone.ratio * m_frequency;
+            if (std::fabs(frequency) >= 0.5*m_sampleRate)
+                continue;
+
+            rotate(tone, frequency / (double)m_sampleRate, m_scratch, m_right);
+            for(uint32_t i=0; i<OSC_CHUNK; i++)
+            {
+                m_left[i] += m_toneGain*m_scratch[i];
+            }
+        }
+        memcpy(m_right, m_left, sizeof(m_right));
+        break;
+    }
+    m_position = 0;
+}
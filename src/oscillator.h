@@ -0,0 +1,143 @@
+/*
+
+  Description:  Test signal generator of a VM: sine,
+                quadrature sine, linear and logarithmic
+                sweeps and multi-tone signals.
+
+                Each tone is a complex phasor that is
+                rotated by exp(j*2*pi*f/fs) every sample,
+                so no sin() or cos() is called per sample.
+                The phasor is split into OSC_LANES lanes,
+                lane k holding the phasor of sample n+k,
+                that all rotate by OSC_LANES samples at a
+                time. The lanes are independent, so the
+                compiler can vectorize the rotation.
+
+                Rounding errors make the magnitude of the
+                phasor drift, so it is renormalized after
+                every chunk of OSC_CHUNK samples.
+
+                Sweeps keep the frequency constant within a
+                chunk and use the frequency at the middle
+                of the chunk, so the phase stays continuous
+                and closely follows an ideal sweep.
+
+  License: GPLv2
+
+*/
+
+#ifndef oscillator_h
+#define oscillator_h
+
+#include <stdint.h>
+#include <vector>
+
+// number of phasors that are rotated in parallel
+#define OSC_LANES       4
+
+// number of samples generated at a time, a multiple
+// of OSC_LANES. the frequency of a sweep is updated
+// and the phasors are renormalized once per chunk.
+#define OSC_CHUNK       32
+
+// lowest frequency of a logarithmic sweep (in Hz)
+#define OSC_MINLOGFREQ  1.0f
+
+// largest number of tones of a multi-tone signal
+#define OSC_MAXTONES    16
+
+class Oscillator
+{
+public:
+    Oscillator();
+
+    enum mode_t {MODE_SINE, MODE_QUADSINE, MODE_SWEEP, MODE_LOGSWEEP, MODE_MULTITONE};
+
+    /** set the kind of signal. the phase is kept,
+        so the signal does not jump. */
+    void setMode(mode_t mode);
+
+    /** set the sample rate (in Hz) */
+    void setSamplerate(float Hz);
+
+    /** set the frequency of the sine, the start
+        frequency of a sweep or the base frequency
+        of a multi-tone signal (in Hz). a running
+        sweep restarts at this frequency. */
+    void setFrequency(float Hz);
+
+    /** set the rate of a sweep, in Hz per second
+        for a linear sweep and in octaves per second
+        for a logarithmic sweep. a negative rate
+        sweeps down. */
+    void setSweepRate(float rate);
+
+    /** set the tones of a multi-tone signal as
+        multiples of the base frequency. every tone
+        gets the same amplitude, so the sum stays
+        within [-1, 1]. at most OSC_MAXTONES tones
+        are used. */
+    void setTones(const std::vector<float> &ratios);
+
+    /** set 'count' tones from an array. does not
+        allocate, so it can be called by the audio
+        thread. */
+    void setTones(const float *ratios, uint32_t count);
+
+    /** restart all tones at zero phase and a sweep
+        at its start frequency */
+    void reset();
+
+    /** the current frequency of a sweep or the
+        frequency of the other signals (in Hz) */
+    float getFrequency() const
+    {
+        return (float)m_frequency;
+    }
+
+    /** generate the left and right channels. sweeps and
+        multi-tone signals are the same on both channels,
+        a quadrature sine has cos() on the left and sin()
+        on the right. */
+    void generate(float *left, float *right, uint32_t samples);
+
+protected:
+    struct tone_t
+    {
+        float   re, im;             // phasor of the next sample
+        double  turns;              // frequency (in cycles per sample) of the multipliers
+        float   mulRe[OSC_LANES];   // multipliers from the phasor to each lane
+        float   mulIm[OSC_LANES];
+        float   stepRe, stepIm;     // rotation by OSC_LANES samples
+        float   ratio;              // frequency as a multiple of the base frequency
+    };
+
+    /** generate the next OSC_CHUNK samples */
+    void refill();
+
+    /** rotate a tone through a chunk at 'turns'
+        cycles per sample, writing the real and
+        imaginary parts of the phasor */
+    void rotate(tone_t &tone, double turns, float *re, float *im);
+
+    /** the frequency of a sweep at the middle of the
+        next chunk (in Hz). moves the sweep to the
+        end of the chunk. */
+    double nextSweepFrequency();
+
+    mode_t      m_mode;
+    float       m_sampleRate;       // in Hz
+    float       m_startFrequency;   // frequency set by setFrequency (in Hz)
+    double      m_frequency;        // current frequency (in Hz), double so a sweep does not drift
+    float       m_sweepRate;        // in Hz/s or octaves/s
+
+    std::vector<tone_t> m_tones;    // the first tone is the sine and the sweep
+    float       m_toneGain;         // amplitude of each tone of a multi-tone signal
+
+    float       m_left[OSC_CHUNK];  // generated samples
+    float       m_right[OSC_CHUNK];
+    float       m_scratch[OSC_CHUNK];
+    uint32_t    m_position;         // next unused sample in m_left and m_right
+};
+
+#endif
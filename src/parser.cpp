@@ -38,6 +38,30 @@ int32_t ParseContext::createVariable(const std::string &name, varInfo::type_t va
     }
 }
 
+void ParseContext::useFastMath()
+{
+    for(ASTNode *statement : m_statements)
+    {
+        useFastMath(statement);
+    }
+}
+
+void ParseContext::useFastMath(ASTNode *node)
+{
+    if (node == 0)
+        return;
+
+    if (node->m_type == ASTNode::NodeFunction)
+        node->m_functionID = functionDefs::getFastFunction(node->m_functionID);
+
+    useFastMath(node->left);
+    useFastMath(node->right);
+    for(ASTNode *arg : node->m_functionArgs)
+    {
+        useFastMath(arg);
+    }
+}
+
 int32_t ParseContext::getVariableByName(const std::string &name)
 {
     const int32_t N=(int32_t)m_variables.size();
@@ -112,12 +136,17 @@ bool Parser::process(const std::vector<token_t> &tokens, ParseContext &context)
     m_tokens = &tokens;
 
     context.tokIdx = 0;
-    return acceptProgram(context);
+    if (!acceptProgram(context))
+        return false;
+
+    if (context.getPrecision() == ParseContext::PrecisionFast)
+        context.useFastMath();
+    return true;
 }
 
 bool Parser::acceptProgram(ParseContext &context)
 {
-    // productions: assignment | delaydefinition | NEWLINE | SEMICOL | EOF
+    // productions: assignment | delaydefinition | precision | virtualrate | NEWLINE | SEMICOL | EOF
 
     bool productionAccepted = true;
     token_t tok = getToken(context);
@@ -137,6 +166,19 @@ bool Parser::acceptProgram(ParseContext &context)
             productionAccepted = true;
             context.addStatement(node);
         }
+        else if (getToken(context).tokID == TOK_PRECISION)
+        {
+            // an invalid precision statement is an error
+            if (!acceptPrecision(context))
+                return false;
+            productionAccepted = true;
+        }
+        else if (getToken(context).tokID == TOK_VIRTUALRATE)
+        {
+            if (!acceptVirtualRate(context))
+                return false;
+            productionAccepted = true;
+        }
         else if (match(context, TOK_NEWLINE))
         {
             productionAccepted = true;
@@ -206,6 +248,61 @@ ASTNode* Parser::acceptAssignment(ParseContext &s)
 }
 
 
+bool Parser::acceptPrecision(ParseContext &s)
+{
+    // production: PRECISION IDENT
+    if (!match(s,TOK_PRECISION))
+    {
+        return false;
+    }
+
+    if (!match(s,TOK_IDENT))
+    {
+        error(s,"Precision 'fast' or 'exact' expected");
+        return false;
+    }
+
+    std::string mode = getToken(s, -1).txt;
+    if (mode == "fast")
+    {
+        s.setPrecision(ParseContext::PrecisionFast);
+    }
+    else if (mode == "exact")
+    {
+        s.setPrecision(ParseContext::PrecisionExact);
+    }
+    else
+    {
+        error(s,"Precision 'fast' or 'exact' expected");
+        return false;
+    }
+    return true;
+}
+
+bool Parser::acceptVirtualRate(ParseContext &s)
+{
+    // production: VIRTUALRATE INTEGER
+    if (!match(s,TOK_VIRTUALRATE))
+    {
+        return false;
+    }
+
+    if (!match(s,TOK_INTEGER))
+    {
+        error(s,"Sample rate in Hz expected");
+        return false;
+    }
+
+    const int32_t rate = atoi(getToken(s, -1).txt.c_str());
+    if (rate <= 0)
+    {
+        error(s,"Sample rate must be positive");
+        return false;
+    }
+    s.setSamplerate((uint32_t)rate);
+    return true;
+}
+
 ASTNode* Parser::acceptDelayDefinition(ParseContext &s)
 {
     // production: DELAY IDENT '[' INTEGER ']'
@@ -679,6 +776,16 @@ ASTNode* Parser::acceptFactor2(ParseContext &s)
         return NULL;
     }
 
+    if (nargs == FUNC_VARARGS)
+    {
+        ASTNode *filterNode = acceptFilterArguments(s, func.tokID);
+        if (filterNode == NULL)
+        {
+            s = savestate;
+        }
+        return filterNode;
+    }
+
     ASTNode* factorNode = new ASTNode(ASTNode::NodeFunction);
     factorNode->m_functionID = func.tokID;
     factorNode->left = 0;
@@ -722,6 +829,169 @@ ASTNode* Parser::acceptFactor2(ParseContext &s)
 }
 
 
+ASTNode* Parser::acceptFilterArguments(ParseContext &s, uint32_t functionID)
+{
+    const bool isBiquad = (functionID == F_biquad) || (functionID == F_biquads);
+
+    // the input signal
+    ASTNode *inputNode = 0;
+    if ((inputNode=acceptExpr(s)) == NULL)
+    {
+        error(s,"Invalid argument or number of arguments");
+        return NULL;
+    }
+
+    // the coefficients are fixed when the program is
+    // compiled, so the filter runs as a single kernel.
+    std::vector<float> coefficients;
+    while(match(s, TOK_COMMA))
+    {
+        ASTNode *coeffNode = acceptExpr(s);
+        float value;
+        if ((coeffNode == NULL) || (!evaluateConstant(coeffNode, value)))
+        {
+            error(s, isBiquad ? "Biquad coefficients must be constant" : "FIR coefficients must be constant");
+            delete coeffNode;
+            delete inputNode;
+            return NULL;
+        }
+        delete coeffNode;
+        coefficients.push_back(value);
+    }
+
+    if (coefficients.empty())
+    {
+        error(s,"Expected a comma in arguments list");
+        delete inputNode;
+        return NULL;
+    }
+
+    if (!match(s, TOK_RPAREN))
+    {
+        delete inputNode;
+        return NULL;
+    }
+
+    int32_t varIdx = isBiquad ? createBiquad(s, functionID, coefficients)
+                              : createFIR(s, functionID, coefficients);
+    if (varIdx < 0)
+    {
+        delete inputNode;
+        return NULL;
+    }
+
+    ASTNode *filterNode = new ASTNode(isBiquad ? ASTNode::NodeBiquad : ASTNode::NodeFIR);
+    filterNode->m_varIdx = varIdx;
+    filterNode->left = inputNode;
+    return filterNode;
+}
+
+int32_t Parser::createFilterVariable(ParseContext &s, const std::string &prefix, varInfo::type_t type)
+{
+    // every filter keeps its own state in
+    // a variable that cannot be named in a script.
+    uint32_t n = 0;
+    while(s.getVariableByName(prefix + std::to_string(n)) >= 0)
+    {
+        n++;
+    }
+    return s.createVariable(prefix + std::to_string(n), type);
+}
+
+int32_t Parser::createFIR(ParseContext &s, uint32_t functionID, const std::vector<float> &coefficients)
+{
+    int32_t varIdx = createFilterVariable(s, "_fir", varInfo::TYPE_FIR);
+
+    // symmetric filters only list the first half
+    // of the taps, including the centre tap.
+    const int32_t N = (int32_t)coefficients.size();
+    varInfo &fir = s.m_variables[varIdx];
+    fir.m_coefficients = coefficients;
+    fir.m_length = N;
+    if (functionID == F_firsymodd)
+        fir.m_length = 2*N-1;
+    if (functionID == F_firsymeven)
+        fir.m_length = 2*N;
+    return varIdx;
+}
+
+int32_t Parser::createBiquad(ParseContext &s, uint32_t functionID, const std::vector<float> &c)
+{
+    // every section is stored as b0, b1, b2, a1, a2,
+    // normalized to a0 = 1.
+    std::vector<float> sections;
+    if ((functionID == F_biquad) && (c.size() == 5))
+    {
+        // gain, a1, a2, b1, b2 with b0 = 1
+        const float g = c[0];
+        const float normalized[5] = {g, g*c[3], g*c[4], c[1], c[2]};
+        sections.assign(normalized, normalized+5);
+    }
+    else if ((functionID == F_biquad) && (c.size() != 6))
+    {
+        error(s,"Biquad needs 5 or 6 coefficients");
+        return -1;
+    }
+    else if ((c.size() % 6) != 0)
+    {
+        error(s,"Cascaded biquads need 6 coefficients per section");
+        return -1;
+    }
+    else
+    {
+        // a0, a1, a2, b0, b1, b2 per section
+        for(uint32_t i=0; i<c.size(); i+=6)
+        {
+            const float a0 = c[i];
+            if (a0 == 0.0f)
+            {
+                error(s,"Biquad coefficient a0 must not be zero");
+                return -1;
+            }
+            const float normalized[5] = {c[i+3]/a0, c[i+4]/a0, c[i+5]/a0, c[i+1]/a0, c[i+2]/a0};
+            sections.insert(sections.end(), normalized, normalized+5);
+        }
+    }
+
+    int32_t varIdx = createFilterVariable(s, "_biquad", varInfo::TYPE_BIQUAD);
+    varInfo &biquad = s.m_variables[varIdx];
+    biquad.m_coefficients = sections;
+    biquad.m_length = (int32_t)(sections.size() / 5);
+    return varIdx;
+}
+
+bool Parser::evaluateConstant(const ASTNode *node, float &value) const
+{
+    float a, b;
+    switch(node->m_type)
+    {
+    case ASTNode::NodeInteger:
+        value = node->m_literalInt;
+        return true;
+    case ASTNode::NodeFloat:
+        value = node->m_literalFloat;
+        return true;
+    case ASTNode::NodeUnaryMinus:
+        if (!evaluateConstant(node->right, a))
+            return false;
+        value = -a;
+        return true;
+    case ASTNode::NodeAdd:
+    case ASTNode::NodeSub:
+    case ASTNode::NodeMul:
+    case ASTNode::NodeDiv:
+        if ((!evaluateConstant(node->left, a)) || (!evaluateConstant(node->right, b)))
+            return false;
+        if (node->m_type == ASTNode::NodeAdd) value = a + b;
+        if (node->m_type == ASTNode::NodeSub) value = a - b;
+        if (node->m_type == ASTNode::NodeMul) value = a * b;
+        if (node->m_type == ASTNode::NodeDiv) value = a / b;
+        return true;
+    default:
+        return false;
+    }
+}
+
 ASTNode* Parser::acceptFactor3(ParseContext &s)
 {
     ParseContext savestate = s;
@@ -45,7 +45,9 @@ public:
                NodeFloat,
                NodeDelayDefinition,
                NodeDelayLookup,
-               NodeDelayAssign
+               NodeDelayAssign,
+               NodeFIR,
+               NodeBiquad
               };
 
     ASTNode(node_t nodeType = NodeUnknown)
@@ -156,6 +158,14 @@ public:
             stream << "Delay def: " << vars[m_varIdx].m_name << "[";
             stream << vars[m_varIdx].m_length << "]";
             break;
+        case NodeFIR:
+            stream << "FIR " << vars[m_varIdx].m_name << " (";
+            stream << vars[m_varIdx].m_length << " taps)";
+            break;
+        case NodeBiquad:
+            stream << "Biquad " << vars[m_varIdx].m_name << " (";
+            stream << vars[m_varIdx].m_length << " sections)";
+            break;
         case NodeFloat:
             stream << m_literalFloat << "(FLOAT)";
             break;
@@ -188,6 +198,11 @@ typedef std::vector<ASTNode*> statements_t;
 class ParseContext
 {
 public:
+    /** precision of the transcendental functions */
+    enum precision_t {PrecisionDefault, PrecisionExact, PrecisionFast};
+
+    ParseContext() : tokIdx(0), m_precision(PrecisionDefault), m_samplerate(0) {}
+
     size_t                tokIdx;
     Reader::position_info tokPos;
 
@@ -206,10 +221,44 @@ public:
         return m_statements;
     }
 
+    /** the precision requested by the program,
+        PrecisionDefault if it has no precision statement */
+    precision_t getPrecision() const
+    {
+        return m_precision;
+    }
+
+    void setPrecision(precision_t precision)
+    {
+        m_precision = precision;
+    }
+
+    /** the virtual sample rate requested by the
+        program in Hz, 0 if it has no virtualrate
+        statement */
+    uint32_t getSamplerate() const
+    {
+        return m_samplerate;
+    }
+
+    void setSamplerate(uint32_t Hz)
+    {
+        m_samplerate = Hz;
+    }
+
+    /** replace the transcendental functions of all
+        statements by their fast approximations */
+    void useFastMath();
+
     std::vector<varInfo>  m_variables;
 
 protected:
+    /** replace the functions of a subtree */
+    void useFastMath(ASTNode *node);
+
     statements_t          m_statements;
+    precision_t           m_precision;
+    uint32_t              m_samplerate;
 };
 
 
@@ -257,6 +306,13 @@ protected:
     /** production: DELAY IDENTIFIER '[' INTEGER ']' */
     ASTNode* acceptDelayDefinition(ParseContext &s);
 
+    /** production: PRECISION IDENTIFIER
+        where the identifier is 'fast' or 'exact' */
+    bool acceptPrecision(ParseContext &s);
+
+    /** production: VIRTUALRATE INTEGER */
+    bool acceptVirtualRate(ParseContext &s);
+
     /** production: expr' -> - term expr' | + term expr' | e
 
         This function will return leftNode when an
@@ -300,12 +356,33 @@ protected:
     /** production: FUNCTION ( expr ) */
     ASTNode* acceptFactor2(ParseContext &s);
 
+    /** production: expr , constexpr {, constexpr} )
+        the arguments of a FIR or biquad filter function,
+        after the opening parenthesis. */
+    ASTNode* acceptFilterArguments(ParseContext &s, uint32_t functionID);
+
+    /** create the hidden state variable of a filter,
+        named prefix0, prefix1, ... */
+    int32_t createFilterVariable(ParseContext &s, const std::string &prefix, varInfo::type_t type);
+
+    /** create a FIR filter variable from its coefficients */
+    int32_t createFIR(ParseContext &s, uint32_t functionID, const std::vector<float> &coefficients);
+
+    /** create a biquad filter variable with normalized
+        sections. returns -1 if the coefficients are
+        invalid. */
+    int32_t createBiquad(ParseContext &s, uint32_t functionID, const std::vector<float> &coefficients);
+
     /** production: ( expr ) */
     ASTNode* acceptFactor3(ParseContext &s);
 
     /** production: - factor */
     ASTNode* acceptFactor4(ParseContext &s);
 
+    /** evaluate an expression of numbers and +, -, *, /.
+        returns false if it is not constant. */
+    bool evaluateConstant(const ASTNode *node, float &value) const;
+
     /** match a token, return true if matched and advance the token index. */
     bool match(ParseContext &s, uint32_t tokenID);
 
@@ -8,6 +8,7 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "reader.h"
 
 Reader::Reader()
@@ -21,17 +22,14 @@ Reader::~Reader()
 {
 }
 
-Reader* Reader::create(const QString &sourceCodeString)
+Reader* Reader::create(const std::string &sourceCodeString)
 {
-    Reader *reader = new Reader();
-
-    QByteArray ar = sourceCodeString.toLocal8Bit();
-    reader->m_source.resize(ar.length());
-
-    if (ar.length() == 0)
+    if (sourceCodeString.empty())
         return NULL;
 
-    memcpy(&(reader->m_source[0]), ar.constData(), ar.length());
+    Reader *reader = new Reader();
+    reader->m_source.resize(sourceCodeString.length());
+    memcpy(&(reader->m_source[0]), sourceCodeString.data(), sourceCodeString.length());
     return reader;
 }
 
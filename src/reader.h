@@ -10,8 +10,8 @@
 #ifndef reader_h
 #define reader_h
 
-#include <QString>
 #include <stdint.h>
+#include <string>
 #include <stack>
 #include <vector>
 
@@ -31,9 +31,10 @@ public:
     size_t  pos;        // the position within the line
   };
 
-  /** Create a reader object using source code in a QString
+  /** Create a reader object using source code in a string
+      in the local 8-bit encoding.
       NULL is returned when an error occured. */
-  static Reader* create(const QString &sourceCodeString);
+  static Reader* create(const std::string &sourceCodeString);
 
   /** Rollback the read pointer to the last marked position.
       When succesfull, the marked position is removed from
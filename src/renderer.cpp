@@ -0,0 +1,394 @@
+/*
+
+  Description:  Offline rendering of BasicDSP scripts.
+
+  License: GPLv2
+
+*/
+
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include "reader.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "asttovm.h"
+#include "ssaprogram.h"
+#include "wavstreamer.h"
+#include "resampler.h"
+#include "logging.h"
+#include "renderer.h"
+
+Renderer::Renderer()
+    : m_script(NULL)
+{
+    for(uint32_t i=0; i<4; i++)
+    {
+        m_slider[i] = 0.0f;
+    }
+}
+
+Renderer::~Renderer()
+{
+}
+
+float Renderer::getFileSamplerate(const std::string &filename)
+{
+    WavStreamer file;
+    WavFormatChunk format;
+    if ((file.openFile(filename) != 0) || (!file.getFormat(format)))
+    {
+        return 0.0f;
+    }
+    return (float)format.dwSamplesPerSec;
+}
+
+bool Renderer::compile(const std::string &source, float sampleRate,
+                       const std::vector<std::string> &monitored, bool fastMath,
+                       RenderScript &script)
+{
+    if (monitored.size() > RENDER_MAXMONITORED)
+    {
+        m_error = "Too many monitored variables";
+        return false;
+    }
+
+    std::unique_ptr<Reader> reader(Reader::create(source));
+    if (!reader)
+    {
+        m_error = "Error: no source code?";
+        return false;
+    }
+
+    Tokenizer tokenizer;
+    std::vector<token_t> tokens;
+    if (!tokenizer.process(reader.get(), tokens))
+    {
+        const Reader::position_info pos = tokenizer.getErrorPosition();
+        m_error = "Tokenizer error on line " + std::to_string(pos.line+1) + ": "
+                + tokenizer.getErrorString();
+        return false;
+    }
+
+    Parser parser;
+    ParseContext context;
+    if (!parser.process(tokens, context))
+    {
+        const Reader::position_info pos = parser.getLastErrorPos();
+        m_error = "Program error on line " + std::to_string(pos.line+1) + ": "
+                + parser.getLastError();
+        return false;
+    }
+
+    // a precision statement in the script
+    // overrides the fast math option.
+    if ((context.getPrecision() == ParseContext::PrecisionDefault) && fastMath)
+    {
+        context.useFastMath();
+    }
+
+    m_machine.setSamplerate(sampleRate);
+    script.sampleRate = sampleRate;
+    script.programRate = m_machine.setProgramSamplerate(context.getSamplerate());
+    if ((context.getSamplerate() != 0) && (script.programRate != context.getSamplerate()))
+    {
+        doLog(LOG_WARN, "Virtual sample rate not supported, running at %g Hz\n",
+              (double)script.programRate);
+    }
+
+    SSAProgram ssa;
+    ParseContext optimized;
+    script.monitored = monitored;
+    if ((!ssa.build(context, script.programRate)) ||
+        (!ssa.generate(optimized, monitored)) ||
+        (!ASTToVM::process(optimized, script.program, script.variables)) ||
+        (!ASTToVM::process(optimized, script.regprogram)) ||
+        (!ASTToVM::process(optimized, script.exprprogram)))
+    {
+        m_error = "AST conversion failed!";
+        return false;
+    }
+
+    for(const std::string &name : monitored)
+    {
+        if (VM::findVariableByName(script.variables, name) < 0)
+        {
+            m_error = "Variable " + name + " is not used by the program";
+            return false;
+        }
+    }
+
+    VM::getMemory(script.exprprogram, script.variables, script.memory);
+    setWarmup(script);
+    if (!script.memory.bounded)
+    {
+        doLog(LOG_DEBUG, "The script has unbounded memory, %s is fed back\n",
+              script.variables[script.memory.feedback].m_name.c_str());
+    }
+    return true;
+}
+
+void Renderer::setWarmup(RenderScript &script)
+{
+    const uint32_t fileRate = (uint32_t)script.sampleRate;
+    const uint32_t programRate = (uint32_t)script.programRate;
+    uint64_t frames = script.memory.length;
+    script.period = 1;
+    if (programRate != fileRate)
+    {
+        // a part of a file only matches a continuous render
+        // when the resamplers start at the same filter phase
+        // and their histories are filled.
+        Resampler down;
+        Resampler up;
+        down.setup(fileRate, programRate);
+        up.setup(programRate, fileRate);
+        script.period = fileRate / std::gcd(fileRate, programRate);
+        frames = ((frames + up.getTaps())*fileRate + programRate - 1) / programRate
+               + down.getTaps();
+    }
+    script.warmup = (uint32_t)std::min(frames, (uint64_t)UINT32_MAX);
+}
+
+bool Renderer::load(const RenderScript &script)
+{
+    m_machine.setSamplerate(script.sampleRate);
+    m_machine.setProgramSamplerate(script.programRate);
+    m_machine.loadProgram(script.program, script.regprogram, script.exprprogram, script.variables);
+    if (m_machine.getProgramSamplerate() != script.programRate)
+    {
+        m_error = "Virtual sample rate not supported";
+        return false;
+    }
+
+    for(uint32_t k=0; k<RENDER_MAXMONITORED; k++)
+    {
+        const std::string name = (k < script.monitored.size()) ? script.monitored[k] : std::string();
+        m_machine.setMonitoringVariable(k/2, k%2, name);
+    }
+    m_script = &script;
+    return true;
+}
+
+void Renderer::setEngine(VirtualMachine::engine_t engine)
+{
+    m_machine.setEngine(engine);
+}
+
+void Renderer::setSlider(uint32_t id, float value)
+{
+    if (id < 4)
+    {
+        m_slider[id] = value;
+    }
+}
+
+void Renderer::setNoiseSeed(uint32_t seed)
+{
+    m_machine.setNoiseSeed(seed);
+}
+
+bool Renderer::writeMonitored(WavWriter *file)
+{
+    // both ring buffers get a value for every run of the
+    // program, so they always hold the same number.
+    PaUtilRingBuffer *rb[2] = {m_machine.getRingBufferPtr(0), m_machine.getRingBufferPtr(1)};
+    const ring_buffer_size_t count = std::min(PaUtil_GetRingBufferReadAvailable(rb[0]),
+                                              PaUtil_GetRingBufferReadAvailable(rb[1]));
+    if (count <= 0)
+    {
+        return true;
+    }
+
+    if (file == NULL)
+    {
+        PaUtil_AdvanceRingBufferReadIndex(rb[0], count);
+        PaUtil_AdvanceRingBufferReadIndex(rb[1], count);
+        return true;
+    }
+
+    const uint32_t channels = m_script->monitored.size();
+    m_monitorFrames.resize(count*channels);
+    for(uint32_t k=0; k<2; k++)
+    {
+        m_monitorBuffer[k].resize(count);
+        PaUtil_ReadRingBuffer(rb[k], &m_monitorBuffer[k][0], count);
+    }
+
+    for(ring_buffer_size_t i=0; i<count; i++)
+    {
+        for(uint32_t c=0; c<channels; c++)
+        {
+            const VirtualMachine::ring_buffer_data_t &data = m_monitorBuffer[c/2][i];
+            m_monitorFrames[i*channels + c] = (c%2 == 0) ? data.s1 : data.s2;
+        }
+    }
+    return file->write(&m_monitorFrames[0], count);
+}
+
+bool Renderer::openInput(const std::string &inFile, WavStreamer &input, WavFormatChunk &format)
+{
+    if ((input.openFile(inFile) != 0) || (!input.getFormat(format)))
+    {
+        m_error = "Cannot read " + inFile + ", only stereo PCM or float .wav files are supported";
+        return false;
+    }
+    if ((float)format.dwSamplesPerSec != m_script->sampleRate)
+    {
+        m_error = inFile + " does not have the sample rate of the script";
+        return false;
+    }
+    return true;
+}
+
+void Renderer::startRun()
+{
+    m_machine.resetProgramState();
+    m_machine.startOffline();
+    for(uint32_t i=0; i<4; i++)
+    {
+        m_machine.setSlider(i, m_slider[i]);
+    }
+    writeMonitored(NULL);
+}
+
+bool Renderer::render(const std::string &inFile, const std::string &outFile,
+                      const std::string &variableFile, renderstats_t &stats)
+{
+    stats.frames = 0;
+    stats.audioTime = 0.0;
+    stats.renderTime = 0.0;
+
+    if (m_script == NULL)
+    {
+        m_error = "No script loaded";
+        return false;
+    }
+
+    WavStreamer input;
+    WavFormatChunk format;
+    if (!openInput(inFile, input, format))
+    {
+        return false;
+    }
+
+    WavWriter output;
+    if (output.openFile(outFile, 2, format.dwSamplesPerSec) != 0)
+    {
+        m_error = "Cannot create " + outFile;
+        return false;
+    }
+
+    WavWriter variables;
+    const bool writeVariables = !variableFile.empty() && !m_script->monitored.empty();
+    if (writeVariables &&
+        (variables.openFile(variableFile, m_script->monitored.size(), (uint32_t)m_script->programRate) != 0))
+    {
+        m_error = "Cannot create " + variableFile;
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    startRun();
+    std::vector<float> inbuf(2*RENDER_BLOCKSIZE);
+    std::vector<float> outbuf(2*RENDER_BLOCKSIZE);
+    const uint32_t frames = input.getSampleCount();
+    bool ok = true;
+    while(ok && (stats.frames < frames))
+    {
+        const uint32_t n = std::min((uint32_t)RENDER_BLOCKSIZE, (uint32_t)(frames - stats.frames));
+        input.fillBuffer(&inbuf[0], n);
+        m_machine.processSamples(&inbuf[0], &outbuf[0], n);
+        ok = output.write(&outbuf[0], n) && writeMonitored(writeVariables ? &variables : NULL);
+        stats.frames += n;
+    }
+    m_machine.stop();
+
+    ok = ok && output.close();
+    if (writeVariables)
+    {
+        ok = variables.close() && ok;
+    }
+
+    stats.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    stats.audioTime = stats.frames / (double)format.dwSamplesPerSec;
+    if (!ok)
+    {
+        m_error = "Error writing the output";
+        return false;
+    }
+    return true;
+}
+
+bool Renderer::renderPart(const std::string &inFile, const std::string &outFile,
+                          uint32_t start, uint32_t first, uint32_t count,
+                          renderstats_t &stats)
+{
+    stats.frames = 0;
+    stats.audioTime = 0.0;
+    stats.renderTime = 0.0;
+
+    if (m_script == NULL)
+    {
+        m_error = "No script loaded";
+        return false;
+    }
+
+    WavStreamer input;
+    WavFormatChunk format;
+    if (!openInput(inFile, input, format))
+    {
+        return false;
+    }
+    if ((start > first) || ((uint64_t)first + count > input.getSampleCount()) || (!input.seek(start)))
+    {
+        m_error = "Frames " + std::to_string(first) + " to " + std::to_string((uint64_t)first + count)
+                + " are not in " + inFile;
+        return false;
+    }
+
+    WavWriter output;
+    if (output.openPart(outFile, 2, first) != 0)
+    {
+        m_error = "Cannot write to " + outFile;
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    startRun();
+    std::vector<float> inbuf(2*RENDER_BLOCKSIZE);
+    std::vector<float> outbuf(2*RENDER_BLOCKSIZE);
+    const uint32_t end = first + count;
+    uint32_t position = start;
+    bool ok = true;
+    while(ok && (position < end))
+    {
+        const uint32_t n = std::min((uint32_t)RENDER_BLOCKSIZE, end - position);
+        input.fillBuffer(&inbuf[0], n);
+        m_machine.processSamples(&inbuf[0], &outbuf[0], n);
+        writeMonitored(NULL);
+
+        // the outputs of the warm-up are discarded
+        if (position + n > first)
+        {
+            const uint32_t skip = (position < first) ? first - position : 0;
+            ok = output.write(&outbuf[2*skip], n - skip);
+        }
+        position += n;
+    }
+    m_machine.stop();
+    ok = output.close() && ok;
+
+    stats.frames = count;
+    stats.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    stats.audioTime = count / (double)format.dwSamplesPerSec;
+    if (!ok)
+    {
+        m_error = "Error writing the output";
+        return false;
+    }
+    return true;
+}
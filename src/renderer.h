@@ -0,0 +1,147 @@
+/*
+
+  Description:  Offline rendering of BasicDSP scripts.
+                A .wav file is run through a VM as fast
+                as the CPU allows, without a soundcard,
+                and the outputs are written to a .wav file.
+
+  License: GPLv2
+
+*/
+
+#ifndef renderer_h
+#define renderer_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "vmtypes.h"
+#include "virtualmachine.h"
+#include "wavstreamer.h"
+#include "wavwriter.h"
+
+// number of frames that are run through the VM at a time
+#define RENDER_BLOCKSIZE    8192
+
+// number of variables that can be written to a file,
+// the VM monitors up to four variables
+#define RENDER_MAXMONITORED 4
+
+/** a script compiled for one sample rate */
+struct RenderScript
+{
+    VM::program_t       program;
+    VM::regprogram_t    regprogram;
+    VM::exprprogram_t   exprprogram;
+    VM::variables_t     variables;
+    float               sampleRate;     // rate of the input and output files in Hz
+    float               programRate;    // rate the script runs at in Hz, see virtualrate
+    std::vector<std::string> monitored; // variables written to the variable file
+
+    VM::memory_t        memory;         // memory of the program at the program rate
+    uint32_t            warmup;         // input frames that bring a render to the state
+                                        // of a continuous one, if the memory is bounded
+    uint32_t            period;         // frames after which the resamplers repeat their phases
+};
+
+/** results of a render */
+struct renderstats_t
+{
+    uint64_t    frames;         // number of stereo samples rendered
+    double      audioTime;      // duration of the audio in seconds
+    double      renderTime;     // time it took to render in seconds
+
+    /** how many times faster than real time the file was rendered */
+    double getRealtimeFactor() const
+    {
+        return (renderTime > 0.0) ? audioTime / renderTime : 0.0;
+    }
+};
+
+class Renderer
+{
+public:
+    Renderer();
+    virtual ~Renderer();
+
+    /** compile the source code of a script for files with a
+        sample rate of 'sampleRate' Hz. Statements that do not
+        contribute to the outputs or to one of the 'monitored'
+        variables are removed. 'fastMath' selects the fast
+        functions if the script has no precision statement.
+        Returns false on an error, see getError(). */
+    bool compile(const std::string &source, float sampleRate,
+                 const std::vector<std::string> &monitored, bool fastMath,
+                 RenderScript &script);
+
+    /** load a compiled script into the VM of this renderer.
+        The script is only read, so several renderers
+        can load the same script. */
+    bool load(const RenderScript &script);
+
+    /** select the execution engine of the VM */
+    void setEngine(VirtualMachine::engine_t engine);
+
+    /** set the value of one of the four sliders,
+        which is kept for all following renders */
+    void setSlider(uint32_t id, float value);
+
+    /** set the seed of the noise generator */
+    void setNoiseSeed(uint32_t seed);
+
+    /** run the stereo file 'inFile' through the loaded script
+        and write the outputs to 'outFile'. If 'variableFile' is
+        not empty, the monitored variables are written to it at
+        the rate of the script. Every render starts from the
+        initial state of the script.
+        Returns false on an error, see getError(). */
+    bool render(const std::string &inFile, const std::string &outFile,
+                const std::string &variableFile, renderstats_t &stats);
+
+    /** render 'count' frames of the stereo file 'inFile' from
+        frame 'first' on into the file 'outFile', which must have
+        been created for the whole file. The script starts from
+        its initial state at frame 'start', the outputs of the
+        frames before 'first' only settle the state and are
+        discarded. Parts of a file can be rendered in parallel,
+        each by its own renderer.
+        Returns false on an error, see getError(). */
+    bool renderPart(const std::string &inFile, const std::string &outFile,
+                    uint32_t start, uint32_t first, uint32_t count,
+                    renderstats_t &stats);
+
+    /** the sample rate of a .wav file in Hz, 0 if it cannot be read */
+    static float getFileSamplerate(const std::string &filename);
+
+    /** description of the last error */
+    std::string getError() const
+    {
+        return m_error;
+    }
+
+protected:
+    /** set the warm-up and period of a compiled script
+        from its memory and the resamplers */
+    static void setWarmup(RenderScript &script);
+
+    /** open an input file and check its sample rate */
+    bool openInput(const std::string &inFile, WavStreamer &input, WavFormatChunk &format);
+
+    /** start the VM from the initial state of the script */
+    void startRun();
+
+    /** read the monitored variables from the ring buffers
+        of the VM. They are written to 'file' if it is not
+        NULL, otherwise they are discarded. */
+    bool writeMonitored(WavWriter *file);
+
+    VirtualMachine  m_machine;
+    const RenderScript *m_script;   // the loaded script
+    float           m_slider[4];    // slider values, set at the start of every render
+    std::string     m_error;
+
+    std::vector<VirtualMachine::ring_buffer_data_t> m_monitorBuffer[2];
+    std::vector<float> m_monitorFrames; // interleaved monitored variables
+};
+
+#endif
@@ -0,0 +1,469 @@
+/*
+
+  Description:  basicdsp-render, a command line tool that
+                runs .wav files through a BasicDSP script
+                faster than real time. In batch mode many
+                files are rendered in parallel, in split mode
+                the parts of a single file. A parameter sweep
+                renders a file for many slider values at once.
+
+  License: GPLv2
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include "renderer.h"
+#include "batchrenderer.h"
+#include "sweeprenderer.h"
+
+static void usage()
+{
+    printf("Usage: basicdsp-render [options] script.dsp input.wav output.wav\n");
+    printf("       basicdsp-render [options] --batch directory script.dsp input.wav...\n");
+    printf("       basicdsp-render [options] --split script.dsp input.wav output.wav\n");
+    printf("       basicdsp-render [options] --sweep n=v1,v2,... script.dsp input.wav output.wav\n\n");
+    printf("Runs stereo .wav files through a BasicDSP script as fast as possible\n");
+    printf("and writes the outputs as 32-bit float .wav files.\n\n");
+    printf("Options:\n");
+    printf("  -b, --batch directory   render all input files on several threads and\n");
+    printf("                          write the outputs with the same names to directory\n");
+    printf("  -p, --split             render parts of a single file on several threads\n");
+    printf("      --settle seconds    time the parts of a split file start early, at\n");
+    printf("                          least the memory of the script (default: %g s\n", RENDER_SETTLETIME);
+    printf("                          for scripts with feedback)\n");
+    printf("  -j, --jobs n            number of threads in batch or split mode (default: all cores)\n");
+    printf("  -w, --sweep n=v1,v2,... render the file for each value of slider n, up to 16\n");
+    printf("                          at a time. with more sliders, every combination is\n");
+    printf("                          rendered to output_slider1_v1_slider2_v2.wav etc.\n");
+    printf("  -m, --monitor name      write variable 'name' to the variable file,\n");
+    printf("                          can be given up to 4 times\n");
+    printf("  -o, --variables file    the .wav file for the monitored variables, in\n");
+    printf("                          batch mode they are written to name.vars.wav\n");
+    printf("  -e, --engine name       sample, block, register, jit or closure (default: block)\n");
+    printf("  -s, --slider n=value    set slider n (1-4) to value\n");
+    printf("      --seed n            seed of the noise generator\n");
+    printf("      --fast              use the fast math functions, unless the script\n");
+    printf("                          has a precision statement\n");
+    printf("  -h, --help              show this text\n");
+}
+
+static bool readFile(const char *filename, std::string &contents)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+/** the name of a file without its directory */
+static std::string getBaseName(const std::string &path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    return (slash == std::string::npos) ? path : path.substr(slash+1);
+}
+
+/** the name of the variable file next to an output file */
+static std::string getVariableFileName(const std::string &outFile)
+{
+    const size_t dot = outFile.find_last_of('.');
+    const size_t slash = outFile.find_last_of("/\\");
+    if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash)))
+    {
+        return outFile + ".vars.wav";
+    }
+    return outFile.substr(0, dot) + ".vars.wav";
+}
+
+static int renderBatch(BatchRenderer &batch, const std::vector<std::string> &inFiles,
+                       const std::string &directory, bool writeVariables)
+{
+    std::vector<renderjob_t> jobs(inFiles.size());
+    for(uint32_t i=0; i<inFiles.size(); i++)
+    {
+        jobs[i].inFile = inFiles[i];
+        jobs[i].outFile = directory + "/" + getBaseName(inFiles[i]);
+        jobs[i].variableFile = writeVariables ? getVariableFileName(jobs[i].outFile) : std::string();
+        if (jobs[i].outFile == jobs[i].inFile)
+        {
+            fprintf(stderr, "%s would overwrite its input\n", jobs[i].outFile.c_str());
+            return 1;
+        }
+    }
+
+    renderstats_t total;
+    const uint32_t failed = batch.render(jobs, total);
+    for(const renderjob_t &job : jobs)
+    {
+        if (!job.ok)
+        {
+            fprintf(stderr, "%s: %s\n", job.inFile.c_str(), job.error.c_str());
+        }
+    }
+
+    printf("Rendered %u of %u files, %.2f s of audio in %.3f s on %u threads, %.1fx real time\n",
+           (uint32_t)(jobs.size() - failed), (uint32_t)jobs.size(), total.audioTime,
+           total.renderTime, batch.getThreads(), total.getRealtimeFactor());
+    return (failed == 0) ? 0 : 1;
+}
+
+static int renderSplit(BatchRenderer &batch, const RenderScript &script, const std::string &inFile,
+                       const std::string &outFile, float settleTime)
+{
+    const uint32_t warmup = batch.getWarmup(settleTime);
+    if (!script.memory.bounded)
+    {
+        fprintf(stderr, "Warning: %s is fed back to itself, so the memory of the script is unbounded.\n"
+                        "The parts settle for %.3f s and the output is only approximate.\n",
+                script.variables[script.memory.feedback].m_name.c_str(), warmup / (double)script.sampleRate);
+    }
+    if (script.memory.noise)
+    {
+        fprintf(stderr, "Warning: the parts use different noise than a single render.\n");
+    }
+
+    renderstats_t total;
+    if (!batch.renderSplit(inFile, outFile, settleTime, total))
+    {
+        fprintf(stderr, "%s\n", batch.getError().c_str());
+        return 1;
+    }
+
+    printf("Rendered %.2f s of audio in %.3f s on %u threads, %.1fx real time\n",
+           total.audioTime, total.renderTime, batch.getThreads(), total.getRealtimeFactor());
+    return 0;
+}
+
+/** a swept slider and its values */
+struct sweep_t
+{
+    uint32_t            id;
+    std::vector<float>  values;
+};
+
+static bool parseSweep(const char *text, sweep_t &sweep)
+{
+    int id;
+    int length;
+    if ((sscanf(text, "%d=%n", &id, &length) != 1) || (id < 1) || (id > 4))
+    {
+        return false;
+    }
+    sweep.id = id-1;
+    sweep.values.clear();
+
+    std::stringstream ss(text + length);
+    std::string value;
+    while(std::getline(ss, value, ','))
+    {
+        char *end;
+        sweep.values.push_back(strtof(value.c_str(), &end));
+        if ((end == value.c_str()) || (*end != 0))
+        {
+            return false;
+        }
+    }
+    return !sweep.values.empty();
+}
+
+static int renderSweep(const RenderScript &script, const std::vector<sweep_t> &sweeps,
+                       const float *sliders, bool setSeed, uint32_t seed,
+                       const std::string &inFile, const std::string &outFile)
+{
+    // the output files are named after the swept values
+    const size_t dot = outFile.find_last_of('.');
+    const size_t slash = outFile.find_last_of("/\\");
+    const bool hasExtension = (dot != std::string::npos) && ((slash == std::string::npos) || (dot > slash));
+    const std::string base = hasExtension ? outFile.substr(0, dot) : outFile;
+    const std::string extension = hasExtension ? outFile.substr(dot) : std::string(".wav");
+
+    // every combination of the swept values,
+    // the first slider changes fastest
+    std::vector<sweeppoint_t> points(1);
+    std::copy(sliders, sliders + 4, points[0].slider);
+    for(const sweep_t &sweep : sweeps)
+    {
+        std::vector<sweeppoint_t> combined;
+        for(float value : sweep.values)
+        {
+            for(sweeppoint_t point : points)
+            {
+                point.slider[sweep.id] = value;
+                char name[64];
+                snprintf(name, sizeof(name), "_slider%u_%g", sweep.id+1, (double)value);
+                point.outFile += name;
+                combined.push_back(point);
+            }
+        }
+        points.swap(combined);
+    }
+    for(sweeppoint_t &point : points)
+    {
+        point.outFile = base + point.outFile + extension;
+        if (point.outFile == inFile)
+        {
+            fprintf(stderr, "%s would overwrite its input\n", point.outFile.c_str());
+            return 1;
+        }
+    }
+
+    SweepRenderer sweep;
+    if (!sweep.load(script))
+    {
+        fprintf(stderr, "%s\n", sweep.getError().c_str());
+        return 1;
+    }
+    if (setSeed)
+    {
+        sweep.setNoiseSeed(seed);
+    }
+
+    renderstats_t total;
+    if (!sweep.render(inFile, points, total))
+    {
+        fprintf(stderr, "%s\n", sweep.getError().c_str());
+        return 1;
+    }
+
+    for(const sweeppoint_t &point : points)
+    {
+        printf("%s\n", point.outFile.c_str());
+    }
+    printf("Rendered %u points, %.2f s of audio in %.3f s, %.1fx real time\n",
+           (uint32_t)points.size(), total.audioTime, total.renderTime, total.getRealtimeFactor());
+    return 0;
+}
+
+static bool parseEngine(const char *name, VirtualMachine::engine_t &engine)
+{
+    static const char *names[] = {"sample", "block", "register", "jit", "closure"};
+    for(uint32_t i=0; i<5; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            engine = (VirtualMachine::engine_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> monitored;
+    std::vector<std::string> files;
+    std::string variableFile;
+    std::string batchDirectory;
+    uint32_t jobs = 0;
+    VirtualMachine::engine_t engine = VirtualMachine::ENGINE_BLOCK;
+    float sliders[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    bool setSeed = false;
+    uint32_t seed = 0;
+    bool fastMath = false;
+    bool splitMode = false;
+    std::vector<sweep_t> sweeps;
+    float settleTime = 0.0f;
+
+    for(int i=1; i<argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = (i+1 < argc);
+        if ((arg == "-h") || (arg == "--help"))
+        {
+            usage();
+            return 0;
+        }
+        else if (((arg == "-b") || (arg == "--batch")) && hasValue)
+        {
+            batchDirectory = argv[++i];
+        }
+        else if ((arg == "-p") || (arg == "--split"))
+        {
+            splitMode = true;
+        }
+        else if (((arg == "-w") || (arg == "--sweep")) && hasValue)
+        {
+            sweep_t sweep;
+            if (!parseSweep(argv[++i], sweep))
+            {
+                fprintf(stderr, "Sweep %s is not n=v1,v2,... with n 1-4\n", argv[i]);
+                return 1;
+            }
+            sweeps.push_back(sweep);
+        }
+        else if ((arg == "--settle") && hasValue)
+        {
+            settleTime = (float)atof(argv[++i]);
+        }
+        else if (((arg == "-j") || (arg == "--jobs")) && hasValue)
+        {
+            jobs = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (((arg == "-m") || (arg == "--monitor")) && hasValue)
+        {
+            monitored.push_back(argv[++i]);
+        }
+        else if (((arg == "-o") || (arg == "--variables")) && hasValue)
+        {
+            variableFile = argv[++i];
+        }
+        else if (((arg == "-e") || (arg == "--engine")) && hasValue)
+        {
+            if (!parseEngine(argv[++i], engine))
+            {
+                fprintf(stderr, "Unknown engine %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (((arg == "-s") || (arg == "--slider")) && hasValue)
+        {
+            int id;
+            float value;
+            if ((sscanf(argv[++i], "%d=%f", &id, &value) != 2) || (id < 1) || (id > 4))
+            {
+                fprintf(stderr, "Slider setting %s is not n=value with n 1-4\n", argv[i]);
+                return 1;
+            }
+            sliders[id-1] = value;
+        }
+        else if ((arg == "--seed") && hasValue)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+            setSeed = true;
+        }
+        else if (arg == "--fast")
+        {
+            fastMath = true;
+        }
+        else if ((arg.size() > 1) && (arg[0] == '-'))
+        {
+            fprintf(stderr, "Unknown option %s\n\n", arg.c_str());
+            usage();
+            return 1;
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+
+    const bool batchMode = !batchDirectory.empty();
+    if ((batchMode && (files.size() < 2)) || (!batchMode && (files.size() != 3)))
+    {
+        usage();
+        return 1;
+    }
+    const bool sweepMode = !sweeps.empty();
+    if ((batchMode && splitMode) || (sweepMode && (batchMode || splitMode)))
+    {
+        fprintf(stderr, "--batch, --split and --sweep cannot be combined\n");
+        return 1;
+    }
+    if ((splitMode || sweepMode) && !monitored.empty())
+    {
+        fprintf(stderr, "Variables cannot be monitored in split or sweep mode\n");
+        return 1;
+    }
+    if (monitored.size() > RENDER_MAXMONITORED)
+    {
+        fprintf(stderr, "At most %d variables can be monitored\n", RENDER_MAXMONITORED);
+        return 1;
+    }
+    if (!batchMode && !variableFile.empty() && monitored.empty())
+    {
+        fprintf(stderr, "No variables to write to %s, use --monitor\n", variableFile.c_str());
+        return 1;
+    }
+
+    std::string source;
+    if (!readFile(files[0].c_str(), source))
+    {
+        fprintf(stderr, "Cannot read %s\n", files[0].c_str());
+        return 1;
+    }
+
+    // the sample rate is part of the compiled program.
+    // in batch mode all files must have the rate of the first.
+    const float sampleRate = Renderer::getFileSamplerate(files[1]);
+    if (sampleRate <= 0.0f)
+    {
+        fprintf(stderr, "Cannot read %s, only stereo PCM or float .wav files are supported\n",
+                files[1].c_str());
+        return 1;
+    }
+
+    Renderer renderer;
+    RenderScript script;
+    if (!renderer.compile(source, sampleRate, monitored, fastMath, script))
+    {
+        fprintf(stderr, "%s: %s\n", files[0].c_str(), renderer.getError().c_str());
+        return 1;
+    }
+
+    if (sweepMode)
+    {
+        // the sweep runs the register byte code in lanes
+        return renderSweep(script, sweeps, sliders, setSeed, seed, files[1], files[2]);
+    }
+
+    if (batchMode || splitMode)
+    {
+        // the script is compiled once and shared by all workers
+        BatchRenderer batch(jobs);
+        if (!batch.load(script))
+        {
+            fprintf(stderr, "%s: %s\n", files[0].c_str(), batch.getError().c_str());
+            return 1;
+        }
+        batch.setEngine(engine);
+        for(uint32_t k=0; k<4; k++)
+        {
+            batch.setSlider(k, sliders[k]);
+        }
+        if (setSeed)
+        {
+            batch.setNoiseSeed(seed);
+        }
+        if (splitMode)
+        {
+            return renderSplit(batch, script, files[1], files[2], settleTime);
+        }
+        return renderBatch(batch, std::vector<std::string>(files.begin()+1, files.end()),
+                           batchDirectory, !monitored.empty());
+    }
+
+    if (!renderer.load(script))
+    {
+        fprintf(stderr, "%s: %s\n", files[0].c_str(), renderer.getError().c_str());
+        return 1;
+    }
+
+    renderer.setEngine(engine);
+    for(uint32_t k=0; k<4; k++)
+    {
+        renderer.setSlider(k, sliders[k]);
+    }
+    if (setSeed)
+    {
+        renderer.setNoiseSeed(seed);
+    }
+
+    renderstats_t stats;
+    if (!renderer.render(files[1], files[2], variableFile, stats))
+    {
+        fprintf(stderr, "%s\n", renderer.getError().c_str());
+        return 1;
+    }
+
+    printf("Rendered %.2f s of audio in %.3f s, %.1fx real time\n",
+           stats.audioTime, stats.renderTime, stats.getRealtimeFactor());
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+
+  Description:  Polyphase sample rate converter.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "resampler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define RESAMPLER_SSE
+#include <xmmintrin.h>
+#endif
+
+// stop band attenuation of the filter (in dB)
+#define RESAMPLER_ATTENUATION   70.0
+
+/** greatest common divisor */
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while(b != 0)
+    {
+        const uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/** modified Bessel function of the first kind, order 0 */
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(uint32_t k=1; k<50; k++)
+    {
+        term *= (0.5*x/k)*(0.5*x/k);
+        sum += term;
+        if (term < 1e-12*sum)
+            break;
+    }
+    return sum;
+}
+
+#ifdef RESAMPLER_SSE
+/** sum of the four elements of a vector */
+static inline float horizontalSum(__m128 v)
+{
+    __m128 high = _mm_movehl_ps(v, v);
+    v = _mm_add_ps(v, high);
+    high = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1));
+    v = _mm_add_ss(v, high);
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+/** the dot products of 'c' with 'a' and with 'b',
+    which share the loads of the coefficients */
+static inline void dotProduct2(const float *a, const float *b, const float *c, uint32_t n,
+                               float &sumA, float &sumB)
+{
+    uint32_t i = 0;
+#ifdef RESAMPLER_SSE
+    __m128 accA0 = _mm_setzero_ps();
+    __m128 accA1 = _mm_setzero_ps();
+    __m128 accB0 = _mm_setzero_ps();
+    __m128 accB1 = _mm_setzero_ps();
+    for(; i+8 <= n; i+=8)
+    {
+        const __m128 c0 = _mm_loadu_ps(c+i);
+        const __m128 c1 = _mm_loadu_ps(c+i+4);
+        accA0 = _mm_add_ps(accA0, _mm_mul_ps(_mm_loadu_ps(a+i), c0));
+        accA1 = _mm_add_ps(accA1, _mm_mul_ps(_mm_loadu_ps(a+i+4), c1));
+        accB0 = _mm_add_ps(accB0, _mm_mul_ps(_mm_loadu_ps(b+i), c0));
+        accB1 = _mm_add_ps(accB1, _mm_mul_ps(_mm_loadu_ps(b+i+4), c1));
+    }
+    if (i+4 <= n)
+    {
+        const __m128 c0 = _mm_loadu_ps(c+i);
+        accA0 = _mm_add_ps(accA0, _mm_mul_ps(_mm_loadu_ps(a+i), c0));
+        accB0 = _mm_add_ps(accB0, _mm_mul_ps(_mm_loadu_ps(b+i), c0));
+        i += 4;
+    }
+    float sa = horizontalSum(_mm_add_ps(accA0, accA1));
+    float sb = horizontalSum(_mm_add_ps(accB0, accB1));
+#else
+    // independent partial sums, which compilers
+    // turn into vector code.
+    float accA[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float accB[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for(; i+4 <= n; i+=4)
+    {
+        for(uint32_t k=0; k<4; k++)
+        {
+            accA[k] += a[i+k]*c[i+k];
+            accB[k] += b[i+k]*c[i+k];
+        }
+    }
+    float sa = (accA[0] + accA[2]) + (accA[1] + accA[3]);
+    float sb = (accB[0] + accB[2]) + (accB[1] + accB[3]);
+#endif
+    for(; i<n; i++)
+    {
+        sa += a[i]*c[i];
+        sb += b[i]*c[i];
+    }
+    sumA = sa;
+    sumB = sb;
+}
+
+Resampler::Resampler()
+    : m_up(1),
+      m_down(1),
+      m_step(1),
+      m_stepPhase(0),
+      m_taps(1)
+{
+    m_coefficients.assign(1, 1.0f);
+    reset();
+}
+
+bool Resampler::isSupported(uint32_t inRate, uint32_t outRate)
+{
+    if ((inRate == 0) || (outRate == 0))
+        return false;
+
+    const uint32_t lower = std::min(inRate, outRate);
+    const uint32_t higher = std::max(inRate, outRate);
+    if (higher > lower*RESAMPLER_MAXRATIO)
+        return false;
+
+    return (outRate / gcd(inRate, outRate)) <= RESAMPLER_MAXPHASES;
+}
+
+bool Resampler::setup(uint32_t inRate, uint32_t outRate)
+{
+    if (!isSupported(inRate, outRate))
+        return false;
+
+    const uint32_t divisor = gcd(inRate, outRate);
+    m_up = outRate / divisor;
+    m_down = inRate / divisor;
+    m_step = m_down / m_up;
+    m_stepPhase = m_down % m_up;
+
+    // the prototype filter runs at m_up times the input
+    // rate. its frequencies are in cycles per sample.
+    const double prototypeRate = (double)m_up * inRate;
+    const double lower = std::min(inRate, outRate);
+    const double cutoff = 0.45*lower / prototypeRate;
+    const double transition = 0.1*lower / prototypeRate;
+
+    // Kaiser's estimates of the length and the window shape
+    const double A = RESAMPLER_ATTENUATION;
+    const double beta = 0.1102*(A - 8.7);
+    const uint32_t length = (uint32_t)ceil((A - 7.95)/(14.36*transition)) + 1;
+    m_taps = (length + m_up - 1) / m_up;
+
+    const uint32_t N = m_up*m_taps;
+    const double centre = 0.5*(N - 1);
+    const double norm = besselI0(beta);
+    std::vector<double> h(N);
+    for(uint32_t i=0; i<N; i++)
+    {
+        const double t = i - centre;
+        const double x = 2.0*cutoff*t;
+        const double sinc = (std::fabs(x) < 1e-12) ? 1.0 : sin(M_PI*x)/(M_PI*x);
+        const double r = t / (0.5*N);
+        const double window = besselI0(beta*sqrt(std::max(0.0, 1.0 - r*r))) / norm;
+
+        // the gain of m_up makes up for the zeros
+        // inserted by the upsampling.
+        h[i] = m_up*2.0*cutoff*sinc*window;
+    }
+
+    // output k is the sum of h[p + j*m_up]*x[n-j], so
+    // phase p takes every m_up'th tap, reversed to
+    // match the history.
+    m_coefficients.resize(N);
+    for(uint32_t p=0; p<m_up; p++)
+    {
+        for(uint32_t j=0; j<m_taps; j++)
+        {
+            m_coefficients[p*m_taps + (m_taps-1-j)] = (float)h[p + j*m_up];
+        }
+    }
+
+    reset();
+    return true;
+}
+
+void Resampler::reset()
+{
+    for(uint32_t c=0; c<2; c++)
+    {
+        m_history[c].assign(m_taps - 1 + RESAMPLER_CHUNK, 0.0f);
+    }
+    m_phase = 0;
+    m_next = 0;
+}
+
+uint32_t Resampler::process(const float *inLeft, const float *inRight, uint32_t samples,
+                            float *outLeft, float *outRight)
+{
+    uint32_t produced = 0;
+    while(samples > 0)
+    {
+        const uint32_t n = std::min(samples, (uint32_t)RESAMPLER_CHUNK);
+        float *left = &m_history[0][0];
+        float *right = &m_history[1][0];
+        memcpy(left + m_taps - 1, inLeft, n*sizeof(float));
+        memcpy(right + m_taps - 1, inRight, n*sizeof(float));
+
+        // output k uses input floor(k*M/L), with
+        // phase (k*M) mod L.
+        while(m_next < n)
+        {
+            dotProduct2(left + m_next, right + m_next, &m_coefficients[m_phase*m_taps], m_taps,
+                        outLeft[produced], outRight[produced]);
+            produced++;
+
+            // advance by M/L inputs without a division
+            m_next += m_step;
+            m_phase += m_stepPhase;
+            if (m_phase >= m_up)
+            {
+                m_phase -= m_up;
+                m_next++;
+            }
+        }
+
+        // keep the last m_taps-1 inputs
+        memmove(left, left + n, (m_taps - 1)*sizeof(float));
+        memmove(right, right + n, (m_taps - 1)*sizeof(float));
+        m_next -= n;
+        inLeft += n;
+        inRight += n;
+        samples -= n;
+    }
+    return produced;
+}
@@ -0,0 +1,96 @@
+/*
+
+  Description:  Polyphase sample rate converter between
+                the soundcard and a program that runs at
+                a lower virtual sample rate.
+
+                The rates are converted by the ratio L/M of
+                two integers: the input is conceptually
+                upsampled by L, low-pass filtered and
+                downsampled by M. Only the outputs that are
+                kept are calculated, each from one of the L
+                phases of the filter, so every output costs
+                a single dot product of getTaps() taps.
+
+                The low-pass filter is a Kaiser windowed
+                sinc with its pass band up to 0.4 times and
+                its stop band from 0.5 times the lower of
+                the two rates, with 70 dB attenuation.
+
+  License: GPLv2
+
+*/
+
+#ifndef resampler_h
+#define resampler_h
+
+#include <stdint.h>
+#include <vector>
+
+// largest ratio between the two rates
+#define RESAMPLER_MAXRATIO      16
+
+// largest number of filter phases, the rates divided
+// by their greatest common divisor
+#define RESAMPLER_MAXPHASES     512
+
+// number of input samples that are filtered at a time
+#define RESAMPLER_CHUNK         256
+
+class Resampler
+{
+public:
+    Resampler();
+
+    /** true if a stream can be converted from
+        'inRate' to 'outRate' (in Hz) */
+    static bool isSupported(uint32_t inRate, uint32_t outRate);
+
+    /** design the filter for a conversion from
+        'inRate' to 'outRate' (in Hz) and reset
+        the state. false if the conversion is not
+        supported. */
+    bool setup(uint32_t inRate, uint32_t outRate);
+
+    /** clear the history of both channels */
+    void reset();
+
+    /** largest number of outputs that 'samples'
+        inputs can produce */
+    uint32_t getMaxOutput(uint32_t samples) const
+    {
+        return (uint32_t)(((uint64_t)samples*m_up + m_down - 1) / m_down) + 1;
+    }
+
+    /** number of filter taps per output sample */
+    uint32_t getTaps() const
+    {
+        return m_taps;
+    }
+
+    /** convert the samples of two channels. the output
+        arrays must hold getMaxOutput(samples) samples.
+        returns the number of output samples. */
+    uint32_t process(const float *inLeft, const float *inRight, uint32_t samples,
+                     float *outLeft, float *outRight);
+
+protected:
+    uint32_t    m_up;           // L, the upsampling factor
+    uint32_t    m_down;         // M, the downsampling factor
+    uint32_t    m_step;         // M/L, inputs from one output to the next
+    uint32_t    m_stepPhase;    // M mod L, the change of the filter phase
+    uint32_t    m_taps;         // taps per phase
+
+    /** the coefficients of phase p are at p*m_taps,
+        in the order of the history, oldest first */
+    std::vector<float> m_coefficients;
+
+    /** the last m_taps-1 inputs, followed by the
+        inputs of the current chunk, oldest first */
+    std::vector<float> m_history[2];
+
+    uint32_t    m_phase;        // filter phase of the next output
+    uint32_t    m_next;         // input of the next output, relative to the chunk
+};
+
+#endif
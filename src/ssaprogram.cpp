@@ -0,0 +1,834 @@
+/*
+
+  Description:  Static single assignment form of a parsed
+                program, used to optimize the program
+                between the parser and the code generators.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "functiondefs.h"
+#include "vmfunctions.h"
+#include "ssaprogram.h"
+
+// largest integer exponent of pow() that is
+// replaced by multiplications
+#define SSA_MAXPOWER 4
+
+SSAProgram::SSAProgram()
+{
+}
+
+bool SSAProgram::build(const ParseContext &context, float samplerate)
+{
+    m_values.clear();
+    m_stores.clear();
+    m_valueNumbers.clear();
+    m_delayDefinitions.clear();
+    m_variables = context.m_variables;
+    m_current.assign(m_variables.size(), -1);
+
+    // the sample rate is a constant, unless
+    // the program assigns the variable itself.
+    int32_t rateIdx = VM::findVariableByName(m_variables, "samplerate");
+    const statements_t &statements = context.getStatements();
+    for(const ASTNode *node : statements)
+    {
+        if ((node != 0) && (node->m_type == ASTNode::NodeAssign) && (node->m_varIdx == rateIdx))
+            rateIdx = -1;
+    }
+    if (rateIdx >= 0)
+    {
+        m_current[rateIdx] = addConstant(samplerate);
+    }
+
+    for(const ASTNode *node : statements)
+    {
+        if (node == 0)
+            continue;
+
+        int32_t value = -1;
+        store_t store;
+        switch(node->m_type)
+        {
+        case ASTNode::NodeDelayDefinition:
+            m_delayDefinitions.push_back(node->m_varIdx);
+            break;
+        case ASTNode::NodeAssign:
+            if ((node->m_varIdx < 0) || (!convertNode(node->right, value)))
+                return false;
+            store.opcode = P_writevar;
+            store.index = node->m_varIdx;
+            store.value = value;
+            m_stores.push_back(store);
+            m_current[node->m_varIdx] = value;
+            break;
+        case ASTNode::NodeDelayAssign:
+            if ((node->m_varIdx < 0) || (!convertNode(node->right, value)))
+                return false;
+            store.opcode = P_writedelay;
+            store.index = node->m_varIdx;
+            store.value = value;
+            m_stores.push_back(store);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SSAProgram::convertNode(const ASTNode *node, int32_t &result)
+{
+    if (node == 0)
+        return false;
+
+    int32_t args[3] = {-1,-1,-1};
+    switch(node->m_type)
+    {
+    default:
+    case ASTNode::NodeUnknown:
+        return false;
+    case ASTNode::NodeFloat:
+        result = addConstant(node->m_literalFloat);
+        return true;
+    case ASTNode::NodeInteger:
+        result = addConstant(node->m_literalInt);
+        return true;
+    case ASTNode::NodeIdent:
+        if (node->m_varIdx < 0)
+            return false;
+        if (m_current[node->m_varIdx] < 0)
+        {
+            // the value of the variable at the start of the program
+            m_current[node->m_varIdx] = addValue(P_readvar, node->m_varIdx, 0.0f);
+        }
+        result = m_current[node->m_varIdx];
+        return true;
+    case ASTNode::NodeDelayLookup:
+        if ((node->m_varIdx < 0) || (!convertNode(node->left, args[0])))
+            return false;
+        result = addValue(P_readdelay, node->m_varIdx, 0.0f, args[0]);
+        return true;
+    case ASTNode::NodeFIR:
+        if ((node->m_varIdx < 0) || (!convertNode(node->left, args[0])))
+            return false;
+        result = addValue(P_fir, node->m_varIdx, 0.0f, args[0]);
+        return true;
+    case ASTNode::NodeBiquad:
+        if ((node->m_varIdx < 0) || (!convertNode(node->left, args[0])))
+            return false;
+        result = addValue(P_biquad, node->m_varIdx, 0.0f, args[0]);
+        return true;
+    case ASTNode::NodeAdd:
+    case ASTNode::NodeSub:
+    case ASTNode::NodeMul:
+    case ASTNode::NodeDiv:
+    {
+        if ((!convertNode(node->left, args[0])) || (!convertNode(node->right, args[1])))
+            return false;
+
+        uint32_t opcode = P_add;
+        if (node->m_type == ASTNode::NodeSub) opcode = P_sub;
+        if (node->m_type == ASTNode::NodeMul) opcode = P_mul;
+        if (node->m_type == ASTNode::NodeDiv) opcode = P_div;
+        result = addValue(opcode, 0, 0.0f, args[0], args[1]);
+        return true;
+    }
+    case ASTNode::NodeUnaryMinus:
+        if (!convertNode(node->right, args[0]))
+            return false;
+        result = addValue(P_neg, 0, 0.0f, args[0]);
+        return true;
+    case ASTNode::NodeFunction:
+    {
+        const uint32_t nargs = node->m_functionArgs.size();
+        if ((nargs > 3) || (functionDefs::getNumberOfArguments(node->m_functionID) != (int32_t)nargs))
+            return false;
+
+        for(uint32_t i=0; i<nargs; i++)
+        {
+            if (!convertNode(node->m_functionArgs[i], args[i]))
+                return false;
+        }
+        result = addValue(node->m_functionID, 0, 0.0f, args[0], args[1], args[2]);
+        return true;
+    }
+    } // end switch
+}
+
+int32_t SSAProgram::addConstant(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    key_t key(2);
+    key[0] = P_literal;
+    key[1] = bits;
+    auto iter = m_valueNumbers.find(key);
+    if (iter != m_valueNumbers.end())
+        return iter->second;
+
+    value_t v;
+    v.opcode = P_literal;
+    v.index = 0;
+    v.value = value;
+    v.args[0] = -1;
+    v.args[1] = -1;
+    v.args[2] = -1;
+    m_values.push_back(v);
+    m_valueNumbers[key] = (int32_t)m_values.size()-1;
+    return (int32_t)m_values.size()-1;
+}
+
+int32_t SSAProgram::addValue(uint32_t opcode, uint32_t index, float value,
+                             int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    if (opcode == P_literal)
+        return addConstant(value);
+
+    const bool pure = isPure(opcode);
+    if (pure)
+    {
+        // constant folding, with the same functions
+        // that evaluate the operation at run time.
+        const int32_t nargs = getNumberOfArguments(opcode);
+        const int32_t args[3] = {arg0, arg1, arg2};
+        float constants[3] = {0.0f, 0.0f, 0.0f};
+        bool allConstant = true;
+        for(int32_t k=0; k<nargs; k++)
+        {
+            if (isConstant(args[k]))
+                constants[k] = m_values[args[k]].value;
+            else
+                allConstant = false;
+        }
+        if (allConstant)
+            return addConstant(evaluate(opcode, constants));
+
+        // algebraic simplification and strength reduction.
+        // only rules that give the same result for all
+        // inputs, or that are explicitly accepted, are used.
+        switch(opcode)
+        {
+        case P_add:
+        case P_mul:
+            // commutative: constants go to the right,
+            // other operands are ordered by value number
+            // so a+b and b+a are shared.
+            if (isConstant(arg0) || ((!isConstant(arg1)) && (arg0 > arg1)))
+                std::swap(arg0, arg1);
+            if ((opcode == P_mul) && isConstant(arg1))
+            {
+                if (m_values[arg1].value == 1.0f)
+                    return arg0;
+
+                // (x*c1)*c2 becomes x*(c1*c2), so constant
+                // factors such as 2*pi are folded.
+                const value_t &inner = m_values[arg0];
+                if ((inner.opcode == P_mul) && isConstant(inner.args[1]))
+                {
+                    const float c = m_values[inner.args[1]].value * m_values[arg1].value;
+                    return addValue(P_mul, 0, 0.0f, inner.args[0], addConstant(c));
+                }
+            }
+            break;
+        case P_sub:
+            // x - (+0) is x, also for x = -0
+            if (isConstant(arg1) && (m_values[arg1].value == 0.0f) && (!std::signbit(m_values[arg1].value)))
+                return arg0;
+            break;
+        case P_div:
+            if (isConstant(arg1))
+            {
+                // division by a constant becomes a multiplication
+                // by its reciprocal. This is exact for powers of
+                // two and may differ by one ulp otherwise.
+                const float c = m_values[arg1].value;
+                const float r = 1.0f/c;
+                if (std::isnormal(c) && std::isnormal(r))
+                    return addValue(P_mul, 0, 0.0f, arg0, addConstant(r));
+            }
+            break;
+        case P_neg:
+            if (m_values[arg0].opcode == P_neg)
+                return m_values[arg0].args[0];
+            break;
+        case P_pow:
+        case P_fastpow:
+            if (isConstant(arg1))
+            {
+                // pow() with a small integer exponent becomes
+                // multiplications. pow(x,0) is left alone, as
+                // dropping x would also drop calls to noise().
+                const float e = m_values[arg1].value;
+                const int32_t n = (int32_t)std::fabs(e);
+                if ((e == std::trunc(e)) && (n >= 1) && (n <= SSA_MAXPOWER))
+                {
+                    int32_t result = arg0;
+                    if (n == 2) result = addValue(P_mul, 0, 0.0f, arg0, arg0);
+                    if (n == 3) result = addValue(P_mul, 0, 0.0f, addValue(P_mul, 0, 0.0f, arg0, arg0), arg0);
+                    if (n == 4)
+                    {
+                        const int32_t sqr = addValue(P_mul, 0, 0.0f, arg0, arg0);
+                        result = addValue(P_mul, 0, 0.0f, sqr, sqr);
+                    }
+                    if (e < 0.0f)
+                        result = addValue(P_div, 0, 0.0f, addConstant(1.0f), result);
+                    return result;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        // common subexpression elimination
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        key_t key(6);
+        key[0] = opcode;
+        key[1] = index;
+        key[2] = bits;
+        key[3] = arg0;
+        key[4] = arg1;
+        key[5] = arg2;
+        auto iter = m_valueNumbers.find(key);
+        if (iter != m_valueNumbers.end())
+            return iter->second;
+        m_valueNumbers[key] = (int32_t)m_values.size();
+    }
+
+    value_t v;
+    v.opcode = opcode;
+    v.index = index;
+    v.value = value;
+    v.args[0] = arg0;
+    v.args[1] = arg1;
+    v.args[2] = arg2;
+    m_values.push_back(v);
+    return (int32_t)m_values.size()-1;
+}
+
+bool SSAProgram::isPure(uint32_t opcode)
+{
+    if ((opcode >= P_add) && (opcode <= P_neg))
+        return true;
+
+    // the noise functions return a different value every
+    // call, delay lines and variables change between reads.
+    if ((opcode == P_noise) || (opcode == P_gaussnoise) || (opcode == P_pinknoise))
+        return false;
+    return (functionDefs::getNumberOfArguments(opcode) >= 0);
+}
+
+int32_t SSAProgram::getNumberOfArguments(uint32_t opcode)
+{
+    switch(opcode)
+    {
+    case P_add:
+    case P_sub:
+    case P_mul:
+    case P_div:
+        return 2;
+    case P_neg:
+    case P_readdelay:
+    case P_fir:
+    case P_biquad:
+        return 1;
+    case P_literal:
+    case P_readvar:
+        return 0;
+    default:
+        return functionDefs::getNumberOfArguments(opcode);
+    }
+}
+
+float SSAProgram::evaluate(uint32_t opcode, const float *args)
+{
+    switch(opcode)
+    {
+    case P_add:     return args[0] + args[1];
+    case P_sub:     return args[0] - args[1];
+    case P_mul:     return args[0] * args[1];
+    case P_div:     return args[0] / args[1];
+    case P_neg:     return -args[0];
+    case P_sin:     return VM::funcSin(args[0]);
+    case P_cos:     return VM::funcCos(args[0]);
+    case P_sin1:    return VM::funcSin1(args[0]);
+    case P_cos1:    return VM::funcCos1(args[0]);
+    case P_mod1:    return VM::funcMod1(args[0]);
+    case P_abs:     return VM::funcAbs(args[0]);
+    case P_round:   return VM::funcRound(args[0]);
+    case P_sqrt:    return VM::funcSqrt(args[0]);
+    case P_tan:     return VM::funcTan(args[0]);
+    case P_tanh:    return VM::funcTanh(args[0]);
+    case P_pow:     return VM::funcPow(args[0], args[1]);
+    case P_limit:   return VM::funcLimit(args[0]);
+    case P_atan2:   return VM::funcAtan2(args[0], args[1]);
+    case P_sign:    return VM::funcSign(args[0]);
+    case P_trunc:   return VM::funcTrunc(args[0]);
+    case P_ceil:    return VM::funcCeil(args[0]);
+    case P_floor:   return VM::funcFloor(args[0]);
+    case P_choose:  return VM::funcChoose(args[0], args[1], args[2]);
+    case P_fastsin:     return VM::fastSin(args[0]);
+    case P_fastcos:     return VM::fastCos(args[0]);
+    case P_fastsin1:    return VM::fastSin1(args[0]);
+    case P_fastcos1:    return VM::fastCos1(args[0]);
+    case P_fasttan:     return VM::fastTan(args[0]);
+    case P_fasttanh:    return VM::fastTanh(args[0]);
+    case P_fastpow:     return VM::fastPow(args[0], args[1]);
+    case P_fastatan2:   return VM::fastAtan2(args[0], args[1]);
+    default:
+        return 0.0f;
+    }
+}
+
+// ********************************************************************************
+//   code generation
+// ********************************************************************************
+
+bool SSAProgram::generate(ParseContext &context, const std::vector<std::string> &monitored) const
+{
+    std::vector<bool> live;
+    findLiveStores(monitored, live);
+
+    context.m_variables = m_variables;
+
+    generator_t gen;
+    gen.variables = &context.m_variables;
+    gen.context = &context;
+    gen.holds.assign(m_variables.size(), -1);
+    gen.remaining.assign(m_values.size(), 0);
+
+    // at the start of the program, each variable
+    // holds its value from the previous sample.
+    const size_t N = m_values.size();
+    for(size_t v=0; v<N; v++)
+    {
+        if (m_values[v].opcode == P_readvar)
+            gen.holds[m_values[v].index] = (int32_t)v;
+    }
+
+    countUses(live, gen.remaining);
+
+    gen.lastWrite.assign(m_variables.size(), -1);
+    for(size_t i=0; i<m_stores.size(); i++)
+    {
+        if (m_stores[i].opcode == P_writedelay)
+            gen.lastWrite[m_stores[i].index] = (int32_t)i;
+    }
+
+    for(int32_t delay : m_delayDefinitions)
+    {
+        ASTNode *node = new ASTNode(ASTNode::NodeDelayDefinition);
+        node->m_varIdx = delay;
+        context.addStatement(node);
+    }
+
+    const size_t S = m_stores.size();
+    std::vector<bool> visited(N, false);
+    for(size_t i=0; i<S; i++)
+    {
+        const store_t &store = m_stores[i];
+        if (!live[i])
+        {
+            if (!keepSideEffects(gen, store.value, (int32_t)i, visited))
+                return false;
+            continue;
+        }
+
+        // a variable holds the value it is assigned, the
+        // value written to a delay line goes to a temporary
+        // if it is needed again.
+        ASTNode *expr = buildTree(gen, store.value, store.opcode == P_writevar);
+        if (expr == 0)
+            return false;
+
+        ASTNode *node;
+        if (store.opcode == P_writevar)
+        {
+            // the value the variable held so far must be
+            // kept in a temporary if it is needed later
+            // and no other variable holds it.
+            const int32_t old = gen.holds[store.index];
+            gen.holds[store.index] = -1;
+            if ((old >= 0) && (old != store.value) && (gen.remaining[old] > 0)
+                && (!isConstant(old)) && (findHolder(gen, old) < 0))
+            {
+                const int32_t tmp = createTemporary(gen);
+                ASTNode *copy = new ASTNode(ASTNode::NodeAssign);
+                copy->m_varIdx = tmp;
+                copy->right = new ASTNode(ASTNode::NodeIdent);
+                copy->right->m_varIdx = store.index;
+                context.addStatement(copy);
+                gen.holds[tmp] = old;
+            }
+
+            node = new ASTNode(ASTNode::NodeAssign);
+            gen.holds[store.index] = store.value;
+        }
+        else
+        {
+            node = new ASTNode(ASTNode::NodeDelayAssign);
+        }
+        node->m_varIdx = store.index;
+        node->right = expr;
+        context.addStatement(node);
+    }
+    return true;
+}
+
+void SSAProgram::findLiveStores(const std::vector<std::string> &monitored, std::vector<bool> &live) const
+{
+    // the last store to each variable determines
+    // the value it has at the end of the program.
+    std::vector<int32_t> lastStore(m_variables.size(), -1);
+    const size_t S = m_stores.size();
+    for(size_t i=0; i<S; i++)
+    {
+        if (m_stores[i].opcode == P_writevar)
+            lastStore[m_stores[i].index] = (int32_t)i;
+    }
+
+    // delay lines are always written, as the writes
+    // also advance the delay line.
+    std::vector<int32_t> work;
+    live.assign(S, false);
+    for(size_t i=0; i<S; i++)
+    {
+        if (m_stores[i].opcode == P_writedelay)
+        {
+            live[i] = true;
+            work.push_back((int32_t)i);
+        }
+    }
+
+    std::vector<std::string> roots = monitored;
+    roots.push_back("out");
+    roots.push_back("outl");
+    roots.push_back("outr");
+    for(const std::string &name : roots)
+    {
+        const int32_t idx = VM::findVariableByName(m_variables, name);
+        if ((idx >= 0) && (lastStore[idx] >= 0) && (!live[lastStore[idx]]))
+        {
+            live[lastStore[idx]] = true;
+            work.push_back(lastStore[idx]);
+        }
+    }
+
+    // a value that reads a variable at the start of
+    // the program needs the value that variable had
+    // at the end of the previous sample.
+    std::vector<bool> needed(m_values.size(), false);
+    std::vector<int32_t> values;
+    while(!work.empty())
+    {
+        values.push_back(m_stores[work.back()].value);
+        work.pop_back();
+        while(!values.empty())
+        {
+            const int32_t v = values.back();
+            values.pop_back();
+            if (needed[v])
+                continue;
+
+            needed[v] = true;
+            const value_t &val = m_values[v];
+            if ((val.opcode == P_readvar) && (lastStore[val.index] >= 0) && (!live[lastStore[val.index]]))
+            {
+                live[lastStore[val.index]] = true;
+                work.push_back(lastStore[val.index]);
+            }
+            for(uint32_t k=0; k<3; k++)
+            {
+                if (val.args[k] >= 0)
+                    values.push_back(val.args[k]);
+            }
+        }
+    }
+}
+
+void SSAProgram::countUses(const std::vector<bool> &live, std::vector<int32_t> &uses) const
+{
+    // arguments always have a lower value
+    // number than the values that use them.
+    const size_t N = m_values.size();
+    uses.assign(N, 0);
+    for(size_t i=0; i<m_stores.size(); i++)
+    {
+        if (live[i])
+            uses[m_stores[i].value]++;
+    }
+    for(size_t v=N; v>0; v--)
+    {
+        if (uses[v-1] == 0)
+            continue;
+        for(uint32_t k=0; k<3; k++)
+        {
+            const int32_t arg = m_values[v-1].args[k];
+            if (arg >= 0)
+                uses[arg]++;
+        }
+    }
+}
+
+bool SSAProgram::hasSideEffects(uint32_t opcode)
+{
+    switch(opcode)
+    {
+    case P_readdelay:
+    case P_fir:
+    case P_biquad:
+    case P_noise:
+    case P_gaussnoise:
+    case P_pinknoise:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool SSAProgram::keepSideEffects(generator_t &gen, int32_t v, int32_t store, std::vector<bool> &visited) const
+{
+    if (visited[v] || isConstant(v) || (findHolder(gen, v) >= 0))
+        return true;
+    visited[v] = true;
+
+    // a noise call is kept even if its value is not used,
+    // so the later calls get the same noise. A delay line
+    // read only moves if the line is not written later.
+    const value_t &val = m_values[v];
+    bool keep = hasSideEffects(val.opcode) && (gen.remaining[v] > 0);
+    if (val.opcode == P_readdelay)
+        keep = keep && (gen.lastWrite[val.index] > store);
+    if ((val.opcode == P_noise) || (val.opcode == P_gaussnoise) || (val.opcode == P_pinknoise))
+        keep = true;
+
+    if (keep)
+    {
+        ASTNode *op = buildOperation(gen, v);
+        if (op == 0)
+            return false;
+
+        const int32_t tmp = createTemporary(gen);
+        ASTNode *assign = new ASTNode(ASTNode::NodeAssign);
+        assign->m_varIdx = tmp;
+        assign->right = op;
+        gen.context->addStatement(assign);
+        gen.holds[tmp] = v;
+        return true;
+    }
+
+    for(uint32_t k=0; k<3; k++)
+    {
+        if ((val.args[k] >= 0) && (!keepSideEffects(gen, val.args[k], store, visited)))
+            return false;
+    }
+    return true;
+}
+
+int32_t SSAProgram::findHolder(const generator_t &gen, int32_t v)
+{
+    const size_t N = gen.holds.size();
+    for(size_t i=0; i<N; i++)
+    {
+        if (gen.holds[i] == v)
+            return (int32_t)i;
+    }
+    return -1;
+}
+
+int32_t SSAProgram::createTemporary(generator_t &gen)
+{
+    // temporaries are numbered from 0 in the
+    // order they are created.
+    uint32_t n = 0;
+    while(VM::findVariableByName(*gen.variables, "_t" + std::to_string(n)) >= 0)
+        n++;
+
+    varInfo info;
+    info.m_name = "_t" + std::to_string(n);
+    gen.variables->push_back(info);
+    gen.holds.push_back(-1);
+    return (int32_t)gen.variables->size()-1;
+}
+
+ASTNode* SSAProgram::buildTree(generator_t &gen, int32_t v, bool root) const
+{
+    const value_t &val = m_values[v];
+    gen.remaining[v]--;
+
+    if (val.opcode == P_literal)
+    {
+        ASTNode *node = new ASTNode(ASTNode::NodeFloat);
+        node->m_literalFloat = val.value;
+        return node;
+    }
+
+    const int32_t holder = findHolder(gen, v);
+    if (holder >= 0)
+    {
+        ASTNode *node = new ASTNode(ASTNode::NodeIdent);
+        node->m_varIdx = holder;
+        return node;
+    }
+
+    // a value needed again later is computed once
+    // into a temporary, unless it is assigned to a
+    // variable anyway.
+    if ((!root) && (gen.remaining[v] > 0))
+    {
+        ASTNode *op = buildOperation(gen, v);
+        if (op == 0)
+            return 0;
+
+        const int32_t tmp = createTemporary(gen);
+        ASTNode *assign = new ASTNode(ASTNode::NodeAssign);
+        assign->m_varIdx = tmp;
+        assign->right = op;
+        gen.context->addStatement(assign);
+        gen.holds[tmp] = v;
+
+        ASTNode *node = new ASTNode(ASTNode::NodeIdent);
+        node->m_varIdx = tmp;
+        return node;
+    }
+    return buildOperation(gen, v);
+}
+
+ASTNode* SSAProgram::buildOperation(generator_t &gen, int32_t v) const
+{
+    const value_t &val = m_values[v];
+
+    ASTNode *args[3] = {0,0,0};
+    const int32_t nargs = getNumberOfArguments(val.opcode);
+    for(int32_t k=0; k<nargs; k++)
+    {
+        args[k] = buildTree(gen, val.args[k], false);
+        if (args[k] == 0)
+        {
+            for(int32_t j=0; j<k; j++)
+                delete args[j];
+            return 0;
+        }
+    }
+
+    ASTNode *node = 0;
+    switch(val.opcode)
+    {
+    case P_readvar:
+        // the variable was overwritten while its
+        // old value was still needed.
+        return 0;
+    case P_readdelay:
+        node = new ASTNode(ASTNode::NodeDelayLookup);
+        node->m_varIdx = val.index;
+        node->left = args[0];
+        return node;
+    case P_fir:
+        node = new ASTNode(ASTNode::NodeFIR);
+        node->m_varIdx = val.index;
+        node->left = args[0];
+        return node;
+    case P_biquad:
+        node = new ASTNode(ASTNode::NodeBiquad);
+        node->m_varIdx = val.index;
+        node->left = args[0];
+        return node;
+    case P_add:
+    case P_sub:
+    case P_mul:
+    case P_div:
+    {
+        const ASTNode::node_t types[] = {ASTNode::NodeAdd, ASTNode::NodeSub, ASTNode::NodeMul, ASTNode::NodeDiv};
+        node = new ASTNode(types[val.opcode-P_add]);
+        node->left = args[0];
+        node->right = args[1];
+        return node;
+    }
+    case P_neg:
+        node = new ASTNode(ASTNode::NodeUnaryMinus);
+        node->right = args[0];
+        return node;
+    default:
+        node = new ASTNode(ASTNode::NodeFunction);
+        node->m_functionID = val.opcode;
+        for(int32_t k=0; k<nargs; k++)
+        {
+            node->m_functionArgs.push_back(args[k]);
+        }
+        return node;
+    }
+}
+
+void SSAProgram::dump(std::ostream &s) const
+{
+    s << "-- SSA PROGRAM --\n\n";
+
+    // values that were simplified away are not shown
+    std::vector<int32_t> uses;
+    countUses(std::vector<bool>(m_stores.size(), true), uses);
+
+    const size_t N = m_values.size();
+    for(size_t v=0; v<N; v++)
+    {
+        if (uses[v] == 0)
+            continue;
+
+        const value_t &val = m_values[v];
+        s << "%" << v << " = ";
+        switch(val.opcode)
+        {
+        case P_literal:
+            s << val.value;
+            break;
+        case P_readvar:
+            s << m_variables[val.index].m_name.c_str();
+            break;
+        case P_readdelay:
+            s << m_variables[val.index].m_name.c_str() << "[%" << val.args[0] << "]";
+            break;
+        case P_fir:
+        case P_biquad:
+            s << m_variables[val.index].m_name.c_str() << "(%" << val.args[0] << ")";
+            break;
+        case P_add: s << "%" << val.args[0] << " + %" << val.args[1]; break;
+        case P_sub: s << "%" << val.args[0] << " - %" << val.args[1]; break;
+        case P_mul: s << "%" << val.args[0] << " * %" << val.args[1]; break;
+        case P_div: s << "%" << val.args[0] << " / %" << val.args[1]; break;
+        case P_neg: s << "-%" << val.args[0]; break;
+        default:
+        {
+            for(uint32_t i=0; i<g_functionDefsLen; i++)
+            {
+                if (g_functionDefs[i].ID == val.opcode)
+                    s << g_functionDefs[i].name.c_str();
+            }
+            s << "(";
+            const int32_t nargs = getNumberOfArguments(val.opcode);
+            for(int32_t k=0; k<nargs; k++)
+            {
+                s << ((k == 0) ? "%" : ", %") << val.args[k];
+            }
+            s << ")";
+            break;
+        }
+        }
+        s << "\n";
+    }
+
+    s << "\n";
+    for(const store_t &store : m_stores)
+    {
+        s << m_variables[store.index].m_name.c_str();
+        if (store.opcode == P_writedelay)
+            s << "[]";
+        s << " = %" << store.value << "\n";
+    }
+}
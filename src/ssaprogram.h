@@ -0,0 +1,193 @@
+/*
+
+  Description:  Static single assignment form of a parsed
+                program, used to optimize the program
+                between the parser and the code generators.
+
+                While the AST is converted, every operation
+                becomes a value that is defined exactly once.
+                Variables map to the value they currently
+                hold, so reading a variable yields its last
+                assigned value, or its value at the start of
+                the program.
+
+                The values are simplified as they are added:
+                operations on constants are folded, identical
+                pure operations are shared (common
+                subexpression elimination across statements),
+                pow() with a small integer exponent becomes
+                multiplications and a division by a constant
+                becomes a multiplication by its reciprocal.
+
+                The optimized program is written back to a
+                ParseContext, so all code generators of
+                ASTToVM use it. Values that are needed more
+                than once are kept in temporary variables
+                named _t0, _t1, ...
+
+                Statements that do not affect the outputs,
+                the monitored variables or a delay line are
+                dropped when the program is written back.
+                Their noise calls and delay line reads that
+                are used later stay where they were.
+
+  License: GPLv2
+
+*/
+
+#ifndef ssaprogram_h
+#define ssaprogram_h
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <string>
+#include "parser.h"
+#include "vmtypes.h"
+
+class SSAProgram
+{
+public:
+    SSAProgram();
+
+    /** build the SSA form of a parsed program.
+        'samplerate' is the value of the samplerate
+        variable, which is folded into constants when
+        the program does not assign it.
+        returns false if the AST contains an unknown node. */
+    bool build(const ParseContext &context, float samplerate);
+
+    /** write the optimized program to an empty ParseContext.
+        Only statements that affect out, outl, outr, the
+        'monitored' variables or a delay line are written.
+        The program can be generated again for a different
+        set of monitored variables without building it. */
+    bool generate(ParseContext &context,
+                  const std::vector<std::string> &monitored = std::vector<std::string>()) const;
+
+    /** dump the (human readable) SSA form to an output stream */
+    void dump(std::ostream &s) const;
+
+    /** an SSA value.
+        The opcodes are the same as for the stack byte code.
+        P_literal is a constant, P_readvar is the value a
+        variable has at the start of the program, P_readdelay
+        reads delay line 'index' at the offset in args[0].
+    */
+    struct value_t
+    {
+        uint32_t    opcode;
+        uint32_t    index;      // variable or delay index
+        float       value;      // value of P_literal
+        int32_t     args[3];    // argument values, unused ones are -1
+    };
+
+    /** an assignment to a variable (P_writevar)
+        or a delay line (P_writedelay) */
+    struct store_t
+    {
+        uint32_t    opcode;
+        uint32_t    index;      // variable or delay index
+        int32_t     value;      // value that is stored
+    };
+
+    const std::vector<value_t>& getValues() const
+    {
+        return m_values;
+    }
+
+    const std::vector<store_t>& getStores() const
+    {
+        return m_stores;
+    }
+
+protected:
+    /** convert an expression to SSA values.
+        the resulting value is returned in 'result'. */
+    bool convertNode(const ASTNode *node, int32_t &result);
+
+    /** add a value, or return an existing or simplified
+        equivalent of it */
+    int32_t addValue(uint32_t opcode, uint32_t index, float value,
+                     int32_t arg0 = -1, int32_t arg1 = -1, int32_t arg2 = -1);
+
+    /** add a constant value */
+    int32_t addConstant(float value);
+
+    /** returns true if value v is a constant */
+    bool isConstant(int32_t v) const
+    {
+        return m_values[v].opcode == P_literal;
+    }
+
+    /** returns true if the operation has no side effects and
+        only depends on its arguments */
+    static bool isPure(uint32_t opcode);
+
+    /** evaluate a pure operation on constant arguments */
+    static float evaluate(uint32_t opcode, const float *args);
+
+    /** number of arguments of an operation */
+    static int32_t getNumberOfArguments(uint32_t opcode);
+
+    /** state of the code generator */
+    struct generator_t
+    {
+        std::vector<int32_t>    remaining;  // references left per value
+        std::vector<int32_t>    holds;      // value held by each variable, or -1
+        std::vector<int32_t>    lastWrite;  // last store to each delay line, or -1
+        std::vector<varInfo>    *variables;
+        ParseContext            *context;
+    };
+
+    /** build the expression tree of value v.
+        values that are used again later are stored in
+        a temporary variable. */
+    ASTNode* buildTree(generator_t &gen, int32_t v, bool root) const;
+
+    /** build the operation of value v, without looking
+        for a variable that already holds it */
+    ASTNode* buildOperation(generator_t &gen, int32_t v) const;
+
+    /** find the stores that affect the outputs, the
+        monitored variables or a delay line, directly
+        or through a later sample */
+    void findLiveStores(const std::vector<std::string> &monitored, std::vector<bool> &live) const;
+
+    /** count the references to each value from the live
+        stores and from the values they depend on. The
+        arguments of a value are counted once, as a value
+        that is used more than once is computed once into
+        a variable that holds it until its last use. */
+    void countUses(const std::vector<bool> &live, std::vector<int32_t> &uses) const;
+
+    /** compute the values of dropped store 'store' that are
+        needed later and have side effects, such as reading a
+        delay line that is written later, into temporaries. They
+        are computed where the store was, so they see the delay
+        lines at the same point of the program. Noise calls are
+        always kept, so the other calls get the same noise. */
+    bool keepSideEffects(generator_t &gen, int32_t v, int32_t store, std::vector<bool> &visited) const;
+
+    /** returns true if the value of the operation depends on
+        when it is computed, or computing it changes a state */
+    static bool hasSideEffects(uint32_t opcode);
+
+    /** returns the variable that holds value v, or -1 */
+    static int32_t findHolder(const generator_t &gen, int32_t v);
+
+    /** create a temporary variable in the generated program */
+    static int32_t createTemporary(generator_t &gen);
+
+    typedef std::vector<uint32_t> key_t;
+
+    std::vector<value_t>    m_values;
+    std::vector<store_t>    m_stores;
+    std::vector<varInfo>    m_variables;
+    std::vector<int32_t>    m_delayDefinitions;     // delay lines in order of definition
+    std::vector<int32_t>    m_current;              // current value of each variable, or -1
+    std::map<key_t, int32_t> m_valueNumbers;        // pure values by operation and arguments
+};
+
+#endif
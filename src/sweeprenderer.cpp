@@ -0,0 +1,156 @@
+/*
+
+  Description:  Offline rendering of a parameter sweep.
+
+  License: GPLv2
+
+*/
+
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include "wavstreamer.h"
+#include "wavwriter.h"
+#include "sweeprenderer.h"
+
+SweepRenderer::SweepRenderer()
+    : m_script(NULL)
+{
+}
+
+SweepRenderer::~SweepRenderer()
+{
+}
+
+bool SweepRenderer::load(const RenderScript &script)
+{
+    if (!m_machine.setSamplerate(script.sampleRate, script.programRate))
+    {
+        m_error = m_machine.getError();
+        return false;
+    }
+    if (!m_machine.loadProgram(script.regprogram, script.variables, 4))
+    {
+        m_error = m_machine.getError();
+        return false;
+    }
+    m_script = &script;
+    return true;
+}
+
+void SweepRenderer::setNoiseSeed(uint32_t seed)
+{
+    m_machine.setNoiseSeed(seed);
+}
+
+bool SweepRenderer::renderGroup(const std::string &inFile, const sweeppoint_t *points, uint32_t count)
+{
+    // the fewest lanes that hold the points, the
+    // spare lanes repeat the last point.
+    const uint32_t lanes = (count <= 4) ? 4 : ((count <= 8) ? 8 : 16);
+    if (!m_machine.loadProgram(m_script->regprogram, m_script->variables, lanes))
+    {
+        m_error = m_machine.getError();
+        return false;
+    }
+    for(uint32_t lane=0; lane<lanes; lane++)
+    {
+        const sweeppoint_t &point = points[std::min(lane, count-1)];
+        for(uint32_t k=0; k<4; k++)
+        {
+            m_machine.setSlider(lane, k, point.slider[k]);
+        }
+    }
+    m_machine.reset();
+
+    WavStreamer input;
+    WavFormatChunk format;
+    if ((input.openFile(inFile) != 0) || (!input.getFormat(format)))
+    {
+        m_error = "Cannot read " + inFile + ", only stereo PCM or float .wav files are supported";
+        return false;
+    }
+    if ((float)format.dwSamplesPerSec != m_script->sampleRate)
+    {
+        m_error = inFile + " does not have the sample rate of the script";
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WavWriter> > outputs;
+    for(uint32_t i=0; i<count; i++)
+    {
+        outputs.push_back(std::unique_ptr<WavWriter>(new WavWriter()));
+        if (outputs[i]->openFile(points[i].outFile, 2, format.dwSamplesPerSec) != 0)
+        {
+            m_error = "Cannot create " + points[i].outFile;
+            return false;
+        }
+    }
+
+    std::vector<float> inbuf(2*RENDER_BLOCKSIZE);
+    std::vector<float> outbuf(2*RENDER_BLOCKSIZE*lanes);
+    float *outbufs[LANE_MAXLANES];
+    for(uint32_t lane=0; lane<lanes; lane++)
+    {
+        outbufs[lane] = &outbuf[2*RENDER_BLOCKSIZE*lane];
+    }
+
+    const uint32_t frames = input.getSampleCount();
+    uint32_t position = 0;
+    bool ok = true;
+    while(ok && (position < frames))
+    {
+        const uint32_t n = std::min((uint32_t)RENDER_BLOCKSIZE, frames - position);
+        input.fillBuffer(&inbuf[0], n);
+        m_machine.process(&inbuf[0], outbufs, n);
+        for(uint32_t i=0; i<count; i++)
+        {
+            ok = ok && outputs[i]->write(outbufs[i], n);
+        }
+        position += n;
+    }
+
+    for(uint32_t i=0; i<count; i++)
+    {
+        ok = outputs[i]->close() && ok;
+    }
+    if (!ok)
+    {
+        m_error = "Error writing the output";
+        return false;
+    }
+    return true;
+}
+
+bool SweepRenderer::render(const std::string &inFile, const std::vector<sweeppoint_t> &points,
+                           renderstats_t &stats)
+{
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    stats.frames = 0;
+    stats.audioTime = 0.0;
+    stats.renderTime = 0.0;
+    if (m_script == NULL)
+    {
+        m_error = "No script loaded";
+        return false;
+    }
+
+    for(size_t first=0; first<points.size(); first += LANE_MAXLANES)
+    {
+        const uint32_t count = (uint32_t)std::min(points.size() - first, (size_t)LANE_MAXLANES);
+        if (!renderGroup(inFile, &points[first], count))
+        {
+            return false;
+        }
+    }
+
+    WavStreamer input;
+    if (input.openFile(inFile) == 0)
+    {
+        stats.frames = (uint64_t)input.getSampleCount() * points.size();
+        stats.audioTime = stats.frames / (double)m_script->sampleRate;
+    }
+    stats.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
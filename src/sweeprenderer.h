@@ -0,0 +1,66 @@
+/*
+
+  Description:  Offline rendering of a parameter sweep.
+                One file is run through a script for many
+                combinations of slider values. The points of
+                the sweep run side by side in the lanes of a
+                LaneMachine, up to LANE_MAXLANES at a time, so
+                the program is decoded once for all of them.
+
+  License: GPLv2
+
+*/
+
+#ifndef sweeprenderer_h
+#define sweeprenderer_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "renderer.h"
+#include "lanemachine.h"
+
+/** a point of a parameter sweep */
+struct sweeppoint_t
+{
+    float           slider[4];      // values of the four sliders
+    std::string     outFile;        // file the outputs of this point are written to
+};
+
+class SweepRenderer
+{
+public:
+    SweepRenderer();
+    virtual ~SweepRenderer();
+
+    /** load a compiled script. The script is only read. */
+    bool load(const RenderScript &script);
+
+    /** set the seed of the noise generator, every point
+        starts from this seed */
+    void setNoiseSeed(uint32_t seed);
+
+    /** run the stereo file 'inFile' through the script for
+        every point of the sweep and write the outputs of each
+        point to its file. 'stats' gets the frames and audio
+        time of all points together.
+        Returns false on an error, see getError(). */
+    bool render(const std::string &inFile, const std::vector<sweeppoint_t> &points,
+                renderstats_t &stats);
+
+    /** description of the last error */
+    std::string getError() const
+    {
+        return m_error;
+    }
+
+protected:
+    /** render up to LANE_MAXLANES points at a time */
+    bool renderGroup(const std::string &inFile, const sweeppoint_t *points, uint32_t count);
+
+    LaneMachine         m_machine;
+    const RenderScript *m_script;   // the loaded script
+    std::string         m_error;
+};
+
+#endif
@@ -306,6 +306,18 @@ bool Tokenizer::process(Reader *r, std::vector<token_t> &result)
                     found = true;
                     result.push_back(tok);
                 }
+                if (tok.txt == std::string("precision"))
+                {
+                    tok.tokID = TOK_PRECISION;
+                    found = true;
+                    result.push_back(tok);
+                }
+                if (tok.txt == std::string("virtualrate"))
+                {
+                    tok.tokID = TOK_VIRTUALRATE;
+                    found = true;
+                    result.push_back(tok);
+                }
                 if (!found)
                 {
                     // if we end up here, it must be an
@@ -37,6 +37,8 @@
 
 // keyword tokens, excluding functions
 #define TOK_DELAY   20
+#define TOK_PRECISION 21
+#define TOK_VIRTUALRATE 22
 
 // other tokens
 #define TOK_INTEGER 30
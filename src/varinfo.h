@@ -8,6 +8,7 @@
 #define varinfo_h
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 /** variable related information */
@@ -18,23 +19,21 @@ struct varInfo
         m_type   = TYPE_VAR;
         m_data   = 0;
         m_value  = 0.0f;
-        m_idx    = 0;
         m_length = 0;
+        m_mask   = 0;
+        m_position = 0;
     }
 
-    virtual ~varInfo()
-    {
-        if (m_data != 0)
-            delete[] m_data;
-    }
-
-    enum type_t {TYPE_VAR, TYPE_DELAY};
+    enum type_t {TYPE_VAR, TYPE_DELAY, TYPE_FIR, TYPE_BIQUAD};
     std::string     m_name;     // variable or delay name
     type_t          m_type;     // type of the variable
-    float           m_value;    // current value for the VM
-    int32_t         m_idx;      // current delay index
-    int32_t         m_length;   // delay length
-    float           *m_data;    // delay memory pointer
+    float           m_value;    // initial value, the VM keeps the current value in VM::values_t
+    int32_t         m_length;   // delay length, number of FIR taps or biquad sections
+    float           *m_data;    // delay, FIR history or biquad state pointer, owned by the DelayArena
+    uint32_t        m_mask;     // allocated delay length - 1, a power of two - 1
+    const uint32_t  *m_position;    // write position shared by all delay lines
+    std::vector<float> m_coefficients;  // FIR coefficients, half of them for a symmetric filter,
+                                        // or b0, b1, b2, a1, a2 of each biquad section
 };
 
 #endif
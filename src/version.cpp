@@ -0,0 +1,9 @@
+// SPDX-FileCopyrightText: 2021-2022 Niels Moseley <asicsforthemasses@gmail.com>
+//
+// SPDX-License-Identifier: GPL-3.0-only
+//
+// version.cpp is auto-generated - do not modify
+//
+
+#include "version.h"
+const char *BASICDSPVERSIONSTRING = "BasicDSP version 2.1.0";
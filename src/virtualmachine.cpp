@@ -10,13 +10,19 @@
 
 */
 
-#include <QDebug>
-#include <QMutexLocker>
+#include <assert.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <ostream>
 #include <algorithm>
+#include <map>
+#include <set>
+#include <chrono>
+#include <thread>
+#include "functiondefs.h"
+#include "vmfunctions.h"
+#include "logging.h"
 #include "virtualmachine.h"
 
 int32_t VM::findVariableByName(const variables_t &vars, const std::string &name)
@@ -32,6 +38,230 @@ int32_t VM::findVariableByName(const variables_t &vars, const std::string &name)
     return -1;
 }
 
+bool VM::getStackDepth(const program_t &program, uint32_t &depth)
+{
+    depth = 0;
+
+    int32_t sp = 0;
+    const size_t N = program.size();
+    size_t pc = 0;
+    while(pc < N)
+    {
+        const uint32_t icode = program[pc++].icode;
+        if (icode & 0x80000000)
+        {
+            switch(icode & 0xff000000)
+            {
+            case P_readvar:
+                sp++;
+                break;
+            case P_writevar:
+            case P_writedelay:
+                sp--;
+                break;
+            case P_readdelay:
+                // replaces the offset with the delayed value
+                if (sp < 1)
+                    return false;
+                break;
+            case P_fir:
+            case P_biquad:
+                // replaces the input with the filter output
+                if (sp < 1)
+                    return false;
+                break;
+            default:
+                return false;
+            }
+        }
+        else
+        {
+            switch(icode)
+            {
+            case P_literal:
+                sp++;
+                pc++;   // skip the literal value
+                break;
+            case P_add:
+            case P_sub:
+            case P_mul:
+            case P_div:
+                if (sp < 2)
+                    return false;
+                sp--;
+                break;
+            case P_neg:
+                if (sp < 1)
+                    return false;
+                break;
+            default:
+            {
+                // functions replace their arguments by the result
+                const int32_t nargs = functionDefs::getNumberOfArguments(icode);
+                if ((nargs < 0) || (sp < nargs))
+                    return false;
+                sp += 1 - nargs;
+                break;
+            }
+            }
+        }
+
+        if ((sp < 0) || (sp > VM_MAXSTACKDEPTH))
+            return false;
+
+        depth = std::max(depth, (uint32_t)sp);
+    }
+    return (sp == 0);
+}
+
+/** add the state elements the value of node 'idx' depends on to
+    'deps'. The state elements are the variables, delay lines and
+    filters, identified by their index. 'current' holds the state
+    the current value of every variable depends on, 'next' collects
+    the state the next contents of every element depend on. */
+static void getDependencies(const VM::exprprogram_t &program, int32_t idx,
+                            std::vector<std::set<uint32_t> > &current,
+                            std::vector<std::set<uint32_t> > &next,
+                            VM::memory_t &memory, std::set<uint32_t> &deps)
+{
+    const VM::exprnode_t &node = program.nodes[idx];
+    std::set<uint32_t> argDeps;
+    for(uint32_t i=0; i<3; i++)
+    {
+        if (node.args[i] >= 0)
+            getDependencies(program, node.args[i], current, next, memory, argDeps);
+    }
+
+    switch(node.opcode)
+    {
+    case P_readvar:
+        deps.insert(current[node.index].begin(), current[node.index].end());
+        break;
+    case P_writevar:
+        current[node.index] = argDeps;
+        break;
+    case P_writedelay:
+        next[node.index].insert(argDeps.begin(), argDeps.end());
+        break;
+    case P_readdelay:
+        deps.insert(node.index);
+        break;
+    case P_fir:
+        next[node.index].insert(argDeps.begin(), argDeps.end());
+        deps.insert(node.index);
+        break;
+    case P_biquad:
+        // a biquad also keeps its earlier outputs
+        next[node.index].insert(argDeps.begin(), argDeps.end());
+        next[node.index].insert(node.index);
+        deps.insert(node.index);
+        break;
+    case P_noise:
+    case P_gaussnoise:
+    case P_pinknoise:
+        memory.noise = true;
+        break;
+    default:
+        break;
+    }
+    deps.insert(argDeps.begin(), argDeps.end());
+}
+
+/** determine the memory of state element 'e', the samples it holds
+    plus the longest memory of the elements it is calculated from.
+    'visit' is 1 while the element is on the search path and 2 when
+    its memory is known. Returns false if 'e' depends on itself. */
+static bool getElementMemory(uint32_t e, const VM::variables_t &vars,
+                             const std::vector<std::set<uint32_t> > &next,
+                             std::vector<uint8_t> &visit, std::vector<uint64_t> &length,
+                             VM::memory_t &memory)
+{
+    if (visit[e] == 2)
+        return true;
+    if (visit[e] == 1)
+    {
+        memory.feedback = (int32_t)e;
+        return false;
+    }
+
+    visit[e] = 1;
+    uint64_t longest = 0;
+    for(uint32_t f : next[e])
+    {
+        if (!getElementMemory(f, vars, next, visit, length, memory))
+            return false;
+        longest = std::max(longest, length[f]);
+    }
+    // a read at an offset beyond the declared length of a
+    // delay line returns older samples, up to the length
+    // rounded to a power of two, see DelayArena::allocate.
+    uint64_t samples = 1;
+    if ((vars[e].m_type == varInfo::TYPE_DELAY) || (vars[e].m_type == varInfo::TYPE_FIR))
+    {
+        while(samples < (uint64_t)vars[e].m_length)
+        {
+            samples <<= 1;
+        }
+    }
+    else if (vars[e].m_type != varInfo::TYPE_VAR)
+    {
+        samples = std::max(vars[e].m_length, 1);
+    }
+    length[e] = samples + longest;
+    visit[e] = 2;
+    return true;
+}
+
+void VM::getMemory(const exprprogram_t &program, const variables_t &vars, memory_t &memory)
+{
+    memory.bounded = true;
+    memory.length = 0;
+    memory.feedback = -1;
+    memory.noise = false;
+
+    // variables the program never writes, such as
+    // the inputs and sliders, hold no state.
+    std::vector<bool> written(vars.size(), false);
+    std::vector<std::set<uint32_t> > current(vars.size());
+    std::vector<std::set<uint32_t> > next(vars.size());
+    for(const exprnode_t &node : program.nodes)
+    {
+        if (node.opcode == P_writevar)
+        {
+            written[node.index] = true;
+            current[node.index].insert(node.index);
+        }
+    }
+
+    // the state that is read by the statements
+    std::set<uint32_t> state;
+    for(uint32_t root : program.statements)
+    {
+        getDependencies(program, root, current, next, memory, state);
+    }
+
+    // the value of a variable at the end of a sample
+    // is its state in the next sample.
+    for(uint32_t i=0; i<vars.size(); i++)
+    {
+        if (written[i])
+            next[i] = current[i];
+    }
+
+    std::vector<uint8_t> visit(vars.size(), 0);
+    std::vector<uint64_t> length(vars.size(), 0);
+    for(uint32_t e : state)
+    {
+        if (!getElementMemory(e, vars, next, visit, length, memory))
+        {
+            memory.bounded = false;
+            return;
+        }
+        memory.length = (uint32_t)std::min(std::max((uint64_t)memory.length, length[e]),
+                                           (uint64_t)UINT32_MAX);
+    }
+}
+
 static int portaudioCallback(
         const void *inputBuffer,
         void *outputBuffer,
@@ -58,20 +288,15 @@ static int portaudioCallback(
 
 
 
-VirtualMachine::VirtualMachine(QMainWindow *guiWindow)
-    : m_guiWindow(guiWindow),
-      m_stream(0),
+VirtualMachine::VirtualMachine()
+    : m_stream(0),
+      m_paInitialized(false),
       m_runState(false)
 {
-    Pa_Initialize();
-
-    for(uint32_t i=0; i<4; i++)
-    {
-        m_monitorVar[i] = NULL;
-    }
-
-    m_inDevice = Pa_GetDefaultInputDevice();
-    m_outDevice = Pa_GetDefaultOutputDevice();
+    // PortAudio is initialised by start(), so a VM
+    // that only renders offline never touches it.
+    m_inDevice = paNoDevice;
+    m_outDevice = paNoDevice;
     m_sampleRate = 44100.0f;
 
     /* Allocate ring buffers for GUI I/O.
@@ -91,20 +316,101 @@ VirtualMachine::VirtualMachine(QMainWindow *guiWindow)
                                     32768, dataptr);
     }
 
+    void *commands = new command_t[VM_COMMANDQUEUESIZE];
+    PaUtil_InitializeRingBuffer(&m_commandQueue, sizeof(command_t),
+                                VM_COMMANDQUEUESIZE, commands);
+    m_vuLevel[0] = 0.0f;
+    m_vuLevel[1] = 0.0f;
+
+    m_handlers = NULL;
+    m_nativeProgram = NULL;
+    m_profiling = false;
+    m_profileRuns = 0;
+    m_staging = false;
+    m_nextProgram = NULL;
+    m_retiredProgram = NULL;
+    m_fadeProgram = NULL;
+    m_fadePosition = 0;
+    m_fadeLength = 0;
+    m_crossfadeTime = 0.005f;
+    m_swapLatency = 0.0;
+    m_noise = &m_noiseGenerator;
+    m_noiseSeed = NOISE_DEFAULTSEED;
+
+    // a major chord with the octave
+    const float tones[] = {1.0f, 1.25f, 1.5f, 2.0f};
+    m_oscillator.setTones(std::vector<float>(tones, tones + 4));
+    m_oscillator.setSamplerate(m_sampleRate);
+
+    m_requestedRate = 0.0f;
+    setupResampling();
+
     init();
 
     m_source = SRC_SOUNDCARD;
+    m_engine = ENGINE_BLOCK;
+}
+
+VirtualMachine::VirtualMachine(const VirtualMachine *machine, staging_t)
+    : m_stream(0),
+      m_paInitialized(false),
+      m_runState(true)
+{
+    // this VM only holds a program, it has no
+    // audio stream or ring buffers of its own.
+    m_inDevice = machine->m_inDevice;
+    m_outDevice = machine->m_outDevice;
+    m_sampleRate = machine->m_sampleRate;
+
+    memset(m_ringbuffer, 0, sizeof(m_ringbuffer));
+    memset(&m_commandQueue, 0, sizeof(m_commandQueue));
+    m_vuLevel[0] = 0.0f;
+    m_vuLevel[1] = 0.0f;
+
+    m_handlers = machine->m_handlers;
+    m_nativeProgram = NULL;
+    m_profiling = false;
+    m_profileRuns = 0;
+    m_staging = true;
+    m_nextProgram = NULL;
+    m_retiredProgram = NULL;
+    m_fadeProgram = NULL;
+    m_fadePosition = 0;
+    m_fadeLength = 0;
+    m_crossfadeTime = 0.0f;
+    m_swapLatency = 0.0;
+
+    // the programs of a machine all draw from its
+    // generator, so the noise continues after a swap.
+    m_noise = machine->m_noise;
+    m_noiseSeed = machine->m_noiseSeed;
+
+    // the resamplers are designed with the program
+    m_requestedRate = machine->m_requestedRate;
+    m_programRate = m_sampleRate;
+    m_resampling = false;
+    m_resampledCount = 0;
+
+    init();
+
+    m_source = machine->m_source;
+    m_engine = machine->m_engine.load(std::memory_order_relaxed);
 }
 
 VirtualMachine::~VirtualMachine()
 {
-    Pa_Terminate();
+    if (m_staging)
+        return;
+
+    if (m_paInitialized)
+        Pa_Terminate();
 
     // de-allocate the ring buffer data
     for(uint32_t i=0; i<2; i++)
     {
         delete m_ringbuffer[i].buffer;
     }
+    delete[] reinterpret_cast<command_t*>(m_commandQueue.buffer);
 }
 
 
@@ -122,17 +428,19 @@ void VirtualMachine::init()
     m_slider[2] = 0;
     m_slider[3] = 0;
 
-    m_leftLevel = 0.0f;
-    m_rightLevel = 0.0f;
-
-    m_phaseaccu = 0.0f;
-    m_freq = 0.0f;
+    for(uint32_t i=0; i<4; i++)
+    {
+        m_monitorVar[i] = NULL;
+        m_monitorIdx[i] = -1;
+    }
 
-    // flush the data in the ring buffers
-    for(uint32_t i=0; i<2; i++)
+    for(uint32_t i=0; i<6; i++)
     {
-        PaUtil_FlushRingBuffer(&m_ringbuffer[i]);
+        m_ioRow[i] = -1;
     }
+
+    m_leftLevel = 0.0f;
+    m_rightLevel = 0.0f;
 }
 
 PaUtilRingBuffer* VirtualMachine::getRingBufferPtr(uint32_t ringBufID)
@@ -146,32 +454,35 @@ PaUtilRingBuffer* VirtualMachine::getRingBufferPtr(uint32_t ringBufID)
 
 bool VirtualMachine::setMonitoringVariable(uint32_t ringBufID, uint32_t channel, const std::string &varname)
 {
-    QMutexLocker lock(&m_controlMutex);
-
-    qDebug() << "setMonitoringVariable called";
+    doLog(LOG_DEBUG, "setMonitoringVariable called\n");
 
     if (ringBufID > 1)
         return false;
     if (channel > 1)
         return false;
 
-    int32_t idx = VM::findVariableByName(m_vars, varname);
-    if (idx < 0)
+    // only the GUI thread changes the variable
+    // store, so it can be searched without locking.
+    command_t cmd;
+    cmd.type = command_t::CMD_MONITOR;
+    cmd.index = ringBufID*2 + channel;
+    cmd.ivalue = VM::findVariableByName(m_vars, varname);
+    cmd.value = 0.0f;
+    postCommand(cmd);
+
+    if (cmd.ivalue < 0)
     {
         // variable not found
-        m_monitorVar[ringBufID*2 + channel] = NULL;
         return false;
     }
 
-    qDebug() << "setMonitoringVariable " << varname.c_str();
-
-    m_monitorVar[ringBufID*2 + channel] = &(m_vars[idx].m_value);
+    doLog(LOG_DEBUG, "setMonitoringVariable %s\n", varname.c_str());
     return true;
 }
 
 bool VirtualMachine::hasAudioFile()
 {
-    QMutexLocker lock(&m_controlMutex);
+    std::lock_guard<std::mutex> lock(m_controlMutex);
     if (m_wavstreamer.isOK())
     {
         return true;
@@ -179,9 +490,9 @@ bool VirtualMachine::hasAudioFile()
     return false;
 }
 
-bool VirtualMachine::setAudioFile(const QString &filename)
+bool VirtualMachine::setAudioFile(const std::string &filename)
 {
-    QMutexLocker lock(&m_controlMutex);
+    std::lock_guard<std::mutex> lock(m_controlMutex);
     if (m_wavstreamer.openFile(filename) != 0)
     {
         return false;
@@ -191,67 +502,366 @@ bool VirtualMachine::setAudioFile(const QString &filename)
 
 void VirtualMachine::loadProgram(const VM::program_t &program, const VM::variables_t &variables)
 {
-    QMutexLocker lock(&m_controlMutex);
+    loadProgram(program, VM::regprogram_t(), VM::exprprogram_t(), variables);
+}
+
+void VirtualMachine::loadProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                                 const VM::variables_t &variables)
+{
+    loadProgram(program, regprogram, VM::exprprogram_t(), variables);
+}
+
+void VirtualMachine::loadProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                                 const VM::exprprogram_t &exprprogram, const VM::variables_t &variables)
+{
+    const std::chrono::steady_clock::time_point loadTime = std::chrono::steady_clock::now();
+
+    // build the new program off the audio thread.
+    // only the GUI thread changes the variable store,
+    // so the names can be matched without locking.
+    VirtualMachine *next = new VirtualMachine(this, staging_t());
+    next->buildProgram(program, regprogram, exprprogram, variables);
+    next->findCarriedVariables(m_vars);
+
+    const std::chrono::steady_clock::time_point buildTime = std::chrono::steady_clock::now();
+
+    if (isRunning())
+    {
+        // the audio thread swaps the program at the
+        // start of its next buffer and returns the old
+        // one when the crossfade has finished.
+        m_nextProgram.store(next, std::memory_order_release);
+        while((m_retiredProgram.load(std::memory_order_acquire) != next)
+              && (Pa_IsStreamActive(m_stream) == 1))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if (m_retiredProgram.load(std::memory_order_acquire) != next)
+    {
+        // the stream is not running, swap the program here.
+        std::lock_guard<std::mutex> lock(m_controlMutex);
+        VirtualMachine *pending = isRunning() ? m_nextProgram.exchange(NULL, std::memory_order_acquire) : next;
+        if (pending != NULL)
+        {
+            processCommands();
+            flushPendingCommands();
+            processCommands();
+            swapProgram(pending, false);
+        }
+        if (m_fadeProgram != NULL)
+        {
+            // the stream stopped during the crossfade
+            m_retiredProgram.store(m_fadeProgram, std::memory_order_release);
+            m_fadeProgram = NULL;
+        }
+    }
+
+    delete m_retiredProgram.exchange(NULL, std::memory_order_acquire);
+
+    const double build = std::chrono::duration<double>(buildTime - loadTime).count();
+    m_swapLatency = std::chrono::duration<double>(m_swapTime - loadTime).count();
+    doLog(LOG_DEBUG, "Program built in %g ms, swapped after %g ms\n", build*1000.0, m_swapLatency*1000.0);
+}
+
+void VirtualMachine::findCarriedVariables(const VM::variables_t &previous)
+{
+    m_carried.clear();
+    for(uint32_t i=0; i<previous.size(); i++)
+    {
+        const int32_t idx = VM::findVariableByName(m_vars, previous[i].m_name);
+        if ((idx >= 0) && (m_vars[idx].m_type == previous[i].m_type))
+        {
+            m_carried.push_back(std::make_pair(i, (uint32_t)idx));
+        }
+    }
+}
+
+void VirtualMachine::swapProgram(VirtualMachine *next, bool crossfade)
+{
+    // carry over the values of the variables and
+    // the contents of the delay lines and the
+    // filter states by name.
+    for(const std::pair<uint32_t, uint32_t> &carry : next->m_carried)
+    {
+        const varInfo &from = m_vars[carry.first];
+        varInfo &to = next->m_vars[carry.second];
+        if (from.m_type == varInfo::TYPE_BIQUAD)
+        {
+            // the state of the sections both filters have
+            const int32_t sections = std::min(from.m_length, to.m_length);
+            std::copy(from.m_data, from.m_data + 2*sections, to.m_data);
+        }
+        else if ((from.m_type == varInfo::TYPE_DELAY) || (from.m_type == varInfo::TYPE_FIR))
+        {
+            // keep the most recent samples at the same offsets.
+            // a FIR history also has a second copy.
+            const uint32_t N = std::min(from.m_mask, to.m_mask) + 1;
+            const uint32_t fromPosition = *from.m_position;
+            const uint32_t toPosition = *to.m_position;
+            const uint32_t mirror = (to.m_type == varInfo::TYPE_FIR) ? to.m_mask + 1 : 0;
+            for(uint32_t k=0; k<N; k++)
+            {
+                const uint32_t idx = (toPosition + k) & to.m_mask;
+                to.m_data[idx] = from.m_data[(fromPosition + k) & from.m_mask];
+                to.m_data[idx + mirror] = to.m_data[idx];
+            }
+        }
+        else
+        {
+            next->m_values[carry.second] = m_values[carry.first];
+        }
+    }
+
+    // the monitored variables are looked up
+    // again in the new program.
+    int32_t monitorIdx[4];
+    for(uint32_t k=0; k<4; k++)
+    {
+        monitorIdx[k] = -1;
+        for(const std::pair<uint32_t, uint32_t> &carry : next->m_carried)
+        {
+            if ((int32_t)carry.first == m_monitorIdx[k])
+                monitorIdx[k] = carry.second;
+        }
+    }
+
+    std::swap(m_program, next->m_program);
+    std::swap(m_vars, next->m_vars);
+    std::swap(m_values, next->m_values);
+    m_delays.swap(next->m_delays);
+    std::swap(m_regprogram, next->m_regprogram);
+    std::swap(m_regops, next->m_regops);
+    std::swap(m_regTemps, next->m_regTemps);
+    std::swap(m_threadedCode, next->m_threadedCode);
+    std::swap(m_threadedSegment, next->m_threadedSegment);
+    m_jit.swap(next->m_jit);
+    std::swap(m_nativeProgram, next->m_nativeProgram);
+    std::swap(m_nativeSegment, next->m_nativeSegment);
+    std::swap(m_closures, next->m_closures);
+    std::swap(m_schedule, next->m_schedule);
+    std::swap(m_blockRows, next->m_blockRows);
+    std::swap(m_blockStack, next->m_blockStack);
+    std::swap(m_stack, next->m_stack);
+    std::swap(m_ioRow, next->m_ioRow);
+    std::swap(m_lout, next->m_lout);
+    std::swap(m_lin, next->m_lin);
+    std::swap(m_rout, next->m_rout);
+    std::swap(m_rin, next->m_rin);
+    std::swap(m_in, next->m_in);
+    std::swap(m_out, next->m_out);
+    std::swap(m_slider, next->m_slider);
+
+    for(uint32_t k=0; k<4; k++)
+    {
+        m_monitorIdx[k] = monitorIdx[k];
+        m_monitorVar[k] = (monitorIdx[k] >= 0) ? &(m_values[monitorIdx[k]]) : NULL;
+    }
+
+    // a program at another rate takes its own resamplers,
+    // which start empty. it cannot be crossfaded, as the
+    // previous program runs at a different rate.
+    if (next->m_programRate != m_programRate)
+    {
+        std::swap(m_programRate, next->m_programRate);
+        std::swap(m_resampling, next->m_resampling);
+        std::swap(m_inResampler, next->m_inResampler);
+        std::swap(m_outResampler, next->m_outResampler);
+        m_resampledCount = 0;
+        crossfade = false;
+    }
+
+    m_swapTime = std::chrono::steady_clock::now();
+
+    // 'next' now holds the previous program. it keeps
+    // running during the crossfade, after which it is
+    // returned to the GUI thread.
+    m_fadeLength = crossfade ? (uint32_t)(m_crossfadeTime * m_programRate) : 0;
+    m_fadePosition = 0;
+    if (m_fadeLength > 0)
+    {
+        m_fadeProgram = next;
+    }
+    else
+    {
+        m_retiredProgram.store(next, std::memory_order_release);
+    }
+}
+
+void VirtualMachine::crossfade(const float *inLeft, const float *inRight,
+                               float *outbuf, uint32_t samples)
+{
+    for(uint32_t i=0; i<samples; i++)
+    {
+        float left;
+        float right;
+        m_fadeProgram->executeProgram(inLeft[i], inRight[i], left, right);
+
+        const float gain = (float)m_fadePosition / (float)m_fadeLength;
+        outbuf[i<<1] = gain*outbuf[i<<1] + (1.0f-gain)*left;
+        outbuf[(i<<1)+1] = gain*outbuf[(i<<1)+1] + (1.0f-gain)*right;
+
+        if (++m_fadePosition >= m_fadeLength)
+        {
+            m_retiredProgram.store(m_fadeProgram, std::memory_order_release);
+            m_fadeProgram = NULL;
+            return;
+        }
+    }
+}
+
+void VirtualMachine::setCrossfade(float seconds)
+{
+    m_crossfadeTime.store(std::max(seconds, 0.0f), std::memory_order_relaxed);
+}
+
+float VirtualMachine::setProgramSamplerate(float Hz)
+{
+    m_requestedRate = std::max(Hz, 0.0f);
+    return getEffectiveRate(m_requestedRate);
+}
+
+float VirtualMachine::getEffectiveRate(float Hz) const
+{
+    // only integer rates below that of the soundcard,
+    // which can be converted in both directions
+    const uint32_t rate = (uint32_t)Hz;
+    const uint32_t device = (uint32_t)m_sampleRate;
+    if ((Hz <= 0.0f) || ((float)rate != Hz) || (rate >= device) ||
+        (!Resampler::isSupported(device, rate)) ||
+        (!Resampler::isSupported(rate, device)))
+    {
+        return m_sampleRate;
+    }
+    return Hz;
+}
+
+void VirtualMachine::setupResampling()
+{
+    m_programRate = getEffectiveRate(m_requestedRate);
+    m_resampling = (m_programRate != (float)m_sampleRate);
+    if ((m_resampling) &&
+        ((!m_inResampler.setup((uint32_t)m_sampleRate, (uint32_t)m_programRate)) ||
+         (!m_outResampler.setup((uint32_t)m_programRate, (uint32_t)m_sampleRate))))
+    {
+        // the program runs at the rate of the soundcard
+        doLog(LOG_ERROR, "Virtual sample rate %g Hz not supported\n", (double)m_programRate);
+        m_programRate = m_sampleRate;
+        m_resampling = false;
+    }
+    m_resampledCount = 0;
+}
 
+void VirtualMachine::buildProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                                  const VM::exprprogram_t &exprprogram, const VM::variables_t &variables)
+{
     init();
+    setupResampling();
 
     m_vars = variables;
     m_program = program;
 
+    // the values are kept in a dense array, so the
+    // variables of the hot path share few cache lines.
+    m_values.resize(m_vars.size());
+    for(uint32_t i=0; i<m_vars.size(); i++)
+    {
+        m_values[i] = m_vars[i].m_value;
+    }
+    m_regprogram = regprogram;
+
+    // the stack of the interpreter holds exactly
+    // as many values as the program needs.
+    uint32_t depth = 0;
+    if (!VM::getStackDepth(m_program, depth))
+    {
+        doLog(LOG_ERROR, "Program has an invalid stack depth\n");
+        m_program.clear();
+    }
+    m_stack.assign(std::max(depth, (uint32_t)1), 0.0f);
+
     // find the lout, rout, lin, rin, in, out
     // variables.
     int32_t idx = VM::findVariableByName(m_vars, "inl");
-    if (idx != -1) m_lin = &(m_vars[idx].m_value);
+    if (idx != -1) m_lin = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "inr");
-    if (idx != -1) m_rin = &(m_vars[idx].m_value);
+    if (idx != -1) m_rin = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "outl");
-    if (idx != -1) m_lout = &(m_vars[idx].m_value);
+    if (idx != -1) m_lout = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "outr");
-    if (idx != -1) m_rout = &(m_vars[idx].m_value);
+    if (idx != -1) m_rout = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "out");
-    if (idx != -1) m_out = &(m_vars[idx].m_value);
+    if (idx != -1) m_out = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "in");
-    if (idx != -1) m_in = &(m_vars[idx].m_value);
+    if (idx != -1) m_in = &(m_values[idx]);
 
     // setup sliders
     idx = VM::findVariableByName(m_vars, "slider1");
-    if (idx != -1) m_slider[0] = &(m_vars[idx].m_value);
+    if (idx != -1) m_slider[0] = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "slider2");
-    if (idx != -1) m_slider[1] = &(m_vars[idx].m_value);
+    if (idx != -1) m_slider[1] = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "slider3");
-    if (idx != -1) m_slider[2] = &(m_vars[idx].m_value);
+    if (idx != -1) m_slider[2] = &(m_values[idx]);
     idx = VM::findVariableByName(m_vars, "slider4");
-    if (idx != -1) m_slider[3] = &(m_vars[idx].m_value);
+    if (idx != -1) m_slider[3] = &(m_values[idx]);
 
     // setup sample rate
     idx = VM::findVariableByName(m_vars, "samplerate");
     if (idx != -1)
     {
-        m_vars[idx].m_value = m_sampleRate;
+        m_values[idx] = m_programRate;
     }
 
     // setup the delay lines
-    for(uint32_t i=0; i<m_vars.size(); i++)
+    m_delays.allocate(m_vars);
+
+    // resolve the register program, if there is one
+    if (!resolveRegisters())
     {
-        if (m_vars[i].m_type != varInfo::TYPE_DELAY)
-            continue;
+        doLog(LOG_WARN, "Register program has invalid operands\n");
+        m_regops.clear();
+    }
+
+    // compile the expression trees, if there are any
+    m_closures.clear();
+    if ((!exprprogram.nodes.empty()) && (!m_closures.build(exprprogram, m_vars, m_values, m_noise)))
+    {
+        doLog(LOG_WARN, "Expression trees cannot be compiled\n");
+    }
+
+    // prepare block execution. if the program cannot
+    // be scheduled, the VM runs it sample-by-sample.
+    if (m_schedule.build(m_program, m_vars))
+    {
+        m_blockRows.assign(m_schedule.getNumberOfRows()*VM_BLOCKSIZE, 0.0f);
+        // three extra rows below the bottom of the stack
+        // keep the operand pointers inside the buffer.
+        m_blockStack.assign((m_schedule.getStackDepth()+4)*VM_BLOCKSIZE, 0.0f);
 
-        if (m_vars[i].m_data != 0)
+        const char *ioNames[] = {"in", "inl", "inr", "out", "outl", "outr"};
+        for(uint32_t k=0; k<6; k++)
         {
-            delete[] m_vars[i].m_data;
+            idx = VM::findVariableByName(m_vars, ioNames[k]);
+            m_ioRow[k] = (idx >= 0) ? m_schedule.getRow(idx) : -1;
         }
-        m_vars[i].m_idx = 0;
-        m_vars[i].m_data = new float[m_vars[i].m_length];
-        memset(m_vars[i].m_data, 0, sizeof(float)*m_vars[i].m_length);
     }
+    else
+    {
+        m_blockRows.clear();
+        m_blockStack.clear();
+    }
+
+    buildThreadedCode();
+    buildNativeCode();
 }
 
 void VirtualMachine::setupSoundcard(PaDeviceIndex inDevice, PaDeviceIndex outDevice, float sampleRate)
 {
-    qDebug() << "VirtualMachine::setupSoundcard";
-    qDebug() << " in:   " << inDevice;
-    qDebug() << " out:  " << outDevice;
-    qDebug() << " rate: " << sampleRate;
+    doLog(LOG_DEBUG, "VirtualMachine::setupSoundcard\n");
+    doLog(LOG_DEBUG, " in:   %d\n", inDevice);
+    doLog(LOG_DEBUG, " out:  %d\n", outDevice);
+    doLog(LOG_DEBUG, " rate: %g\n", (double)sampleRate);
 
     // stop the virtual machine
     // no mutex needed here, as it's handled in the
@@ -261,14 +871,37 @@ void VirtualMachine::setupSoundcard(PaDeviceIndex inDevice, PaDeviceIndex outDev
 
     m_inDevice = inDevice;
     m_outDevice = outDevice;
-    m_sampleRate = sampleRate;
+    setSamplerate(sampleRate);
+}
+
+void VirtualMachine::setSamplerate(float Hz)
+{
+    m_sampleRate = Hz;
+    m_oscillator.setSamplerate(Hz);
+    setupResampling();
+}
+
+void VirtualMachine::resetRun()
+{
+    // every run starts with the same noise
+    // and test signals
+    m_noise->seed(m_noiseSeed);
+    m_oscillator.reset();
+    m_inResampler.reset();
+    m_outResampler.reset();
+    m_resampledCount = 0;
+
+    m_leftLevel = 0.0f;
+    m_rightLevel = 0.0f;
+    m_vuLevel[0] = 0.0f;
+    m_vuLevel[1] = 0.0f;
 }
 
 bool VirtualMachine::start()
 {
-    qDebug() << "VirtualMachine::start()";
+    doLog(LOG_DEBUG, "VirtualMachine::start()\n");
 
-    QMutexLocker lock(&m_controlMutex);
+    std::lock_guard<std::mutex> lock(m_controlMutex);
 
     // check if portaudio is already running
     if (m_stream != 0)
@@ -278,8 +911,18 @@ bool VirtualMachine::start()
         Pa_CloseStream(m_stream);
     }
 
-    m_leftLevel = 0.0f;
-    m_rightLevel = 0.0f;
+    if (!m_paInitialized)
+    {
+        PaError error = Pa_Initialize();
+        if (error != paNoError)
+        {
+            doLog(LOG_ERROR, "Portaudio: %s\n", Pa_GetErrorText(error));
+            return false;
+        }
+        m_paInitialized = true;
+    }
+
+    resetRun();
 
     const double sampleRate = m_sampleRate;
     const uint32_t framesPerBuffer = 0;
@@ -288,14 +931,14 @@ bool VirtualMachine::start()
     PaStreamParameters outputParams;
 
     memset(&inputParams, 0, sizeof(inputParams));
-    inputParams.device = m_inDevice;
+    inputParams.device = (m_inDevice == paNoDevice) ? Pa_GetDefaultInputDevice() : m_inDevice;
     inputParams.suggestedLatency = 0.2f;
     inputParams.channelCount = 2;
     inputParams.suggestedLatency = 0.2;
     inputParams.sampleFormat = sampleFormat;
 
     memset(&outputParams, 0, sizeof(outputParams));
-    outputParams.device = m_outDevice;
+    outputParams.device = (m_outDevice == paNoDevice) ? Pa_GetDefaultOutputDevice() : m_outDevice;
     outputParams.suggestedLatency = 0.2f;
     outputParams.channelCount = 2;
     outputParams.suggestedLatency = 0.2;
@@ -316,7 +959,7 @@ bool VirtualMachine::start()
         error = Pa_StartStream(m_stream);
         if (error == paNoError)
         {
-            qDebug() << "Stream started!";
+            doLog(LOG_DEBUG, "Stream started!\n");
             m_runState = true;
             return true;
         }
@@ -326,54 +969,273 @@ bool VirtualMachine::start()
         if (error == paUnanticipatedHostError)
         {
             const PaHostErrorInfo *info = Pa_GetLastHostErrorInfo();
-            qDebug() << "Portaudio host error: " << info->errorText << "\n";
+            doLog(LOG_ERROR, "Portaudio host error: %s\n", info->errorText);
         }
         else
         {
-            qDebug() << "Portaudio: " << Pa_GetErrorText(error) << "\n";
+            doLog(LOG_ERROR, "Portaudio: %s\n", Pa_GetErrorText(error));
         }
     }
     return false;
 }
 
-void VirtualMachine::stop()
+void VirtualMachine::resetProgramState()
 {
-    QMutexLocker lock(&m_controlMutex);
+    command_t cmd;
+    cmd.type = command_t::CMD_RESET;
+    cmd.index = 0;
+    cmd.ivalue = 0;
+    cmd.value = 0.0f;
+    postCommand(cmd);
+}
 
-    if (m_stream != 0)
+void VirtualMachine::resetValues()
+{
+    for(uint32_t i=0; i<m_vars.size(); i++)
     {
-        Pa_AbortStream(m_stream);
-        Pa_CloseStream(m_stream);
-        m_stream = 0;
+        m_values[i] = m_vars[i].m_value;
     }
-    m_leftLevel = 0.0f;
-    m_rightLevel = 0.0f;
-
-    m_runState = false;
-}
+
+    const int32_t idx = VM::findVariableByName(m_vars, "samplerate");
+    if (idx != -1)
+    {
+        m_values[idx] = m_programRate;
+    }
+    m_delays.reset();
+}
+
+void VirtualMachine::startOffline()
+{
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+
+    if (m_stream != 0)
+    {
+        Pa_AbortStream(m_stream);
+        Pa_CloseStream(m_stream);
+        m_stream = 0;
+    }
+
+    resetRun();
+    m_runState = true;
+}
+
+void VirtualMachine::stop()
+{
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+
+    if (m_stream != 0)
+    {
+        Pa_AbortStream(m_stream);
+        Pa_CloseStream(m_stream);
+        m_stream = 0;
+    }
+    m_leftLevel = 0.0f;
+    m_rightLevel = 0.0f;
+    m_vuLevel[0] = 0.0f;
+    m_vuLevel[1] = 0.0f;
+
+    m_runState = false;
+}
 
 void VirtualMachine::setSlider(uint32_t id, float value)
 {
-    QMutexLocker lock(&m_controlMutex);
-    if (id < 4)
+    command_t cmd;
+    cmd.type = command_t::CMD_SLIDER;
+    cmd.index = id;
+    cmd.ivalue = 0;
+    cmd.value = value;
+    postCommand(cmd);
+}
+
+void VirtualMachine::setSource(src_t source)
+{
+    command_t cmd;
+    cmd.type = command_t::CMD_SOURCE;
+    cmd.index = 0;
+    cmd.ivalue = source;
+    cmd.value = 0.0f;
+    postCommand(cmd);
+}
+
+void VirtualMachine::setFrequency(double Hz)
+{
+    command_t cmd;
+    cmd.type = command_t::CMD_FREQUENCY;
+    cmd.index = 0;
+    cmd.ivalue = 0;
+    cmd.value = Hz;
+    postCommand(cmd);
+}
+
+void VirtualMachine::setSweepRate(double rate)
+{
+    command_t cmd;
+    cmd.type = command_t::CMD_SWEEPRATE;
+    cmd.index = 0;
+    cmd.ivalue = 0;
+    cmd.value = rate;
+    postCommand(cmd);
+}
+
+void VirtualMachine::setTones(const std::vector<float> &ratios)
+{
+    // one command per tone, the audio thread sets the
+    // tones when the last one arrives. older tones that
+    // are still pending are dropped, as their number
+    // may differ.
+    m_pendingCommands.erase(std::remove_if(m_pendingCommands.begin(), m_pendingCommands.end(),
+                                           [](const command_t &pending)
+                                           {
+                                               return pending.type == command_t::CMD_TONES;
+                                           }),
+                            m_pendingCommands.end());
+
+    const uint32_t count = std::min(std::max((uint32_t)ratios.size(), (uint32_t)1), (uint32_t)OSC_MAXTONES);
+    for(uint32_t i=0; i<count; i++)
+    {
+        command_t cmd;
+        cmd.type = command_t::CMD_TONES;
+        cmd.index = i;
+        cmd.ivalue = (int32_t)count;
+        cmd.value = (i < ratios.size()) ? ratios[i] : 1.0f;
+        postCommand(cmd);
+    }
+}
+
+void VirtualMachine::setNoiseSeed(uint32_t seed)
+{
+    m_noiseSeed = seed;
+
+    command_t cmd;
+    cmd.type = command_t::CMD_SEED;
+    cmd.index = 0;
+    cmd.ivalue = (int32_t)seed;
+    cmd.value = 0.0f;
+    postCommand(cmd);
+}
+
+void VirtualMachine::postCommand(const command_t &cmd)
+{
+    // all commands set the state of a control, so a
+    // command that is still pending is simply replaced.
+    bool replaced = false;
+    for(command_t &pending : m_pendingCommands)
     {
-        if (m_slider[id] != 0)
+        if ((pending.type == cmd.type) && (pending.index == cmd.index))
         {
-            *m_slider[id]=value;
+            pending = cmd;
+            replaced = true;
         }
     }
+    if (!replaced)
+    {
+        m_pendingCommands.push_back(cmd);
+    }
+    flushPendingCommands();
 }
 
-void VirtualMachine::setSource(src_t source)
+void VirtualMachine::flushPendingCommands()
 {
-    QMutexLocker locker(&m_controlMutex);
-    m_source = source;
+    size_t sent = 0;
+    while(sent < m_pendingCommands.size())
+    {
+        if (PaUtil_WriteRingBuffer(&m_commandQueue, &m_pendingCommands[sent], 1) != 1)
+            break;
+        sent++;
+    }
+    m_pendingCommands.erase(m_pendingCommands.begin(), m_pendingCommands.begin() + sent);
 }
 
-void VirtualMachine::setFrequency(double Hz)
+void VirtualMachine::processCommands()
+{
+    command_t cmd;
+    while(PaUtil_ReadRingBuffer(&m_commandQueue, &cmd, 1) == 1)
+    {
+        applyCommand(cmd);
+    }
+}
+
+void VirtualMachine::applyCommand(const command_t &cmd)
+{
+    switch(cmd.type)
+    {
+    case command_t::CMD_SLIDER:
+        if ((cmd.index < 4) && (m_slider[cmd.index] != 0))
+        {
+            *m_slider[cmd.index] = cmd.value;
+        }
+        break;
+    case command_t::CMD_SOURCE:
+        m_source = (src_t)cmd.ivalue;
+        switch(m_source)
+        {
+        case SRC_SINE:
+            m_oscillator.setMode(Oscillator::MODE_SINE);
+            break;
+        case SRC_QUADSINE:
+            m_oscillator.setMode(Oscillator::MODE_QUADSINE);
+            break;
+        case SRC_SWEEP:
+            m_oscillator.setMode(Oscillator::MODE_SWEEP);
+            break;
+        case SRC_LOGSWEEP:
+            m_oscillator.setMode(Oscillator::MODE_LOGSWEEP);
+            break;
+        case SRC_MULTITONE:
+            m_oscillator.setMode(Oscillator::MODE_MULTITONE);
+            break;
+        default:
+            break;
+        }
+        break;
+    case command_t::CMD_FREQUENCY:
+        m_oscillator.setFrequency(cmd.value);
+        break;
+    case command_t::CMD_SWEEPRATE:
+        m_oscillator.setSweepRate(cmd.value);
+        break;
+    case command_t::CMD_SEED:
+        m_noise->seed((uint32_t)cmd.ivalue);
+        break;
+    case command_t::CMD_PROFILING:
+        m_profiling = (cmd.ivalue != 0);
+        if (m_profiling)
+        {
+            m_profileRuns.store(0, std::memory_order_relaxed);
+        }
+        break;
+    case command_t::CMD_RESET:
+        resetValues();
+        break;
+    case command_t::CMD_TONES:
+        if (cmd.index >= OSC_MAXTONES)
+            break;
+        m_toneRatios[cmd.index] = cmd.value;
+        if (cmd.index+1 == (uint32_t)cmd.ivalue)
+        {
+            m_oscillator.setTones(m_toneRatios, (uint32_t)cmd.ivalue);
+        }
+        break;
+    case command_t::CMD_MONITOR:
+        if (cmd.index >= 4)
+            break;
+        if ((cmd.ivalue < 0) || ((size_t)cmd.ivalue >= m_vars.size()))
+        {
+            m_monitorVar[cmd.index] = NULL;
+            m_monitorIdx[cmd.index] = -1;
+        }
+        else
+        {
+            m_monitorVar[cmd.index] = &(m_values[cmd.ivalue]);
+            m_monitorIdx[cmd.index] = cmd.ivalue;
+        }
+        break;
+    }
+}
+
+void VirtualMachine::setEngine(engine_t engine)
 {
-    QMutexLocker locker(&m_controlMutex);
-    m_freq = Hz;
+    m_engine.store(engine, std::memory_order_relaxed);
 }
 
 void VirtualMachine::processSamples(const float *inbuf, float *outbuf,
@@ -383,10 +1245,14 @@ void VirtualMachine::processSamples(const float *inbuf, float *outbuf,
     // called by the audio subsystem
     // blocking it is not a good idea
     // therefore, we'll try to lock the mutex
-    // but if that fails, we return a muted buffer
+    // but if that fails, we return a muted buffer.
+    // the GUI only holds the mutex to start or stop the
+    // stream, to open an audio file and to swap a program
+    // while the stream is not running. The other controls
+    // arrive through the command queue or atomics.
     //
 
-    bool success = m_controlMutex.tryLock();
+    bool success = m_controlMutex.try_lock();
     if (!success)
     {
         for(uint32_t i=0; i<framesPerBuffer; i++)
@@ -397,139 +1263,203 @@ void VirtualMachine::processSamples(const float *inbuf, float *outbuf,
         return;
     }
 
+    processCommands();
+
+    // swap in a new program at the buffer boundary
+    VirtualMachine *next = m_nextProgram.exchange(NULL, std::memory_order_acquire);
+    if (next != NULL)
+    {
+        swapProgram(next, m_runState);
+    }
+
     // todo: make multiplier respect the frames per buffer
     // so we get block-size independent VU meter behaviour.
     m_leftLevel *= 0.9f;
     m_rightLevel *= 0.9f;
 
+    const bool useBlocks = (m_engine == ENGINE_BLOCK) && m_schedule.isValid()
+                            && m_runState && (m_program.size() != 0);
+
     float wavBuffer[2];
-    for(uint32_t i=0; i<framesPerBuffer; i++)
+    float inLeft[VM_BLOCKSIZE];
+    float inRight[VM_BLOCKSIZE];
+    uint32_t offset = 0;
+    while(offset < framesPerBuffer)
     {
-        float left;
-        float right;
+        const uint32_t samples = std::min(framesPerBuffer - offset, (uint32_t)VM_BLOCKSIZE);
 
-        switch(m_source)
+        // the test signals are generated a block at a time
+        const bool oscillator = (m_source == SRC_SINE) || (m_source == SRC_QUADSINE)
+                                || (m_source == SRC_SWEEP) || (m_source == SRC_LOGSWEEP)
+                                || (m_source == SRC_MULTITONE);
+        if (oscillator)
         {
-        default:
-        case SRC_SOUNDCARD:
-            left = *inbuf++;
-            right = *inbuf++;
-            break;
-        case SRC_WAV:           
-            m_wavstreamer.fillBuffer(wavBuffer, 1);
-            left = wavBuffer[0];
-            right = wavBuffer[1];
-            break;
-        case SRC_NOISE:
-            left = -1.0f+2.0f*static_cast<float>(rand())/RAND_MAX;
-            right = -1.0f+2.0f*static_cast<float>(rand())/RAND_MAX;
-            break;
-        case SRC_SINE:
-            left = cos(2.0f*3.1415927f*m_phaseaccu);
-            right = left;
-            m_phaseaccu += (m_freq / m_sampleRate);
-            if (m_phaseaccu > 1.0f)
-            {
-                m_phaseaccu -= 1.0f;
-            }
-            else if (m_phaseaccu < 0.0f)
+            m_oscillator.generate(inLeft, inRight, samples);
+        }
+
+        for(uint32_t i=0; i<samples; i++)
+        {
+            float left;
+            float right;
+
+            switch(m_source)
             {
-                // safety check
-                m_phaseaccu = 0.0f;
+            default:
+            case SRC_SOUNDCARD:
+                left = *inbuf++;
+                right = *inbuf++;
+                break;
+            case SRC_WAV:
+                m_wavstreamer.fillBuffer(wavBuffer, 1);
+                left = wavBuffer[0];
+                right = wavBuffer[1];
+                break;
+            case SRC_NOISE:
+                left = m_noise->uniform();
+                right = m_noise->uniform();
+                break;
+            case SRC_SINE:
+            case SRC_QUADSINE:
+            case SRC_SWEEP:
+            case SRC_LOGSWEEP:
+            case SRC_MULTITONE:
+                left = inLeft[i];
+                right = inRight[i];
+                break;
+            case SRC_IMPULSE:
+                left = 0.0f;
+                right = 0.0f;
             }
-            break;
-        case SRC_QUADSINE:
-            left = cos(2.0f*3.1415927f*m_phaseaccu);
-            right = sin(2.0f*3.1415927f*m_phaseaccu);
-            m_phaseaccu += (m_freq / m_sampleRate);
-            if (m_phaseaccu > 1.0f)
+
+            float left_abs = fabs(left);
+            float right_abs = fabs(right);
+
+            if (left_abs > m_leftLevel)
             {
-                m_phaseaccu -= 1.0f;
+                m_leftLevel = left_abs;
             }
-            else if (m_phaseaccu < -1.0f)
+            if (right_abs > m_rightLevel)
             {
-                m_phaseaccu += 1.0f;
+                m_rightLevel = right_abs;
             }
-            break;
-        case SRC_IMPULSE:
-            left = 0.0f;
-            right = 0.0f;
-        }
 
-        float left_abs = fabs(left);
-        float right_abs = fabs(right);
-
-        if (left_abs > m_leftLevel)
-        {
-            m_leftLevel = left_abs;
+            inLeft[i] = left;
+            inRight[i] = right;
         }
-        if (right_abs > m_rightLevel)
-        {
-            m_rightLevel = right_abs;
-        }
-        executeProgram(left, right, outbuf[i<<1], outbuf[(i<<1)+1]);
 
-        ring_buffer_data_t scope;
-        ring_buffer_data_t spectrum;
-
-        if (m_monitorVar[0] != NULL)
+        float *out = outbuf + (offset<<1);
+        if (m_resampling)
         {
-            scope.s1 = *m_monitorVar[0];
+            runResampled(inLeft, inRight, out, samples, useBlocks);
         }
         else
         {
-            scope.s1 = 0;
+            runProgram(inLeft, inRight, out, samples, useBlocks);
         }
+        offset += samples;
+    }
 
-        if (m_monitorVar[1] != NULL)
-        {
-            scope.s2 = *m_monitorVar[1];
-        }
-        else
-        {
-            scope.s2 = 0;
-        }
+    m_vuLevel[0].store(m_leftLevel, std::memory_order_relaxed);
+    m_vuLevel[1].store(m_rightLevel, std::memory_order_relaxed);
 
-        if (m_monitorVar[2] != NULL)
-        {
-            spectrum.s1 = *m_monitorVar[2];
-        }
-        else
-        {
-            spectrum.s1 = 0;
-        }
+    m_controlMutex.unlock();
+}
 
-        if (m_monitorVar[3] != NULL)
-        {
-            spectrum.s2 = *m_monitorVar[3];
-        }
-        else
+void VirtualMachine::runProgram(const float *inLeft, const float *inRight,
+                                float *outbuf, uint32_t samples, bool useBlocks)
+{
+    if (useBlocks)
+    {
+        executeBlock(inLeft, inRight, outbuf, samples);
+    }
+    else
+    {
+        for(uint32_t i=0; i<samples; i++)
         {
-            spectrum.s2 = 0;
+            executeProgram(inLeft[i], inRight[i], outbuf[i<<1], outbuf[(i<<1)+1]);
+
+            float monitor[4];
+            for(uint32_t k=0; k<4; k++)
+            {
+                monitor[k] = (m_monitorVar[k] != NULL) ? *m_monitorVar[k] : 0.0f;
+            }
+            writeRingBuffers(monitor[0], monitor[1], monitor[2], monitor[3]);
         }
+    }
 
-        PaUtil_WriteRingBuffer(&m_ringbuffer[0], &scope, 1);
-        PaUtil_WriteRingBuffer(&m_ringbuffer[1], &spectrum, 1);
+    if (m_fadeProgram != NULL)
+    {
+        crossfade(inLeft, inRight, outbuf, samples);
+    }
+
+    if (m_profiling && m_runState)
+    {
+        // only this thread writes the counter
+        m_profileRuns.store(m_profileRuns.load(std::memory_order_relaxed) + samples,
+                            std::memory_order_relaxed);
     }
-    m_controlMutex.unlock();
 }
 
-uint32_t VirtualMachine::execFIR(uint32_t n, float *stack)
+void VirtualMachine::runResampled(const float *inLeft, const float *inRight,
+                                  float *outbuf, uint32_t samples, bool useBlocks)
 {
-    return 0;
+    // the program rate is lower, so a block gives
+    // at most VM_BLOCKSIZE samples.
+    float programLeft[VM_BLOCKSIZE];
+    float programRight[VM_BLOCKSIZE];
+    float programOut[2*VM_BLOCKSIZE];
+    const uint32_t n = m_inResampler.process(inLeft, inRight, samples, programLeft, programRight);
+    if (n > 0)
+    {
+        runProgram(programLeft, programRight, programOut, n, useBlocks);
+    }
+
+    for(uint32_t i=0; i<n; i++)
+    {
+        programLeft[i] = programOut[i<<1];
+        programRight[i] = programOut[(i<<1)+1];
+    }
+    m_resampledCount += m_outResampler.process(programLeft, programRight, n,
+                                               m_resampled[0] + m_resampledCount,
+                                               m_resampled[1] + m_resampledCount);
+
+    // both resamplers start at the same time and
+    // round up the number of outputs, so there are
+    // always enough samples for the block.
+    const uint32_t count = std::min(samples, m_resampledCount);
+    for(uint32_t i=0; i<count; i++)
+    {
+        outbuf[i<<1] = m_resampled[0][i];
+        outbuf[(i<<1)+1] = m_resampled[1][i];
+    }
+    for(uint32_t i=count; i<samples; i++)
+    {
+        outbuf[i<<1] = 0.0f;
+        outbuf[(i<<1)+1] = 0.0f;
+    }
+
+    m_resampledCount -= count;
+    memmove(m_resampled[0], m_resampled[0] + count, m_resampledCount*sizeof(float));
+    memmove(m_resampled[1], m_resampled[1] + count, m_resampledCount*sizeof(float));
 }
 
-uint32_t VirtualMachine::execBiquad(uint32_t n, float *stack)
+void VirtualMachine::writeRingBuffers(float scope1, float scope2, float spectrum1, float spectrum2)
 {
-    return 0;
+    ring_buffer_data_t scope;
+    ring_buffer_data_t spectrum;
+
+    scope.s1 = scope1;
+    scope.s2 = scope2;
+    spectrum.s1 = spectrum1;
+    spectrum.s2 = spectrum2;
+
+    PaUtil_WriteRingBuffer(&m_ringbuffer[0], &scope, 1);
+    PaUtil_WriteRingBuffer(&m_ringbuffer[1], &spectrum, 1);
 }
 
 void VirtualMachine::executeProgram(float inLeft, float inRight, float &outLeft, float &outRight)
 {
     const size_t instructions = m_program.size();
-    size_t pc = 0;    // program counter
-    size_t sp = 0;    // stack pointer
-    float stack[2048];
 
     // check if we have a program ..
     // or if we're not running...
@@ -554,10 +1484,65 @@ void VirtualMachine::executeProgram(float inLeft, float inRight, float &outLeft,
         *m_rin = inRight;
     }
 
-    while(pc < instructions)
+    if ((m_engine == ENGINE_REGISTER) && (!m_regops.empty()))
+    {
+        executeRegisters();
+    }
+    else if ((m_engine == ENGINE_JIT) && (m_nativeProgram != NULL))
+    {
+        m_nativeProgram();
+    }
+    else if ((m_engine == ENGINE_CLOSURE) && m_closures.isValid())
+    {
+        m_closures.execute();
+    }
+    else if (!m_threadedCode.empty())
+    {
+        executeThreaded(&m_threadedCode[0]);
+    }
+    else
+    {
+        executeStatements(0, instructions);
+    }
+
+    if (m_out != 0)
+    {
+        outLeft = *m_out;
+        outRight = *m_out;
+    }
+    else
+    {
+        if (m_lout != 0)
+        {
+            outLeft = *m_lout;
+        }
+        else
+        {
+            outLeft = 0.0f;
+        }
+        if (m_rout != 0)
+        {
+            outRight = *m_rout;
+        }
+        else
+        {
+            outRight = 0.0f;
+        }
+    }
+
+    m_delays.advance();
+}
+
+void VirtualMachine::executeStatements(size_t pcBegin, size_t pcEnd)
+{
+    size_t pc = pcBegin;    // program counter
+    size_t sp = 0;          // stack pointer
+    float *stack = &m_stack[0];
+    float *values = m_values.data();
+
+    while(pc < pcEnd)
     {
         VM::instruction_t instruction = m_program[pc++];
-        int32_t offset; // for delay access
         if (instruction.icode & 0x80000000)
         {
             // special instruction with additional parameter
@@ -565,24 +1550,22 @@ void VirtualMachine::executeProgram(float inLeft, float inRight, float &outLeft,
             switch(instruction.icode & 0xff000000)
             {
             case P_readvar:     // push
-                stack[sp++] = m_vars[n].m_value;
+                stack[sp++] = values[n];
                 break;
             case P_writevar:    // pop
-                m_vars[n].m_value = stack[--sp];
+                values[n] = stack[--sp];
                 break;
             case P_fir:
-                sp-=execFIR(n, stack+sp);
+                stack[sp-1] = VM::funcFIR(stack[sp-1], &m_vars[n]);
                 break;
             case P_biquad:
-                sp-=execBiquad(n, stack+sp);
+                stack[sp-1] = VM::funcBiquad(stack[sp-1], &m_vars[n]);
                 break;
             case P_writedelay:  // write to the start of the delay
-                m_vars[n].m_data[m_vars[n].m_idx] = stack[--sp];
+                VM::funcWriteDelay(stack[--sp], &m_vars[n]);
                 break;
             case P_readdelay:   // read from the delay
-                offset = std::floor(stack[sp-1]);   // get offset of delay
-                offset = (m_vars[n].m_idx+offset) % m_vars[n].m_length;
-                stack[sp-1] = m_vars[n].m_data[offset];
+                stack[sp-1] = VM::funcReadDelay(stack[sp-1], &m_vars[n]);
                 break;
             default:
                 // TODO: produce error
@@ -672,7 +1655,13 @@ void VirtualMachine::executeProgram(float inLeft, float inRight, float &outLeft,
                     stack[sp-1]=-1.0f;
                 break;
             case P_noise:
-                stack[sp++]=-1.0f+2.0f*static_cast<float>(rand())/RAND_MAX;
+                stack[sp++]=m_noise->uniform();
+                break;
+            case P_gaussnoise:
+                stack[sp++]=m_noise->gaussian();
+                break;
+            case P_pinknoise:
+                stack[sp++]=m_noise->pink();
                 break;
             case P_trunc:
                 stack[sp-1] = std::trunc(stack[sp-1]);
@@ -694,165 +1683,1410 @@ void VirtualMachine::executeProgram(float inLeft, float inRight, float &outLeft,
                     stack[sp-1]=stack[sp+1];
                 }
                 break;
+            case P_fastsin:
+                stack[sp-1] = VM::fastSin(stack[sp-1]);
+                break;
+            case P_fastcos:
+                stack[sp-1] = VM::fastCos(stack[sp-1]);
+                break;
+            case P_fastsin1:
+                stack[sp-1] = VM::fastSin1(stack[sp-1]);
+                break;
+            case P_fastcos1:
+                stack[sp-1] = VM::fastCos1(stack[sp-1]);
+                break;
+            case P_fasttan:
+                stack[sp-1] = VM::fastTan(stack[sp-1]);
+                break;
+            case P_fasttanh:
+                stack[sp-1] = VM::fastTanh(stack[sp-1]);
+                break;
+            case P_fastpow:
+                sp--;
+                stack[sp-1] = VM::fastPow(stack[sp-1], stack[sp]);
+                break;
+            case P_fastatan2:
+                sp--;
+                stack[sp-1] = VM::fastAtan2(stack[sp-1], stack[sp]);
+                break;
             default:
                 // TODO: produce error
                 break;
             }
         }
-        if (sp>2044)
-        {
-            // stack overflow!
-            return;
-        }
     }
+}
 
-    if (m_out != 0)
-    {
-        outLeft = *m_out;
-        outRight = *m_out;
-    }
-    else
+bool VirtualMachine::resolveRegisters()
+{
+    m_regops.clear();
+    m_regTemps.assign(m_regprogram.temporaries, 0.0f);
+
+    const size_t N = m_regprogram.code.size();
+    for(size_t i=0; i<N; i++)
     {
-        if (m_lout != 0)
+        const VM::reginstr_t &instr = m_regprogram.code[i];
+        regop_t op;
+        op.opcode = instr.opcode;
+
+        // resolve the destination and the three sources.
+        // unused operands are resolved but never read.
+        uint32_t operands[4] = {instr.dst, instr.src[0], instr.src[1], instr.src[2]};
+        float *ptrs[4];
+        for(uint32_t k=0; k<4; k++)
         {
-            outLeft = *m_lout;
+            const uint32_t idx = operands[k] & R_INDEXMASK;
+            switch(operands[k] & R_KINDMASK)
+            {
+            case R_VAR:
+                if (idx >= m_values.size())
+                    return false;
+                ptrs[k] = &m_values[idx];
+                break;
+            case R_CONST:
+                if (idx >= m_regprogram.constants.size())
+                    return false;
+                ptrs[k] = &m_regprogram.constants[idx];
+                break;
+            case R_TEMP:
+                if (idx >= m_regTemps.size())
+                    return false;
+                ptrs[k] = &m_regTemps[idx];
+                break;
+            default:
+                return false;
+            }
         }
-        else
+
+        // delay operations address the delay by index
+        if (op.opcode & 0x80000000)
         {
-            outLeft = 0.0f;
+            uint32_t n = op.opcode & 0xFFFF;
+            uint32_t kind = op.opcode & 0xff000000;
+            if ((kind == P_readdelay) || (kind == P_writedelay))
+            {
+                if ((n >= m_vars.size()) || (m_vars[n].m_type != varInfo::TYPE_DELAY))
+                    return false;
+            }
+            if (kind == P_fir)
+            {
+                if ((n >= m_vars.size()) || (m_vars[n].m_type != varInfo::TYPE_FIR))
+                    return false;
+            }
+            if (kind == P_biquad)
+            {
+                if ((n >= m_vars.size()) || (m_vars[n].m_type != varInfo::TYPE_BIQUAD))
+                    return false;
+            }
+            if ((kind != P_writevar) && (kind != P_writedelay) && (kind != P_readdelay) &&
+                (kind != P_fir) && (kind != P_biquad))
+                return false;
         }
-        if (m_rout != 0)
+        else if ((op.opcode != P_add) && (op.opcode != P_sub) && (op.opcode != P_mul) &&
+                 (op.opcode != P_div) && (op.opcode != P_neg) &&
+                 (functionDefs::getNumberOfArguments(op.opcode) < 0))
         {
-            outRight = *m_rout;
+            // executeRegisters only runs known instructions
+            return false;
         }
-        else
+
+        op.dst = ptrs[0];
+        op.src[0] = ptrs[1];
+        op.src[1] = ptrs[2];
+        op.src[2] = ptrs[3];
+        m_regops.push_back(op);
+    }
+    return true;
+}
+
+void VirtualMachine::executeRegisters()
+{
+    const size_t N = m_regops.size();
+    const regop_t *op = &m_regops[0];
+    for(size_t i=0; i<N; i++, op++)
+    {
+        const float *a = op->src[0];
+        const float *b = op->src[1];
+        const float *c = op->src[2];
+        float *dst = op->dst;
+        if (op->opcode & 0x80000000)
         {
-            outRight = 0.0f;
+            uint32_t n = op->opcode & 0xFFFF;
+            switch(op->opcode & 0xff000000)
+            {
+            case P_writevar:
+                *dst = *a;
+                break;
+            case P_writedelay:
+                VM::funcWriteDelay(*a, &m_vars[n]);
+                break;
+            case P_readdelay:
+                *dst = VM::funcReadDelay(*a, &m_vars[n]);
+                break;
+            case P_fir:
+                *dst = VM::funcFIR(*a, &m_vars[n]);
+                break;
+            case P_biquad:
+                *dst = VM::funcBiquad(*a, &m_vars[n]);
+                break;
+            default:
+                break;
+            }
+            continue;
+        }
+
+        switch(op->opcode)
+        {
+        case P_add:
+            *dst = *a + *b;
+            break;
+        case P_sub:
+            *dst = *a - *b;
+            break;
+        case P_mul:
+            *dst = *a * *b;
+            break;
+        case P_div:
+            *dst = *a / *b;
+            break;
+        case P_neg:
+            *dst = -*a;
+            break;
+        case P_sin:
+            *dst = sin(*a);
+            break;
+        case P_tan:
+            *dst = tan(*a);
+            break;
+        case P_tanh:
+            *dst = tanh(*a);
+            break;
+        case P_cos:
+            *dst = cos(*a);
+            break;
+        case P_sin1:
+            *dst = sin(2.0f*M_PI*(*a));
+            break;
+        case P_cos1:
+            *dst = cos(2.0f*M_PI*(*a));
+            break;
+        case P_mod1:
+            *dst = *a-(int)(*a);
+            break;
+        case P_abs:
+            *dst = fabs(*a);
+            break;
+        case P_sqrt:
+            *dst = sqrt(*a);
+            break;
+        case P_round:
+            *dst = round(*a);
+            break;
+        case P_pow:
+            *dst = pow(*a, *b);
+            break;
+        case P_limit:
+            *dst = std::max(std::min(*a, 1.0f), -1.0f);
+            break;
+        case P_atan2:
+            *dst = atan2(*a, *b);
+            break;
+        case P_sign:
+            *dst = (*a >= 0.0f) ? 1.0f : -1.0f;
+            break;
+        case P_noise:
+            *dst = m_noise->uniform();
+            break;
+        case P_gaussnoise:
+            *dst = m_noise->gaussian();
+            break;
+        case P_pinknoise:
+            *dst = m_noise->pink();
+            break;
+        case P_trunc:
+            *dst = std::trunc(*a);
+            break;
+        case P_ceil:
+            *dst = std::ceil(*a);
+            break;
+        case P_floor:
+            *dst = std::floor(*a);
+            break;
+        case P_choose:
+            *dst = (*a >= 0.0f) ? *b : *c;
+            break;
+        case P_fastsin:
+            *dst = VM::fastSin(*a);
+            break;
+        case P_fastcos:
+            *dst = VM::fastCos(*a);
+            break;
+        case P_fastsin1:
+            *dst = VM::fastSin1(*a);
+            break;
+        case P_fastcos1:
+            *dst = VM::fastCos1(*a);
+            break;
+        case P_fasttan:
+            *dst = VM::fastTan(*a);
+            break;
+        case P_fasttanh:
+            *dst = VM::fastTanh(*a);
+            break;
+        case P_fastpow:
+            *dst = VM::fastPow(*a, *b);
+            break;
+        case P_fastatan2:
+            *dst = VM::fastAtan2(*a, *b);
+            break;
+        default:
+            // resolveRegisters rejects unknown instructions
+            assert(false);
+            break;
         }
     }
+}
 
-    // update the delay line pointers
-    for(uint32_t i=0; i<m_vars.size(); i++)
+// handler numbers of the direct-threaded code,
+// in the same order as the table in executeThreaded.
+enum
+{
+    H_END, H_UNKNOWN, H_ADD, H_SUB, H_MUL, H_DIV, H_NEG, H_LITERAL,
+    H_SIN, H_COS, H_SIN1, H_COS1, H_MOD1, H_ABS, H_ROUND, H_SQRT,
+    H_TAN, H_TANH, H_POW, H_LIMIT, H_ATAN2, H_SIGN, H_NOISE, H_TRUNC,
+    H_CEIL, H_FLOOR, H_CHOOSE,
+    H_FASTSIN, H_FASTCOS, H_FASTSIN1, H_FASTCOS1, H_FASTTAN, H_FASTTANH,
+    H_FASTPOW, H_FASTATAN2, H_GAUSSNOISE, H_PINKNOISE,
+    H_READVAR, H_WRITEVAR, H_FIR, H_BIQUAD, H_WRITEDELAY, H_READDELAY,
+
+    // superinstructions
+    H_ADDC, H_SUBC, H_MULC, H_DIVC,     // operation with a literal
+    H_ADDV, H_SUBV, H_MULV, H_DIVV,     // operation with a variable
+    H_READMULC,                         // push variable * literal
+    H_MULADD,                           // multiply-accumulate of the top three elements
+    H_MACVC,                            // add variable * literal to the top element
+    H_WRITEKEEP,                        // write variable and keep the value on the stack
+    H_COUNT
+};
+
+static const char* const handlerNames[H_COUNT] =
+{
+    "END", "UNKNOWN", "ADD", "SUB", "MUL", "DIV", "NEG", "LOAD",
+    "SIN", "COS", "SIN1", "COS1", "MOD1", "ABS", "ROUND", "SQRT",
+    "TAN", "TANH", "POW", "LIMIT", "ATAN2", "SIGN", "NOISE", "TRUNC",
+    "CEIL", "FLOOR", "CHOOSE",
+    "FASTSIN", "FASTCOS", "FASTSIN1", "FASTCOS1", "FASTTAN", "FASTTANH",
+    "FASTPOW", "FASTATAN2", "GAUSSNOISE", "PINKNOISE",
+    "READ", "WRITE", "FIR", "BIQUAD", "WRITEDELAY", "READDELAY",
+    "ADDC", "SUBC", "MULC", "DIVC",
+    "ADDV", "SUBV", "MULV", "DIVV",
+    "READMULC", "MULADD", "MACVC", "WRITEKEEP"
+};
+
+VirtualMachine::threaded_t VirtualMachine::decodeInstruction(size_t &pc)
+{
+    VM::instruction_t instruction = m_program[pc++];
+    threaded_t code;
+    code.handler = NULL;
+    code.var = NULL;
+    code.constant = 0.0f;
+    code.id = H_UNKNOWN;
+    if (instruction.icode & 0x80000000)
+    {
+        uint32_t n = instruction.icode & 0xFFFF;
+        switch(instruction.icode & 0xff000000)
+        {
+        case P_readvar:
+            code.id = H_READVAR;
+            code.var = &m_values[n];
+            break;
+        case P_writevar:
+            code.id = H_WRITEVAR;
+            code.var = &m_values[n];
+            break;
+        case P_fir:
+            code.id = H_FIR;
+            code.delay = &m_vars[n];
+            break;
+        case P_biquad:
+            code.id = H_BIQUAD;
+            code.delay = &m_vars[n];
+            break;
+        case P_writedelay:
+            code.id = H_WRITEDELAY;
+            code.delay = &m_vars[n];
+            break;
+        case P_readdelay:
+            code.id = H_READDELAY;
+            code.delay = &m_vars[n];
+            break;
+        default:
+            break;
+        }
+    }
+    else
     {
-        if (m_vars[i].m_type == varInfo::TYPE_DELAY)
+        switch(instruction.icode)
         {
-            m_vars[i].m_idx--;
-            if (m_vars[i].m_idx < 0)
+        case P_add: code.id = H_ADD; break;
+        case P_sub: code.id = H_SUB; break;
+        case P_mul: code.id = H_MUL; break;
+        case P_div: code.id = H_DIV; break;
+        case P_neg: code.id = H_NEG; break;
+        case P_literal:
+            code.id = H_LITERAL;
+            code.value = m_program[pc++].value;
+            break;
+        case P_sin:     code.id = H_SIN; break;
+        case P_cos:     code.id = H_COS; break;
+        case P_sin1:    code.id = H_SIN1; break;
+        case P_cos1:    code.id = H_COS1; break;
+        case P_mod1:    code.id = H_MOD1; break;
+        case P_abs:     code.id = H_ABS; break;
+        case P_round:   code.id = H_ROUND; break;
+        case P_sqrt:    code.id = H_SQRT; break;
+        case P_tan:     code.id = H_TAN; break;
+        case P_tanh:    code.id = H_TANH; break;
+        case P_pow:     code.id = H_POW; break;
+        case P_limit:   code.id = H_LIMIT; break;
+        case P_atan2:   code.id = H_ATAN2; break;
+        case P_sign:    code.id = H_SIGN; break;
+        case P_noise:   code.id = H_NOISE; break;
+        case P_trunc:   code.id = H_TRUNC; break;
+        case P_ceil:    code.id = H_CEIL; break;
+        case P_floor:   code.id = H_FLOOR; break;
+        case P_choose:  code.id = H_CHOOSE; break;
+        case P_fastsin:     code.id = H_FASTSIN; break;
+        case P_fastcos:     code.id = H_FASTCOS; break;
+        case P_fastsin1:    code.id = H_FASTSIN1; break;
+        case P_fastcos1:    code.id = H_FASTCOS1; break;
+        case P_fasttan:     code.id = H_FASTTAN; break;
+        case P_fasttanh:    code.id = H_FASTTANH; break;
+        case P_fastpow:     code.id = H_FASTPOW; break;
+        case P_fastatan2:   code.id = H_FASTATAN2; break;
+        case P_gaussnoise:  code.id = H_GAUSSNOISE; break;
+        case P_pinknoise:   code.id = H_PINKNOISE; break;
+        default:
+            break;
+        }
+    }
+    return code;
+}
+
+bool VirtualMachine::fuseInstructions(std::vector<threaded_t> &code)
+{
+    if (code.size() < 2)
+        return false;
+
+    threaded_t &first = code[code.size()-2];
+    const threaded_t &second = code.back();
+
+    uint32_t fused = H_UNKNOWN;
+    switch(second.id)
+    {
+    case H_ADD:
+    case H_SUB:
+    case H_MUL:
+    case H_DIV:
+        if (first.id == H_LITERAL)
+        {
+            // LOAD c; OP -> OPC c
+            fused = H_ADDC + (second.id - H_ADD);
+            first.constant = first.value;
+        }
+        else if (first.id == H_READVAR)
+        {
+            // READ x; OP -> OPV x
+            fused = H_ADDV + (second.id - H_ADD);
+        }
+        else if ((first.id == H_MUL) && (second.id == H_ADD))
+        {
+            // MUL; ADD -> MULADD
+            fused = H_MULADD;
+        }
+        else if ((first.id == H_READMULC) && (second.id == H_ADD))
+        {
+            // READMULC x c; ADD -> MACVC x c
+            fused = H_MACVC;
+        }
+        break;
+    case H_MULC:
+        if (first.id == H_READVAR)
+        {
+            // READ x; MULC c -> READMULC x c
+            fused = H_READMULC;
+            first.constant = second.constant;
+        }
+        break;
+    case H_READVAR:
+        if ((first.id == H_WRITEVAR) && (first.var == second.var))
+        {
+            // WRITE x; READ x -> WRITEKEEP x
+            fused = H_WRITEKEEP;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (fused == H_UNKNOWN)
+        return false;
+
+    first.id = fused;
+    code.pop_back();
+    return true;
+}
+
+#ifdef VM_THREADED_DISPATCH
+
+void VirtualMachine::buildThreadedCode()
+{
+    m_threadedCode.clear();
+    m_threadedSegment.clear();
+
+    if (m_handlers == NULL)
+    {
+        executeThreaded(NULL);
+    }
+
+    if (m_program.size() == 0)
+        return;
+
+    // code for the whole program
+    std::vector<BlockSchedule::range_t> program(1);
+    program[0].begin = 0;
+    program[0].end = (uint32_t)m_program.size();
+    appendThreadedCode(program);
+
+    // code for the serial segments of the block schedule.
+    // all statements of a segment are executed in one go.
+    if (m_schedule.isValid())
+    {
+        const std::vector<BlockSchedule::segment_t> &segments = m_schedule.getSegments();
+        for(const BlockSchedule::segment_t &seg : segments)
+        {
+            m_threadedSegment.push_back(m_threadedCode.size());
+            if (seg.serial)
             {
-                m_vars[i].m_idx = m_vars[i].m_length-1;
+                appendThreadedCode(seg.statements);
             }
         }
     }
 }
 
-void VirtualMachine::dump(std::ostream &s)
+void VirtualMachine::appendThreadedCode(const std::vector<BlockSchedule::range_t> &statements)
 {
-    QMutexLocker lock(&m_controlMutex);
+    std::vector<threaded_t> code;
+    for(const BlockSchedule::range_t &range : statements)
+    {
+        size_t pc = range.begin;
+        while(pc < range.end)
+        {
+            code.push_back(decodeInstruction(pc));
 
-    s << "-- VIRTUAL MACHINE PROGRAM --\n\n";
-    size_t N = m_program.size();
-    for(size_t i=0; i<N; i++)
+            // peephole: keep fusing the tail of the code,
+            // so fused instructions can be fused again.
+            while(fuseInstructions(code)) {}
+        }
+    }
+
+    threaded_t end;
+    end.var = NULL;
+    end.constant = 0.0f;
+    end.id = H_END;
+    code.push_back(end);
+
+    for(threaded_t &instr : code)
     {
-        uint32_t varIdx = m_program[i].icode & 0xFFFF; // variable index)
-        if (m_program[i].icode & 0x80000000)
+        instr.handler = m_handlers[instr.id];
+    }
+    m_threadedCode.insert(m_threadedCode.end(), code.begin(), code.end());
+}
+
+void VirtualMachine::executeThreaded(const threaded_t *ip)
+{
+    static const void* const handlers[H_COUNT] =
+    {
+        &&op_end, &&op_unknown, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_neg, &&op_literal,
+        &&op_sin, &&op_cos, &&op_sin1, &&op_cos1, &&op_mod1, &&op_abs, &&op_round, &&op_sqrt,
+        &&op_tan, &&op_tanh, &&op_pow, &&op_limit, &&op_atan2, &&op_sign, &&op_noise, &&op_trunc,
+        &&op_ceil, &&op_floor, &&op_choose,
+        &&op_fastsin, &&op_fastcos, &&op_fastsin1, &&op_fastcos1, &&op_fasttan, &&op_fasttanh,
+        &&op_fastpow, &&op_fastatan2, &&op_gaussnoise, &&op_pinknoise,
+        &&op_readvar, &&op_writevar, &&op_fir, &&op_biquad, &&op_writedelay, &&op_readdelay,
+        &&op_addc, &&op_subc, &&op_mulc, &&op_divc,
+        &&op_addv, &&op_subv, &&op_mulv, &&op_divv,
+        &&op_readmulc, &&op_muladd, &&op_macvc, &&op_writekeep
+    };
+
+    if (ip == NULL)
+    {
+        m_handlers = handlers;
+        return;
+    }
+
+    // the stack depth of the program was checked when it
+    // was loaded, so the handlers do not check for overflow.
+    float *sp = &m_stack[0];    // points to the first free stack element
+
+#define NEXT() goto *(++ip)->handler
+
+    goto *ip->handler;
+
+op_end:
+    return;
+op_unknown:
+    // getStackDepth rejects unknown instructions at load
+    assert(false);
+    NEXT();
+op_readvar:
+    *sp++ = *ip->var;
+    NEXT();
+op_writevar:
+    *ip->var = *--sp;
+    NEXT();
+op_literal:
+    *sp++ = ip->value;
+    NEXT();
+op_add:
+    sp--;
+    sp[-1] += sp[0];
+    NEXT();
+op_sub:
+    sp--;
+    sp[-1] = sp[-1] - sp[0];
+    NEXT();
+op_mul:
+    sp--;
+    sp[-1] *= sp[0];
+    NEXT();
+op_div:
+    sp--;
+    sp[-1] /= sp[0];
+    NEXT();
+op_neg:
+    sp[-1] = -sp[-1];
+    NEXT();
+op_sin:
+    sp[-1] = sin(sp[-1]);
+    NEXT();
+op_cos:
+    sp[-1] = cos(sp[-1]);
+    NEXT();
+op_sin1:
+    sp[-1] = sin(2.0f*M_PI*sp[-1]);
+    NEXT();
+op_cos1:
+    sp[-1] = cos(2.0f*M_PI*sp[-1]);
+    NEXT();
+op_mod1:
+    sp[-1] = sp[-1]-(int)sp[-1];
+    NEXT();
+op_abs:
+    sp[-1] = fabs(sp[-1]);
+    NEXT();
+op_round:
+    sp[-1] = round(sp[-1]);
+    NEXT();
+op_sqrt:
+    sp[-1] = sqrt(sp[-1]);
+    NEXT();
+op_tan:
+    sp[-1] = tan(sp[-1]);
+    NEXT();
+op_tanh:
+    sp[-1] = tanh(sp[-1]);
+    NEXT();
+op_pow:
+    sp--;
+    sp[-1] = pow(sp[-1], sp[0]);
+    NEXT();
+op_limit:
+    sp[-1] = std::max(std::min(sp[-1], 1.0f), -1.0f);
+    NEXT();
+op_atan2:
+    sp--;
+    sp[-1] = atan2(sp[-1], sp[0]);
+    NEXT();
+op_sign:
+    sp[-1] = (sp[-1] >= 0.0f) ? 1.0f : -1.0f;
+    NEXT();
+op_noise:
+    *sp++ = m_noise->uniform();
+    NEXT();
+op_gaussnoise:
+    *sp++ = m_noise->gaussian();
+    NEXT();
+op_pinknoise:
+    *sp++ = m_noise->pink();
+    NEXT();
+op_trunc:
+    sp[-1] = std::trunc(sp[-1]);
+    NEXT();
+op_ceil:
+    sp[-1] = std::ceil(sp[-1]);
+    NEXT();
+op_floor:
+    sp[-1] = std::floor(sp[-1]);
+    NEXT();
+op_choose:
+    sp -= 2;
+    sp[-1] = (sp[-1] >= 0.0f) ? sp[0] : sp[1];
+    NEXT();
+op_fastsin:
+    sp[-1] = VM::fastSin(sp[-1]);
+    NEXT();
+op_fastcos:
+    sp[-1] = VM::fastCos(sp[-1]);
+    NEXT();
+op_fastsin1:
+    sp[-1] = VM::fastSin1(sp[-1]);
+    NEXT();
+op_fastcos1:
+    sp[-1] = VM::fastCos1(sp[-1]);
+    NEXT();
+op_fasttan:
+    sp[-1] = VM::fastTan(sp[-1]);
+    NEXT();
+op_fasttanh:
+    sp[-1] = VM::fastTanh(sp[-1]);
+    NEXT();
+op_fastpow:
+    sp--;
+    sp[-1] = VM::fastPow(sp[-1], sp[0]);
+    NEXT();
+op_fastatan2:
+    sp--;
+    sp[-1] = VM::fastAtan2(sp[-1], sp[0]);
+    NEXT();
+op_fir:
+    sp[-1] = VM::funcFIR(sp[-1], ip->delay);
+    NEXT();
+op_biquad:
+    sp[-1] = VM::funcBiquad(sp[-1], ip->delay);
+    NEXT();
+op_writedelay:
+    VM::funcWriteDelay(*--sp, ip->delay);
+    NEXT();
+op_readdelay:
+    sp[-1] = VM::funcReadDelay(sp[-1], ip->delay);
+    NEXT();
+op_addc:
+    sp[-1] += ip->constant;
+    NEXT();
+op_subc:
+    sp[-1] = sp[-1] - ip->constant;
+    NEXT();
+op_mulc:
+    sp[-1] *= ip->constant;
+    NEXT();
+op_divc:
+    sp[-1] /= ip->constant;
+    NEXT();
+op_addv:
+    sp[-1] += *ip->var;
+    NEXT();
+op_subv:
+    sp[-1] = sp[-1] - *ip->var;
+    NEXT();
+op_mulv:
+    sp[-1] *= *ip->var;
+    NEXT();
+op_divv:
+    sp[-1] /= *ip->var;
+    NEXT();
+op_readmulc:
+    *sp++ = *ip->var * ip->constant;
+    NEXT();
+op_muladd:
+    sp -= 2;
+    sp[-1] += sp[0]*sp[1];
+    NEXT();
+op_macvc:
+    sp[-1] += *ip->var * ip->constant;
+    NEXT();
+op_writekeep:
+    *ip->var = sp[-1];
+    NEXT();
+
+#undef NEXT
+}
+
+#else
+
+void VirtualMachine::buildThreadedCode()
+{
+    // no direct-threaded dispatch on this compiler,
+    // the switch-based interpreter is used instead.
+    m_threadedCode.clear();
+    m_threadedSegment.clear();
+}
+
+void VirtualMachine::appendThreadedCode(const std::vector<BlockSchedule::range_t> &)
+{
+}
+
+void VirtualMachine::executeThreaded(const threaded_t *)
+{
+}
+
+#endif
+
+void VirtualMachine::setProfiling(bool enabled)
+{
+    command_t cmd;
+    cmd.type = command_t::CMD_PROFILING;
+    cmd.index = 0;
+    cmd.ivalue = enabled ? 1 : 0;
+    cmd.value = 0.0f;
+    postCommand(cmd);
+}
+
+/** count the n-grams of a sequence of instruction names */
+static void countNGrams(const std::vector<const char*> &names, uint32_t n,
+                        std::map<std::string, uint64_t> &counts)
+{
+    for(size_t i=0; i+n<=names.size(); i++)
+    {
+        std::string key = names[i];
+        for(uint32_t k=1; k<n; k++)
         {
-            switch(m_program[i].icode & 0xff000000)
+            key += " ";
+            key += names[i+k];
+        }
+        counts[key]++;
+    }
+}
+
+/** write the most frequent entries of an n-gram table */
+static void writeNGrams(std::ostream &s, const std::map<std::string, uint64_t> &counts,
+                        uint64_t runs, uint32_t maxEntries)
+{
+    std::vector<std::pair<uint64_t, std::string> > sorted;
+    for(auto iter = counts.begin(); iter != counts.end(); iter++)
+    {
+        sorted.push_back(std::make_pair(iter->second, iter->first));
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const std::pair<uint64_t, std::string> &a, const std::pair<uint64_t, std::string> &b)
+        {
+            return a.first > b.first;
+        });
+
+    for(size_t i=0; (i<sorted.size()) && (i<maxEntries); i++)
+    {
+        s << "  " << sorted[i].first*runs << "\t" << sorted[i].second << "\n";
+    }
+}
+
+void VirtualMachine::dumpProfile(std::ostream &s, uint32_t maxEntries)
+{
+    // like dump(), the program is only replaced by the GUI
+    // thread. the counter is read at the start, so all
+    // n-grams are weighted by the same number of runs.
+    const uint64_t runs = m_profileRuns.load(std::memory_order_relaxed);
+
+    // instruction names of the stack program
+    std::vector<const char*> names;
+    size_t pc = 0;
+    while(pc < m_program.size())
+    {
+        names.push_back(handlerNames[decodeInstruction(pc).id]);
+    }
+
+    // instruction names of the fused threaded program
+    std::vector<const char*> fusedNames;
+    for(size_t i=0; (i<m_threadedCode.size()) && (m_threadedCode[i].id != H_END); i++)
+    {
+        fusedNames.push_back(handlerNames[m_threadedCode[i].id]);
+    }
+
+    s << "-- OPCODE PROFILE --\n\n";
+    s << runs << " program runs\n";
+    s << names.size() << " stack instructions per run\n";
+    if (!fusedNames.empty())
+    {
+        s << fusedNames.size() << " threaded instructions per run after fusion\n";
+    }
+
+    for(uint32_t n=1; n<=3; n++)
+    {
+        std::map<std::string, uint64_t> counts;
+        countNGrams(names, n, counts);
+        s << "\nstack instruction " << n << "-grams:\n";
+        writeNGrams(s, counts, runs, maxEntries);
+    }
+
+    for(uint32_t n=1; (n<=2) && (!fusedNames.empty()); n++)
+    {
+        std::map<std::string, uint64_t> counts;
+        countNGrams(fusedNames, n, counts);
+        s << "\nfused instruction " << n << "-grams:\n";
+        writeNGrams(s, counts, runs, maxEntries);
+    }
+}
+
+void VirtualMachine::buildNativeCode()
+{
+    m_jit.clear();
+    m_nativeProgram = NULL;
+    m_nativeSegment.clear();
+
+    if ((!JITCompiler::isSupported()) || (m_program.size() == 0))
+        return;
+
+    std::vector<BlockSchedule::range_t> program(1);
+    program[0].begin = 0;
+    program[0].end = (uint32_t)m_program.size();
+    int32_t programIdx = m_jit.addFunction(m_program, m_vars, m_values, m_noise, program);
+
+    std::vector<int32_t> segmentIdx;
+    if (m_schedule.isValid())
+    {
+        for(const BlockSchedule::segment_t &seg : m_schedule.getSegments())
+        {
+            int32_t idx = -1;
+            if (seg.serial)
             {
-            case P_readvar:
-                s << "READ " << m_vars[varIdx].m_name.c_str() << "\n";
-                break;
-            case P_writevar:
-                s << "WRITE " << m_vars[varIdx].m_name.c_str() << "\n";
-                break;
-            case P_readdelay:
-                s << "READDELAY " << m_vars[varIdx].m_name.c_str() << "\n";
+                idx = m_jit.addFunction(m_program, m_vars, m_values, m_noise, seg.statements);
+            }
+            segmentIdx.push_back(idx);
+        }
+    }
+
+    if (!m_jit.finalize())
+    {
+        // nothing could be compiled, or there is no
+        // executable memory: use the interpreter.
+        m_jit.clear();
+        return;
+    }
+
+    m_nativeProgram = m_jit.getFunction(programIdx);
+    for(int32_t idx : segmentIdx)
+    {
+        m_nativeSegment.push_back(m_jit.getFunction(idx));
+    }
+}
+
+void VirtualMachine::executeBlock(const float *inLeft, const float *inRight,
+                                  float *outbuf, uint32_t samples)
+{
+    float *rows = &m_blockRows[0];
+
+    // setup input signal rows
+    if (m_ioRow[IO_IN] >= 0)
+    {
+        float *row = rows + m_ioRow[IO_IN]*VM_BLOCKSIZE;
+        for(uint32_t i=0; i<samples; i++)
+        {
+            row[i] = (inLeft[i] + inRight[i]) / 2.0f;
+        }
+    }
+    if (m_ioRow[IO_INL] >= 0)
+    {
+        memcpy(rows + m_ioRow[IO_INL]*VM_BLOCKSIZE, inLeft, sizeof(float)*samples);
+    }
+    if (m_ioRow[IO_INR] >= 0)
+    {
+        memcpy(rows + m_ioRow[IO_INR]*VM_BLOCKSIZE, inRight, sizeof(float)*samples);
+    }
+
+    const std::vector<BlockSchedule::segment_t> &segments = m_schedule.getSegments();
+    const uint32_t blockPosition = m_delays.getPosition();
+    const bool threaded = !m_threadedCode.empty();
+    const bool native = !m_nativeSegment.empty();
+    for(size_t segIdx=0; segIdx<segments.size(); segIdx++)
+    {
+        const BlockSchedule::segment_t &seg = segments[segIdx];
+        if (!seg.serial)
+        {
+            for(const BlockSchedule::range_t &range : seg.statements)
+            {
+                executeBlockStatement(range.begin, range.end, samples);
+            }
+            continue;
+        }
+
+        // statements in a feedback loop run sample-by-sample
+        // on the scalar variables. each segment starts at
+        // the delay position of the start of the block.
+        m_delays.setPosition(blockPosition);
+        for(uint32_t i=0; i<samples; i++)
+        {
+            for(uint32_t v : seg.gather)
+            {
+                m_values[v] = rows[m_schedule.getRow(v)*VM_BLOCKSIZE + i];
+            }
+            if (native && (m_nativeSegment[segIdx] != NULL))
+            {
+                m_nativeSegment[segIdx]();
+            }
+            else if (threaded)
+            {
+                executeThreaded(&m_threadedCode[m_threadedSegment[segIdx]]);
+            }
+            else
+            {
+                for(const BlockSchedule::range_t &range : seg.statements)
+                {
+                    executeStatements(range.begin, range.end);
+                }
+            }
+            for(uint32_t v : seg.scatter)
+            {
+                rows[m_schedule.getRow(v)*VM_BLOCKSIZE + i] = m_values[v];
+            }
+            m_delays.advance();
+        }
+    }
+
+    // all delay lines have moved a whole block
+    m_delays.setPosition(blockPosition - samples);
+
+    // collect outputs. variables that are never
+    // written hold the same value for the whole block.
+    const float *outRow[3];
+    const float *outVar[3] = {m_out, m_lout, m_rout};
+    for(uint32_t k=0; k<3; k++)
+    {
+        const int32_t row = m_ioRow[IO_OUT+k];
+        outRow[k] = (row >= 0) ? rows + row*VM_BLOCKSIZE : NULL;
+    }
+
+    for(uint32_t i=0; i<samples; i++)
+    {
+        float left = 0.0f;
+        float right = 0.0f;
+        if (m_out != 0)
+        {
+            left = (outRow[0] != NULL) ? outRow[0][i] : *outVar[0];
+            right = left;
+        }
+        else
+        {
+            if (m_lout != 0)
+            {
+                left = (outRow[1] != NULL) ? outRow[1][i] : *outVar[1];
+            }
+            if (m_rout != 0)
+            {
+                right = (outRow[2] != NULL) ? outRow[2][i] : *outVar[2];
+            }
+        }
+        outbuf[i<<1] = left;
+        outbuf[(i<<1)+1] = right;
+    }
+
+    // send monitored variables to the GUI
+    const float *monitor[4];
+    uint32_t stride[4];
+    const float zero = 0.0f;
+    for(uint32_t k=0; k<4; k++)
+    {
+        const int32_t row = (m_monitorIdx[k] >= 0) ? m_schedule.getRow(m_monitorIdx[k]) : -1;
+        if (row >= 0)
+        {
+            monitor[k] = rows + row*VM_BLOCKSIZE;
+            stride[k] = 1;
+        }
+        else
+        {
+            monitor[k] = (m_monitorVar[k] != NULL) ? m_monitorVar[k] : &zero;
+            stride[k] = 0;
+        }
+    }
+
+    for(uint32_t i=0; i<samples; i++)
+    {
+        writeRingBuffers(monitor[0][i*stride[0]], monitor[1][i*stride[1]],
+                         monitor[2][i*stride[2]], monitor[3][i*stride[3]]);
+    }
+
+    // leave the last value of the block in the
+    // scalar variables, so the next block and
+    // the sample-by-sample engine can continue.
+    const uint32_t nvars = (uint32_t)m_vars.size();
+    for(uint32_t v=0; v<nvars; v++)
+    {
+        const int32_t row = m_schedule.getRow(v);
+        if (row >= 0)
+        {
+            m_values[v] = rows[row*VM_BLOCKSIZE + samples - 1];
+        }
+    }
+}
+
+void VirtualMachine::executeBlockStatement(size_t pcBegin, size_t pcEnd, uint32_t samples)
+{
+    float *rows = &m_blockRows[0];
+    float *stack = &m_blockStack[3*VM_BLOCKSIZE];
+    size_t pc = pcBegin;    // program counter
+    size_t sp = 0;          // stack pointer, in rows of VM_BLOCKSIZE floats
+
+    while(pc < pcEnd)
+    {
+        VM::instruction_t instruction = m_program[pc++];
+
+        // top of stack and the elements below it
+        float *s0 = stack + sp*VM_BLOCKSIZE;
+        float *s1 = s0 - VM_BLOCKSIZE;
+        float *s2 = s1 - VM_BLOCKSIZE;
+        float *s3 = s2 - VM_BLOCKSIZE;
+        if (instruction.icode & 0x80000000)
+        {
+            uint32_t n = instruction.icode & 0xFFFF;
+            int32_t row = m_schedule.getRow(n);
+            switch(instruction.icode & 0xff000000)
+            {
+            case P_readvar:     // push
+                if (row >= 0)
+                {
+                    memcpy(s0, rows + row*VM_BLOCKSIZE, sizeof(float)*samples);
+                }
+                else
+                {
+                    const float value = m_values[n];
+                    for(uint32_t i=0; i<samples; i++) s0[i] = value;
+                }
+                sp++;
                 break;
-            case P_writedelay:
-                s << "WRITEDELAY " << m_vars[varIdx].m_name.c_str() << "\n";
+            case P_writevar:    // pop
+                memcpy(rows + row*VM_BLOCKSIZE, s1, sizeof(float)*samples);
+                sp--;
                 break;
             default:
-                s << "UNKNOWN\n";
+                // delays, FIR and biquad are never
+                // scheduled for block execution
                 break;
             }
         }
         else
         {
-            switch(m_program[i].icode)
+            switch(instruction.icode)
             {
             case P_add:
-                s << "ADD\n";
+                for(uint32_t i=0; i<samples; i++) s2[i] += s1[i];
+                sp--;
                 break;
             case P_sub:
-                s << "SUB\n";
+                for(uint32_t i=0; i<samples; i++) s2[i] -= s1[i];
+                sp--;
                 break;
             case P_mul:
-                s << "MUL\n";
+                for(uint32_t i=0; i<samples; i++) s2[i] *= s1[i];
+                sp--;
                 break;
             case P_div:
-                s << "DIV\n";
+                for(uint32_t i=0; i<samples; i++) s2[i] /= s1[i];
+                sp--;
                 break;
-            case P_literal:
-                s << "LOAD " << m_program[i+1].value << "\n";
-                i++;
+            case P_neg:
+                for(uint32_t i=0; i<samples; i++) s1[i] = -s1[i];
                 break;
             case P_sin:
-                s << "SIN\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = sin(s1[i]);
+                break;
+            case P_tan:
+                for(uint32_t i=0; i<samples; i++) s1[i] = tan(s1[i]);
+                break;
+            case P_tanh:
+                for(uint32_t i=0; i<samples; i++) s1[i] = tanh(s1[i]);
                 break;
             case P_cos:
-                s << "COS\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = cos(s1[i]);
                 break;
             case P_sin1:
-                s << "SIN1\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = sin(2.0f*M_PI*s1[i]);
                 break;
             case P_cos1:
-                s << "COS1\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = cos(2.0f*M_PI*s1[i]);
                 break;
+            case P_literal:
+            {
+                const float value = m_program[pc++].value;
+                for(uint32_t i=0; i<samples; i++) s0[i] = value;
+                sp++;
+                break;
+            }
             case P_mod1:
-                s << "MOD1\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = s1[i]-(int)s1[i];
                 break;
             case P_abs:
-                s << "ABS\n";
-                break;
-            case P_tan:
-                s << "TAN\n";
-                break;
-            case P_tanh:
-                s << "TANH\n";
-                break;
-            case P_pow:
-                s << "POW\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = fabs(s1[i]);
                 break;
             case P_sqrt:
-                s << "SQRT\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = sqrt(s1[i]);
                 break;
             case P_round:
-                s << "ROUND\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = round(s1[i]);
+                break;
+            case P_pow:
+                for(uint32_t i=0; i<samples; i++) s2[i] = pow(s2[i], s1[i]);
+                sp--;
                 break;
             case P_limit:
-                s << "LIMIT\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = std::max(std::min(s1[i], 1.0f), -1.0f);
                 break;
             case P_atan2:
-                s << "ATAN2\n";
+                for(uint32_t i=0; i<samples; i++) s2[i] = atan2(s2[i], s1[i]);
+                sp--;
+                break;
+            case P_sign:
+                for(uint32_t i=0; i<samples; i++) s1[i] = (s1[i] >= 0.0f) ? 1.0f : -1.0f;
                 break;
             case P_noise:
-                s << "NOISE\n";
+                m_noise->uniform(s0, samples);
+                sp++;
+                break;
+            case P_gaussnoise:
+                m_noise->gaussian(s0, samples);
+                sp++;
+                break;
+            case P_pinknoise:
+                m_noise->pink(s0, samples);
+                sp++;
                 break;
             case P_trunc:
-                s << "TRUNC\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = std::trunc(s1[i]);
                 break;
             case P_ceil:
-                s << "CEIL\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = std::ceil(s1[i]);
                 break;
             case P_floor:
-                s << "FLOOR\n";
+                for(uint32_t i=0; i<samples; i++) s1[i] = std::floor(s1[i]);
                 break;
             case P_choose:
-                s << "CHOOSE\n";
+                for(uint32_t i=0; i<samples; i++) s3[i] = (s3[i] >= 0.0f) ? s2[i] : s1[i];
+                sp-=2;
+                break;
+            // the fast functions are inlined, so the
+            // compiler can vectorize these loops.
+            case P_fastsin:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastSin(s1[i]);
+                break;
+            case P_fastcos:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastCos(s1[i]);
+                break;
+            case P_fastsin1:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastSin1(s1[i]);
+                break;
+            case P_fastcos1:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastCos1(s1[i]);
+                break;
+            case P_fasttan:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastTan(s1[i]);
+                break;
+            case P_fasttanh:
+                for(uint32_t i=0; i<samples; i++) s1[i] = VM::fastTanh(s1[i]);
+                break;
+            case P_fastpow:
+                for(uint32_t i=0; i<samples; i++) s2[i] = VM::fastPow(s2[i], s1[i]);
+                sp--;
+                break;
+            case P_fastatan2:
+                for(uint32_t i=0; i<samples; i++) s2[i] = VM::fastAtan2(s2[i], s1[i]);
+                sp--;
+                break;
+            default:
+                // getStackDepth rejects unknown instructions at load
+                assert(false);
+                break;
+            }
+        }
+    }
+}
+/** get the mnemonic of an opcode without variable index */
+static const char* opcodeName(uint32_t opcode)
+{
+    switch(opcode)
+    {
+    case P_add:     return "ADD";
+    case P_sub:     return "SUB";
+    case P_mul:     return "MUL";
+    case P_div:     return "DIV";
+    case P_neg:     return "NEG";
+    case P_literal: return "LOAD";
+    case P_sin:     return "SIN";
+    case P_cos:     return "COS";
+    case P_sin1:    return "SIN1";
+    case P_cos1:    return "COS1";
+    case P_mod1:    return "MOD1";
+    case P_abs:     return "ABS";
+    case P_tan:     return "TAN";
+    case P_tanh:    return "TANH";
+    case P_pow:     return "POW";
+    case P_sqrt:    return "SQRT";
+    case P_round:   return "ROUND";
+    case P_limit:   return "LIMIT";
+    case P_atan2:   return "ATAN2";
+    case P_sign:    return "SIGN";
+    case P_noise:   return "NOISE";
+    case P_trunc:   return "TRUNC";
+    case P_ceil:    return "CEIL";
+    case P_floor:   return "FLOOR";
+    case P_choose:  return "CHOOSE";
+    case P_fastsin:     return "FASTSIN";
+    case P_fastcos:     return "FASTCOS";
+    case P_fastsin1:    return "FASTSIN1";
+    case P_fastcos1:    return "FASTCOS1";
+    case P_fasttan:     return "FASTTAN";
+    case P_fasttanh:    return "FASTTANH";
+    case P_fastpow:     return "FASTPOW";
+    case P_fastatan2:   return "FASTATAN2";
+    case P_gaussnoise:  return "GAUSSNOISE";
+    case P_pinknoise:   return "PINKNOISE";
+    default:        return "UNKNOWN";
+    }
+}
+
+void VirtualMachine::dumpOperand(std::ostream &s, uint32_t operand)
+{
+    const uint32_t idx = operand & R_INDEXMASK;
+    switch(operand & R_KINDMASK)
+    {
+    case R_VAR:
+        s << m_vars[idx].m_name.c_str();
+        break;
+    case R_CONST:
+        s << m_regprogram.constants[idx];
+        break;
+    case R_TEMP:
+        s << "t" << idx;
+        break;
+    default:
+        s << "?";
+        break;
+    }
+}
+
+void VirtualMachine::dump(std::ostream &s)
+{
+    // the program is only replaced by loadProgram on the
+    // GUI thread, so it is read without the control mutex,
+    // which would mute the audio thread.
+    s << "-- VIRTUAL MACHINE PROGRAM --\n\n";
+    size_t N = m_program.size();
+    for(size_t i=0; i<N; i++)
+    {
+        uint32_t varIdx = m_program[i].icode & 0xFFFF; // variable index)
+        if (m_program[i].icode & 0x80000000)
+        {
+            switch(m_program[i].icode & 0xff000000)
+            {
+            case P_readvar:
+                s << "READ " << m_vars[varIdx].m_name.c_str() << "\n";
+                break;
+            case P_writevar:
+                s << "WRITE " << m_vars[varIdx].m_name.c_str() << "\n";
+                break;
+            case P_readdelay:
+                s << "READDELAY " << m_vars[varIdx].m_name.c_str() << "\n";
+                break;
+            case P_writedelay:
+                s << "WRITEDELAY " << m_vars[varIdx].m_name.c_str() << "\n";
+                break;
+            case P_fir:
+                s << "FIR " << m_vars[varIdx].m_name.c_str() << "\n";
+                break;
+            case P_biquad:
+                s << "BIQUAD " << m_vars[varIdx].m_name.c_str() << "\n";
                 break;
             default:
                 s << "UNKNOWN\n";
                 break;
             }
         }
+        else if (m_program[i].icode == P_literal)
+        {
+            s << "LOAD " << m_program[i+1].value << "\n";
+            i++;
+        }
+        else
+        {
+            s << opcodeName(m_program[i].icode) << "\n";
+        }
+    }
+
+    if (m_jit.getCodeSize() > 0)
+    {
+        s << "\n" << m_jit.getCodeSize() << " bytes of native code";
+        if (m_nativeProgram == NULL)
+        {
+            s << ", program runs in the interpreter";
+        }
+        s << "\n";
+    }
+
+    if (m_closures.isValid())
+    {
+        s << m_closures.getNumberOfClosures() << " closures\n";
+    }
+
+    if (m_regops.empty())
+        return;
+
+    s << "\n-- REGISTER PROGRAM --\n\n";
+    N = m_regprogram.code.size();
+    for(size_t i=0; i<N; i++)
+    {
+        const VM::reginstr_t &instr = m_regprogram.code[i];
+        uint32_t varIdx = instr.opcode & 0xFFFF;
+        if (instr.opcode & 0x80000000)
+        {
+            switch(instr.opcode & 0xff000000)
+            {
+            case P_writevar:
+                dumpOperand(s, instr.dst);
+                s << " = ";
+                dumpOperand(s, instr.src[0]);
+                break;
+            case P_readdelay:
+                dumpOperand(s, instr.dst);
+                s << " = " << m_vars[varIdx].m_name.c_str() << "[";
+                dumpOperand(s, instr.src[0]);
+                s << "]";
+                break;
+            case P_writedelay:
+                s << m_vars[varIdx].m_name.c_str() << " = ";
+                dumpOperand(s, instr.src[0]);
+                break;
+            case P_fir:
+            case P_biquad:
+                dumpOperand(s, instr.dst);
+                s << " = " << m_vars[varIdx].m_name.c_str() << "(";
+                dumpOperand(s, instr.src[0]);
+                s << ")";
+                break;
+            default:
+                s << "UNKNOWN";
+                break;
+            }
+        }
+        else
+        {
+            int32_t nargs = 1;
+            if ((instr.opcode == P_add) || (instr.opcode == P_sub) ||
+                (instr.opcode == P_mul) || (instr.opcode == P_div))
+            {
+                nargs = 2;
+            }
+            else if (instr.opcode != P_neg)
+            {
+                nargs = functionDefs::getNumberOfArguments(instr.opcode);
+            }
+
+            dumpOperand(s, instr.dst);
+            s << " = " << opcodeName(instr.opcode);
+            for(int32_t k=0; k<nargs; k++)
+            {
+                s << ((k == 0) ? " " : ", ");
+                dumpOperand(s, instr.src[k]);
+            }
+        }
+        s << "\n";
     }
+    s << "\n" << N << " register instructions, "
+      << m_regprogram.constants.size() << " constants, "
+      << m_regprogram.temporaries << " temporaries\n";
 }
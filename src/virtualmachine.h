@@ -15,69 +15,38 @@
 
 #include <stdint.h>
 #include <vector>
-#include <QMutex>
-#include "varinfo.h"
-#include "qmainwindow.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include "vmtypes.h"
+#include "blockschedule.h"
+#include "jitcompiler.h"
+#include "closureprogram.h"
+#include "delayarena.h"
+#include "noisegenerator.h"
+#include "oscillator.h"
+#include "resampler.h"
 #include "portaudio.h"
-#include "portaudio_helper.h"
 #include "pa_ringbuffer.h"
 #include "wavstreamer.h"
 
-#ifndef M_PI
-#define M_PI 3.1415927
+// GCC and Clang support labels as values, which
+// the VM uses for direct-threaded dispatch.
+// Other compilers use the switch-based interpreter.
+#if defined(__GNUC__) && !defined(VM_NO_THREADED_DISPATCH)
+#define VM_THREADED_DISPATCH
 #endif
 
-// instruction set of the VM
-#define P_add 1
-#define P_sub 2
-#define P_mul 3
-#define P_div 4
-#define P_neg 5
-
-#define P_literal 200
-
-#define P_sin   100
-#define P_cos   101
-#define P_sin1  102
-#define P_cos1  103
-#define P_mod1  104
-#define P_abs   105
-#define P_round 106
-#define P_sqrt  107
-#define P_tan   108
-#define P_tanh  109
-#define P_pow   110
-#define P_limit 111
-#define P_atan2 112
-#define P_sign  113
-#define P_noise 114
-#define P_trunc 115
-#define P_ceil  116
-#define P_floor 117
-#define P_choose 118
-
-// the following opcodes use the lower 16 bits for further identifying a variable or FIR
-#define P_writevar      0x81000000
-#define P_readvar       0x82000000
-#define P_fir           0x83000000
-#define P_biquad        0x84000000
-#define P_writedelay    0x85000000
-#define P_readdelay     0x86000000
-
-namespace VM
-{
-    union instruction_t
-    {
-        uint32_t icode;
-        float    value;
-    };
-
-    typedef std::vector<instruction_t> program_t;
-    typedef std::vector<varInfo>       variables_t;
+// number of samples at the soundcard rate that the
+// output resampler can hold, VM_BLOCKSIZE for the
+// current block plus the samples left over from the
+// previous one
+#define VM_RESAMPLEDSIZE (2*VM_BLOCKSIZE + 2*RESAMPLER_MAXRATIO)
 
-    /** find a variable by name. returns -1 if not found */
-    int32_t findVariableByName(const variables_t &vars, const std::string &name);
-}
+// number of control commands that can be queued
+// for the audio thread. must be a power of two.
+#define VM_COMMANDQUEUESIZE 1024
 
 /** Virtual machine that executes BasicDSP programs.
     The VM runs in a different thread (due to PortAudio)
@@ -87,15 +56,70 @@ namespace VM
 class VirtualMachine
 {
 public:
-    VirtualMachine(QMainWindow *guiWindow);
+    VirtualMachine();
     virtual ~VirtualMachine();
 
     /** load a program consisting of byte code */
     void loadProgram(const VM::program_t &program, const VM::variables_t &variables);
 
-    /** start the execution of the program */
+    /** load a program consisting of stack byte code and
+        the equivalent register byte code. */
+    void loadProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                     const VM::variables_t &variables);
+
+    /** load a program consisting of stack byte code, the
+        equivalent register byte code and expression trees.
+        The program is built on the calling thread. While the
+        VM is running, the audio thread swaps it in at the
+        start of a buffer, so the stream keeps running.
+        Variables and delay lines with the same name as in
+        the previous program keep their values. */
+    void loadProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                     const VM::exprprogram_t &exprprogram, const VM::variables_t &variables);
+
+    /** set the duration of the crossfade from the previous
+        to the new program in seconds. 0 switches at once. */
+    void setCrossfade(float seconds);
+
+    /** set the sample rate in Hz of the programs loaded after
+        this call. A program with a lower rate than the
+        soundcard runs behind a polyphase resampler, so it is
+        executed less often. 0 runs programs at the rate of
+        the soundcard, as does a rate that is not lower or
+        cannot be converted. Returns the rate the programs
+        will run at. */
+    float setProgramSamplerate(float Hz);
+
+    /** the sample rate of the loaded program in Hz */
+    float getProgramSamplerate() const
+    {
+        return m_programRate;
+    }
+
+    /** time in seconds from the last call to loadProgram
+        until the new program was running */
+    double getSwapLatency() const
+    {
+        return m_swapLatency;
+    }
+
+    /** start the execution of the program on the
+        soundcard. PortAudio is initialised here on
+        the first call. */
     bool start();
 
+    /** return the variables, delay lines and filter
+        states of the loaded program to their initial
+        values, as if it was loaded again. The audio
+        thread resets them at its next buffer. */
+    void resetProgramState();
+
+    /** start the execution of the program without an
+        audio stream. The caller runs the program by
+        calling processSamples, for instance to render
+        a file faster than real time. */
+    void startOffline();
+
     /** stop the execution of the program */
     void stop();
 
@@ -110,32 +134,91 @@ public:
                         float *outbuf,
                         uint32_t framesPerBuffer);
 
-    /** get the current VU levels */
+    /** get the current VU levels.
+        This is called periodically by the GUI, so it also
+        sends the commands that did not fit in the queue. */
     void getVU(float &left, float &right)
     {
-        QMutexLocker locker(&m_controlMutex);
-        left = m_leftLevel;
-        right = m_rightLevel;
+        flushPendingCommands();
+        left = m_vuLevel[0].load(std::memory_order_relaxed);
+        right = m_vuLevel[1].load(std::memory_order_relaxed);
     }
 
     /** set the value of a slider */
     void setSlider(uint32_t id, float value);
 
     /** set the source input */
-    enum src_t {SRC_SOUNDCARD, SRC_NOISE, SRC_SINE, SRC_QUADSINE, SRC_WAV, SRC_IMPULSE};
+    enum src_t {SRC_SOUNDCARD, SRC_NOISE, SRC_SINE, SRC_QUADSINE, SRC_WAV, SRC_IMPULSE,
+                SRC_SWEEP, SRC_LOGSWEEP, SRC_MULTITONE};
     void setSource(src_t source);
 
-    /** set the frequency for the sine or quadsine generator in Hertz */
+    /** set the frequency for the sine or quadsine generator in Hertz.
+        this is the start frequency of a sweep and the base
+        frequency of the multi-tone source. */
     void setFrequency(double Hz);
 
-    /** dump the (human readable) VM program to an output stream */
+    /** set the sweep rate, in Hertz per second for SRC_SWEEP
+        and in octaves per second for SRC_LOGSWEEP */
+    void setSweepRate(double rate);
+
+    /** set the tones of the multi-tone source as multiples
+        of the frequency */
+    void setTones(const std::vector<float> &ratios);
+
+    /** set the seed of the noise generator, which is
+        restarted from it now and at every start(). */
+    void setNoiseSeed(uint32_t seed);
+
+    /** select the execution engine.
+        ENGINE_SAMPLE runs the whole program once per sample.
+        ENGINE_BLOCK runs each statement over a block of
+        VM_BLOCKSIZE samples, except for statements that
+        are part of a feedback loop.
+        ENGINE_REGISTER runs the register byte code once
+        per sample, if it was loaded.
+        ENGINE_JIT runs the program as native code once
+        per sample. It falls back to the interpreter if
+        the program could not be compiled.
+        ENGINE_CLOSURE runs the expression trees compiled
+        into closures once per sample, if they were loaded.
+        It is the portable alternative to ENGINE_JIT.
+
+        The block engine also runs its serial segments
+        as native code when available.
+    */
+    enum engine_t {ENGINE_SAMPLE, ENGINE_BLOCK, ENGINE_REGISTER, ENGINE_JIT, ENGINE_CLOSURE};
+    void setEngine(engine_t engine);
+
+    engine_t getEngine() const
+    {
+        return m_engine;
+    }
+
+    /** dump the (human readable) VM program to an output stream.
+        must be called by the thread that loads the programs. */
     void dump(std::ostream &s);
 
+    /** enable or disable opcode profiling.
+        enabling the profiler resets its counters.
+        The audio thread applies it at its next buffer. */
+    void setProfiling(bool enabled);
+
+    /** write the opcode n-gram profile to an output stream.
+        The byte code has no branches, so every program run
+        executes each instruction exactly once. The profile
+        therefore weights the n-grams of the program by the
+        number of runs counted while profiling was enabled.
+        Both the plain stack instructions and the direct-threaded
+        code after superinstruction fusion are reported, the
+        latter shows which sequences are still left to fuse.
+    */
+    void dumpProfile(std::ostream &s, uint32_t maxEntries = 20);
+
     /** set monitoring variables for ring buffer */
     bool setMonitoringVariable(uint32_t ringBufID, uint32_t channel, const std::string &varname);
 
     /** set the audio file for the wav streamer */
-    bool setAudioFile(const QString &filename);
+    bool setAudioFile(const std::string &filename);
 
     /** returns true if there is a valid audio file to use */
     bool hasAudioFile();
@@ -144,10 +227,17 @@ public:
         to allow the reading of data by the GUI thread */
     PaUtilRingBuffer* getRingBufferPtr(uint32_t ringBufID);
 
-    /** set the soundcard device parameters */
+    /** set the soundcard device parameters.
+        paNoDevice selects the default device when the
+        stream is started. */
     void setupSoundcard(PaDeviceIndex inDevice, PaDeviceIndex outDevice,
                         float sampleRate);
 
+    /** set the sample rate in Hz of a VM that runs without
+        a soundcard. Programs must be loaded after this call,
+        as the rate is part of the program. */
+    void setSamplerate(float Hz);
+
     PaDeviceIndex getInputDevice() const
     {
         return m_inDevice;
@@ -170,39 +260,254 @@ public:
     };
 
 protected:
+    struct staging_t {};
+
+    /** create a VM that only holds a program, which is
+        built off the audio thread and then swapped into
+        'machine'. It has no audio stream of its own. */
+    VirtualMachine(const VirtualMachine *machine, staging_t);
+
+    /** build a program and its variables in this VM */
+    void buildProgram(const VM::program_t &program, const VM::regprogram_t &regprogram,
+                      const VM::exprprogram_t &exprprogram, const VM::variables_t &variables);
+
+    /** restart the noise, the test signals, the
+        resamplers and the levels for a new run */
+    void resetRun();
+
+    /** return the variables and delay lines to their
+        initial values. called by the audio thread. */
+    void resetValues();
+
+    /** set m_programRate from the requested rate and
+        design the resamplers for it */
+    void setupResampling();
+
+    /** the rate a program requesting 'Hz' runs at */
+    float getEffectiveRate(float Hz) const;
+
+    /** run the program over a block of samples at
+        the rate of the program, writing interleaved
+        stereo output */
+    void runProgram(const float *inLeft, const float *inRight,
+                    float *outbuf, uint32_t samples, bool useBlocks);
+
+    /** convert a block of input samples to the rate of
+        the program, run it and convert the output back
+        to the rate of the soundcard */
+    void runResampled(const float *inLeft, const float *inRight,
+                      float *outbuf, uint32_t samples, bool useBlocks);
+
+    /** find the variables of the previous program
+        that this program takes over */
+    void findCarriedVariables(const VM::variables_t &previous);
+
+    /** exchange the program with the one in 'next',
+        carrying over the state. 'next' holds the previous
+        program afterwards, which is returned through
+        m_retiredProgram, after a crossfade if requested. */
+    void swapProgram(VirtualMachine *next, bool crossfade);
+
+    /** mix the output of the previous program into
+        the output buffer during a crossfade */
+    void crossfade(const float *inLeft, const float *inRight,
+                   float *outbuf, uint32_t samples);
+
+    /** control command from the GUI thread to the audio thread */
+    struct command_t
+    {
+        enum type_t {CMD_SLIDER, CMD_SOURCE, CMD_FREQUENCY, CMD_MONITOR, CMD_SEED, CMD_SWEEPRATE,
+                     CMD_TONES, CMD_PROFILING, CMD_RESET};
+
+        type_t      type;
+        uint32_t    index;      // slider number, monitor channel or tone number
+        int32_t     ivalue;     // source, monitored variable index, noise seed, number of tones
+                                // or profiling on/off
+        float       value;      // slider value, frequency, sweep rate or tone ratio
+    };
+
+    /** send a command to the audio thread without blocking it.
+        when the queue is full, the command is kept and sent
+        later. A newer command for the same control replaces
+        it, so only the latest value is sent. */
+    void postCommand(const command_t &cmd);
+
+    /** move the pending commands to the queue, as far as
+        they fit. only called by the GUI thread. */
+    void flushPendingCommands();
+
+    /** apply all queued commands. must be called
+        by the audio thread or with the control
+        mutex held. */
+    void processCommands();
+
+    /** apply a single command */
+    void applyCommand(const command_t &cmd);
+
     /** initialize internal pointers */
     void init();
 
     /** execute the program once */
     void executeProgram(float inLeft, float inRight, float &outLeft, float &outRight);
 
-    /** calculate FIR output.
-        returns the number of stack elements that are popped.
+    /** execute the instructions in the range [pcBegin, pcEnd) once */
+    void executeStatements(size_t pcBegin, size_t pcEnd);
+
+    /** write a register operand in human readable form */
+    void dumpOperand(std::ostream &s, uint32_t operand);
+
+    /** execute the register program once */
+    void executeRegisters();
+
+    /** resolve the operands of the register program
+        to pointers. returns false if an operand is
+        out of range. */
+    bool resolveRegisters();
+
+    /** one pre-decoded instruction of the direct-threaded code */
+    struct threaded_t
+    {
+        const void *handler;    // address of the instruction handler
+        union
+        {
+            float       *var;   // variable for read and write
+            varInfo     *delay; // delay line or filter
+            float       value;  // literal value
+        };
+        float       constant;   // constant operand of superinstructions
+        uint32_t    id;         // handler number
+    };
+
+    /** translate the stack program into direct-threaded code
+        for the whole program and for each serial segment
+        of the block schedule. */
+    void buildThreadedCode();
+
+    /** append the statements to the direct-threaded code,
+        fuse common instruction sequences into superinstructions
+        and terminate the code with an end instruction. */
+    void appendThreadedCode(const std::vector<BlockSchedule::range_t> &statements);
+
+    /** decode one stack instruction at pc and advance pc */
+    threaded_t decodeInstruction(size_t &pc);
+
+    /** try to fuse the last two instructions of the code
+        into a superinstruction. returns true if fused. */
+    static bool fuseInstructions(std::vector<threaded_t> &code);
+
+    /** execute direct-threaded code starting at ip
+        until an end instruction is reached.
+        when ip is NULL, only the handler table is set up.
     */
-    uint32_t execFIR(uint32_t n, float *stack);
+    void executeThreaded(const threaded_t *ip);
+
+    /** compile the program and the serial segments of
+        the block schedule into native code, if possible. */
+    void buildNativeCode();
 
-    /** calculate Biquad section.
-        returns the number of stack elements that are popped.
+    /** execute the program for a block of samples
+        using the block schedule.
+        the outputs are written interleaved to outbuf.
     */
-    uint32_t execBiquad(uint32_t n, float *stack);
+    void executeBlock(const float *inLeft, const float *inRight,
+                      float *outbuf, uint32_t samples);
+
+    /** execute one statement for a block of samples */
+    void executeBlockStatement(size_t pcBegin, size_t pcEnd, uint32_t samples);
+
+    /** send one sample of the monitored variables to the GUI */
+    void writeRingBuffers(float scope1, float scope2, float spectrum1, float spectrum2);
 
-    QMainWindow *m_guiWindow;
     PaStream    *m_stream;
+    bool        m_paInitialized;    // true once start() has initialised PortAudio
 
     PaDeviceIndex m_inDevice;
     PaDeviceIndex m_outDevice;
     double      m_sampleRate;   // the current sample rate in Hz
 
+    // virtual sample rate. the program runs at m_programRate,
+    // the resamplers convert from and to the soundcard rate.
+    float       m_requestedRate;    // rate of the programs to load, 0 for the soundcard rate
+    float       m_programRate;      // rate of the loaded program in Hz
+    bool        m_resampling;       // true if m_programRate differs from m_sampleRate
+    Resampler   m_inResampler;      // soundcard to program rate
+    Resampler   m_outResampler;     // program to soundcard rate
+    float       m_resampled[2][VM_RESAMPLEDSIZE];   // output at the soundcard rate, left and right
+    uint32_t    m_resampledCount;   // samples in m_resampled
+
     float       m_leftLevel;    // the left channel VU level
     float       m_rightLevel;   // the right channel VU level
     bool        m_runState;     // true if VM is running a program
 
-    QMutex      m_controlMutex; // mutex to synchronize GUI and VM threads
+    std::atomic<float> m_vuLevel[2];    // VU levels published to the GUI thread
+
+    // the control mutex protects loading programs and
+    // starting and stopping the stream. The audio thread
+    // does not wait for it and mutes while it is held.
+    // All other controls go through the command queue.
+    std::mutex  m_controlMutex; // mutex to synchronize GUI and VM threads
+    PaUtilRingBuffer m_commandQueue;    // lock-free queue of command_t from the GUI thread
+    std::vector<command_t> m_pendingCommands;   // commands that did not fit in the queue
+
+    // program hot-swap. the GUI thread publishes a new
+    // program in m_nextProgram, the audio thread returns
+    // the previous one in m_retiredProgram.
+    bool        m_staging;          // true if this VM only holds a program
+    std::atomic<VirtualMachine*> m_nextProgram;     // program to swap in, or NULL
+    std::atomic<VirtualMachine*> m_retiredProgram;  // previous program to delete, or NULL
+    VirtualMachine  *m_fadeProgram; // previous program during a crossfade, or NULL
+    uint32_t    m_fadePosition;     // samples of the crossfade done
+    uint32_t    m_fadeLength;       // length of the crossfade in samples
+    std::atomic<float> m_crossfadeTime; // crossfade duration in seconds
+    std::vector<std::pair<uint32_t, uint32_t> > m_carried;  // previous and new index of carried variables
+    std::chrono::steady_clock::time_point m_swapTime;       // when the last program was swapped in
+    double      m_swapLatency;      // seconds from loadProgram to the swap
 
     VM::program_t   m_program;  // VM byte code
     VM::variables_t m_vars;     // VM program variables
+    VM::values_t    m_values;   // current values of m_vars, by variable index
+    DelayArena      m_delays;   // memory of the delay lines in m_vars
 
     src_t   m_source;           // selected input source
+    std::atomic<engine_t> m_engine; // selected execution engine
+
+    NoiseGenerator  m_noiseGenerator;   // noise of the input source and the program
+    NoiseGenerator  *m_noise;           // generator in use, that of the machine for a staging VM
+    uint32_t        m_noiseSeed;        // seed used at start()
+
+    /** register instruction with its operands resolved
+        to the variable store, constant pool or temporaries */
+    struct regop_t
+    {
+        uint32_t    opcode;
+        float       *dst;
+        const float *src[3];
+    };
+
+    VM::regprogram_t        m_regprogram;   // register byte code
+    std::vector<regop_t>    m_regops;       // resolved register byte code, empty if unavailable
+    std::vector<float>      m_regTemps;     // temporary registers
+
+    std::vector<threaded_t> m_threadedCode;     // direct-threaded code, empty if unavailable
+    std::vector<size_t>     m_threadedSegment;  // start of the threaded code of each block segment
+    const void* const       *m_handlers;        // handler addresses used by executeThreaded
+
+    JITCompiler                         m_jit;              // native code generator
+    JITCompiler::function_t             m_nativeProgram;    // native code of the whole program, or NULL
+    std::vector<JITCompiler::function_t> m_nativeSegment;   // native code of each block segment, or NULL
+
+    ClosureProgram  m_closures;     // expression trees compiled into closures
+
+    bool        m_profiling;        // true if program runs are counted, set by the audio thread
+    std::atomic<uint64_t> m_profileRuns;    // number of program runs while profiling
+
+    BlockSchedule       m_schedule;     // statement schedule for block execution
+    std::vector<float>  m_blockRows;    // per-sample variable values for block execution
+    std::vector<float>  m_blockStack;   // stack for block execution
+    std::vector<float>  m_stack;        // stack for sample execution, sized to the program
+
+    enum {IO_IN, IO_INL, IO_INR, IO_OUT, IO_OUTL, IO_OUTR};
+    int32_t m_ioRow[6];         // block rows of the input and output variables, or -1
 
     // the following pointers are variables in
     // m_vars, or NULL if the variable does not exist
@@ -215,12 +520,13 @@ protected:
     float   *m_out;             // pointer to mono OUT variable
     float   *m_slider[4];       // pointers to slider variables
 
-    float   m_freq;             // sine or quadsine frequency (in Hz)
-    float   m_phaseaccu;        // phase accumulator [0..1) for frequency generator
+    Oscillator  m_oscillator;   // generator of the sine, sweep and multi-tone sources
+    float       m_toneRatios[OSC_MAXTONES]; // tones received by the audio thread
 
     // variables to send to spectrum & scope displays
     // can be NULL if nothing is selected
     float   *m_monitorVar[4];
+    int32_t m_monitorIdx[4];    // variable index of the monitored variables, or -1
 
     // thread-safe ring buffers for GUI I/O
     PaUtilRingBuffer m_ringbuffer[2];
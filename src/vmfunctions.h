@@ -0,0 +1,122 @@
+/*
+
+  Description:  Built-in functions of the VM that are
+                evaluated out of line by the native and
+                closure backends.
+
+                They evaluate exactly the same expressions
+                as the interpreter, so all backends produce
+                identical results.
+
+  License: GPLv2
+
+*/
+
+#ifndef vmfunctions_h
+#define vmfunctions_h
+
+#include <math.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include "vmtypes.h"
+#include "firkernel.h"
+#include "fastmath.h"
+#include "noisegenerator.h"
+
+namespace VM
+{
+    inline float funcSin(float x)   { return sin(x); }
+    inline float funcCos(float x)   { return cos(x); }
+    inline float funcSin1(float x)  { return sin(2.0f*M_PI*x); }
+    inline float funcCos1(float x)  { return cos(2.0f*M_PI*x); }
+    inline float funcMod1(float x)  { return x-(int)x; }
+    inline float funcAbs(float x)   { return fabs(x); }
+    inline float funcRound(float x) { return round(x); }
+    inline float funcSqrt(float x)  { return sqrt(x); }
+    inline float funcTan(float x)   { return tan(x); }
+    inline float funcTanh(float x)  { return tanh(x); }
+    inline float funcTrunc(float x) { return std::trunc(x); }
+    inline float funcCeil(float x)  { return std::ceil(x); }
+    inline float funcFloor(float x) { return std::floor(x); }
+    inline float funcPow(float x, float y)      { return pow(x, y); }
+    inline float funcAtan2(float y, float x)    { return atan2(y, x); }
+
+    inline float funcLimit(float x)
+    {
+        return std::max(std::min(x, 1.0f), -1.0f);
+    }
+
+    inline float funcSign(float x)
+    {
+        return (x >= 0.0f) ? 1.0f : -1.0f;
+    }
+
+    inline float funcChoose(float c, float a, float b)
+    {
+        return (c >= 0.0f) ? a : b;
+    }
+
+    inline float funcNoise(NoiseGenerator *noise)
+    {
+        return noise->uniform();
+    }
+
+    inline float funcGaussNoise(NoiseGenerator *noise)
+    {
+        return noise->gaussian();
+    }
+
+    inline float funcPinkNoise(NoiseGenerator *noise)
+    {
+        return noise->pink();
+    }
+
+    /** read a delay line at offset x from the current position.
+        the offset is truncated, offsets beyond the allocated
+        length wrap around. */
+    inline float funcReadDelay(float x, varInfo *delay)
+    {
+        const uint32_t offset = static_cast<uint32_t>(static_cast<int32_t>(x));
+        return delay->m_data[(*delay->m_position + offset) & delay->m_mask];
+    }
+
+    /** write the current position of a delay line */
+    inline void funcWriteDelay(float x, varInfo *delay)
+    {
+        delay->m_data[*delay->m_position & delay->m_mask] = x;
+    }
+
+    /** filter x with a FIR filter. the history is kept
+        twice in a row, so the last samples are always
+        contiguous for the kernel. */
+    inline float funcFIR(float x, varInfo *fir)
+    {
+        const uint32_t pos = *fir->m_position & fir->m_mask;
+        fir->m_data[pos] = x;
+        fir->m_data[pos + fir->m_mask + 1] = x;
+        return firKernel(fir->m_data + pos, &fir->m_coefficients[0],
+                         fir->m_length, (uint32_t)fir->m_coefficients.size());
+    }
+
+    /** filter x with a cascade of biquad sections in
+        transposed direct form II. the coefficients of
+        each section are b0, b1, b2, a1, a2. */
+    inline float funcBiquad(float x, varInfo *biquad)
+    {
+        const float *c = &biquad->m_coefficients[0];
+        float *state = biquad->m_data;
+        for(int32_t i=0; i<biquad->m_length; i++)
+        {
+            const float y = c[0]*x + state[0];
+            state[0] = c[1]*x - c[3]*y + state[1];
+            state[1] = c[2]*x - c[4]*y;
+            x = y;
+            c += 5;
+            state += 2;
+        }
+        return x;
+    }
+}
+
+#endif
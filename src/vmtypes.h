@@ -0,0 +1,182 @@
+/*
+
+  Byte code definitions shared by the compiler
+  and the virtual machine
+
+  Copyright 2006-2016
+  Niels A. Moseley
+  Pieter-Tjerk de Boer
+
+  License: GPLv2
+
+*/
+
+#ifndef vmtypes_h
+#define vmtypes_h
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "varinfo.h"
+
+#ifndef M_PI
+#define M_PI 3.1415927
+#endif
+
+// maximum depth of the evaluation stack of
+// the stack byte code. deeper programs are
+// rejected by the compiler.
+#define VM_MAXSTACKDEPTH 2044
+
+// instruction set of the VM
+#define P_add 1
+#define P_sub 2
+#define P_mul 3
+#define P_div 4
+#define P_neg 5
+
+#define P_literal 200
+
+#define P_sin   100
+#define P_cos   101
+#define P_sin1  102
+#define P_cos1  103
+#define P_mod1  104
+#define P_abs   105
+#define P_round 106
+#define P_sqrt  107
+#define P_tan   108
+#define P_tanh  109
+#define P_pow   110
+#define P_limit 111
+#define P_atan2 112
+#define P_sign  113
+#define P_noise 114
+#define P_trunc 115
+#define P_ceil  116
+#define P_floor 117
+#define P_choose 118
+
+// fast approximations of the transcendental functions,
+// see fastmath.h. programs in fast-math mode use these
+// instead of the exact functions above. Like the other
+// functions, ID-100 is their index in g_functionDefs.
+#define P_fastsin   124
+#define P_fastcos   125
+#define P_fastsin1  126
+#define P_fastcos1  127
+#define P_fasttan   128
+#define P_fasttanh  129
+#define P_fastpow   130
+#define P_fastatan2 131
+
+// noise variants of P_noise
+#define P_gaussnoise 132
+#define P_pinknoise  133
+
+// the following opcodes use the lower 16 bits for further identifying a variable or FIR
+#define P_writevar      0x81000000
+#define P_readvar       0x82000000
+#define P_fir           0x83000000
+#define P_biquad        0x84000000
+#define P_writedelay    0x85000000
+#define P_readdelay     0x86000000
+
+// operand kinds of the register byte code.
+// the lower bits hold the variable index,
+// constant pool index or temporary register number.
+#define R_VAR       0x00000000
+#define R_CONST     0x40000000
+#define R_TEMP      0x80000000
+#define R_KINDMASK  0xC0000000
+#define R_INDEXMASK 0x3FFFFFFF
+
+namespace VM
+{
+    union instruction_t
+    {
+        uint32_t icode;
+        float    value;
+    };
+
+    typedef std::vector<instruction_t> program_t;
+    typedef std::vector<varInfo>       variables_t;
+
+    /** runtime values of the variables of a program.
+        The index of a variable in variables_t is its slot
+        in values_t, so the byte code addresses the values
+        directly. The values are kept apart from the
+        variable information to keep them dense. */
+    typedef std::vector<float>         values_t;
+
+    /** three-address instruction of the register byte code.
+        dst = opcode(src[0], src[1], src[2])
+        The opcodes are the same as for the stack byte code;
+        P_readdelay and P_writedelay keep the delay index in
+        their lower 16 bits and P_writevar is a plain move.
+    */
+    struct reginstr_t
+    {
+        uint32_t opcode;
+        uint32_t dst;       // destination operand
+        uint32_t src[3];    // source operands, unused ones are 0
+    };
+
+    struct regprogram_t
+    {
+        regprogram_t() : temporaries(0) {}
+
+        std::vector<reginstr_t> code;
+        std::vector<float>      constants;      // constant pool
+        uint32_t                temporaries;    // number of temporary registers
+    };
+
+    /** node of an expression tree program.
+        The opcodes are the same as for the stack byte code,
+        the variable or delay index of P_readvar, P_writevar,
+        P_readdelay and P_writedelay is kept in 'index'.
+    */
+    struct exprnode_t
+    {
+        uint32_t    opcode;
+        uint32_t    index;      // variable or delay index
+        float       value;      // value of P_literal
+        int32_t     args[3];    // argument nodes, unused ones are -1
+    };
+
+    struct exprprogram_t
+    {
+        std::vector<exprnode_t> nodes;
+        std::vector<uint32_t>   statements; // root node of each statement
+    };
+
+    /** determine the maximum depth of the evaluation stack
+        of a stack program. returns false if the program
+        underflows the stack, leaves values on the stack,
+        contains an instruction with an unknown stack effect
+        or needs more than VM_MAXSTACKDEPTH entries. */
+    bool getStackDepth(const program_t &program, uint32_t &depth);
+
+    /** how far back in time the outputs of a program
+        depend on its inputs */
+    struct memory_t
+    {
+        bool        bounded;    // false if a value is fed back to itself, as in an IIR filter
+        uint32_t    length;     // number of past samples the state depends on, if bounded
+        int32_t     feedback;   // a variable, delay or biquad in a feedback loop, -1 if none
+        bool        noise;      // true if the program uses a noise generator
+    };
+
+    /** determine the memory of an expression tree program.
+        A variable that is read before it is written keeps
+        one sample of state, a delay line or FIR filter keeps
+        m_length samples rounded up to a power of two. The memory is the longest chain of
+        such state elements, it is unbounded if an element
+        depends on its own earlier values. */
+    void getMemory(const exprprogram_t &program, const variables_t &vars, memory_t &memory);
+
+    /** find a variable by name. returns -1 if not found */
+    int32_t findVariableByName(const variables_t &vars, const std::string &name);
+}
+
+#endif
@@ -11,9 +11,10 @@
 
   rev3: first working version
   rev4: converted to unicode filenames & wxwidgets FileStream
+  rev5: standard C++ streams, so the VM does not depend on Qt
 ********************************************************************/
 
-#include <QFile>
+#include <string.h>
 #include "wavstreamer.h"
 
 #define TEMPBUFFERSIZE 65536
@@ -36,55 +37,54 @@ WavStreamer::~WavStreamer()
         delete[] static_cast<char*>(tempBuffer);
 }
 
-int32_t WavStreamer::openFile(const QString &filename)
+void WavStreamer::closeFile()
 {
-    if (m_waveStream != 0)
-    {
-        delete m_waveStream;
-        m_waveStream = 0;
-    }
+    delete m_waveStream;    // destructor automatically closes the file.
+    m_waveStream = NULL;
+}
+
+uint32_t WavStreamer::readBytes(void *buffer, uint32_t bytes)
+{
+    m_waveStream->read(static_cast<char*>(buffer), bytes);
+    return static_cast<uint32_t>(m_waveStream->gcount());
+}
 
-    if (m_file.isOpen())
+int32_t WavStreamer::openFile(const std::string &filename)
+{
+    if (m_waveStream != 0)
     {
-        m_file.close();
+        closeFile();
     }
 
     m_isOK = false;
 
     // try to open the file
-    m_file.setFileName(filename);
-    if (m_file.open(QIODevice::ReadOnly) == false)
+    m_waveStream = new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!m_waveStream->is_open())
     {
+        closeFile();
         return -2;  // error opening file
     }
 
-    m_waveStream = new QDataStream(&m_file);
-
     // check for RIFF file & size
-    size_t bytes = m_waveStream->readRawData(m_chunkType, 4);
+    size_t bytes = readBytes(m_chunkType, 4);
     if ((bytes != 4) || (strncmp(m_chunkType, "RIFF", 4)!=0))
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
-    bytes = m_waveStream->readRawData((char*)&m_chunkSize, 4);
+    bytes = readBytes(&m_chunkSize, 4);
     if (bytes != 4)
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
-    bytes = m_waveStream->readRawData((char*)&m_chunkType, 4);
+    bytes = readBytes(&m_chunkType, 4);
     if ((bytes != 4) && (strncmp(m_chunkType, "WAVE", 4)!=0))
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
@@ -92,14 +92,12 @@ int32_t WavStreamer::openFile(const QString &filename)
     if (!findChunk("fmt "))
     {
         // error, format chunk not found!
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
     // now, read the format chunk
-    bytes = m_waveStream->readRawData((char*)&m_waveFormat, sizeof(WavFormatChunk));
+    bytes = readBytes(&m_waveFormat, sizeof(WavFormatChunk));
     if (m_waveFormat.wFormatTag == 65534)  // WAVE_FORMAT_EXTENSIBLE case..
     {
         m_waveFormat.wFormatTag = 1;  // treat as PCM data, which should be the same when we have only 2 channels.
@@ -107,17 +105,13 @@ int32_t WavStreamer::openFile(const QString &filename)
 
     if (((m_waveFormat.wFormatTag != 3) && (m_waveFormat.wFormatTag != 1)) || (m_waveFormat.wChannels != 2))
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;  // wrong format!
     }
     // formats smaller than 16 bits are not supported!
     if (m_waveFormat.wBitsPerSample < 16)
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
@@ -125,19 +119,17 @@ int32_t WavStreamer::openFile(const QString &filename)
     // important in the WAVE_FORMAT_EXTENSIBLE case!
     if (sizeof(WavFormatChunk) != m_chunkSize)
     {
-        m_waveStream->skipRawData(m_chunkSize - sizeof(WavFormatChunk));
+        m_waveStream->seekg(m_chunkSize - sizeof(WavFormatChunk), std::ios::cur);
     }
 
     // now, search for the audio data and set the file offset pointers
     if (!findChunk("data"))
     {
-        delete m_waveStream;
-        m_waveStream = NULL;
-        m_file.close();
+        closeFile();
         return -1;
     }
 
-    m_playStart  = m_waveStream->device()->pos();
+    m_playStart  = m_waveStream->tellg();
     m_playOffset = m_playStart;
     m_playEnd    = m_playStart + m_chunkSize;
 
@@ -161,21 +153,21 @@ bool WavStreamer::findChunk(const char ID[4])
         return false;
     }
 
-    size_t bytesRead = m_waveStream->device()->pos();
+    size_t bytesRead = m_waveStream->tellg();
     m_chunkSize = 0;
 
     // iterate until we get a format chunk..
     while ((m_riffSize > bytesRead) && (strncmp(m_chunkType, ID, 4)!=0))
     {
         // skip the size of the chunk (except for the first RIFF chunk!)
-        m_waveStream->skipRawData(m_chunkSize);
+        m_waveStream->seekg(m_chunkSize, std::ios::cur);
         bytesRead += m_chunkSize;
 
         // read type of next chunk
-        size_t bytes = m_waveStream->readRawData(m_chunkType, 4);
+        size_t bytes = readBytes(m_chunkType, 4);
         bytesRead += bytes;
 
-        bytes = m_waveStream->readRawData((char*)&m_chunkSize, 4);
+        bytes = readBytes(&m_chunkSize, 4);
         bytesRead += bytes;
     }
 
@@ -217,7 +209,7 @@ uint32_t WavStreamer::readRawData(uint32_t requestedSamples)
         if (bytes_to_read > (m_playEnd - m_playOffset))  // check for wrap-around
         {
             int readAmount = (m_playEnd - m_playOffset);
-            uint32_t bytesRead = m_waveStream->readRawData(static_cast<char*>(tempBuffer) + offset, readAmount);
+            uint32_t bytesRead = readBytes(static_cast<char*>(tempBuffer) + offset, readAmount);
             if (bytesRead != readAmount)
             {
                 // FIXME: file read error
@@ -225,7 +217,8 @@ uint32_t WavStreamer::readRawData(uint32_t requestedSamples)
                 return 0;
             }
 
-            m_waveStream->device()->seek(m_playStart);
+            m_waveStream->clear();
+            m_waveStream->seekg(m_playStart);
 
             offset += readAmount;
             m_playOffset = m_playStart;
@@ -233,7 +226,7 @@ uint32_t WavStreamer::readRawData(uint32_t requestedSamples)
         }
         else
         {
-            uint32_t bytesRead = m_waveStream->readRawData(static_cast<char*>(tempBuffer) + offset, bytes_to_read);
+            uint32_t bytesRead = readBytes(static_cast<char*>(tempBuffer) + offset, bytes_to_read);
             if (bytesRead != bytes_to_read)
             {
                 // FIXME: file read error
@@ -337,6 +330,30 @@ void WavStreamer::fillBuffer(float *stereoBuffer, uint32_t stereoSamples)
     }
 }
 
+bool WavStreamer::seek(uint32_t stereoSample)
+{
+    if ((m_waveStream == NULL) || (stereoSample >= getSampleCount()))
+    {
+        return false;
+    }
+
+    m_playOffset = m_playStart + stereoSample*m_waveFormat.wBlockAlign;
+    m_waveStream->clear();
+    m_waveStream->seekg(m_playOffset);
+    readRawData(TEMPBUFFERSIZE);
+    sampleIndex = 0;
+    return m_isOK;
+}
+
+uint32_t WavStreamer::getSampleCount() const
+{
+    if ((m_waveStream == NULL) || (m_waveFormat.wBlockAlign == 0))
+    {
+        return 0;
+    }
+    return (m_playEnd - m_playStart) / m_waveFormat.wBlockAlign;
+}
+
 bool WavStreamer::getFormat(WavFormatChunk &output) const
 {
     if (m_waveStream == NULL)
@@ -14,13 +14,9 @@
 #ifndef wavstreamer_h
 #define wavstreamer_h
 
-#include <QFile>
-#include <QString>
-#include <QMutex>
-#include <QMutexLocker>
-#include <QDataStream>
-
 #include <stdint.h>
+#include <string>
+#include <fstream>
 // ----------------------------------------------------------
 
 #pragma pack(push)
@@ -58,7 +54,7 @@ public:
     /** Opens a file for reading
         @return error code. 0 = ok, -1 = invalid format, -2 = cannot open file
     */
-    int32_t openFile(const QString &filename);
+    int32_t openFile(const std::string &filename);
 
     /** returns true if there is a correct wav file to be streamed */
     bool isOK() const
@@ -76,9 +72,8 @@ public:
     void fillBuffer(float *stereoBuffer, uint32_t stereoSamples);
 
     /** returns the filename of the currently loaded file. */
-    QString GetFilename()
+    std::string GetFilename()
     {
-        //QMutexLocker lock(&m_mutex);
         return m_filename;
     }
 
@@ -88,9 +83,18 @@ public:
     */
     bool getFormat(WavFormatChunk &output) const;
 
-protected:
-    //QMutex  m_mutex;            // mutex for protecting loading & buffer filling.
+    /** returns the number of stereo samples in the file,
+        after which fillBuffer starts over at the beginning.
+        0 if no file was opened.
+    */
+    uint32_t getSampleCount() const;
+
+    /** continue streaming at stereo sample 'stereoSample'
+        @return false if the sample is not in the file
+    */
+    bool seek(uint32_t stereoSample);
 
+protected:
     bool findChunk(const char ID[4]);
 
     /** ReadSamples fills temp_buffer with data.
@@ -98,9 +102,16 @@ protected:
     */
     uint32_t readRawData(uint32_t requestedSamples);
 
-    QFile       m_file;
-    QDataStream *m_waveStream;          // the file to be used
-    QString     m_filename;
+    /** read 'bytes' bytes from the file.
+        @return the number of bytes read
+    */
+    uint32_t readBytes(void *buffer, uint32_t bytes);
+
+    /** close the file after an error */
+    void closeFile();
+
+    std::ifstream *m_waveStream;        // the file to be used
+    std::string m_filename;
 
     uint32_t    m_riffSize;
     int32_t     m_playOffset;      // playback offset (into file)
@@ -0,0 +1,180 @@
+/*
+
+  Description:  Writer of .wav files with 32-bit
+                float samples.
+
+  License: GPLv2
+
+*/
+
+#include <string.h>
+#include "wavstreamer.h"
+#include "wavwriter.h"
+
+// largest data chunk a RIFF file can describe
+#define WAVWRITER_MAXBYTES 0xFFFFFF00u
+
+// size of the RIFF header, the samples follow it
+#define WAVWRITER_HEADERSIZE 44
+
+static void putU32(char *p, uint32_t v)
+{
+    // RIFF files are little endian
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)((v >> 8) & 0xFF);
+    p[2] = (char)((v >> 16) & 0xFF);
+    p[3] = (char)(v >> 24);
+}
+
+static void putU16(char *p, uint16_t v)
+{
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)(v >> 8);
+}
+
+WavWriter::WavWriter()
+    : m_channels(0),
+      m_sampleRate(0),
+      m_frames(0),
+      m_part(false)
+{
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+int32_t WavWriter::openFile(const std::string &filename, uint32_t channels, uint32_t sampleRate)
+{
+    close();
+
+    if ((channels == 0) || (channels > 16) || (sampleRate == 0))
+    {
+        return -1;
+    }
+
+    m_file.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open())
+    {
+        return -2;
+    }
+
+    m_channels = channels;
+    m_sampleRate = sampleRate;
+    m_frames = 0;
+    m_part = false;
+
+    // the sizes are filled in by close()
+    writeHeader();
+    return m_file.good() ? 0 : -2;
+}
+
+int32_t WavWriter::openPart(const std::string &filename, uint32_t channels, uint32_t firstFrame)
+{
+    close();
+
+    if ((channels == 0) || (channels > 16) ||
+        ((uint64_t)firstFrame * channels * sizeof(float) > WAVWRITER_MAXBYTES))
+    {
+        return -1;
+    }
+
+    m_file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_file.is_open())
+    {
+        return -2;
+    }
+
+    m_channels = channels;
+    m_frames = firstFrame;
+    m_part = true;
+    m_file.seekp(WAVWRITER_HEADERSIZE + (std::streamoff)firstFrame * channels * sizeof(float));
+    return m_file.good() ? 0 : -2;
+}
+
+bool WavWriter::skip(uint32_t frames)
+{
+    if (!m_file.is_open())
+    {
+        return false;
+    }
+
+    const uint64_t bytes = (uint64_t)(m_frames + (uint64_t)frames) * m_channels * sizeof(float);
+    if (bytes > WAVWRITER_MAXBYTES)
+    {
+        return false;
+    }
+    if (frames == 0)
+    {
+        return true;
+    }
+
+    // writing the last byte makes the file long enough,
+    // the bytes before it read as zero.
+    m_file.seekp(WAVWRITER_HEADERSIZE + (std::streamoff)bytes - 1);
+    m_file.put(0);
+    m_frames += frames;
+    return m_file.good();
+}
+
+void WavWriter::writeHeader()
+{
+    const uint32_t dataBytes = m_frames * m_channels * sizeof(float);
+
+    char header[WAVWRITER_HEADERSIZE];
+    memcpy(header, "RIFF", 4);
+    putU32(header + 4, 36 + dataBytes);
+    memcpy(header + 8, "WAVE", 4);
+
+    memcpy(header + 12, "fmt ", 4);
+    putU32(header + 16, sizeof(WavFormatChunk));
+    putU16(header + 20, 3);     // IEEE float
+    putU16(header + 22, (uint16_t)m_channels);
+    putU32(header + 24, m_sampleRate);
+    putU32(header + 28, m_sampleRate * m_channels * sizeof(float));
+    putU16(header + 32, (uint16_t)(m_channels * sizeof(float)));
+    putU16(header + 34, 32);
+
+    memcpy(header + 36, "data", 4);
+    putU32(header + 40, dataBytes);
+
+    m_file.write(header, sizeof(header));
+}
+
+bool WavWriter::write(const float *samples, uint32_t frames)
+{
+    if (!m_file.is_open())
+    {
+        return false;
+    }
+
+    const uint64_t bytes = (uint64_t)(m_frames + (uint64_t)frames) * m_channels * sizeof(float);
+    if (bytes > WAVWRITER_MAXBYTES)
+    {
+        return false;
+    }
+
+    // the samples are written in the byte order of the
+    // machine, as WavStreamer reads them.
+    m_file.write(reinterpret_cast<const char*>(samples), frames * m_channels * sizeof(float));
+    m_frames += frames;
+    return m_file.good();
+}
+
+bool WavWriter::close()
+{
+    if (!m_file.is_open())
+    {
+        return true;
+    }
+
+    if (!m_part)
+    {
+        m_file.seekp(0);
+        writeHeader();
+    }
+    const bool ok = m_file.good();
+    m_file.close();
+    return ok;
+}
@@ -0,0 +1,70 @@
+/*
+
+  Description:  Writer of .wav files with 32-bit
+                float samples, the counterpart of
+                WavStreamer for offline rendering.
+
+  License: GPLv2
+
+*/
+
+#ifndef wavwriter_h
+#define wavwriter_h
+
+#include <stdint.h>
+#include <string>
+#include <fstream>
+
+class WavWriter
+{
+public:
+    WavWriter();
+    virtual ~WavWriter();
+
+    /** create a file for 'channels' interleaved channels.
+        @return error code. 0 = ok, -1 = invalid format, -2 = cannot create file
+    */
+    int32_t openFile(const std::string &filename, uint32_t channels, uint32_t sampleRate);
+
+    /** open a file made by openFile() to write its frames from
+        'firstFrame' on. Several writers can fill separate parts
+        of a file, close() does not change its header.
+        @return error code. 0 = ok, -1 = invalid format, -2 = cannot open file
+    */
+    int32_t openPart(const std::string &filename, uint32_t channels, uint32_t firstFrame);
+
+    /** leave room for 'frames' frames, which are filled
+        with silence unless they are written with openPart().
+        @return false if the file could not be written
+    */
+    bool skip(uint32_t frames);
+
+    /** append 'frames' frames of interleaved samples.
+        @return false if the file could not be written
+    */
+    bool write(const float *samples, uint32_t frames);
+
+    /** complete the header and close the file.
+        @return false if the file could not be written
+    */
+    bool close();
+
+    /** number of frames written or skipped so far,
+        including those before the start of a part */
+    uint32_t getFrameCount() const
+    {
+        return m_frames;
+    }
+
+protected:
+    /** write the RIFF header for the current number of frames */
+    void writeHeader();
+
+    std::ofstream   m_file;
+    uint32_t        m_channels;
+    uint32_t        m_sampleRate;
+    uint32_t        m_frames;
+    bool            m_part;         // true if the file was opened by openPart()
+};
+
+#endif
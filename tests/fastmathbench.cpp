@@ -0,0 +1,195 @@
+/*
+
+    Accuracy and throughput of the fast-math
+    approximations compared to libm.
+
+    The errors are measured against double precision
+    libm, the throughput is measured on blocks of
+    samples, like the block engine of the VM.
+
+    Build and run:
+      cmake --build build --target basicdsp-fastmathbench
+      ./build/basicdsp-fastmathbench
+
+    License: GPLv2
+
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include "vmfunctions.h"
+#include "fastmath.h"
+
+#define BLOCKSIZE 4096
+#define REPEATS   2000
+
+struct result_t
+{
+    double  maxAbs;     // largest absolute error
+    double  maxRel;     // largest relative error, for |reference| > 1e-3
+    double  atWorst;    // argument of the largest absolute error
+};
+
+/** measure the error of a one-argument approximation
+    on 'n' evenly spaced points in [lo, hi] */
+template<class FAST, class REF>
+static result_t measure1(FAST fast, REF ref, double lo, double hi, uint32_t n)
+{
+    result_t r = {0.0, 0.0, lo};
+    for(uint32_t i=0; i<n; i++)
+    {
+        const float x = (float)(lo + (hi-lo)*i/(n-1));
+        const double expected = ref((double)x);
+        const double err = fabs((double)fast(x) - expected);
+        if (err > r.maxAbs)
+        {
+            r.maxAbs = err;
+            r.atWorst = x;
+        }
+        if (fabs(expected) > 1e-3)
+            r.maxRel = std::max(r.maxRel, err/fabs(expected));
+    }
+    return r;
+}
+
+/** measure the error of a two-argument approximation
+    on an n x n grid */
+template<class FAST, class REF>
+static result_t measure2(FAST fast, REF ref, double lo1, double hi1,
+                         double lo2, double hi2, uint32_t n)
+{
+    result_t r = {0.0, 0.0, lo1};
+    for(uint32_t i=0; i<n; i++)
+    {
+        for(uint32_t j=0; j<n; j++)
+        {
+            const float a = (float)(lo1 + (hi1-lo1)*i/(n-1));
+            const float b = (float)(lo2 + (hi2-lo2)*j/(n-1));
+            const double expected = ref((double)a, (double)b);
+            const double err = fabs((double)fast(a, b) - expected);
+            if (err > r.maxAbs)
+            {
+                r.maxAbs = err;
+                r.atWorst = a;
+            }
+            if (fabs(expected) > 1e-3)
+                r.maxRel = std::max(r.maxRel, err/fabs(expected));
+        }
+    }
+    return r;
+}
+
+/** nanoseconds per call of a one-argument function
+    applied to a block of samples. each function is
+    passed as a lambda, so it is inlined into the loop
+    as in the block engine. */
+template<class F> static double throughput1(F f, float lo, float hi)
+{
+    std::vector<float> in(BLOCKSIZE), out(BLOCKSIZE);
+    for(uint32_t i=0; i<BLOCKSIZE; i++)
+    {
+        in[i] = lo + (hi-lo)*i/BLOCKSIZE;
+    }
+
+    float sink = 0.0f;
+    auto t0 = std::chrono::steady_clock::now();
+    for(uint32_t k=0; k<REPEATS; k++)
+    {
+        for(uint32_t i=0; i<BLOCKSIZE; i++)
+        {
+            out[i] = f(in[i]);
+        }
+        sink += out[k % BLOCKSIZE];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (sink == 12345.0f)
+        printf(" ");
+    return std::chrono::duration<double, std::nano>(t1-t0).count() / ((double)BLOCKSIZE*REPEATS);
+}
+
+template<class F> static double throughput2(F f, float lo1, float hi1, float lo2, float hi2)
+{
+    std::vector<float> a(BLOCKSIZE), b(BLOCKSIZE), out(BLOCKSIZE);
+    for(uint32_t i=0; i<BLOCKSIZE; i++)
+    {
+        a[i] = lo1 + (hi1-lo1)*i/BLOCKSIZE;
+        b[i] = lo2 + (hi2-lo2)*((i*7919) % BLOCKSIZE)/BLOCKSIZE;
+    }
+
+    float sink = 0.0f;
+    auto t0 = std::chrono::steady_clock::now();
+    for(uint32_t k=0; k<REPEATS; k++)
+    {
+        for(uint32_t i=0; i<BLOCKSIZE; i++)
+        {
+            out[i] = f(a[i], b[i]);
+        }
+        sink += out[k % BLOCKSIZE];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (sink == 12345.0f)
+        printf(" ");
+    return std::chrono::duration<double, std::nano>(t1-t0).count() / ((double)BLOCKSIZE*REPEATS);
+}
+
+static void report(const char *name, const char *range, const result_t &r, double libmNs, double fastNs)
+{
+    printf("%-10s %-22s %10.3g %10.3g %12.5g %8.2f %8.2f %6.1fx\n",
+           name, range, r.maxAbs, r.maxRel, r.atWorst, libmNs, fastNs, libmNs/fastNs);
+}
+
+int main()
+{
+    const uint32_t N = 2000001;
+    printf("%-10s %-22s %10s %10s %12s %8s %8s %7s\n",
+           "function", "range", "max abs", "max rel", "worst at", "libm ns", "fast ns", "speedup");
+
+    report("sin1", "[-4, 4]",
+           measure1(VM::fastSin1, [](double x) { return sin(2.0*M_PI*x); }, -4.0, 4.0, N),
+           throughput1([](float x) { return VM::funcSin1(x); }, -4.0f, 4.0f),
+           throughput1([](float x) { return VM::fastSin1(x); }, -4.0f, 4.0f));
+    report("cos1", "[-4, 4]",
+           measure1(VM::fastCos1, [](double x) { return cos(2.0*M_PI*x); }, -4.0, 4.0, N),
+           throughput1([](float x) { return VM::funcCos1(x); }, -4.0f, 4.0f),
+           throughput1([](float x) { return VM::fastCos1(x); }, -4.0f, 4.0f));
+    report("sin", "[-10, 10]",
+           measure1(VM::fastSin, [](double x) { return sin(x); }, -10.0, 10.0, N),
+           throughput1([](float x) { return VM::funcSin(x); }, -10.0f, 10.0f),
+           throughput1([](float x) { return VM::fastSin(x); }, -10.0f, 10.0f));
+    report("sin", "[-1000, 1000]",
+           measure1(VM::fastSin, [](double x) { return sin(x); }, -1000.0, 1000.0, N),
+           throughput1([](float x) { return VM::funcSin(x); }, -1000.0f, 1000.0f),
+           throughput1([](float x) { return VM::fastSin(x); }, -1000.0f, 1000.0f));
+    report("cos", "[-10, 10]",
+           measure1(VM::fastCos, [](double x) { return cos(x); }, -10.0, 10.0, N),
+           throughput1([](float x) { return VM::funcCos(x); }, -10.0f, 10.0f),
+           throughput1([](float x) { return VM::fastCos(x); }, -10.0f, 10.0f));
+    report("tan", "[-1.5, 1.5]",
+           measure1(VM::fastTan, [](double x) { return tan(x); }, -1.5, 1.5, N),
+           throughput1([](float x) { return VM::funcTan(x); }, -1.5f, 1.5f),
+           throughput1([](float x) { return VM::fastTan(x); }, -1.5f, 1.5f));
+    report("tanh", "[-10, 10]",
+           measure1(VM::fastTanh, [](double x) { return tanh(x); }, -10.0, 10.0, N),
+           throughput1([](float x) { return VM::funcTanh(x); }, -10.0f, 10.0f),
+           throughput1([](float x) { return VM::fastTanh(x); }, -10.0f, 10.0f));
+    report("tanh", "[-0.01, 0.01]",
+           measure1(VM::fastTanh, [](double x) { return tanh(x); }, -0.01, 0.01, N),
+           throughput1([](float x) { return VM::funcTanh(x); }, -0.01f, 0.01f),
+           throughput1([](float x) { return VM::fastTanh(x); }, -0.01f, 0.01f));
+    report("pow", "[0.01, 10]^[-4, 4]",
+           measure2(VM::fastPow, [](double x, double y) { return pow(x, y); }, 0.01, 10.0, -4.0, 4.0, 1501),
+           throughput2([](float a, float b) { return VM::funcPow(a, b); }, 0.01f, 10.0f, -4.0f, 4.0f),
+           throughput2([](float a, float b) { return VM::fastPow(a, b); }, 0.01f, 10.0f, -4.0f, 4.0f));
+    report("pow", "[0, 1]^[0.5, 2]",
+           measure2(VM::fastPow, [](double x, double y) { return pow(x, y); }, 0.0, 1.0, 0.5, 2.0, 1501),
+           throughput2([](float a, float b) { return VM::funcPow(a, b); }, 0.0f, 1.0f, 0.5f, 2.0f),
+           throughput2([](float a, float b) { return VM::fastPow(a, b); }, 0.0f, 1.0f, 0.5f, 2.0f));
+    report("atan2", "[-2, 2]^2",
+           measure2(VM::fastAtan2, [](double y, double x) { return atan2(y, x); }, -2.0, 2.0, -2.0, 2.0, 1501),
+           throughput2([](float a, float b) { return VM::funcAtan2(a, b); }, -2.0f, 2.0f, -2.0f, 2.0f),
+           throughput2([](float a, float b) { return VM::fastAtan2(a, b); }, -2.0f, 2.0f, -2.0f, 2.0f));
+    return 0;
+}
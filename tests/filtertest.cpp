@@ -0,0 +1,101 @@
+/*
+
+    Tests of the filter builtins. Every filter must give
+    the output of the same filter written out as script
+    code, on every engine.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <algorithm>
+#include "renderer.h"
+
+#define FILTERTEST_FRAMES 1000
+
+static const VirtualMachine::engine_t engines[] =
+    {VirtualMachine::ENGINE_SAMPLE, VirtualMachine::ENGINE_BLOCK, VirtualMachine::ENGINE_REGISTER,
+     VirtualMachine::ENGINE_JIT, VirtualMachine::ENGINE_CLOSURE};
+
+/** the left output of a script on an engine, for
+    an input that is neither periodic nor smooth */
+static std::vector<float> run(const char *source, VirtualMachine::engine_t engine)
+{
+    Renderer renderer;
+    RenderScript script;
+    BOOST_REQUIRE_MESSAGE(renderer.compile(source, 44100.0f, std::vector<std::string>(), false, script),
+                          renderer.getError());
+
+    VirtualMachine machine;
+    machine.setSamplerate(44100.0f);
+    machine.loadProgram(script.program, script.regprogram, script.exprprogram, script.variables);
+    machine.setEngine(engine);
+
+    std::vector<float> input(2*FILTERTEST_FRAMES);
+    for(uint32_t i=0; i<2*FILTERTEST_FRAMES; i++)
+    {
+        input[i] = (float)((i*7919) % 1000) / 1000.0f - 0.5f;
+    }
+    std::vector<float> output(2*FILTERTEST_FRAMES);
+    machine.resetProgramState();
+    machine.startOffline();
+    machine.processSamples(&input[0], &output[0], FILTERTEST_FRAMES);
+    machine.stop();
+
+    std::vector<float> left(FILTERTEST_FRAMES);
+    for(uint32_t i=0; i<FILTERTEST_FRAMES; i++)
+    {
+        left[i] = output[2*i];
+    }
+    return left;
+}
+
+/** compare a filter with the script code it stands for */
+static void checkFilter(const char *filter, const char *reference)
+{
+    for(VirtualMachine::engine_t engine : engines)
+    {
+        const std::vector<float> x = run(filter, engine);
+        const std::vector<float> y = run(reference, engine);
+        float maxError = 0.0f;
+        for(uint32_t i=0; i<FILTERTEST_FRAMES; i++)
+        {
+            maxError = std::max(maxError, std::fabs(x[i] - y[i]));
+        }
+        BOOST_CHECK_MESSAGE(maxError < 1e-5f, "engine " << engine << ": error " << maxError);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fir_matches_delay_line)
+{
+    checkFilter("outl = fir(inl, 0.1, 0.2, 0.3, 0.4)\n",
+                "delay d[4]\nd = inl\noutl = 0.1*d[0] + 0.2*d[1] + 0.3*d[2] + 0.4*d[3]\n");
+    checkFilter("outl = firsymodd(inl, 0.1, -0.2, 0.5)\n",
+                "delay d[5]\nd = inl\noutl = 0.1*d[0] - 0.2*d[1] + 0.5*d[2] - 0.2*d[3] + 0.1*d[4]\n");
+    checkFilter("outl = firsymeven(inl, 0.3, 0.7)\n",
+                "delay d[4]\nd = inl\noutl = 0.3*d[0] + 0.7*d[1] + 0.7*d[2] + 0.3*d[3]\n");
+}
+
+BOOST_AUTO_TEST_CASE(biquad_matches_direct_form)
+{
+    // H(z) = (b0 + b1 z^-1 + b2 z^-2) / (a0 + a1 z^-1 + a2 z^-2)
+    // in direct form II, w1 and w2 hold the past values of w.
+    checkFilter("outl = biquad(inl, 2.0, -0.5, 0.25, 0.2, 0.4, 0.2)\n",
+                "w = (inl + 0.5*w1 - 0.25*w2) / 2.0\n"
+                "outl = 0.2*w + 0.4*w1 + 0.2*w2\nw2 = w1\nw1 = w\n");
+
+    // the legacy form biquad(x, g, a1, a2, b1, b2) is the
+    // section {g, g*b1, g*b2, a1, a2}
+    checkFilter("outl = biquad(inl, 0.5, -0.9, 0.4, 0.3, -0.2)\n",
+                "w = inl + 0.9*w1 - 0.4*w2\n"
+                "outl = 0.5*(w + 0.3*w1 - 0.2*w2)\nw2 = w1\nw1 = w\n");
+
+    // a cascade runs the sections one after the other
+    checkFilter("outl = biquads(inl, 2.0, -0.5, 0.25, 0.2, 0.4, 0.2, 1.0, -1.2, 0.5, 1.0, -0.5, 0.3)\n",
+                "w = (inl + 0.5*w1 - 0.25*w2) / 2.0\n"
+                "y = 0.2*w + 0.4*w1 + 0.2*w2\nw2 = w1\nw1 = w\n"
+                "v = y + 1.2*v1 - 0.5*v2\n"
+                "outl = v - 0.5*v1 + 0.3*v2\nv2 = v1\nv1 = v\n");
+}
@@ -0,0 +1,38 @@
+/*
+
+    Tests of the noise sources of the VM.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include "testmachine.h"
+
+BOOST_AUTO_TEST_CASE(noise_is_reproducible)
+{
+    // two machines with the same seed produce the same
+    // noise, a different seed gives different noise.
+    const char *source = "outl = noise()\noutr = gaussnoise() + pinknoise()\n";
+    TestMachine first, second, third;
+    third.setNoiseSeed(7);
+    BOOST_REQUIRE(compile(source, first));
+    BOOST_REQUIRE(compile(source, second));
+    BOOST_REQUIRE(compile(source, third));
+    first.setRunning();
+    second.setRunning();
+    third.setRunning();
+
+    const uint32_t frames = 256;
+    std::vector<float> in(2*frames, 0.0f);
+    std::vector<float> out1(2*frames), out2(2*frames), out3(2*frames);
+    first.processSamples(&in[0], &out1[0], frames);
+    second.processSamples(&in[0], &out2[0], frames);
+    third.processSamples(&in[0], &out3[0], frames);
+    BOOST_CHECK(out1 == out2);
+    BOOST_CHECK(out1 != out3);
+    for(uint32_t i=0; i<frames; i++)
+    {
+        BOOST_CHECK((out1[2*i] >= -1.0f) && (out1[2*i] < 1.0f));
+    }
+}
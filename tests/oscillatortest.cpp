@@ -0,0 +1,71 @@
+/*
+
+    Tests of the test signal sources of the VM.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <algorithm>
+#include "testmachine.h"
+
+BOOST_AUTO_TEST_CASE(quadsine_source_follows_frequency)
+{
+    // the rotating phasor must stay on the exact
+    // sine and cosine, also across buffers that
+    // are not a multiple of the chunk size.
+    const char *source = "outl = inl\noutr = inr\n";
+    TestMachine machine;
+    BOOST_REQUIRE(compile(source, machine));
+    machine.setRunning();
+    machine.setSource(VirtualMachine::SRC_QUADSINE);
+    machine.setFrequency(1000.0);
+
+    const double step = 2.0*M_PI*1000.0/machine.getSamplerate();
+    std::vector<float> in(2*1000, 0.0f);
+    std::vector<float> out(2*1000);
+    uint32_t n = 0;
+    double maxError = 0.0;
+    for(uint32_t frames=1; frames<=1000; frames+=37)
+    {
+        machine.processSamples(&in[0], &out[0], frames);
+        for(uint32_t i=0; i<frames; i++, n++)
+        {
+            maxError = std::max(maxError, std::fabs(out[2*i] - cos(step*n)));
+            maxError = std::max(maxError, std::fabs(out[2*i+1] - sin(step*n)));
+        }
+    }
+    BOOST_CHECK(maxError < 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(multitone_source_takes_new_tones)
+{
+    // the tones reach the audio thread through the
+    // command queue and restart at zero phase.
+    const char *source = "outl = inl\noutr = inr\n";
+    TestMachine machine;
+    BOOST_REQUIRE(compile(source, machine));
+    machine.setRunning();
+    machine.setSource(VirtualMachine::SRC_MULTITONE);
+    machine.setFrequency(1000.0);
+
+    const uint32_t frames = 256;
+    std::vector<float> in(2*frames, 0.0f);
+    std::vector<float> out(2*frames);
+    machine.processSamples(&in[0], &out[0], frames);
+
+    const float ratios[] = {1.0f, 3.0f};
+    machine.setTones(std::vector<float>(ratios, ratios + 2));
+    machine.processSamples(&in[0], &out[0], frames);
+
+    const double step = 2.0*M_PI*1000.0/machine.getSamplerate();
+    double maxError = 0.0;
+    for(uint32_t i=0; i<frames; i++)
+    {
+        const double expected = 0.5*(cos(step*i) + cos(3.0*step*i));
+        maxError = std::max(maxError, std::fabs(out[2*i] - expected));
+    }
+    BOOST_CHECK(maxError < 1e-4);
+}
@@ -0,0 +1,173 @@
+/*
+
+    Tests of the offline renderers. The renderers
+    read and write .wav files in the working
+    directory.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include "wavstreamer.h"
+#include "wavwriter.h"
+#include "renderer.h"
+#include "batchrenderer.h"
+
+BOOST_AUTO_TEST_CASE(render_processes_whole_file)
+{
+    // a file written by WavWriter runs through a script
+    // offline and is read back by WavStreamer.
+    const uint32_t frames = 3*RENDER_BLOCKSIZE + 100;
+    std::vector<float> input(2*frames);
+    for(uint32_t i=0; i<frames; i++)
+    {
+        input[2*i] = (float)(i % 100) / 100.0f;
+        input[2*i+1] = -0.5f;
+    }
+    WavWriter writer;
+    BOOST_REQUIRE(writer.openFile("render_in.wav", 2, 48000) == 0);
+    BOOST_REQUIRE(writer.write(&input[0], frames));
+    BOOST_REQUIRE(writer.close());
+    BOOST_CHECK(Renderer::getFileSamplerate("render_in.wav") == 48000.0f);
+
+    Renderer renderer;
+    RenderScript script;
+    const char *source = "outl = inl*slider1\noutr = inr + samplerate\nn = n + 1\n";
+    BOOST_REQUIRE(renderer.compile(source, 48000.0f, std::vector<std::string>(1, "n"), false, script));
+    BOOST_REQUIRE(renderer.load(script));
+    renderer.setSlider(0, 2.0f);
+
+    renderstats_t stats;
+    BOOST_REQUIRE(renderer.render("render_in.wav", "render_out.wav", "render_vars.wav", stats));
+    BOOST_CHECK(stats.frames == frames);
+
+    WavStreamer output;
+    BOOST_REQUIRE(output.openFile("render_out.wav") == 0);
+    BOOST_REQUIRE(output.getSampleCount() == frames);
+    std::vector<float> result(2*frames);
+    output.fillBuffer(&result[0], frames);
+    for(uint32_t i=0; i<frames; i++)
+    {
+        BOOST_REQUIRE(result[2*i] == 2.0f*input[2*i]);
+        BOOST_REQUIRE(result[2*i+1] == 47999.5f);
+    }
+
+    // a second render starts from the initial state
+    BOOST_REQUIRE(renderer.render("render_in.wav", "render_out.wav", "render_vars.wav", stats));
+    std::ifstream vars("render_vars.wav", std::ios::in | std::ios::binary);
+    vars.seekg(44 + 4*(frames-1));
+    float last = 0.0f;
+    vars.read(reinterpret_cast<char*>(&last), sizeof(last));
+    BOOST_CHECK(last == (float)frames);
+}
+
+BOOST_AUTO_TEST_CASE(batch_render_matches_single_render)
+{
+    // every file of a batch starts from the initial state
+    // and seed, whichever worker renders it.
+    const uint32_t frames = 20000;
+    std::vector<float> input(2*frames);
+    for(uint32_t i=0; i<2*frames; i++)
+    {
+        input[i] = (float)((i*7919) % 1000) / 1000.0f - 0.5f;
+    }
+    WavWriter writer;
+    BOOST_REQUIRE(writer.openFile("batch_in.wav", 2, 44100) == 0);
+    BOOST_REQUIRE(writer.write(&input[0], frames));
+    BOOST_REQUIRE(writer.close());
+
+    const char *source = "delay d[100]\nd = inl\ny = y + 0.1*(d[99] - y)\noutl = y + 0.1*noise()\noutr = inr\n";
+    Renderer renderer;
+    RenderScript script;
+    BOOST_REQUIRE(renderer.compile(source, 44100.0f, std::vector<std::string>(), false, script));
+    BOOST_REQUIRE(renderer.load(script));
+    renderstats_t stats;
+    BOOST_REQUIRE(renderer.render("batch_in.wav", "batch_ref.wav", "", stats));
+
+    BatchRenderer batch(3);
+    BOOST_REQUIRE(batch.load(script));
+    std::vector<renderjob_t> jobs(7);
+    for(uint32_t i=0; i<jobs.size(); i++)
+    {
+        jobs[i].inFile = "batch_in.wav";
+        jobs[i].outFile = "batch_out" + std::to_string(i) + ".wav";
+    }
+    jobs[6].inFile = "batch_missing.wav";
+    BOOST_CHECK(batch.render(jobs, stats) == 1);
+    BOOST_CHECK(stats.frames == 6*frames);
+    BOOST_CHECK(!jobs[6].ok);
+
+    WavStreamer reference;
+    BOOST_REQUIRE(reference.openFile("batch_ref.wav") == 0);
+    std::vector<float> expected(2*frames);
+    reference.fillBuffer(&expected[0], frames);
+    for(uint32_t i=0; i<6; i++)
+    {
+        BOOST_REQUIRE(jobs[i].ok);
+        WavStreamer output;
+        BOOST_REQUIRE(output.openFile(jobs[i].outFile) == 0);
+        std::vector<float> result(2*frames);
+        output.fillBuffer(&result[0], frames);
+        BOOST_CHECK(result == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(split_render_matches_single_render)
+{
+    // the parts start early by the memory of the script,
+    // so a script without feedback renders exactly as
+    // in a single pass.
+    const uint32_t frames = RENDER_PARTFRAMES + RENDER_PARTFRAMES/2;
+    std::vector<float> input(2*frames);
+    for(uint32_t i=0; i<2*frames; i++)
+    {
+        input[i] = (float)((i*7919) % 1000) / 1000.0f - 0.5f;
+    }
+    WavWriter writer;
+    BOOST_REQUIRE(writer.openFile("split_in.wav", 2, 44100) == 0);
+    BOOST_REQUIRE(writer.write(&input[0], frames));
+    BOOST_REQUIRE(writer.close());
+
+    // the second script reads beyond the declared length
+    // of its delay line, which holds 128 samples.
+    const char *sources[2] = {"delay d[100]\nd = inl\ny = fir(inr, 0.1, 0.2, 0.3, 0.4)\n"
+                              "outl = 0.5*d[99] + prev\nprev = y\noutr = y\n",
+                              "delay d[100]\nd = inl\noutl = d[120]\noutr = d[127]\n"};
+    Renderer renderer;
+    RenderScript script;
+    for(const char *source : sources)
+    {
+        BOOST_REQUIRE(renderer.compile(source, 44100.0f, std::vector<std::string>(), false, script));
+        BOOST_CHECK(script.memory.bounded);
+        BOOST_CHECK(script.memory.length == 128);
+        BOOST_REQUIRE(renderer.load(script));
+        renderstats_t stats;
+        BOOST_REQUIRE(renderer.render("split_in.wav", "split_ref.wav", "", stats));
+
+        BatchRenderer batch(2);
+        BOOST_REQUIRE(batch.load(script));
+        BOOST_CHECK(batch.getWarmup(0.0f) == 128);
+        BOOST_REQUIRE(batch.renderSplit("split_in.wav", "split_out.wav", 0.0f, stats));
+        BOOST_CHECK(stats.frames == frames);
+
+        WavStreamer reference;
+        WavStreamer output;
+        BOOST_REQUIRE(reference.openFile("split_ref.wav") == 0);
+        BOOST_REQUIRE(output.openFile("split_out.wav") == 0);
+        BOOST_CHECK(output.getSampleCount() == frames);
+        std::vector<float> expected(2*frames);
+        std::vector<float> result(2*frames);
+        reference.fillBuffer(&expected[0], frames);
+        output.fillBuffer(&result[0], frames);
+        BOOST_CHECK(result == expected);
+    }
+
+    // a one pole filter feeds its output back
+    const char *iir = "y = 0.9*y + 0.1*inl\noutl = y\n";
+    BOOST_REQUIRE(renderer.compile(iir, 44100.0f, std::vector<std::string>(), false, script));
+    BOOST_CHECK(!script.memory.bounded);
+    BOOST_REQUIRE(script.memory.feedback >= 0);
+    BOOST_CHECK(script.variables[script.memory.feedback].m_name == "y");
+}
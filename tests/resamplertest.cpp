@@ -0,0 +1,79 @@
+/*
+
+    Tests of the resamplers between the soundcard
+    rate and the rate of the program.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <algorithm>
+#include "testmachine.h"
+
+BOOST_AUTO_TEST_CASE(virtual_rate_runs_fewer_samples)
+{
+    // at 8 kHz the program runs 8000/44100 times per
+    // soundcard sample. a 1 kHz tone passes the
+    // resamplers, a 6 kHz tone is above the Nyquist
+    // frequency of the program and is removed.
+    const char *source = "n = n + 1\noutl = n\noutr = inr\n";
+    const float frequencies[2] = {1000.0f, 6000.0f};
+    float amplitude[2];
+    for(uint32_t k=0; k<2; k++)
+    {
+        TestMachine machine;
+        BOOST_REQUIRE(machine.setProgramSamplerate(8000.0f) == 8000.0f);
+        BOOST_REQUIRE(compile(source, machine));
+        BOOST_REQUIRE(machine.getProgramSamplerate() == 8000.0f);
+        machine.setRunning();
+        machine.setSource(VirtualMachine::SRC_SINE);
+        machine.setFrequency(frequencies[k]);
+
+        const uint32_t frames = 44100;
+        std::vector<float> in(2*frames, 0.0f);
+        std::vector<float> out(2*frames);
+        for(uint32_t done=0; done<frames; done+=441)
+        {
+            machine.processSamples(&in[2*done], &out[2*done], 441);
+        }
+
+        const float expected = frames * 8000.0f / machine.getSamplerate();
+        BOOST_CHECK(std::fabs(out[2*(frames-1)] - expected) < 0.01f*expected);
+
+        amplitude[k] = 0.0f;
+        for(uint32_t i=frames/2; i<frames; i++)
+        {
+            amplitude[k] = std::max(amplitude[k], std::fabs(out[2*i+1]));
+        }
+    }
+    BOOST_CHECK(std::fabs(amplitude[0] - 1.0f) < 0.01f);
+    BOOST_CHECK(amplitude[1] < 0.001f);
+}
+
+BOOST_AUTO_TEST_CASE(virtual_rate_needs_both_directions)
+{
+    // 48000 -> 8080 Hz has 101 filter phases, the way
+    // back has 600, more than the resampler supports.
+    // the program then runs at the rate of the soundcard.
+    TestMachine machine;
+    machine.setSamplerate(48000.0f);
+    BOOST_CHECK(machine.setProgramSamplerate(8080.0f) == 48000.0f);
+    BOOST_REQUIRE(compile("outl = inl\noutr = inr\n", machine));
+    BOOST_CHECK(machine.getProgramSamplerate() == 48000.0f);
+    machine.setRunning();
+    machine.setSource(VirtualMachine::SRC_SINE);
+    machine.setFrequency(1000.0);
+
+    const uint32_t frames = 4800;
+    std::vector<float> in(2*frames, 0.0f);
+    std::vector<float> out(2*frames);
+    machine.processSamples(&in[0], &out[0], frames);
+    double power = 0.0;
+    for(uint32_t i=frames/2; i<frames; i++)
+    {
+        power += out[2*i]*out[2*i];
+    }
+    BOOST_CHECK(std::fabs(sqrt(power/(frames/2)) - sqrt(0.5)) < 0.01);
+}
@@ -0,0 +1,128 @@
+/*
+
+    Tests of the SSA optimizer. The optimized program
+    must give the same outputs as the program straight
+    from the parser.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <cmath>
+#include "reader.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "asttovm.h"
+#include "virtualmachine.h"
+#include "renderer.h"
+
+#define SSATEST_FRAMES 1000
+
+/** the stereo outputs of a program for a
+    ramp on the left and a tone on the right */
+static std::vector<float> run(VirtualMachine &machine)
+{
+    std::vector<float> input(2*SSATEST_FRAMES);
+    for(uint32_t i=0; i<SSATEST_FRAMES; i++)
+    {
+        input[2*i] = (float)i / SSATEST_FRAMES;
+        input[2*i+1] = sinf(0.1f*i);
+    }
+    std::vector<float> output(2*SSATEST_FRAMES);
+    machine.resetProgramState();
+    machine.startOffline();
+    machine.processSamples(&input[0], &output[0], SSATEST_FRAMES);
+    machine.stop();
+    return output;
+}
+
+static const VirtualMachine::engine_t engines[] =
+    {VirtualMachine::ENGINE_SAMPLE, VirtualMachine::ENGINE_BLOCK, VirtualMachine::ENGINE_REGISTER,
+     VirtualMachine::ENGINE_JIT, VirtualMachine::ENGINE_CLOSURE};
+
+/** load the program without the optimizer */
+static bool loadUnoptimized(const char *source, VirtualMachine &machine)
+{
+    std::unique_ptr<Reader> reader(Reader::create(std::string(source)));
+    Tokenizer tokenizer;
+    std::vector<token_t> tokens;
+    if (!tokenizer.process(reader.get(), tokens))
+        return false;
+
+    Parser parser;
+    ParseContext context;
+    if (!parser.process(tokens, context))
+        return false;
+
+    VM::program_t program;
+    VM::regprogram_t regprogram;
+    VM::exprprogram_t exprprogram;
+    VM::variables_t vars;
+    if ((!ASTToVM::process(context, program, vars)) ||
+        (!ASTToVM::process(context, regprogram)) ||
+        (!ASTToVM::process(context, exprprogram)))
+        return false;
+
+    machine.setSamplerate(44100.0f);
+    machine.loadProgram(program, regprogram, exprprogram, vars);
+    return true;
+}
+
+/** compare the optimized program with the program
+    without the optimizer, on every engine. The noise
+    depends on the engine. */
+static void checkOptimized(const char *source)
+{
+    VirtualMachine reference;
+    BOOST_REQUIRE(loadUnoptimized(source, reference));
+
+    Renderer renderer;
+    RenderScript script;
+    BOOST_REQUIRE_MESSAGE(renderer.compile(source, 44100.0f, std::vector<std::string>(), false, script),
+                          renderer.getError());
+    VirtualMachine machine;
+    machine.setSamplerate(44100.0f);
+    machine.loadProgram(script.program, script.regprogram, script.exprprogram, script.variables);
+
+    for(VirtualMachine::engine_t engine : engines)
+    {
+        reference.setEngine(engine);
+        machine.setEngine(engine);
+        BOOST_CHECK_MESSAGE(run(machine) == run(reference), "engine " << engine);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dropped_store_reads_delay_before_write)
+{
+    // a is not written to the program, its value is used
+    // by out, after the delay line has been written.
+    checkOptimized("delay d[4]\na = d[0]\nd = inl\nout = a\n");
+}
+
+BOOST_AUTO_TEST_CASE(dropped_store_keeps_order_of_noise)
+{
+    checkOptimized("a = noise()\nb = noise()\noutl = b\noutr = a\n");
+}
+
+BOOST_AUTO_TEST_CASE(value_of_delay_store_is_used_again)
+{
+    // limit(d) is written to q and used by outl, after
+    // f, which it depends on, was overwritten.
+    checkOptimized("delay q[9]\nd = atan2(inl, f)\nf = limit(d)\nq = limit(d)\n"
+                   "f = 0.5\noutl = limit(d)\n");
+}
+
+BOOST_AUTO_TEST_CASE(shared_values_do_not_overflow_counts)
+{
+    // every line uses x twice, so the first value of x
+    // is used 2^70 times by the expanded expression.
+    std::string source = "x = inl\n";
+    for(uint32_t i=0; i<70; i++)
+    {
+        source += "x = limit(x*x + inr)\n";
+    }
+    source += "out = x\n";
+    checkOptimized(source.c_str());
+}
@@ -0,0 +1,74 @@
+/*
+
+    Tests of the parameter sweeps, which run
+    several slider settings in SIMD lanes.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include "wavstreamer.h"
+#include "wavwriter.h"
+#include "renderer.h"
+#include "sweeprenderer.h"
+
+BOOST_AUTO_TEST_CASE(sweep_lanes_match_single_renders)
+{
+    // every lane gives exactly the output of a VM
+    // running the register byte code with its sliders
+    const uint32_t frames = 20000;
+    std::vector<float> input(2*frames);
+    for(uint32_t i=0; i<2*frames; i++)
+    {
+        input[i] = (float)((i*7919) % 1000) / 1000.0f - 0.5f;
+    }
+    WavWriter writer;
+    BOOST_REQUIRE(writer.openFile("sweep_in.wav", 2, 44100) == 0);
+    BOOST_REQUIRE(writer.write(&input[0], frames));
+    BOOST_REQUIRE(writer.close());
+
+    const char *source = "delay d[100]\nd = inl + 0.1*noise()\n"
+                         "lp = lp + slider1*(inr - lp)\n"
+                         "z = biquad(inl, 0.2, 0.4, 0.2, -0.5, 0.3)\n"
+                         "outl = slider2*d[99] + d[slider2*50] + choose(inl, lp, z)\n"
+                         "outr = tanh(slider1*z)\n";
+    Renderer renderer;
+    RenderScript script;
+    BOOST_REQUIRE(renderer.compile(source, 44100.0f, std::vector<std::string>(), false, script));
+    BOOST_REQUIRE(renderer.load(script));
+    renderer.setEngine(VirtualMachine::ENGINE_REGISTER);
+
+    std::vector<sweeppoint_t> points(5);
+    for(uint32_t i=0; i<points.size(); i++)
+    {
+        points[i].slider[0] = 0.1f*(i+1);
+        points[i].slider[1] = 0.9f - 0.15f*i;
+        points[i].slider[2] = 0.0f;
+        points[i].slider[3] = 0.0f;
+        points[i].outFile = "sweep_out" + std::to_string(i) + ".wav";
+    }
+
+    SweepRenderer sweep;
+    BOOST_REQUIRE(sweep.load(script));
+    renderstats_t stats;
+    BOOST_REQUIRE(sweep.render("sweep_in.wav", points, stats));
+    BOOST_CHECK(stats.frames == points.size()*frames);
+
+    for(const sweeppoint_t &point : points)
+    {
+        renderer.setSlider(0, point.slider[0]);
+        renderer.setSlider(1, point.slider[1]);
+        BOOST_REQUIRE(renderer.render("sweep_in.wav", "sweep_ref.wav", "", stats));
+
+        WavStreamer reference;
+        WavStreamer output;
+        BOOST_REQUIRE(reference.openFile("sweep_ref.wav") == 0);
+        BOOST_REQUIRE(output.openFile(point.outFile) == 0);
+        std::vector<float> expected(2*frames);
+        std::vector<float> result(2*frames);
+        reference.fillBuffer(&expected[0], frames);
+        output.fillBuffer(&result[0], frames);
+        BOOST_CHECK(result == expected);
+    }
+}
@@ -0,0 +1,57 @@
+/*
+
+    A VM for the unit tests that runs without
+    opening an audio stream.
+
+    License: GPLv2
+
+*/
+
+#ifndef testmachine_h
+#define testmachine_h
+
+#include <memory>
+#include "reader.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "asttovm.h"
+#include "virtualmachine.h"
+
+/** runs a VM without opening an audio stream,
+    the test thread takes the place of the audio thread */
+class TestMachine : public VirtualMachine
+{
+public:
+    TestMachine() : VirtualMachine() {}
+
+    void setRunning()
+    {
+        m_runState = true;
+    }
+};
+
+/** compile a script to stack byte code and load
+    it into the machine */
+inline bool compile(const char *source, TestMachine &machine)
+{
+    std::unique_ptr<Reader> reader(Reader::create(std::string(source)));
+    Tokenizer tokenizer;
+    std::vector<token_t> tokens;
+    if (!tokenizer.process(reader.get(), tokens))
+        return false;
+
+    Parser parser;
+    ParseContext context;
+    if (!parser.process(tokens, context))
+        return false;
+
+    VM::program_t program;
+    VM::variables_t vars;
+    if (!ASTToVM::process(context, program, vars))
+        return false;
+
+    machine.loadProgram(program, vars);
+    return true;
+}
+
+#endif
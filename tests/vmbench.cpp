@@ -0,0 +1,560 @@
+/*
+
+    Benchmarks of the virtual machine and the compiler,
+    to compare builds and to find regressions when an
+    engine changes.
+
+    * the cost of single opcodes on every engine, from
+      scripts that chain the opcode OPBENCH_CHAIN times,
+    * nanoseconds per sample of every script in the
+      examples directory on every engine,
+    * compile and load times of large generated scripts.
+
+    The results are written as JSON, the progress goes
+    to stderr. The accuracy of the fast math functions is
+    measured by basicdsp-fastmathbench.
+
+    Build and run, like basicdsp-fastmathbench:
+      cmake --build build --target basicdsp-bench
+      ./build/basicdsp-bench --examples examples --output bench.json
+
+    License: GPLv2
+
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include "renderer.h"
+
+#define BENCH_SAMPLERATE 44100.0f
+
+// number of times an opcode is repeated in its script
+#define OPBENCH_CHAIN    64
+
+static const char *engineNames[] = {"sample", "block", "register", "jit", "closure"};
+#define BENCH_ENGINES   5
+
+#ifdef __VERSION__
+#define BENCH_COMPILER  __VERSION__
+#else
+#define BENCH_COMPILER  "unknown"
+#endif
+
+/** a renderer that runs a script on samples in
+    memory instead of on a file */
+class BenchRenderer : public Renderer
+{
+public:
+    /** nanoseconds per sample of the loaded script, the
+        fastest of 'repeats' runs over 'input' */
+    double measure(const std::vector<float> &input, uint32_t repeats)
+    {
+        const uint32_t frames = (uint32_t)(input.size() / 2);
+        std::vector<float> output(2*RENDER_BLOCKSIZE);
+        double best = 0.0;
+
+        // the first run warms the caches and is not counted
+        for(uint32_t k=0; k<=repeats; k++)
+        {
+            startRun();
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            for(uint32_t position=0; position<frames; position += RENDER_BLOCKSIZE)
+            {
+                const uint32_t n = std::min((uint32_t)RENDER_BLOCKSIZE, frames - position);
+                m_machine.processSamples(&input[2*position], &output[0], n);
+                writeMonitored(NULL);
+            }
+            const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            m_machine.stop();
+
+            const double ns = std::chrono::duration<double, std::nano>(t1-t0).count() / frames;
+            if ((k == 1) || ((k > 1) && (ns < best)))
+            {
+                best = ns;
+            }
+        }
+        return best;
+    }
+};
+
+/** an opcode benchmark. The step is repeated OPBENCH_CHAIN
+    times, $ is replaced by the result of the previous step
+    and # by the number of the step. */
+struct opbench_t
+{
+    const char  *name;
+    uint32_t    opcode;
+    const char  *step;
+    uint32_t    baseline;   // opcode of an earlier benchmark that is also in
+                            // the step and whose cost is subtracted, or 0
+};
+
+static const opbench_t opBenches[] =
+{
+    {"add",         P_add,          "$ + c",                        0},
+    {"sub",         P_sub,          "$ - c",                        0},
+    {"mul",         P_mul,          "$ * c",                        0},
+    {"div",         P_div,          "$ / c",                        0},
+    {"neg",         P_neg,          "-$ * c",                       P_mul},
+    {"sin",         P_sin,          "sin($)",                       0},
+    {"cos",         P_cos,          "cos($)",                       0},
+    {"sin1",        P_sin1,         "sin1($)",                      0},
+    {"cos1",        P_cos1,         "cos1($)",                      0},
+    {"mod1",        P_mod1,         "mod1($)",                      0},
+    {"abs",         P_abs,          "abs($)",                       0},
+    {"round",       P_round,        "round($)",                     0},
+    {"sqrt",        P_sqrt,         "sqrt($)",                      0},
+    {"tan",         P_tan,          "tan($)",                       0},
+    {"tanh",        P_tanh,         "tanh($)",                      0},
+    {"pow",         P_pow,          "pow($, 0.9)",                  0},
+    {"limit",       P_limit,        "limit($)",                     0},
+    {"atan2",       P_atan2,        "atan2($, c)",                  0},
+    {"sign",        P_sign,         "sign($)",                      0},
+    {"noise",       P_noise,        "$ + noise()",                  P_add},
+    {"trunc",       P_trunc,        "trunc($)",                     0},
+    {"ceil",        P_ceil,         "ceil($)",                      0},
+    {"floor",       P_floor,        "floor($)",                     0},
+    {"choose",      P_choose,       "choose($, c, inr)",            0},
+    {"fastsin",     P_fastsin,      "fastsin($)",                   0},
+    {"fastcos",     P_fastcos,      "fastcos($)",                   0},
+    {"fastsin1",    P_fastsin1,     "fastsin1($)",                  0},
+    {"fastcos1",    P_fastcos1,     "fastcos1($)",                  0},
+    {"fasttan",     P_fasttan,      "fasttan($)",                   0},
+    {"fasttanh",    P_fasttanh,     "fasttanh($)",                  0},
+    {"fastpow",     P_fastpow,      "fastpow($, 0.9)",              0},
+    {"fastatan2",   P_fastatan2,    "fastatan2($, c)",              0},
+    {"gaussnoise",  P_gaussnoise,   "$ + gaussnoise()",             P_add},
+    {"readdelay",   P_readdelay,    "$ + d[#]",                     P_add},
+    {"fir8",        P_fir,          "fir($, 0.1, 0.2, 0.3, 0.2, 0.1, 0.05, 0.02, 0.01)", 0},
+    {"biquad",      P_biquad,       "biquad($, 1, -0.5, 0.2, 0.3, 0.1, 0.05)", 0},
+};
+
+struct options_t
+{
+    uint32_t    frames;     // samples per run
+    uint32_t    repeats;    // runs per measurement
+    std::string examples;   // directory of the example scripts
+    std::string output;     // JSON file, stdout if empty
+};
+
+static bool readFile(const std::string &filename, std::string &contents)
+{
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string result = "\"";
+    for(char c : text)
+    {
+        if ((c == '"') || (c == '\\'))
+        {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            result += code;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+/** the number of instructions of a register program with
+    opcode 'opcode'. The index of a delay or filter in the
+    lower bits is ignored. */
+static uint32_t countOpcode(const VM::regprogram_t &program, uint32_t opcode)
+{
+    const uint32_t mask = (opcode & 0x80000000) ? 0xFF000000 : 0xFFFFFFFF;
+    uint32_t count = 0;
+    for(const VM::reginstr_t &instr : program.code)
+    {
+        if ((instr.opcode & mask) == opcode)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/** the script of an opcode benchmark with 'chain' steps */
+static std::string makeOpScript(const char *step, uint32_t chain)
+{
+    std::string source = "delay d[128]\nd = inl\nc = 1.5 + 0.25*inr\nv0 = 1.5 + 0.25*inl\n";
+    for(uint32_t i=1; i<=chain; i++)
+    {
+        std::string expr;
+        for(const char *p = step; *p != 0; p++)
+        {
+            if (*p == '$')
+                expr += "v" + std::to_string(i-1);
+            else if (*p == '#')
+                expr += std::to_string(i);
+            else
+                expr += *p;
+        }
+        source += "v" + std::to_string(i) + " = " + expr + "\n";
+    }
+    source += "out = v" + std::to_string(chain) + "\n";
+    return source;
+}
+
+/** a script of 'statements' statements that mixes
+    arithmetic, functions, delays and filters */
+static std::string makeLargeScript(uint32_t statements)
+{
+    std::string source = "delay d[256]\nd = inl\nv0 = inl\n";
+    for(uint32_t i=1; i<statements; i++)
+    {
+        const std::string prev = "v" + std::to_string(i-1);
+        const std::string older = "v" + std::to_string(i/2);
+        std::string expr;
+        switch(i % 5)
+        {
+        case 0:
+            expr = prev + "*0.99 + " + older + "*0.01";
+            break;
+        case 1:
+            expr = "tanh(" + prev + " + slider1*" + older + ")";
+            break;
+        case 2:
+            expr = prev + " + d[" + std::to_string(i % 256) + "]*0.1";
+            break;
+        case 3:
+            expr = "fir(" + prev + ", 0.25, 0.5, 0.25)";
+            break;
+        default:
+            expr = "choose(" + prev + " - " + older + ", sin1(" + prev + "), " + older + ")";
+            break;
+        }
+        source += "v" + std::to_string(i) + " = " + expr + "\n";
+    }
+    source += "out = v" + std::to_string(statements-1) + "\n";
+    return source;
+}
+
+static bool compile(const std::string &source, RenderScript &script, std::string &error)
+{
+    Renderer compiler;
+    if (!compiler.compile(source, BENCH_SAMPLERATE, std::vector<std::string>(), false, script))
+    {
+        error = compiler.getError();
+        return false;
+    }
+    return true;
+}
+
+/** nanoseconds per sample of a script on every engine */
+static bool measureScript(const RenderScript &script, const std::vector<float> &input,
+                          const options_t &options, double ns[BENCH_ENGINES], std::string &error)
+{
+    BenchRenderer renderer;
+    if (!renderer.load(script))
+    {
+        error = renderer.getError();
+        return false;
+    }
+    for(uint32_t k=0; k<4; k++)
+    {
+        renderer.setSlider(k, 0.5f);
+    }
+    for(uint32_t e=0; e<BENCH_ENGINES; e++)
+    {
+        renderer.setEngine((VirtualMachine::engine_t)e);
+        ns[e] = renderer.measure(input, options.repeats);
+    }
+    return true;
+}
+
+static void writeEngines(FILE *fp, const double ns[BENCH_ENGINES])
+{
+    fprintf(fp, "{");
+    for(uint32_t e=0; e<BENCH_ENGINES; e++)
+    {
+        fprintf(fp, "%s\"%s\": %.3f", (e > 0) ? ", " : "", engineNames[e], ns[e]);
+    }
+    fprintf(fp, "}");
+}
+
+/** the opcode benchmarks. The cost of an opcode is the time of
+    its script minus that of a script without steps and minus the
+    cost of the baseline opcode, divided by the number of times the
+    opcode was added to the register code. */
+static bool benchOpcodes(FILE *fp, const std::vector<float> &input, const options_t &options)
+{
+    RenderScript empty;
+    std::string error;
+    double emptyNs[BENCH_ENGINES];
+    if (!compile(makeOpScript("", 0), empty, error) ||
+        !measureScript(empty, input, options, emptyNs, error))
+    {
+        fprintf(stderr, "Empty script: %s\n", error.c_str());
+        return false;
+    }
+
+    const uint32_t count = sizeof(opBenches) / sizeof(opBenches[0]);
+    std::vector<double> results(count*BENCH_ENGINES, 0.0);
+    fprintf(fp, "  \"opcodes\": [\n");
+    for(uint32_t i=0; i<count; i++)
+    {
+        const opbench_t &bench = opBenches[i];
+        fprintf(stderr, "opcode %s\n", bench.name);
+
+        RenderScript script;
+        double *ns = &results[i*BENCH_ENGINES];
+        if (!compile(makeOpScript(bench.step, OPBENCH_CHAIN), script, error) ||
+            !measureScript(script, input, options, ns, error))
+        {
+            fprintf(stderr, "Opcode %s: %s\n", bench.name, error.c_str());
+            return false;
+        }
+
+        // the compiler may fold or merge steps, so
+        // the instructions are counted
+        const uint32_t instances = countOpcode(script.regprogram, bench.opcode)
+                                 - countOpcode(empty.regprogram, bench.opcode);
+        const double *baselineNs = NULL;
+        uint32_t baselines = 0;
+        for(uint32_t j=0; j<i; j++)
+        {
+            if ((bench.baseline != 0) && (opBenches[j].opcode == bench.baseline))
+            {
+                baselineNs = &results[j*BENCH_ENGINES];
+                baselines = countOpcode(script.regprogram, bench.baseline)
+                          - countOpcode(empty.regprogram, bench.baseline);
+            }
+        }
+        for(uint32_t e=0; e<BENCH_ENGINES; e++)
+        {
+            ns[e] -= emptyNs[e];
+            if (baselineNs != NULL)
+            {
+                ns[e] -= baselineNs[e]*baselines;
+            }
+            ns[e] = (instances > 0) ? ns[e] / instances : 0.0;
+        }
+
+        fprintf(fp, "    {\"name\": \"%s\", \"instances\": %u, \"ns\": ", bench.name, instances);
+        if (instances > 0)
+        {
+            writeEngines(fp, ns);
+        }
+        else
+        {
+            fprintf(fp, "null");
+        }
+        fprintf(fp, "}%s\n", (i+1 < count) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    return true;
+}
+
+/** nanoseconds per sample of the example scripts */
+static bool benchExamples(FILE *fp, const std::vector<float> &input, const options_t &options)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    for(const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(options.examples, ec))
+    {
+        if (entry.path().extension() == ".dsp")
+        {
+            files.push_back(entry.path().string());
+        }
+    }
+    if (ec)
+    {
+        fprintf(stderr, "Cannot read directory %s\n", options.examples.c_str());
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    fprintf(fp, "  \"scripts\": [\n");
+    for(size_t i=0; i<files.size(); i++)
+    {
+        fprintf(stderr, "script %s\n", files[i].c_str());
+
+        std::string source;
+        RenderScript script;
+        std::string error;
+        double ns[BENCH_ENGINES];
+        if (!readFile(files[i], source) || !compile(source, script, error) ||
+            !measureScript(script, input, options, ns, error))
+        {
+            fprintf(stderr, "Script %s: %s\n", files[i].c_str(), error.c_str());
+            return false;
+        }
+
+        fprintf(fp, "    {\"file\": %s, \"instructions\": %u, \"ns_per_sample\": ",
+                jsonString(std::filesystem::path(files[i]).filename().string()).c_str(),
+                (uint32_t)script.regprogram.code.size());
+        writeEngines(fp, ns);
+        fprintf(fp, "}%s\n", (i+1 < files.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    return true;
+}
+
+/** compile and load times of generated scripts. Loading
+    builds the native code and closures of the program. */
+static bool benchCompiler(FILE *fp, const options_t &options)
+{
+    static const uint32_t sizes[] = {100, 300, 1000};
+    const uint32_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+    fprintf(fp, "  \"compile\": [\n");
+    for(uint32_t i=0; i<count; i++)
+    {
+        fprintf(stderr, "compile %u statements\n", sizes[i]);
+        const std::string source = makeLargeScript(sizes[i]);
+
+        double compileMs = 0.0;
+        double loadMs = 0.0;
+        RenderScript script;
+        for(uint32_t k=0; k<options.repeats; k++)
+        {
+            std::string error;
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            if (!compile(source, script, error))
+            {
+                fprintf(stderr, "Compile %u statements: %s\n", sizes[i], error.c_str());
+                return false;
+            }
+            const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            Renderer renderer;
+            renderer.load(script);
+            const std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+            const double c = std::chrono::duration<double, std::milli>(t1-t0).count();
+            const double l = std::chrono::duration<double, std::milli>(t2-t1).count();
+            compileMs = (k == 0) ? c : std::min(compileMs, c);
+            loadMs = (k == 0) ? l : std::min(loadMs, l);
+        }
+
+        fprintf(fp, "    {\"statements\": %u, \"instructions\": %u, \"compile_ms\": %.3f, \"load_ms\": %.3f}%s\n",
+                sizes[i], (uint32_t)script.regprogram.code.size(), compileMs, loadMs,
+                (i+1 < count) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    return true;
+}
+
+static void usage()
+{
+    printf("Usage: basicdsp-bench [options]\n\n");
+    printf("Measures the opcodes, the example scripts and the compiler\n");
+    printf("and writes the results as JSON.\n\n");
+    printf("Options:\n");
+    printf("  -e, --examples directory  directory of the example scripts (default: examples)\n");
+    printf("  -o, --output file         write the results to file instead of stdout\n");
+    printf("  -f, --frames n            samples per run (default: 32768)\n");
+    printf("  -r, --repeats n           runs per measurement, the fastest counts (default: 3)\n");
+    printf("  -q, --quick               fewer and shorter runs\n");
+}
+
+int main(int argc, char *argv[])
+{
+    options_t options;
+    options.frames = 32768;
+    options.repeats = 3;
+    options.examples = "examples";
+
+    for(int i=1; i<argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = (i+1 < argc);
+        if ((arg == "-h") || (arg == "--help"))
+        {
+            usage();
+            return 0;
+        }
+        else if (((arg == "-e") || (arg == "--examples")) && hasValue)
+        {
+            options.examples = argv[++i];
+        }
+        else if (((arg == "-o") || (arg == "--output")) && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if (((arg == "-f") || (arg == "--frames")) && hasValue)
+        {
+            options.frames = std::max((uint32_t)strtoul(argv[++i], NULL, 10), 1u);
+        }
+        else if (((arg == "-r") || (arg == "--repeats")) && hasValue)
+        {
+            options.repeats = std::max((uint32_t)strtoul(argv[++i], NULL, 10), 1u);
+        }
+        else if ((arg == "-q") || (arg == "--quick"))
+        {
+            options.frames = 8192;
+            options.repeats = 2;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    // a stereo input with tones and some noise, so the
+    // branches of the scripts are not predictable
+    std::vector<float> input(2*options.frames);
+    uint32_t lfsr = 0x12345678;
+    for(uint32_t i=0; i<options.frames; i++)
+    {
+        lfsr = lfsr*1664525 + 1013904223;
+        const float noise = (float)(lfsr >> 8) / 16777216.0f - 0.5f;
+        input[2*i] = 0.5f*sinf(0.0314f*i) + 0.1f*noise;
+        input[2*i+1] = 0.5f*cosf(0.0021f*i) - 0.1f*noise;
+    }
+
+    FILE *fp = stdout;
+    if (!options.output.empty())
+    {
+        fp = fopen(options.output.c_str(), "w");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "Cannot create %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"compiler\": %s,\n", jsonString(BENCH_COMPILER).c_str());
+    fprintf(fp, "  \"frames\": %u,\n", options.frames);
+    fprintf(fp, "  \"repeats\": %u,\n", options.repeats);
+    fprintf(fp, "  \"chain\": %u,\n", OPBENCH_CHAIN);
+    const bool ok = benchOpcodes(fp, input, options) &&
+                    benchExamples(fp, input, options) &&
+                    benchCompiler(fp, options);
+    fprintf(fp, "}\n");
+
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    return ok ? 0 : 1;
+}
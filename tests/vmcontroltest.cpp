@@ -0,0 +1,103 @@
+/*
+
+    Stress test of the control path between the
+    GUI thread and the audio thread of the VM.
+
+    License: GPLv2
+
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <sstream>
+#include "testmachine.h"
+
+BOOST_AUTO_TEST_CASE(control_does_not_mute_audio)
+{
+    // the output never drops below 0.5, so a buffer
+    // with a zero in it was muted by the VM.
+    TestMachine machine;
+    BOOST_REQUIRE(compile("level = 0.5 + 0.25*slider1\nout = level\n", machine));
+    machine.setSource(VirtualMachine::SRC_SINE);
+    machine.setRunning();
+
+    const uint32_t buffers = 20000;
+    const uint32_t frames = 256;
+    std::atomic<bool> done(false);
+    std::thread gui([&machine, &done]()
+    {
+        uint32_t n = 0;
+        while(!done)
+        {
+            float left, right;
+            machine.setSlider(0, static_cast<float>(rand())/RAND_MAX);
+            machine.setFrequency(100.0 + (n % 1000));
+            machine.setMonitoringVariable(0, n & 1, (n & 2) ? "level" : "out");
+            machine.getVU(left, right);
+            machine.setEngine((n & 4) ? VirtualMachine::ENGINE_BLOCK : VirtualMachine::ENGINE_SAMPLE);
+            machine.setCrossfade(0.001f*(n & 7));
+            machine.setProfiling((n & 8) != 0);
+            if ((n % 64) == 0)
+            {
+                std::stringstream ss;
+                machine.dump(ss);
+                machine.dumpProfile(ss);
+                machine.resetProgramState();
+            }
+            n++;
+        }
+    });
+
+    std::vector<float> in(2*frames, 0.0f);
+    std::vector<float> out(2*frames);
+    uint32_t muted = 0;
+    for(uint32_t b=0; b<buffers; b++)
+    {
+        machine.processSamples(&in[0], &out[0], frames);
+        for(uint32_t i=0; i<2*frames; i++)
+        {
+            if (out[i] < 0.5f)
+            {
+                muted++;
+                break;
+            }
+        }
+    }
+    done = true;
+    gui.join();
+
+    BOOST_CHECK_EQUAL(muted, 0);
+
+    // the last slider value reaches the program, also
+    // when the queue was full while it was set.
+    machine.setSlider(0, 1.0f);
+    machine.processSamples(&in[0], &out[0], frames);
+    float left, right;
+    machine.getVU(left, right);
+    machine.processSamples(&in[0], &out[0], frames);
+    BOOST_CHECK_CLOSE(out[2*frames-1], 0.75f, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(hot_swap_keeps_state)
+{
+    // the counter and the delay line carry over to the
+    // new program, a variable that was renamed does not.
+    TestMachine machine;
+    machine.setCrossfade(0.0f);
+    BOOST_REQUIRE(compile("delay d[4]\nn = n + 1\nm = m + 1\nd = n\nout = n\n", machine));
+    machine.setSource(VirtualMachine::SRC_SINE);
+    machine.setRunning();
+
+    const uint32_t frames = 16;
+    std::vector<float> in(2*frames, 0.0f);
+    std::vector<float> out(2*frames);
+    machine.processSamples(&in[0], &out[0], frames);
+    BOOST_CHECK_EQUAL(out[2*frames-1], 16.0f);
+
+    BOOST_REQUIRE(compile("delay d[4]\nn = n + 1\nk = k + 1\nout = d[3] + 1000*k\n", machine));
+    machine.processSamples(&in[0], &out[0], frames);
+    // d[3] was written three samples before the swap
+    BOOST_CHECK_EQUAL(out[0], 1000.0f + 14.0f);
+}